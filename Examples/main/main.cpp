@@ -198,13 +198,16 @@ int wmain( int argc, wchar_t* argv[] )
 		return 2;
 	}
 
-	if( Whisper::findLanguageKeyA( params.language.c_str() ) == UINT_MAX )
+	if( params.language != "auto" && Whisper::findLanguageKeyA( params.language.c_str() ) == UINT_MAX )
 	{
 		fprintf( stderr, "error: unknown language '%s'\n", params.language.c_str() );
 		whisper_print_usage( argc, argv, params );
 		return 3;
 	}
 
+	if( !params.timeline.empty() )
+		Whisper::timelineStart( 0 );
+
 	ComLight::CComPtr<iModel> model;
 	HRESULT hr = loadWhisperModel( params.model.c_str(), &model );
 	if( FAILED( hr ) )
@@ -221,6 +224,19 @@ int wmain( int argc, wchar_t* argv[] )
 		return 5;
 	}
 
+	if( !params.draft_model.empty() )
+	{
+		ComLight::CComPtr<iModel> draft;
+		hr = loadWhisperModel( params.draft_model.c_str(), &draft );
+		if( SUCCEEDED( hr ) )
+			hr = context->setDraftModel( draft, 4 );
+		if( FAILED( hr ) )
+		{
+			printError( "failed to load the draft model", hr );
+			return 4;
+		}
+	}
+
 	ComLight::CComPtr<iMediaFoundation> mf;
 	hr = initMediaFoundation( &mf );
 	if( FAILED( hr ) )
@@ -273,6 +289,7 @@ int wmain( int argc, wchar_t* argv[] )
 		wparams.max_len = params.output_wts && params.max_len == 0 ? 60 : params.max_len;
 
 		wparams.setFlag( eFullParamsFlags::SpeedupAudio, params.speed_up );
+		wparams.setFlag( eFullParamsFlags::SkipSilence, params.skip_silence );
 		// sPrintUserData user_data = { &params, &audio.pcmf32s };
 		sPrintUserData user_data = { &params };
 
@@ -310,6 +327,12 @@ int wmain( int argc, wchar_t* argv[] )
 	}
 
 	context->timingsPrint();
+	if( !params.timeline.empty() )
+	{
+		hr = Whisper::timelineStop( params.timeline.c_str() );
+		if( FAILED( hr ) )
+			printError( "failed to save the timeline", hr );
+	}
 	context = nullptr;
 	return 0;
 }
\ No newline at end of file
@@ -36,6 +36,7 @@ void whisper_print_usage( int argc, wchar_t** argv, const whisper_params& params
 	fprintf( stderr, "  -ml N,    --max-len N     [%-7d] maximum segment length in characters\n", params.max_len );
 	fprintf( stderr, "  -wt N,    --word-thold N  [%-7.2f] word timestamp probability threshold\n", params.word_thold );
 	fprintf( stderr, "  -su,      --speed-up      [%-7s] speed up audio by x2 (reduced accuracy)\n", cstr( params.speed_up ) );
+	fprintf( stderr, "  -ss,      --skip-silence  [%-7s] don't transcribe long silences detected with VAD\n", cstr( params.skip_silence ) );
 	fprintf( stderr, "  -tr,      --translate     [%-7s] translate from source language to english\n", cstr( params.translate ) );
 	fprintf( stderr, "  -di,      --diarize       [%-7s] stereo audio diarization\n", cstr( params.diarize ) );
 	fprintf( stderr, "  -otxt,    --output-txt    [%-7s] output result in a text file\n", cstr( params.output_txt ) );
@@ -45,9 +46,11 @@ void whisper_print_usage( int argc, wchar_t** argv, const whisper_params& params
 	fprintf( stderr, "  -ps,      --print-special [%-7s] print special tokens\n", cstr( params.print_special ) );
 	fprintf( stderr, "  -nc,      --no-colors     [%-7s] do not print colors\n", cstr( !params.print_colors ) );
 	fprintf( stderr, "  -nt,      --no-timestamps [%-7s] do not print timestamps\n", cstr( params.no_timestamps ) );
-	fprintf( stderr, "  -l LANG,  --language LANG [%-7s] spoken language\n", params.language.c_str() );
+	fprintf( stderr, "  -l LANG,  --language LANG [%-7s] spoken language, \"auto\" to detect\n", params.language.c_str() );
 	fprintf( stderr, "  -m FNAME, --model FNAME   [%-7S] model path\n", params.model.c_str() );
+	fprintf( stderr, "  -dm FNAME, --draft-model FNAME [%-7S] smaller model to speed up greedy decoding\n", params.draft_model.c_str() );
 	fprintf( stderr, "  -f FNAME, --file FNAME    [%-7s] path of the input audio file\n", "" );
+	fprintf( stderr, "  -tl FNAME, --timeline FNAME [%-7S] save the timeline of CPU events in Chrome trace format\n", params.timeline.c_str() );
 	fprintf( stderr, "\n" );
 }
 
@@ -78,6 +81,7 @@ bool whisper_params::parse( int argc, wchar_t* argv[] )
 		else if( arg == L"-ml" || arg == L"--max-len" ) { max_len = std::stoul( argv[ ++i ] ); }
 		else if( arg == L"-wt" || arg == L"--word-thold" ) { word_thold = std::stof( argv[ ++i ] ); }
 		else if( arg == L"-su" || arg == L"--speed-up" ) { speed_up = true; }
+		else if( arg == L"-ss" || arg == L"--skip-silence" ) { skip_silence = true; }
 		else if( arg == L"-tr" || arg == L"--translate" ) { translate = true; }
 		else if( arg == L"-di" || arg == L"--diarize" ) { diarize = true; }
 		else if( arg == L"-otxt" || arg == L"--output-txt" ) { output_txt = true; }
@@ -89,7 +93,9 @@ bool whisper_params::parse( int argc, wchar_t* argv[] )
 		else if( arg == L"-nt" || arg == L"--no-timestamps" ) { no_timestamps = true; }
 		else if( arg == L"-l" || arg == L"--language" ) { language = utf8( argv[ ++i ] ); }
 		else if( arg == L"-m" || arg == L"--model" ) { model = argv[ ++i ]; }
+		else if( arg == L"-dm" || arg == L"--draft-model" ) { draft_model = argv[ ++i ]; }
 		else if( arg == L"-f" || arg == L"--file" ) { fname_inp.push_back( argv[ ++i ] ); }
+		else if( arg == L"-tl" || arg == L"--timeline" ) { timeline = argv[ ++i ]; }
 		else
 		{
 			fprintf( stderr, "error: unknown argument: %S\n", arg.c_str() );
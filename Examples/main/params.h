@@ -16,6 +16,7 @@ struct whisper_params
 	float word_thold = 0.01f;
 
 	bool speed_up = false;
+	bool skip_silence = false;
 	bool translate = false;
 	bool diarize = false;
 	bool output_txt = false;
@@ -28,6 +29,10 @@ struct whisper_params
 
 	std::string language = "en";
 	std::wstring model = L"models/ggml-base.en.bin";
+	// Optional smaller model for speculative decoding
+	std::wstring draft_model;
+	// Optional path of the Chrome trace JSON file with the timeline of the run
+	std::wstring timeline;
 	std::vector<std::wstring> fname_inp;
 
 	whisper_params();
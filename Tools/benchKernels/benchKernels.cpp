@@ -0,0 +1,63 @@
+#include "../../Whisper/API/iContext.cl.h"
+#include <stdio.h>
+#include <string>
+using namespace Whisper;
+
+static void printUsage()
+{
+	fprintf( stderr, "usage: benchKernels [options]\n" );
+	fprintf( stderr, "  -t N, --threads N     count of threads for the parallel kernels, default is all logical processors\n" );
+	fprintf( stderr, "  -o FNAME, --output FNAME  save the results into that JSON file\n" );
+	fprintf( stderr, "  --golden FNAME        instead of the benchmark, run the regression test against the golden outputs in that file\n" );
+	fprintf( stderr, "  --update-golden       with --golden, save the outputs into that file instead of comparing\n" );
+}
+
+int wmain( int argc, wchar_t* argv[] )
+{
+	int threads = 0;
+	std::wstring output;
+	std::wstring golden;
+	bool updateGolden = false;
+	for( int i = 1; i < argc; i++ )
+	{
+		const std::wstring arg = argv[ i ];
+		if( i + 1 < argc && ( arg == L"-t" || arg == L"--threads" ) )
+			threads = _wtoi( argv[ ++i ] );
+		else if( i + 1 < argc && ( arg == L"-o" || arg == L"--output" ) )
+			output = argv[ ++i ];
+		else if( i + 1 < argc && arg == L"--golden" )
+			golden = argv[ ++i ];
+		else if( arg == L"--update-golden" )
+			updateGolden = true;
+		else
+		{
+			printUsage();
+			return 1;
+		}
+	}
+
+	// The results are printed with the logger
+	{
+		sLoggerSetup logSetup;
+		logSetup.flags = eLoggerFlags::UseStandardError;
+		logSetup.level = eLogLevel::Debug;
+		setupLogger( logSetup );
+	}
+
+	if( !golden.empty() )
+	{
+		const HRESULT hr = cpuGoldenTests( threads, golden.c_str(), updateGolden ? 1 : 0 );
+		if( S_OK == hr )
+			return 0;
+		if( S_FALSE == hr )
+			return 2;
+		fprintf( stderr, "golden tests failed, HRESULT 0x%08X\n", (unsigned int)hr );
+		return hr;
+	}
+
+	const HRESULT hr = benchmarkCpuKernels( threads, output.empty() ? nullptr : output.c_str() );
+	if( SUCCEEDED( hr ) )
+		return 0;
+	fprintf( stderr, "benchmark failed, HRESULT 0x%08X\n", (unsigned int)hr );
+	return hr;
+}
\ No newline at end of file
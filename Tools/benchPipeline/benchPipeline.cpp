@@ -0,0 +1,591 @@
+#include "../../Whisper/API/iContext.cl.h"
+#include "../../Whisper/API/iMediaFoundation.cl.h"
+#include "../../ComLightLib/comLightClient.h"
+#include <psapi.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+using namespace Whisper;
+
+namespace
+{
+	enum struct eMode : uint8_t
+	{
+		Full,
+		Streamed,
+		Parallel,
+	};
+
+	const char* modeName( eMode m )
+	{
+		switch( m )
+		{
+		case eMode::Full: return "full";
+		case eMode::Streamed: return "streamed";
+		case eMode::Parallel: return "parallel";
+		}
+		return "unknown";
+	}
+
+	struct Arguments
+	{
+		std::wstring model;
+		std::wstring directory;
+		std::wstring output;
+		// Directory with the golden token sequences, and whether to replace them with the current output
+		std::wstring golden;
+		bool updateGolden = false;
+		eModelImplementation impl = eModelImplementation::GPU;
+		std::vector<int> threads;
+		std::vector<eMode> modes;
+		int parallelContexts = 4;
+		int warmup = 1;
+		std::string language = "en";
+
+		bool parse( int argc, wchar_t* argv[] );
+	};
+
+	void printUsage()
+	{
+		fprintf( stderr, "usage: benchPipeline -m MODEL -i DIRECTORY [options]\n" );
+		fprintf( stderr, "  -m FNAME, --model FNAME      the model to load once, and use for all runs\n" );
+		fprintf( stderr, "  -i DIR, --input DIR          directory with *.wav files to transcribe\n" );
+		fprintf( stderr, "  -gpu, -hybrid, -reference    implementation of the model, default is GPU\n" );
+		fprintf( stderr, "  -t N[,N...], --threads N     CPU thread counts to measure, default 4\n" );
+		fprintf( stderr, "  --modes LIST                 comma-separated list of full, streamed, parallel; default is all of them\n" );
+		fprintf( stderr, "  -p N, --processors N         count of contexts for the parallel mode, default 4\n" );
+		fprintf( stderr, "  -w N, --warmup N             untimed runs of the first file before the measures, default 1\n" );
+		fprintf( stderr, "  -l LANG, --language LANG     spoken language, default en\n" );
+		fprintf( stderr, "  -o FNAME, --output FNAME     save the results into that JSON file\n" );
+		fprintf( stderr, "  --golden DIR                 compare the text tokens with the golden ones saved in that directory\n" );
+		fprintf( stderr, "  --update-golden              save the text tokens into the golden directory instead of comparing\n" );
+	}
+
+	// Split the comma-separated list
+	std::vector<std::wstring> splitList( const wchar_t* arg )
+	{
+		std::vector<std::wstring> res;
+		std::wstring s = arg;
+		size_t begin = 0;
+		while( true )
+		{
+			const size_t end = s.find( L',', begin );
+			res.push_back( s.substr( begin, end - begin ) );
+			if( end == std::wstring::npos )
+				return res;
+			begin = end + 1;
+		}
+	}
+
+	bool Arguments::parse( int argc, wchar_t* argv[] )
+	{
+		for( int i = 1; i < argc; i++ )
+		{
+			const std::wstring arg = argv[ i ];
+			if( arg == L"-gpu" ) { impl = eModelImplementation::GPU; continue; }
+			if( arg == L"-hybrid" ) { impl = eModelImplementation::Hybrid; continue; }
+			if( arg == L"-reference" ) { impl = eModelImplementation::Reference; continue; }
+			if( arg == L"--update-golden" ) { updateGolden = true; continue; }
+
+			if( i + 1 >= argc )
+			{
+				fprintf( stderr, "error: the option %S needs a value\n", arg.c_str() );
+				return false;
+			}
+			const wchar_t* val = argv[ ++i ];
+			if( arg == L"-m" || arg == L"--model" ) { model = val; }
+			else if( arg == L"-i" || arg == L"--input" ) { directory = val; }
+			else if( arg == L"-o" || arg == L"--output" ) { output = val; }
+			else if( arg == L"--golden" ) { golden = val; }
+			else if( arg == L"-p" || arg == L"--processors" ) { parallelContexts = _wtoi( val ); }
+			else if( arg == L"-w" || arg == L"--warmup" ) { warmup = _wtoi( val ); }
+			else if( arg == L"-l" || arg == L"--language" )
+			{
+				language.clear();
+				for( const wchar_t* p = val; 0 != *p; p++ )
+					language += (char)*p;
+			}
+			else if( arg == L"-t" || arg == L"--threads" )
+			{
+				for( const std::wstring& s : splitList( val ) )
+					threads.push_back( _wtoi( s.c_str() ) );
+			}
+			else if( arg == L"--modes" )
+			{
+				for( const std::wstring& s : splitList( val ) )
+				{
+					if( s == L"full" ) modes.push_back( eMode::Full );
+					else if( s == L"streamed" ) modes.push_back( eMode::Streamed );
+					else if( s == L"parallel" ) modes.push_back( eMode::Parallel );
+					else
+					{
+						fprintf( stderr, "error: unknown mode %S\n", s.c_str() );
+						return false;
+					}
+				}
+			}
+			else
+			{
+				fprintf( stderr, "error: unknown argument: %S\n", arg.c_str() );
+				return false;
+			}
+		}
+
+		if( model.empty() || directory.empty() )
+		{
+			fprintf( stderr, "error: the model and the input directory are required\n" );
+			return false;
+		}
+		if( updateGolden && golden.empty() )
+		{
+			fprintf( stderr, "error: --update-golden requires the golden directory\n" );
+			return false;
+		}
+		if( threads.empty() )
+			threads.push_back( 4 );
+		if( modes.empty() )
+			modes = { eMode::Full, eMode::Streamed, eMode::Parallel };
+		return true;
+	}
+
+	using Clock = std::chrono::steady_clock;
+
+	double secondsSince( Clock::time_point tp )
+	{
+		return std::chrono::duration<double>( Clock::now() - tp ).count();
+	}
+
+	// The encoder begin callback is called before every 30-seconds window; the intervals between these calls are the latencies of the windows
+	struct WindowTimes
+	{
+		std::vector<double>* latencies;
+		Clock::time_point last;
+		bool started = false;
+
+		static HRESULT __cdecl encoderBegin( iContext* ctx, void* pv ) noexcept
+		{
+			WindowTimes& wt = *(WindowTimes*)pv;
+			const Clock::time_point now = Clock::now();
+			if( wt.started )
+				wt.latencies->push_back( std::chrono::duration<double>( now - wt.last ).count() );
+			wt.last = now;
+			wt.started = true;
+			return S_OK;
+		}
+
+		void finish()
+		{
+			if( started )
+				latencies->push_back( secondsSince( last ) );
+			started = false;
+		}
+	};
+
+	struct FileResult
+	{
+		std::wstring name;
+		double audioSeconds = 0;
+		double seconds = 0;
+		uint32_t tokens = 0;
+		// IDs of the text tokens, for the golden outputs
+		std::vector<int> tokenIds;
+	};
+
+	struct RunResult
+	{
+		eMode mode;
+		int threads;
+		std::vector<FileResult> files;
+		// Latencies of the individual windows, in seconds; the parallel mode doesn't report these
+		std::vector<double> windows;
+
+		double audioSeconds() const
+		{
+			double res = 0;
+			for( const auto& f : files ) res += f.audioSeconds;
+			return res;
+		}
+		double seconds() const
+		{
+			double res = 0;
+			for( const auto& f : files ) res += f.seconds;
+			return res;
+		}
+		size_t tokens() const
+		{
+			size_t res = 0;
+			for( const auto& f : files ) res += f.tokens;
+			return res;
+		}
+	};
+
+	// Percentile of the sorted vector, with the nearest rank method
+	double percentile( const std::vector<double>& sorted, double p )
+	{
+		if( sorted.empty() )
+			return 0;
+		size_t idx = (size_t)std::ceil( p * (double)sorted.size() );
+		idx = std::clamp( idx, (size_t)1, sorted.size() ) - 1;
+		return sorted[ idx ];
+	}
+
+	size_t peakWorkingSet()
+	{
+		PROCESS_MEMORY_COUNTERS pmc;
+		if( !GetProcessMemoryInfo( GetCurrentProcess(), &pmc, sizeof( pmc ) ) )
+			return 0;
+		return pmc.PeakWorkingSetSize;
+	}
+
+	class Benchmark
+	{
+		const Arguments& args;
+		ComLight::CComPtr<iModel> model;
+		ComLight::CComPtr<iContext> context;
+		ComLight::CComPtr<iMediaFoundation> mf;
+		std::vector<std::wstring> files;
+		std::vector<RunResult> results;
+		// Peak working set of the process, in bytes. Windows only tracks the peak since the process start, it can't be measured for the individual runs.
+		size_t peakRss = 0;
+
+		HRESULT listFiles();
+		HRESULT runFile( eMode mode, int threads, const std::wstring& path, FileResult& fr, std::vector<double>& windows );
+
+	public:
+		Benchmark( const Arguments& a ) : args( a ) { }
+		HRESULT initialize();
+		HRESULT run();
+		void print() const;
+		HRESULT saveJson( const wchar_t* path ) const;
+		HRESULT checkGolden() const;
+	};
+
+	HRESULT Benchmark::listFiles()
+	{
+		std::wstring pattern = args.directory;
+		pattern += L"\\*.wav";
+		WIN32_FIND_DATAW fd;
+		HANDLE h = FindFirstFileW( pattern.c_str(), &fd );
+		if( INVALID_HANDLE_VALUE == h )
+			return HRESULT_FROM_WIN32( GetLastError() );
+		do
+		{
+			if( 0 == ( fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) )
+				files.push_back( args.directory + L"\\" + fd.cFileName );
+		}
+		while( FindNextFileW( h, &fd ) );
+		FindClose( h );
+
+		// Sorted, for the same order of the runs on all computers
+		std::sort( files.begin(), files.end() );
+		return files.empty() ? HRESULT_FROM_WIN32( ERROR_FILE_NOT_FOUND ) : S_OK;
+	}
+
+	HRESULT Benchmark::initialize()
+	{
+		HRESULT hr = listFiles();
+		if( FAILED( hr ) )
+		{
+			fprintf( stderr, "error: no *.wav files in the directory %S\n", args.directory.c_str() );
+			return hr;
+		}
+
+		hr = initMediaFoundation( &mf );
+		if( FAILED( hr ) )
+		{
+			fprintf( stderr, "error: failed to initialize Media Foundation runtime\n" );
+			return hr;
+		}
+
+		const Clock::time_point started = Clock::now();
+		hr = loadModel( args.model.c_str(), args.impl, nullptr, &model );
+		if( FAILED( hr ) )
+		{
+			fprintf( stderr, "error: failed to load the model\n" );
+			return hr;
+		}
+		fprintf( stderr, "Loaded the model in %.3f seconds, %zu audio files\n", secondsSince( started ), files.size() );
+
+		return model->createContext( &context );
+	}
+
+	HRESULT Benchmark::runFile( eMode mode, int threads, const std::wstring& path, FileResult& fr, std::vector<double>& windows )
+	{
+		sFullParams wparams;
+		CHECK( context->fullDefaultParams( eSamplingStrategy::Greedy, &wparams ) );
+		wparams.resetFlag( eFullParamsFlags::PrintRealtime | eFullParamsFlags::PrintProgress | eFullParamsFlags::PrintTimestamps );
+		wparams.language = makeLanguageKey( args.language.c_str() );
+		wparams.cpuThreads = threads;
+		// No temperature fallback, the output is deterministic and the time is comparable between builds
+		wparams.temperature_inc = 0;
+
+		WindowTimes wt;
+		wt.latencies = &windows;
+		wparams.encoder_begin_callback = &WindowTimes::encoderBegin;
+		wparams.encoder_begin_callback_user_data = &wt;
+
+		// The length of the audio; for the streamed mode the buffer is only used for that, the time to decode it isn't measured
+		ComLight::CComPtr<iAudioBuffer> buffer;
+		CHECK( mf->loadAudioFile( path.c_str(), false, &buffer ) );
+		fr.audioSeconds = (double)buffer->countSamples() / 16000.0;
+
+		const Clock::time_point started = Clock::now();
+		switch( mode )
+		{
+		case eMode::Full:
+			CHECK( context->runFull( wparams, buffer ) );
+			break;
+		case eMode::Streamed:
+		{
+			ComLight::CComPtr<iAudioReader> reader;
+			CHECK( mf->openAudioFile( path.c_str(), false, &reader ) );
+			sProgressSink progressSink{ nullptr, nullptr };
+			CHECK( context->runStreamed( wparams, progressSink, reader ) );
+			break;
+		}
+		case eMode::Parallel:
+			CHECK( context->runFullParallel( wparams, buffer, args.parallelContexts ) );
+			break;
+		}
+		fr.seconds = secondsSince( started );
+		wt.finish();
+
+		// Count of the text tokens, without the special ones
+		ComLight::CComPtr<iTranscribeResult> result;
+		CHECK( context->getResults( eResultFlags::Tokens, &result ) );
+		sTranscribeLength len;
+		CHECK( result->getSize( len ) );
+		const sToken* const tokens = result->getTokens();
+		fr.tokenIds.clear();
+		for( uint32_t i = 0; i < len.countTokens; i++ )
+			if( !( tokens[ i ].flags & eTokenFlags::Special ) )
+				fr.tokenIds.push_back( tokens[ i ].id );
+		fr.tokens = (uint32_t)fr.tokenIds.size();
+		return S_OK;
+	}
+
+	HRESULT Benchmark::run()
+	{
+		for( int threads : args.threads )
+		{
+			for( eMode mode : args.modes )
+			{
+				// Warmup runs populate the caches, the lazily created GPU resources, and the memory pools of the context
+				for( int i = 0; i < args.warmup; i++ )
+				{
+					FileResult fr;
+					std::vector<double> windows;
+					CHECK( runFile( mode, threads, files[ 0 ], fr, windows ) );
+				}
+
+				RunResult& rr = results.emplace_back();
+				rr.mode = mode;
+				rr.threads = threads;
+				for( const std::wstring& path : files )
+				{
+					FileResult& fr = rr.files.emplace_back();
+					const size_t slash = path.find_last_of( L'\\' );
+					fr.name = path.substr( slash + 1 );
+					const HRESULT hr = runFile( mode, threads, path, fr, rr.windows );
+					if( FAILED( hr ) )
+					{
+						fprintf( stderr, "error: failed to transcribe %S in %s mode, HRESULT 0x%08X\n", path.c_str(), modeName( mode ), (unsigned int)hr );
+						return hr;
+					}
+				}
+				if( mode == eMode::Parallel )
+					rr.windows.clear();
+				std::sort( rr.windows.begin(), rr.windows.end() );
+				fprintf( stderr, "%s, %i threads: complete\n", modeName( mode ), threads );
+			}
+		}
+		peakRss = peakWorkingSet();
+		return S_OK;
+	}
+
+	void Benchmark::print() const
+	{
+		printf( "%-9s %7s %10s %10s %8s %8s %10s %10s\n", "Mode", "Threads", "Audio, s", "Time, s", "RTF", "Tokens/s", "p50, ms", "p99, ms" );
+		for( const RunResult& rr : results )
+		{
+			const double seconds = rr.seconds();
+			printf( "%-9s %7i %10.2f %10.3f %8.4f %8.1f %10.1f %10.1f\n",
+				modeName( rr.mode ), rr.threads, rr.audioSeconds(), seconds, seconds / rr.audioSeconds(), (double)rr.tokens() / seconds,
+				percentile( rr.windows, 0.5 ) * 1000, percentile( rr.windows, 0.99 ) * 1000 );
+		}
+		printf( "Peak working set of the process: %.1f MB\n", (double)peakRss / ( 1 << 20 ) );
+	}
+
+	// Escape the file name for JSON, assuming it's mostly ASCII
+	std::string jsonString( const std::wstring& ws )
+	{
+		std::string res;
+		const int len = WideCharToMultiByte( CP_UTF8, 0, ws.c_str(), (int)ws.length(), nullptr, 0, nullptr, nullptr );
+		std::string utf8( (size_t)len, '\0' );
+		WideCharToMultiByte( CP_UTF8, 0, ws.c_str(), (int)ws.length(), utf8.data(), len, nullptr, nullptr );
+		for( char c : utf8 )
+		{
+			if( c == '"' || c == '\\' )
+				res += '\\';
+			res += c;
+		}
+		return res;
+	}
+
+	HRESULT Benchmark::saveJson( const wchar_t* path ) const
+	{
+		FILE* f = nullptr;
+		if( 0 != _wfopen_s( &f, path, L"wb" ) || nullptr == f )
+			return E_FAIL;
+
+		const char* implName = "gpu";
+		if( args.impl == eModelImplementation::Hybrid )
+			implName = "hybrid";
+		else if( args.impl == eModelImplementation::Reference )
+			implName = "reference";
+
+		fprintf( f, "{\n\"model\":\"%s\",\"implementation\":\"%s\",\"parallelContexts\":%i,\"peakRssBytes\":%zu,\n\"runs\":[",
+			jsonString( args.model ).c_str(), implName, args.parallelContexts, peakRss );
+		for( size_t i = 0; i < results.size(); i++ )
+		{
+			const RunResult& rr = results[ i ];
+			const double seconds = rr.seconds();
+			fprintf( f, "%s{\"mode\":\"%s\",\"threads\":%i,\"audioSeconds\":%.3f,\"seconds\":%.4f,\"rtf\":%.5f,\"tokens\":%zu,\"tokensPerSecond\":%.2f,",
+				( 0 == i ) ? "\n" : ",\n", modeName( rr.mode ), rr.threads, rr.audioSeconds(), seconds, seconds / rr.audioSeconds(), rr.tokens(), (double)rr.tokens() / seconds );
+			fprintf( f, "\"windows\":%zu,\"windowP50\":%.4f,\"windowP99\":%.4f,\"files\":[",
+				rr.windows.size(), percentile( rr.windows, 0.5 ), percentile( rr.windows, 0.99 ) );
+			for( size_t j = 0; j < rr.files.size(); j++ )
+			{
+				const FileResult& fr = rr.files[ j ];
+				fprintf( f, "%s{\"name\":\"%s\",\"audioSeconds\":%.3f,\"seconds\":%.4f,\"tokens\":%u}",
+					( 0 == j ) ? "" : ",", jsonString( fr.name ).c_str(), fr.audioSeconds, fr.seconds, fr.tokens );
+			}
+			fprintf( f, "]}" );
+		}
+		fprintf( f, "\n]}\n" );
+		fclose( f );
+		return S_OK;
+	}
+
+	// Golden token sequences, one text file per input file and mode, with space-separated IDs of the text tokens.
+	// The sampling is greedy without the temperature fallback, the golden outputs should match exactly; the thread count doesn't change the output.
+	HRESULT Benchmark::checkGolden() const
+	{
+		if( args.updateGolden )
+			CreateDirectoryW( args.golden.c_str(), nullptr );
+
+		size_t countCompared = 0, countFailed = 0;
+		std::vector<bool> saved( 3, false );
+		for( const RunResult& rr : results )
+		{
+			if( args.updateGolden && saved[ (uint8_t)rr.mode ] )
+				continue;
+			saved[ (uint8_t)rr.mode ] = true;
+
+			for( const FileResult& fr : rr.files )
+			{
+				std::wstring path = args.golden;
+				path += L"\\";
+				path += fr.name;
+				path += L".";
+				for( const char* p = modeName( rr.mode ); 0 != *p; p++ )
+					path += (wchar_t)*p;
+				path += L".txt";
+
+				if( args.updateGolden )
+				{
+					FILE* f = nullptr;
+					if( 0 != _wfopen_s( &f, path.c_str(), L"w" ) || nullptr == f )
+					{
+						fprintf( stderr, "error: unable to create %S\n", path.c_str() );
+						return E_FAIL;
+					}
+					for( size_t i = 0; i < fr.tokenIds.size(); i++ )
+						fprintf( f, ( 0 == i ) ? "%i" : " %i", fr.tokenIds[ i ] );
+					fprintf( f, "\n" );
+					fclose( f );
+					continue;
+				}
+
+				std::vector<int> expected;
+				FILE* f = nullptr;
+				if( 0 != _wfopen_s( &f, path.c_str(), L"r" ) || nullptr == f )
+				{
+					fprintf( stderr, "error: no golden tokens for %S in %s mode\n", fr.name.c_str(), modeName( rr.mode ) );
+					countFailed++;
+					continue;
+				}
+				int id;
+				while( 1 == fscanf_s( f, "%i", &id ) )
+					expected.push_back( id );
+				fclose( f );
+
+				countCompared++;
+				if( expected == fr.tokenIds )
+					continue;
+				countFailed++;
+				const size_t len = std::min( expected.size(), fr.tokenIds.size() );
+				size_t i = 0;
+				while( i < len && expected[ i ] == fr.tokenIds[ i ] )
+					i++;
+				fprintf( stderr, "golden: %S in %s mode, %i threads: %zu tokens, expected %zu, the first difference at token %zu\n",
+					fr.name.c_str(), modeName( rr.mode ), rr.threads, fr.tokenIds.size(), expected.size(), i );
+			}
+		}
+
+		if( args.updateGolden )
+		{
+			printf( "Saved the golden tokens into %S\n", args.golden.c_str() );
+			return S_OK;
+		}
+		printf( "Golden tokens: %zu outputs compared, %zu different\n", countCompared, countFailed );
+		return ( 0 == countFailed ) ? S_OK : S_FALSE;
+	}
+}
+
+int wmain( int argc, wchar_t* argv[] )
+{
+	Arguments args;
+	if( !args.parse( argc, argv ) )
+	{
+		printUsage();
+		return 1;
+	}
+
+	// Only the warnings and errors, the results are printed to the standard output
+	{
+		sLoggerSetup logSetup;
+		logSetup.flags = eLoggerFlags::UseStandardError;
+		logSetup.level = eLogLevel::Warning;
+		setupLogger( logSetup );
+	}
+
+	Benchmark bench{ args };
+	HRESULT hr = bench.initialize();
+	if( FAILED( hr ) )
+		return 2;
+	hr = bench.run();
+	if( FAILED( hr ) )
+		return 3;
+
+	bench.print();
+	if( !args.output.empty() )
+	{
+		hr = bench.saveJson( args.output.c_str() );
+		if( FAILED( hr ) )
+		{
+			fprintf( stderr, "error: failed to save %S\n", args.output.c_str() );
+			return 4;
+		}
+	}
+	if( !args.golden.empty() )
+	{
+		hr = bench.checkGolden();
+		if( S_OK != hr )
+			return 5;
+	}
+	return 0;
+}
\ No newline at end of file
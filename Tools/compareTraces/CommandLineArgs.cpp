@@ -4,15 +4,36 @@
 
 static bool printUsage()
 {
-	fprintf( stderr, "Usage: compareTraces.exe trace1.bin trace2.bin [-diff N]\n" );
+	fprintf( stderr, "Usage: compareTraces.exe trace1.bin trace2.bin [-diff N] [-stats] [-hist] [-t N] [-atol X] [-rtol X]\n" );
+	fprintf( stderr, "  -diff N   print all elements of the item N of trace A, and the matching item of trace B\n" );
+	fprintf( stderr, "  -stats    compare statistics of the items instead of the payload\n" );
+	fprintf( stderr, "  -hist     print ULP and relative error histograms of every item\n" );
+	fprintf( stderr, "  -t N      count of threads, default is all logical processors\n" );
+	fprintf( stderr, "  -atol X, -rtol X  absolute and relative tolerance, the default is only failing on NaN or infinity mismatches\n" );
+	fprintf( stderr, "The exit code is 2 when the items have different shapes, or elements outside of the tolerance\n" );
 	return false;
 }
 
+template<class T>
+static bool parseNumber( const wchar_t* arg, T& result )
+{
+	CStringA tmp;
+	tmp.Format( "%S", arg );
+	tmp.Trim();
+	auto res = std::from_chars( tmp, cstr( tmp ) + tmp.GetLength(), result );
+	if( res.ec != (std::errc)0 )
+	{
+		fprintf( stderr, "Unable to parse string into number\n" );
+		return false;
+	}
+	return true;
+}
+
 bool CommandLineArgs::parse( int argc, wchar_t* argv[] )
 {
 	size_t idx = 0;
 	CString sw;
-	CStringA tmp;
+	bool hasTolerance = false;
 	for( int i = 1; i < argc; i++ )
 	{
 		if( argv[ i ][ 0 ] != L'-' )
@@ -24,23 +45,51 @@ bool CommandLineArgs::parse( int argc, wchar_t* argv[] )
 			continue;
 		}
 		sw = argv[ i ];
+		if( 0 == sw.CompareNoCase( L"-stats" ) )
+		{
+			statistics = true;
+			continue;
+		}
+		if( 0 == sw.CompareNoCase( L"-hist" ) )
+		{
+			histograms = true;
+			continue;
+		}
+
+		// The rest of the switches have a value
+		i++;
+		if( i >= argc )
+			return printUsage();
 		if( 0 == sw.CompareNoCase( L"-diff" ) )
 		{
-			i++;
-			if( i >= argc )
-				return printUsage();
-			tmp.Format( "%S", argv[ i ] );
-			tmp.Trim();
 			uint64_t v;
-			auto res = std::from_chars( tmp, cstr( tmp ) + tmp.GetLength(), v );
-			if( res.ec != (std::errc)0 )
-			{
-				fprintf( stderr, "Unable to parse string into number\n" );
+			if( !parseNumber( argv[ i ], v ) )
 				return false;
-			}
 			printDiff = v;
 			continue;
 		}
+		if( 0 == sw.CompareNoCase( L"-t" ) )
+		{
+			if( !parseNumber( argv[ i ], threads ) )
+				return false;
+			continue;
+		}
+		if( 0 == sw.CompareNoCase( L"-atol" ) )
+		{
+			if( !parseNumber( argv[ i ], absoluteTolerance ) )
+				return false;
+			hasTolerance = true;
+			continue;
+		}
+		if( 0 == sw.CompareNoCase( L"-rtol" ) )
+		{
+			if( !parseNumber( argv[ i ], relativeTolerance ) )
+				return false;
+			if( !hasTolerance )
+				absoluteTolerance = 0;
+			hasTolerance = true;
+			continue;
+		}
 		return printUsage();
 	}
 
@@ -3,6 +3,15 @@
 struct CommandLineArgs
 {
 	int64_t printDiff = -1;
+	// Compare statistics of the items instead of the payload
+	bool statistics = false;
+	// Print ULP and relative error histograms of every item
+	bool histograms = false;
+	// Count of threads to compare the payload, 0 = all logical processors
+	int threads = 0;
+	// Tolerance of the comparison, the default infinite absolute tolerance reports no failures
+	float absoluteTolerance = INFINITY;
+	float relativeTolerance = 0;
 	std::array<CString, 2> inputs;
 
 	bool parse( int argc, wchar_t* argv[] );
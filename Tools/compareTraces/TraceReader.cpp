@@ -1,5 +1,7 @@
 #include "stdafx.h"
 #include "TraceReader.h"
+#include <compressapi.h>
+#pragma comment( lib, "Cabinet.lib" )
 using namespace Tracing;
 
 const sTraceItem& TraceReader::operator[]( size_t idx ) const
@@ -9,6 +11,13 @@ const sTraceItem& TraceReader::operator[]( size_t idx ) const
 	return items[ idx ];
 }
 
+const sTensorStats& TraceReader::stats( size_t idx ) const
+{
+	if( idx >= countItems || nullptr == statsPointer )
+		throw E_BOUNDS;
+	return statsPointer[ idx ];
+}
+
 CStringA TraceReader::getName( const sTraceItem& item ) const
 {
 	const size_t idx = item.stringIndex;
@@ -25,22 +34,121 @@ HRESULT TraceReader::open( LPCTSTR path )
 	CHECK( file.Create( path, GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING ) );
 	CHECK( mapping.MapFile( file ) );
 
+	const uint64_t cbFile = mapping.GetMappingSize();
+	if( cbFile < sizeof( sFileHeader ) )
+		return HRESULT_FROM_WIN32( ERROR_HANDLE_EOF );
+
 	const uint8_t* rsi = mapping;
 	const sFileHeader& header = *(const sFileHeader*)rsi;
 	if( header.magic != header.correctMagic )
 		return E_INVALIDARG;
+	if( header.formatVersion > 1 || header.cbItem != sizeof( sTraceItem ) )
+		return HRESULT_FROM_WIN32( ERROR_NOT_SUPPORTED );
 	countItems = header.countItems;
 	countStrings = header.countStrings;
+	flags = ( header.formatVersion >= 1 ) ? header.flags : 0;
+
+	// Verify the file is large enough for the header
+	uint64_t cbExpected = sizeof( sFileHeader ) + header.bytesPayload + header.bytesStrings + (uint64_t)header.cbItem * countItems;
+	if( header.formatVersion >= 1 )
+		cbExpected += sizeof( sTensorStats ) * countItems;
+	if( cbExpected > cbFile || (uint64_t)countStrings * 4 > header.bytesStrings )
+		return HRESULT_FROM_WIN32( ERROR_HANDLE_EOF );
 
 	rsi += sizeof( sFileHeader );
 	payloadPointer = rsi;
+	payloadBytes = header.bytesPayload;
+	if( 0 != ( flags & (uint8_t)eFileFlags::Compressed ) )
+	{
+		CHECK( decompress( rsi, header.bytesPayload ) );
+		payloadPointer = payloadBuffer.data();
+		payloadBytes = payloadBuffer.size();
+	}
 
 	rsi += header.bytesPayload;
 	stringIndex = (const uint32_t*)( rsi );
 	stringData = (const char*)( rsi + countStrings * 4 );
+	stringDataBytes = header.bytesStrings - countStrings * 4;
 
 	rsi += header.bytesStrings;
 	items = (const sTraceItem*)rsi;
 
+	if( header.formatVersion >= 1 )
+	{
+		rsi += (size_t)header.cbItem * countItems;
+		statsPointer = (const sTensorStats*)rsi;
+	}
+	return validate();
+}
+
+HRESULT TraceReader::validate() const
+{
+	if( 0 != stringDataBytes && 0 != stringData[ stringDataBytes - 1 ] )
+		return E_INVALIDARG;
+	for( size_t i = 0; i < countStrings; i++ )
+		if( stringIndex[ i ] >= stringDataBytes )
+			return E_BOUNDS;
+
+	for( size_t i = 0; i < countItems; i++ )
+	{
+		const sTraceItem& item = items[ i ];
+		if( item.stringIndex >= countStrings )
+			return E_BOUNDS;
+		if( !hasPayload() )
+			continue;
+		if( item.payloadOffset > payloadBytes || item.payloadSize > payloadBytes - item.payloadOffset )
+			return E_BOUNDS;
+	}
 	return S_OK;
+}
+
+HRESULT TraceReader::decompress( const uint8_t* rsi, uint64_t cb )
+{
+	// Measure the decompressed size first, to allocate the buffer once
+	const uint8_t* const rsiEnd = rsi + cb;
+	size_t cbOriginal = 0;
+	for( const uint8_t* p = rsi; p < rsiEnd; )
+	{
+		if( (size_t)( rsiEnd - p ) < sizeof( sCompressedBlock ) )
+			return E_INVALIDARG;
+		const sCompressedBlock& block = *(const sCompressedBlock*)p;
+		p += sizeof( sCompressedBlock );
+		if( block.cbCompressed > block.cbOriginal || (size_t)( rsiEnd - p ) < block.cbCompressed )
+			return E_INVALIDARG;
+		cbOriginal += block.cbOriginal;
+		p += block.cbCompressed;
+	}
+	payloadBuffer.resize( cbOriginal );
+
+	DECOMPRESSOR_HANDLE decompressor = nullptr;
+	if( !CreateDecompressor( compressionAlgorithm, nullptr, &decompressor ) )
+		return HRESULT_FROM_WIN32( GetLastError() );
+
+	HRESULT hr = S_OK;
+	uint8_t* rdi = payloadBuffer.data();
+	while( rsi < rsiEnd )
+	{
+		const sCompressedBlock& block = *(const sCompressedBlock*)rsi;
+		rsi += sizeof( sCompressedBlock );
+		if( block.cbCompressed == block.cbOriginal )
+			memcpy( rdi, rsi, block.cbOriginal );
+		else
+		{
+			SIZE_T cbDecompressed = 0;
+			if( !Decompress( decompressor, rsi, block.cbCompressed, rdi, block.cbOriginal, &cbDecompressed ) )
+			{
+				hr = HRESULT_FROM_WIN32( GetLastError() );
+				break;
+			}
+			if( cbDecompressed != block.cbOriginal )
+			{
+				hr = E_INVALIDARG;
+				break;
+			}
+		}
+		rsi += block.cbCompressed;
+		rdi += block.cbOriginal;
+	}
+	CloseDecompressor( decompressor );
+	return hr;
 }
\ No newline at end of file
@@ -8,14 +8,23 @@ namespace Tracing
 	class TraceReader
 	{
 		const uint8_t* payloadPointer = nullptr;
+		uint64_t payloadBytes = 0;
 		const sTraceItem* items = nullptr;
 		size_t countItems = 0;
 		size_t countStrings = 0;
 		const uint32_t* stringIndex = nullptr;
 		const char* stringData = nullptr;
+		size_t stringDataBytes = 0;
+		const sTensorStats* statsPointer = nullptr;
+		uint8_t flags = 0;
 
 		CAtlFile file;
 		CAtlFileMapping<uint8_t> mapping;
+		// Decompressed payload of the compressed traces
+		std::vector<uint8_t> payloadBuffer;
+
+		HRESULT decompress( const uint8_t* rsi, uint64_t cb );
+		HRESULT validate() const;
 
 	public:
 
@@ -31,5 +40,11 @@ namespace Tracing
 		{
 			return payloadPointer + item.payloadOffset;
 		}
+
+		// False for the traces saved with statistics only
+		bool hasPayload() const { return 0 == ( flags & (uint8_t)eFileFlags::StatisticsOnly ); }
+		// False for the traces in the original format, without the statistics
+		bool hasStatistics() const { return nullptr != statsPointer; }
+		const sTensorStats& stats( size_t idx ) const;
 	};
 }
\ No newline at end of file
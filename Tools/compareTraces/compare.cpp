@@ -1,8 +1,8 @@
 #include "stdafx.h"
-#include "../../Whisper/API/iContext.cl.h"
 #include "TraceReader.h"
-#include "../../Whisper/ML/testUtils.h"
+#include "numericDiff.h"
 #include "compare.h"
+#include <atlcoll.h>
 using namespace Tracing;
 using namespace DirectCompute;
 
@@ -56,172 +56,336 @@ namespace
 		return sz;
 	}
 
-	class Comparer
+	inline double relativeDiff( float a, float b )
 	{
-		TraceReader& readerA;
-		TraceReader& readerB;
+		const double scale = std::max( std::abs( (double)a ), std::abs( (double)b ) );
+		if( scale == 0 )
+			return 0;
+		return std::abs( (double)a - (double)b ) / scale;
+	}
 
-		bool diffBuffers( size_t i, const sTraceItem& a, const sTraceItem& b, const CStringA& name )
-		{
-			const size_t lenA = *(const uint64_t*)a.size.data();
-			const size_t lenB = *(const uint64_t*)b.size.data();
-			if( lenA != lenB )
-			{
-				printf( "Buffer %zu \"%s\": different size, %zu in trace A, %zu in trace B\n", i, cstr( name ), lenA, lenB );
-				return false;
-			}
-			if( a.dataType != b.dataType )
-			{
-				printf( "Buffer %zu \"%s\": different data types\n", i, cstr( name ) );
-				return false;
-			}
+	// Indices of the items with the same name in both traces
+	struct ItemPair
+	{
+		size_t a, b;
+	};
 
-			switch( a.dataType )
-			{
-			case eDataType::FP32:
-				return buffersFp32( i, name, (const float*)readerA.payload( a ), (const float*)readerB.payload( b ), lenA );
-			}
-			throw E_NOTIMPL;
+	// The traces may have items in different order, or extra items in one of them, e.g. the hybrid model traces less than the GPU one.
+	// The items are matched by the formatted name which includes the layer index, and the count of the previous items with the same name, for the decoder which runs many times.
+	class ItemAlignment
+	{
+		CAtlMap<CStringA, size_t> map;
+		CAtlMap<CStringA, uint32_t> occurrences;
+		CStringA key;
+
+		const CStringA& makeKey( const TraceReader& reader, size_t i )
+		{
+			const CStringA name = reader.getName( reader[ i ] );
+			uint32_t occurrence = 0;
+			auto p = occurrences.Lookup( name );
+			if( nullptr != p )
+				occurrence = ++p->m_value;
+			else
+				occurrences.SetAt( name, 0 );
+			key.Format( "%s#%u", cstr( name ), occurrence );
+			return key;
 		}
 
-		bool diffTensors( size_t i, const sTraceItem& a, const sTraceItem& b, const CStringA& name )
+		static void printExtra( const TraceReader& reader, const std::vector<size_t>& list, char which )
 		{
-			const __m128i ne1 = load( a.size );
-			const __m128i ne2 = load( b.size );
-			if( !vectorEqual( ne1, ne2 ) )
+			constexpr size_t maxPrint = 16;
+			if( list.empty() )
+				return;
+			printf( "%zu items are only in trace %c:\n", list.size(), which );
+			for( size_t i = 0; i < list.size() && i < maxPrint; i++ )
 			{
-				printf( "Tensor %zu \"%s\" - different size: trace A size is ", i, cstr( name ) );
-				printSize( ne1 );
-				printf( ", trace B size is " );
-				printSize( ne2 );
-				printf( "\n" );
-				return false;
+				const sTraceItem& item = reader[ list[ i ] ];
+				printf( "\t%s %zu \"%s\"\n", cstr( item.itemType ), list[ i ], cstr( reader.getName( item ) ) );
 			}
+			if( list.size() > maxPrint )
+				printf( "\t...\n" );
+		}
 
-			const __m128i stride1 = load( a.stride );
-			const __m128i stride2 = load( b.stride );
-			if( !vectorEqual( stride1, stride2 ) )
-			{
-				printf( "Tensor %zu \"%s\" - different memory layout\n", i, cstr( name ) );
-				return false;
-			}
+	public:
 
-			if( a.dataType != b.dataType )
+		std::vector<ItemPair> align( const TraceReader& a, const TraceReader& b )
+		{
+			map.InitHashTable( 0x10007 );
+			for( size_t i = 0; i < b.size(); i++ )
+				map.SetAt( makeKey( b, i ), i );
+
+			occurrences.RemoveAll();
+			std::vector<ItemPair> pairs;
+			pairs.reserve( std::min( a.size(), b.size() ) );
+			std::vector<size_t> onlyA, onlyB;
+			std::vector<bool> matchedB( b.size(), false );
+			for( size_t i = 0; i < a.size(); i++ )
 			{
-				printf( "Tensor %zu \"%s\": different data types\n", i, cstr( name ) );
-				return false;
+				auto p = map.Lookup( makeKey( a, i ) );
+				if( nullptr == p )
+				{
+					onlyA.push_back( i );
+					continue;
+				}
+				pairs.push_back( ItemPair{ i, p->m_value } );
+				matchedB[ p->m_value ] = true;
 			}
+			for( size_t i = 0; i < b.size(); i++ )
+				if( !matchedB[ i ] )
+					onlyB.push_back( i );
+
+			printf( "Trace A has %zu entries, trace B %zu entries, %zu of them matched by name\n", a.size(), b.size(), pairs.size() );
+			printExtra( a, onlyA, 'A' );
+			printExtra( b, onlyB, 'B' );
+			return pairs;
+		}
+	};
 
-			size_t elements = (uint32_t)_mm_cvtsi128_si32( ne1 );
-			elements *= (uint32_t)_mm_extract_epi32( ne1, 1 );
-			elements *= (uint32_t)_mm_extract_epi32( ne1, 2 );
-			elements *= (uint32_t)_mm_extract_epi32( ne1, 3 );
+	// Verify the matched items have the same type, size and memory layout
+	bool sameShape( const ItemPair& pair, const sTraceItem& a, const sTraceItem& b, const CStringA& name )
+	{
+		if( a.itemType != b.itemType )
+		{
+			printf( "Item %zu \"%s\": different type, trace A %s, trace B %s\n", pair.a, cstr( name ), cstr( a.itemType ), cstr( b.itemType ) );
+			return false;
+		}
+		if( a.dataType != b.dataType )
+		{
+			printf( "%s %zu \"%s\": different data types\n", cstr( a.itemType ), pair.a, cstr( name ) );
+			return false;
+		}
 
-			switch( a.dataType )
-			{
-			case eDataType::FP32:
-				return tensorsFp32( i, name, (const float*)readerA.payload( a ), (const float*)readerB.payload( b ), elements, ne1, stride1 );
-			}
-			throw E_NOTIMPL;
+		const __m128i ne1 = load( a.size );
+		const __m128i ne2 = load( b.size );
+		if( !vectorEqual( ne1, ne2 ) )
+		{
+			printf( "%s %zu \"%s\" - different size: trace A size is ", cstr( a.itemType ), pair.a, cstr( name ) );
+			printSize( ne1 );
+			printf( ", trace B size is " );
+			printSize( ne2 );
+			printf( "\n" );
+			return false;
 		}
 
-	protected:
-		virtual bool buffersFp32( size_t idx, const CStringA& name, const float* a, const float* b, size_t length ) = 0;
-		virtual bool tensorsFp32( size_t idx, const CStringA& name, const float* a, const float* b, size_t length, __m128i ne, __m128i nb ) = 0;
+		if( a.itemType == eItemType::Tensor && !vectorEqual( load( a.stride ), load( b.stride ) ) )
+		{
+			printf( "Tensor %zu \"%s\" - different memory layout\n", pair.a, cstr( name ) );
+			return false;
+		}
+		return true;
+	}
 
-	public:
+	void printHeader( const ItemPair& pair, const sTraceItem& a, const CStringA& name )
+	{
+		if( a.itemType == eItemType::Tensor )
+		{
+			printSize( load( a.size ) );
+			printf( " " );
+		}
+		if( pair.a == pair.b )
+			printf( "%s %zu \"%s\": ", cstr( a.itemType ), pair.a, cstr( name ) );
+		else
+			printf( "%s %zu / %zu \"%s\": ", cstr( a.itemType ), pair.a, pair.b, cstr( name ) );
+	}
 
-		Comparer( TraceReader& t1, TraceReader& t2 ) :
-			readerA( t1 ), readerB( t2 ) { }
+	// Compares the payload of the matched items on the thread pool.
+	// Large items are split into chunks, and the items are processed in batches of limited size, the output is printed after each batch.
+	class ParallelDiff
+	{
+		static constexpr size_t chunkElements = 1 << 20;
+		static constexpr size_t batchElements = 64 << 20;
 
-		bool compare( size_t i )
+		struct Chunk
+		{
+			size_t item;
+			size_t begin, end;
+		};
+
+		const TraceReader& readerA;
+		const TraceReader& readerB;
+		const CommandLineArgs& args;
+		const sDiffStats::Tolerance tolerance;
+		PTP_WORK work = nullptr;
+		int threads = 1;
+
+		// The current batch
+		std::vector<ItemPair> items;
+		std::vector<Chunk> chunks;
+		std::vector<sDiffStats> results;
+		size_t elements = 0;
+		volatile long nextChunk = 0;
+
+		sDiffStats total;
+		size_t countCompared = 0;
+		size_t countFailed = 0;
+
+		static void __stdcall callbackStatic( PTP_CALLBACK_INSTANCE Instance, PVOID pv, PTP_WORK Work )
 		{
-			const sTraceItem& a = readerA[ i ];
-			const sTraceItem& b = readerB[ i ];
-			CStringA name1 = readerA.getName( a );
-			CStringA name2 = readerB.getName( b );
+			( (ParallelDiff*)pv )->runChunks();
+		}
 
-			if( a.itemType != b.itemType )
+		void runChunks() noexcept
+		{
+			while( true )
 			{
-				printf( "Item %zu: different type, trace A %s \"%s\", trace B %s \"%s\"\n", i,
-					cstr( a.itemType ), cstr( name1 ), cstr( b.itemType ), cstr( name2 ) );
-				return false;
+				const size_t i = (size_t)InterlockedIncrement( &nextChunk ) - 1;
+				if( i >= chunks.size() )
+					return;
+				const Chunk& c = chunks[ i ];
+				const ItemPair& pair = items[ c.item ];
+				const sTraceItem& a = readerA[ pair.a ];
+				const sTraceItem& b = readerB[ pair.b ];
+				sDiffStats& rdi = results[ i ];
+				if( a.dataType == eDataType::FP32 )
+				{
+					const float* pa = (const float*)readerA.payload( a );
+					const float* pb = (const float*)readerB.payload( b );
+					rdi.add( pa + c.begin, pb + c.begin, c.end - c.begin, tolerance );
+				}
+				else
+				{
+					const uint16_t* pa = (const uint16_t*)readerA.payload( a );
+					const uint16_t* pb = (const uint16_t*)readerB.payload( b );
+					rdi.add( pa + c.begin, pb + c.begin, c.end - c.begin, tolerance );
+				}
 			}
+		}
+
+		void flush()
+		{
+			if( items.empty() )
+				return;
 
-			if( name1 != name2 )
+			results.assign( chunks.size(), sDiffStats{} );
+			nextChunk = 0;
+			if( threads > 1 && chunks.size() > 1 )
 			{
-				printf( "%s %zu: different names, they are \"%s\" and \"%s\"\n", cstr( a.itemType ), i, cstr( name1 ), cstr( name2 ) );
-				return false;
+				const int count = (int)std::min( (size_t)threads, chunks.size() );
+				for( int i = 1; i < count; i++ )
+					SubmitThreadpoolWork( work );
+				runChunks();
+				WaitForThreadpoolWorkCallbacks( work, FALSE );
 			}
+			else
+				runChunks();
 
-			switch( a.itemType )
+			// The chunks are in the order of the items, merge and print
+			size_t idxChunk = 0;
+			for( size_t i = 0; i < items.size(); i++ )
 			{
-			case eItemType::Buffer:
-				return diffBuffers( i, a, b, name1 );
-			case eItemType::Tensor:
-				return diffTensors( i, a, b, name1 );
-			default:
-				throw E_INVALIDARG;
+				sDiffStats diff;
+				for( ; idxChunk < chunks.size() && chunks[ idxChunk ].item == i; idxChunk++ )
+					diff.merge( results[ idxChunk ] );
+
+				const ItemPair& pair = items[ i ];
+				const sTraceItem& a = readerA[ pair.a ];
+				printHeader( pair, a, readerA.getName( a ) );
+				diff.print();
+				if( args.histograms )
+					diff.printHistograms();
+
+				total.merge( diff );
+				countCompared++;
+				if( 0 != diff.countOutside )
+					countFailed++;
 			}
-		}
-	};
 
-	class PrintSummary : public Comparer
-	{
-		bool buffersFp32( size_t idx, const CStringA& name, const float* a, const float* b, size_t length ) override;
-		bool tensorsFp32( size_t idx, const CStringA& name, const float* a, const float* b, size_t length, __m128i ne, __m128i nb ) override;
+			items.clear();
+			chunks.clear();
+			elements = 0;
+		}
 
 	public:
-		PrintSummary( TraceReader& a, TraceReader& b ) : Comparer( a, b ) { }
-	};
 
-	bool PrintSummary::buffersFp32( size_t idx, const CStringA& name, const float* a, const float* b, size_t length )
-	{
-		sTensorDiff diff = computeDiff( a, b, length );
-		printf( "%s %zu \"%s\": ", cstr( eItemType::Buffer ), idx, cstr( name ) );
-		diff.print();
-		return true;
-	}
+		ParallelDiff( const TraceReader& a, const TraceReader& b, const CommandLineArgs& cla ) :
+			readerA( a ), readerB( b ), args( cla ),
+			tolerance{ cla.absoluteTolerance, cla.relativeTolerance }
+		{ }
+		ParallelDiff( const ParallelDiff& ) = delete;
 
-	bool PrintSummary::tensorsFp32( size_t idx, const CStringA& name, const float* a, const float* b, size_t length, __m128i ne, __m128i nb )
-	{
-		printSize( ne );
-		printf( " " );
-		sTensorDiff diff = computeDiff( a, b, length );
-		printf( "%s %zu \"%s\": ", cstr( eItemType::Tensor ), idx, cstr( name ) );
-		diff.print();
-		return true;
-	}
+		~ParallelDiff()
+		{
+			if( nullptr != work )
+				CloseThreadpoolWork( work );
+		}
 
-	class PrintDiff : public Comparer
-	{
-		bool buffersFp32( size_t idx, const CStringA& name, const float* a, const float* b, size_t length ) override;
-		bool tensorsFp32( size_t idx, const CStringA& name, const float* a, const float* b, size_t length, __m128i ne, __m128i nb ) override;
-	public:
-		PrintDiff( TraceReader& a, TraceReader& b ) : Comparer( a, b ) { }
-	};
+		HRESULT create()
+		{
+			threads = args.threads;
+			if( threads <= 0 )
+			{
+				SYSTEM_INFO si;
+				GetSystemInfo( &si );
+				threads = (int)si.dwNumberOfProcessors;
+			}
+			if( threads <= 1 )
+				return S_OK;
+			work = CreateThreadpoolWork( &callbackStatic, this, nullptr );
+			if( nullptr == work )
+				return HRESULT_FROM_WIN32( GetLastError() );
+			return S_OK;
+		}
 
-	bool PrintDiff::buffersFp32( size_t idx, const CStringA& name, const float* A, const float* B, size_t length )
-	{
-		printf( "idx\tA\tB\tA(hex)\tB(hex)\tdiff\n" );
-		for( size_t i = 0; i < length; i++ )
+		// Queue the matched pair of items for comparison, returns false if they have different shapes
+		bool add( const ItemPair& pair )
+		{
+			const sTraceItem& a = readerA[ pair.a ];
+			const sTraceItem& b = readerB[ pair.b ];
+			const CStringA name = readerA.getName( a );
+			if( !sameShape( pair, a, b, name ) )
+				return false;
+			if( a.dataType != eDataType::FP32 && a.dataType != eDataType::FP16 )
+			{
+				printHeader( pair, a, name );
+				printf( "unsupported data type, skipped\n" );
+				return true;
+			}
+
+			const size_t length = (size_t)( a.payloadSize / elementSize( a.dataType ) );
+			const size_t idx = items.size();
+			items.push_back( pair );
+			for( size_t i = 0; i < length; i += chunkElements )
+				chunks.push_back( Chunk{ idx, i, std::min( i + chunkElements, length ) } );
+			if( 0 == length )
+				chunks.push_back( Chunk{ idx, 0, 0 } );
+
+			elements += length;
+			if( elements >= batchElements )
+				flush();
+			return true;
+		}
+
+		HRESULT finish()
 		{
-			const float a = *A;
-			const float b = *B;
-			__m128 vf = _mm_setr_ps( a, b, 0, 0 );
-			__m128i vi = _mm_castps_si128( vf );
-			const float diff = std::abs( a - b );
-			printf( "%zu\t%g\t%g\t0x%08X\t0x%08X\t%g\n",
-				i, a, b, _mm_cvtsi128_si32( vi ), _mm_extract_epi32( vi, 1 ), diff );
+			flush();
+			printf( "Total: " );
+			total.print();
+			total.printHistograms();
+			if( std::isfinite( args.absoluteTolerance ) )
+				printf( "%zu items compared, %zu of them have elements outside of the tolerance\n", countCompared, countFailed );
+			return ( 0 == countFailed ) ? S_OK : S_FALSE;
 		}
-		return true;
-	}
+	};
 
-	std::array<uint32_t, 4> storeSize( __m128i v )
+	bool diffStats( const TraceReader& readerA, const TraceReader& readerB, const ItemPair& pair )
 	{
-		std::array<uint32_t, 4> a;
-		_mm_storeu_si128( ( __m128i* )a.data(), v );
-		return a;
+		const sTraceItem& a = readerA[ pair.a ];
+		const sTraceItem& b = readerB[ pair.b ];
+		const CStringA name = readerA.getName( a );
+		if( !sameShape( pair, a, b, name ) )
+			return false;
+
+		const sTensorStats& sa = readerA.stats( pair.a );
+		const sTensorStats& sb = readerB.stats( pair.b );
+		printHeader( pair, a, name );
+		printf( "min %g / %g, max %g / %g, mean %g / %g (%g), L2 %g / %g (%g)",
+			sa.min, sb.min, sa.max, sb.max,
+			sa.mean, sb.mean, relativeDiff( sa.mean, sb.mean ),
+			sa.l2, sb.l2, relativeDiff( sa.l2, sb.l2 ) );
+		if( 0 != sa.countNonFinite || 0 != sb.countNonFinite )
+			printf( ", non-finite %u / %u", sa.countNonFinite, sb.countNonFinite );
+		printf( sa.hash == sb.hash ? ", identical\n" : "\n" );
+		return true;
 	}
 
 	std::array<size_t, 4> storeStrides( __m128i v )
@@ -233,14 +397,45 @@ namespace
 		return a;
 	}
 
-	bool PrintDiff::tensorsFp32( size_t idx, const CStringA& name, const float* A, const float* B, size_t length, __m128i ne, __m128i nb )
+	void printElement( CStringA& line, float a, float b )
 	{
-		const int dims = tensorDims( ne );
-		const std::array<uint32_t, 4> size = storeSize( ne );
-		const std::array<size_t, 4> strides = storeStrides( ne );
+		__m128 vf = _mm_setr_ps( a, b, 0, 0 );
+		__m128i vi = _mm_castps_si128( vf );
+		const float diff = std::abs( a - b );
+		line.AppendFormat( "%g\t%g\t0x%08X\t0x%08X\t%g\n",
+			a, b, _mm_cvtsi128_si32( vi ), _mm_extract_epi32( vi, 1 ), diff );
+		printf( "%s", cstr( line ) );
+	}
+
+	// Print all elements of the matched FP32 items
+	HRESULT printDiff( const TraceReader& readerA, const TraceReader& readerB, const ItemPair& pair )
+	{
+		const sTraceItem& a = readerA[ pair.a ];
+		const sTraceItem& b = readerB[ pair.b ];
+		if( !sameShape( pair, a, b, readerA.getName( a ) ) )
+			return S_FALSE;
+		if( a.dataType != eDataType::FP32 )
+			return E_NOTIMPL;
+		const float* A = (const float*)readerA.payload( a );
+		const float* B = (const float*)readerB.payload( b );
+
 		CStringA line;
-		if( dims > 4 )
-			throw E_UNEXPECTED;
+		if( a.itemType == eItemType::Buffer )
+		{
+			const size_t length = *(const uint64_t*)a.size.data();
+			printf( "idx\tA\tB\tA(hex)\tB(hex)\tdiff\n" );
+			for( size_t i = 0; i < length; i++ )
+			{
+				line.Format( "%zu\t", i );
+				printElement( line, A[ i ], B[ i ] );
+			}
+			return S_OK;
+		}
+
+		const __m128i ne = load( a.size );
+		const int dims = tensorDims( ne );
+		const std::array<uint32_t, 4>& size = a.size;
+		const std::array<size_t, 4> strides = storeStrides( load( a.stride ) );
 
 		for( int i = 0; i < dims; i++ )
 		{
@@ -253,14 +448,9 @@ namespace
 
 		if( 0 == dims )
 		{
-			const float a = *A;
-			const float b = *B;
-			__m128 vf = _mm_setr_ps( a, b, 0, 0 );
-			__m128i vi = _mm_castps_si128( vf );
-			const float diff = std::abs( a - b );
-			printf( "%g\t%g\t0x%08X\t0x%08X\t%g\n",
-				a, b, _mm_cvtsi128_si32( vi ), _mm_extract_epi32( vi, 1 ), diff );
-			return true;
+			line.Empty();
+			printElement( line, *A, *B );
+			return S_OK;
 		}
 
 		size_t offLayer2 = 0;
@@ -282,20 +472,60 @@ namespace
 							line.AppendFormat( "%i\t", z );
 						if( dims > 3 )
 							line.AppendFormat( "%i\t", w );
-
-						const float a = A[ off ];
-						const float b = B[ off ];
-						__m128 vf = _mm_setr_ps( a, b, 0, 0 );
-						__m128i vi = _mm_castps_si128( vf );
-						const float diff = std::abs( a - b );
-						line.AppendFormat( "%g\t%g\t0x%08X\t0x%08X\t%g\n",
-							a, b, _mm_cvtsi128_si32( vi ), _mm_extract_epi32( vi, 1 ), diff );
-						printf( "%s", cstr( line ) );
+						printElement( line, A[ off ], B[ off ] );
 					}
 				}
 			}
 		}
-		return true;
+		return S_OK;
+	}
+
+	HRESULT compareImpl( const TraceReader& a, const TraceReader& b, const CommandLineArgs& arguments )
+	{
+		// The traces saved with statistics only are compared by these statistics, without the payload
+		const bool statistics = arguments.statistics || !a.hasPayload() || !b.hasPayload();
+		if( statistics && !( a.hasStatistics() && b.hasStatistics() ) )
+		{
+			fprintf( stderr, "Comparing statistics requires both traces in the new format\n" );
+			return E_INVALIDARG;
+		}
+
+		ItemAlignment alignment;
+		const std::vector<ItemPair> pairs = alignment.align( a, b );
+
+		if( arguments.printDiff >= 0 )
+		{
+			if( !( a.hasPayload() && b.hasPayload() ) )
+			{
+				fprintf( stderr, "-diff requires both traces with the payload\n" );
+				return E_INVALIDARG;
+			}
+			for( const ItemPair& p : pairs )
+				if( p.a == (size_t)arguments.printDiff )
+					return printDiff( a, b, p );
+
+			fprintf( stderr, "Trace A has %zu entries; entry %zu ain't there, or trace B has no item with that name\n",
+				a.size(), (size_t)arguments.printDiff );
+			return E_INVALIDARG;
+		}
+
+		size_t countMismatches = 0;
+		if( statistics )
+		{
+			for( const ItemPair& p : pairs )
+				if( !diffStats( a, b, p ) )
+					countMismatches++;
+			return ( 0 == countMismatches ) ? S_OK : S_FALSE;
+		}
+
+		ParallelDiff diff{ a, b, arguments };
+		CHECK( diff.create() );
+		for( const ItemPair& p : pairs )
+			if( !diff.add( p ) )
+				countMismatches++;
+		const HRESULT hr = diff.finish();
+		CHECK( hr );
+		return ( 0 == countMismatches ) ? hr : S_FALSE;
 	}
 }
 
@@ -308,7 +538,7 @@ HRESULT compareTraces( const CommandLineArgs& arguments )
 	HRESULT hr = a.open( pathA );
 	if( FAILED( hr ) )
 	{
-		fwprintf( stderr, L"Unable to load trace A from \"%s\"", pathA );
+		fwprintf( stderr, L"Unable to load trace A from \"%s\"\n", pathA );
 		printError( hr );
 		return hr;
 	}
@@ -316,46 +546,17 @@ HRESULT compareTraces( const CommandLineArgs& arguments )
 	hr = b.open( pathB );
 	if( FAILED( hr ) )
 	{
-		fwprintf( stderr, L"Unable to load trace B from \"%s\"", pathA );
+		fwprintf( stderr, L"Unable to load trace B from \"%s\"\n", pathB );
 		printError( hr );
 		return hr;
 	}
 
 	wprintf( L"Trace A:   %s\n", pathA );
 	wprintf( L"Trace B:   %s\n", pathB );
-	const size_t sizeA = a.size();
-	const size_t sizeB = b.size();
-	const size_t count = std::min( sizeA, sizeB );
-
-	if( arguments.printDiff >= 0 )
-	{
-		if( arguments.printDiff >= (int64_t)count )
-		{
-			fprintf( stderr, "Trace A has %zu entries, trace B %zu entries; entry %zu ain't there\n",
-				sizeA, sizeB, (size_t)arguments.printDiff );
-			return E_INVALIDARG;
-		}
-		try
-		{
-			PrintDiff print{ a, b };
-			print.compare( arguments.printDiff );
-			return S_OK;
-		}
-		catch( HRESULT hr )
-		{
-			return hr;
-		}
-	}
-
-	printf( "Trace A has %zu entries, trace B %zu entries, comparing first %zu\n", sizeA, sizeB, count );
 
 	try
 	{
-		PrintSummary print{ a, b };
-		for( size_t i = 0; i < count; i++ )
-			if( !print.compare( i ) )
-				return S_FALSE;
-		return S_OK;
+		return compareImpl( a, b, arguments );
 	}
 	catch( HRESULT hr )
 	{
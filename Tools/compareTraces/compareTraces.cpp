@@ -10,6 +10,8 @@ int wmain( int argc, wchar_t* argv[] )
 		return 1;
 
 	HRESULT hr = compareTraces( cla );
+	if( S_FALSE == hr )
+		return 2;	// The traces are different
 	if( SUCCEEDED( hr ) )
 		return 0;
 	return hr;
@@ -0,0 +1,160 @@
+#include "stdafx.h"
+#include "numericDiff.h"
+#include <cmath>
+
+namespace
+{
+	inline uint32_t bitcast( float f )
+	{
+		return (uint32_t)_mm_cvtsi128_si32( _mm_castps_si128( _mm_set_ss( f ) ) );
+	}
+
+	// Map the bits of FP32 numbers to integers with the same order as the numbers; the distance between these integers is the count of ULPs between the numbers
+	inline int64_t orderedBits( float f )
+	{
+		const int32_t i = (int32_t)bitcast( f );
+		return ( i >= 0 ) ? i : (int64_t)INT32_MIN - i;
+	}
+
+	// Portable replacement of the F16C instruction
+	inline float halfToFloat( uint16_t h )
+	{
+		const uint32_t sign = (uint32_t)( h & 0x8000u ) << 16;
+		const uint32_t exponent = ( h >> 10 ) & 0x1Fu;
+		const uint32_t mantissa = h & 0x3FFu;
+		uint32_t bits;
+		if( exponent == 0x1F )
+			bits = sign | 0x7F800000u | ( mantissa << 13 );
+		else if( exponent != 0 )
+			bits = sign | ( ( exponent + 112 ) << 23 ) | ( mantissa << 13 );
+		else
+		{
+			// Zero or denormal, these are normal numbers in FP32
+			const float f = (float)mantissa * ( 1.0f / 16777216.0f );
+			return sign ? -f : f;
+		}
+		return _mm_cvtss_f32( _mm_castsi128_ps( _mm_cvtsi32_si128( (int)bits ) ) );
+	}
+
+	inline size_t ulpBucket( uint64_t ulp )
+	{
+		unsigned long idx;
+		if( !_BitScanReverse64( &idx, ulp ) )
+			return 0;
+		return std::min( (size_t)idx + 1, sDiffStats::ulpBuckets - 1 );
+	}
+
+	inline size_t relativeBucket( float rel )
+	{
+		constexpr size_t buckets = sDiffStats::relativeBuckets;
+		if( rel >= 0.1f )
+			return buckets - 1;
+		if( rel < 1E-7f )
+			return 1;
+		// 1E-7 = bucket 2, 0.01 = bucket 7
+		const int decade = (int)std::floor( std::log10( rel ) ) + 9;
+		return (size_t)std::clamp( decade, 2, (int)buckets - 2 );
+	}
+
+	inline void addElement( sDiffStats& s, float a, float b, const sDiffStats::Tolerance& tol )
+	{
+		if( bitcast( a ) == bitcast( b ) )
+		{
+			s.ulp[ 0 ]++;
+			s.relative[ 0 ]++;
+			return;
+		}
+		if( !( std::isfinite( a ) && std::isfinite( b ) ) )
+		{
+			s.countNonFinite++;
+			s.countOutside++;
+			return;
+		}
+
+		const float diff = std::abs( a - b );
+		const float scale = std::max( std::abs( a ), std::abs( b ) );
+		const float rel = ( scale > 0 ) ? diff / scale : 0.0f;
+		const uint64_t ulp = (uint64_t)std::abs( orderedBits( a ) - orderedBits( b ) );
+
+		s.maxAbsDiff = std::max( s.maxAbsDiff, diff );
+		s.maxRelativeDiff = std::max( s.maxRelativeDiff, rel );
+		s.sumSquares += (double)diff * diff;
+		s.maxUlp = (uint32_t)std::max( (uint64_t)s.maxUlp, std::min( ulp, (uint64_t)UINT_MAX ) );
+		s.ulp[ ulpBucket( ulp ) ]++;
+		s.relative[ relativeBucket( rel ) ]++;
+		if( diff > tol.absolute + tol.relative * scale )
+			s.countOutside++;
+	}
+}
+
+void sDiffStats::add( const float* a, const float* b, size_t count, const Tolerance& tol )
+{
+	for( size_t i = 0; i < count; i++ )
+		addElement( *this, a[ i ], b[ i ], tol );
+	length += count;
+}
+
+void sDiffStats::add( const uint16_t* a, const uint16_t* b, size_t count, const Tolerance& tol )
+{
+	for( size_t i = 0; i < count; i++ )
+		addElement( *this, halfToFloat( a[ i ] ), halfToFloat( b[ i ] ), tol );
+	length += count;
+}
+
+void sDiffStats::merge( const sDiffStats& that )
+{
+	length += that.length;
+	maxAbsDiff = std::max( maxAbsDiff, that.maxAbsDiff );
+	maxRelativeDiff = std::max( maxRelativeDiff, that.maxRelativeDiff );
+	sumSquares += that.sumSquares;
+	maxUlp = std::max( maxUlp, that.maxUlp );
+	countNonFinite += that.countNonFinite;
+	countOutside += that.countOutside;
+	for( size_t i = 0; i < ulpBuckets; i++ )
+		ulp[ i ] += that.ulp[ i ];
+	for( size_t i = 0; i < relativeBuckets; i++ )
+		relative[ i ] += that.relative[ i ];
+}
+
+void sDiffStats::print() const
+{
+	const double avgDiffSquared = ( length > 0 ) ? sumSquares / (double)length : 0.0;
+	printf( "%zu elements, maxAbsDiff = %g, avgDiffSquared = %g, maxRelativeDiff = %g, maxUlp = %u, equal %.2f%%",
+		length, maxAbsDiff, avgDiffSquared, maxRelativeDiff, maxUlp,
+		( length > 0 ) ? 100.0 * (double)ulp[ 0 ] / (double)length : 100.0 );
+	if( 0 != countNonFinite )
+		printf( ", %zu non-finite", countNonFinite );
+	if( 0 != countOutside )
+		printf( ", %zu outside of the tolerance", countOutside );
+	printf( "\n" );
+}
+
+void sDiffStats::printHistograms() const
+{
+	if( 0 == length )
+		return;
+	const double mul = 100.0 / (double)length;
+
+	printf( "\tULP:" );
+	for( size_t i = 0; i < ulpBuckets; i++ )
+	{
+		if( 0 == ulp[ i ] )
+			continue;
+		if( 0 == i )
+			printf( " 0: %.2f%%", ulp[ i ] * mul );
+		else if( i + 1 == ulpBuckets )
+			printf( " %u+: %.2f%%", 1u << ( i - 1 ), ulp[ i ] * mul );
+		else
+			printf( " %u: %.2f%%", 1u << ( i - 1 ), ulp[ i ] * mul );
+	}
+
+	static const std::array<const char*, relativeBuckets> relativeNames =
+	{
+		"0", "<1E-7", "1E-7", "1E-6", "1E-5", "1E-4", "1E-3", "1E-2", ">=0.1"
+	};
+	printf( "\n\trelative:" );
+	for( size_t i = 0; i < relativeBuckets; i++ )
+		if( 0 != relative[ i ] )
+			printf( " %s: %.2f%%", relativeNames[ i ], relative[ i ] * mul );
+	printf( "\n" );
+}
\ No newline at end of file
@@ -0,0 +1,39 @@
+#pragma once
+
+// Accumulated difference between two vectors of numbers.
+// The code is portable, it only uses SSE 4.1 which every AMD64 processor in use supports.
+struct sDiffStats
+{
+	// Histogram of the distances in units in the last place: bucket 0 is bitwise equal, bucket k is [ 2^(k-1) .. 2^k ), the last one is everything above
+	static constexpr size_t ulpBuckets = 18;
+	// Histogram of the relative errors: bucket 0 is bitwise equal, then below 1E-7, then decades [ 1E-7 .. 1E-6 ) up to [ 0.01 .. 0.1 ), the last one is 0.1 and above
+	static constexpr size_t relativeBuckets = 9;
+
+	size_t length = 0;
+	float maxAbsDiff = 0;
+	float maxRelativeDiff = 0;
+	double sumSquares = 0;
+	uint32_t maxUlp = 0;
+	// Count of elements where only one of the vectors has a non-finite number, or both do but different ones
+	size_t countNonFinite = 0;
+	// Count of elements outside of the tolerance
+	size_t countOutside = 0;
+	std::array<size_t, ulpBuckets> ulp = {};
+	std::array<size_t, relativeBuckets> relative = {};
+
+	// The element is outside of the tolerance when abs( a - b ) > absolute + relative * max( abs( a ), abs( b ) )
+	struct Tolerance
+	{
+		float absolute = INFINITY;
+		float relative = 0;
+	};
+
+	void add( const float* a, const float* b, size_t count, const Tolerance& tol );
+	void add( const uint16_t* a, const uint16_t* b, size_t count, const Tolerance& tol );
+	void merge( const sDiffStats& that );
+
+	// Print a single line summary
+	void print() const;
+	// Print both histograms
+	void printHistograms() const;
+};
\ No newline at end of file
@@ -9,6 +9,8 @@
 #include <d3d11.h>
 
 #include <vector>
+#include <algorithm>
+#include <cmath>
 #include <array>
 #include <emmintrin.h>
 #include <smmintrin.h>
@@ -38,6 +38,17 @@ namespace Whisper
 		// Performance information
 		virtual HRESULT COMLIGHTCALL timingsPrint() = 0;
 		virtual HRESULT COMLIGHTCALL timingsReset() = 0;
+
+		// Encode the first 30 seconds of the audio, run a single decoder step, and report probabilities of the spoken languages.
+		// When runFull() is then called with the same buffer, it reuses both the spectrogram and the encoder output of that window.
+		virtual HRESULT COMLIGHTCALL detectLanguage( const sFullParams& params, const iAudioBuffer* buffer, pfnDetectedLanguages pfn, void* pv ) = 0;
+
+		// Split the audio at silences into up to countContexts pieces, and transcribe them in parallel on temporary contexts which share the model.
+		// The new segment callback is called once, after all the pieces are complete. The encoder begin callback is not called.
+		virtual HRESULT COMLIGHTCALL runFullParallel( const sFullParams& params, const iAudioBuffer* buffer, int countContexts ) = 0;
+
+		// Use a smaller model to speed up the decoder with speculative decoding; pass nullptr to disable
+		virtual HRESULT COMLIGHTCALL setDraftModel( iModel* draft, int countTokens ) = 0;
 	};
 
 	struct DECLSPEC_NOVTABLE iModel : public ComLight::IUnknown
@@ -61,6 +72,11 @@ namespace Whisper
 	uint32_t COMLIGHTCALL findLanguageKeyA( const char* lang );
 
 	HRESULT COMLIGHTCALL getSupportedLanguages( sLanguageList& rdi );
+
+	HRESULT COMLIGHTCALL timelineStart( uint32_t eventsPerThread );
+	HRESULT COMLIGHTCALL timelineStop( const wchar_t* path );
+	HRESULT COMLIGHTCALL benchmarkCpuKernels( int threads, const wchar_t* jsonPath );
+	HRESULT COMLIGHTCALL cpuGoldenTests( int threads, const wchar_t* goldenPath, int update );
 }
 
 #include "sFullParams.h"
\ No newline at end of file
@@ -35,6 +35,20 @@ namespace Whisper
 		// Performance information
 		HRESULT __stdcall timingsPrint();
 		HRESULT __stdcall timingsReset();
+
+		// Encode the first 30 seconds of the audio, run a single decoder step, and report probabilities of the spoken languages.
+		// When runFull() is then called with the same buffer, it reuses both the spectrogram and the encoder output of that window.
+		HRESULT __stdcall detectLanguage( const sFullParams& params, const iAudioBuffer* buffer, pfnDetectedLanguages pfn, void* pv );
+
+		// Split the audio at silences into up to countContexts pieces, and transcribe them in parallel on temporary contexts which share the model.
+		// The new segment callback is called once, after all the pieces are complete. The encoder begin callback is not called.
+		HRESULT __stdcall runFullParallel( const sFullParams& params, const iAudioBuffer* buffer, int countContexts );
+
+		// Use a smaller model to speed up the decoder with speculative decoding; pass nullptr to disable.
+		// The draft model proposes up to countTokens tokens at a time, this model verifies all of them with a single decoder pass.
+		// Only applies to the greedy decoding at zero temperature. The text is equivalent to the output without the draft model up to floating-point rounding:
+		// the verification pass computes the rows with different kernels, a token with nearly equal probability to the best one may come out differently.
+		HRESULT __stdcall setDraftModel( iModel* draft, int countTokens );
 	};
 
 	__interface __declspec( novtable, uuid( "abefb4c9-e8d8-46a3-8747-5afbadef1adb" ) ) iModel : public IUnknown
@@ -56,6 +70,20 @@ namespace Whisper
 	uint32_t __stdcall findLanguageKeyA( const char* lang );
 
 	HRESULT __stdcall getSupportedLanguages( sLanguageList& rdi );
+
+	// Start recording a timeline of CPU events: profiler blocks, phases of the model loader, batches of the CPU decoder's thread pool.
+	// Each thread keeps up to eventsPerThread latest events, pass 0 for the default of 64k.
+	HRESULT __stdcall timelineStart( uint32_t eventsPerThread );
+	// Stop recording the timeline, and save the events into Chrome trace JSON file, viewable in chrome://tracing or https://ui.perfetto.dev/
+	HRESULT __stdcall timelineStop( const wchar_t* path );
+
+	// Development-only benchmark of the CPU kernels of the hybrid model and the audio pipeline; prints the results to the log.
+	// Pass 0 threads for the count of logical processors; when jsonPath is not nullptr, also saves the results into that JSON file.
+	HRESULT __stdcall benchmarkCpuKernels( int threads, const wchar_t* jsonPath );
+
+	// Development-only regression test of the CPU kernels against the FP64 reference, and the golden outputs saved in the trace file.
+	// When update is non-zero, saves the outputs into that file instead. Returns S_FALSE when any output is outside of the error bounds.
+	HRESULT __stdcall cpuGoldenTests( int threads, const wchar_t* goldenPath, int update );
 }
 
 #include "sFullParams.h"
\ No newline at end of file
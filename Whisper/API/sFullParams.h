@@ -25,6 +25,8 @@ namespace Whisper
 		PrintProgress = 0x10,
 		PrintRealtime = 0x20,
 		PrintTimestamps = 0x40,
+		// Run voice activity detection over the complete audio buffer, and don't encode long silences
+		SkipSilence = 0x80,
 
 		// Experimental
 		TokenTimestamps = 0x100,
@@ -72,6 +74,15 @@ namespace Whisper
 		// [EXPERIMENTAL] speed-up techniques
 		int  audio_ctx;         // overwrite the audio context size (0 = use default)
 
+		// Temperature fallback: when the output of a window fails these thresholds, it's decoded again with a higher temperature.
+		// Disabled by default; OpenAI's defaults are temperature_inc = 0.2, compression_ratio_thold = 2.4, logprob_thold = -1.0.
+		// The retries change the output, and make the slow windows up to 5 times slower.
+		float temperature;              // initial decoding temperature, 0 = greedy
+		float temperature_inc;          // temperature increment for each retry, 0 = disable the fallback
+		float compression_ratio_thold;  // similar to OpenAI's "compression_ratio_threshold" (~2.4), 0 = disabled
+		float logprob_thold;            // average log-probability of the tokens (~-1.0), 0 = disabled
+		uint32_t seed;                  // seed of the random generator for the sampling at positive temperatures; the same seed gives the same output
+
 		// tokens to provide the whisper model as initial prompt
 		// these are prepended to any existing text context from a previous call
 		const whisper_token* prompt_tokens;
@@ -15,4 +15,14 @@ namespace Whisper
 		uint32_t length;
 		const sLanguageEntry* pointer;
 	};
+
+	// Output of the language detection
+	struct sLanguageProbability
+	{
+		uint32_t key;
+		float probability;
+	};
+
+	// Receives the detected languages, sorted by probability in descending order
+	using pfnDetectedLanguages = HRESULT( __stdcall* )( int len, const sLanguageProbability* buffer, void* pv );
 }
\ No newline at end of file
@@ -1,7 +1,6 @@
 #include <stdafx.h>
 #include "BufferAllocator.h"
-#include <immintrin.h>
-#include <ammintrin.h>
+#include "LargePages.h"
 using namespace CpuCompute;
 
 HRESULT BufferAllocator::create( size_t cb )
@@ -20,8 +19,7 @@ namespace
 	{
 		const size_t mask = 31;
 		cb += mask;
-		// We require AVX1+FMA3 support, might as well use BMI1
-		return _andn_u64( mask, cb );
+		return cb & ~mask;
 	}
 }
 
@@ -46,7 +44,7 @@ void* BufferAllocator::allocate( size_t cb, size_t align ) noexcept
 
 namespace
 {
-	// 2 MB of memory, we hope the OS kernel will then be smart enough to give us large pages.
+	// 2 MB of memory, the size of large pages on AMD64
 	constexpr size_t virtualAllocGranularityExp2 = 21;
 
 	constexpr size_t virtualAllocGranularityMask = ( ( (size_t)1 ) << virtualAllocGranularityExp2 ) - 1;
@@ -56,7 +54,7 @@ namespace
 	{
 		const size_t mask = virtualAllocGranularityMask;
 		cb += mask;
-		return _andn_u64( mask, cb );
+		return cb & ~mask;
 	}
 }
 
@@ -65,12 +63,27 @@ HRESULT VirtualAllocator::create( size_t cb )
 	if( nullptr != pointer )
 		return HRESULT_FROM_WIN32( ERROR_ALREADY_INITIALIZED );
 	cb = roundUpVirtualAlloc( cb );
+	head = 0;
+
+	size_t cbLarge = cb;
+	if( shouldUseLargePages( cbLarge ) )
+	{
+		pointer = (uint8_t*)allocateLargePages( cbLarge, -1 );
+		if( nullptr != pointer )
+		{
+			sizeAllocated = sizeVirtual = cbLarge;
+			largePages = true;
+			countPagesAllocated( cbLarge, true );
+			return S_OK;
+		}
+	}
+
 	pointer = (uint8_t*)VirtualAlloc( NULL, cb, MEM_RESERVE, PAGE_READWRITE );
 	if( nullptr != pointer )
 	{
-		head = 0;
 		sizeAllocated = 0;
 		sizeVirtual = cb;
+		largePages = false;
 		return S_OK;
 	}
 
@@ -101,6 +114,7 @@ void* VirtualAllocator::allocate( size_t cb, size_t align ) noexcept
 		if( nullptr != res )
 		{
 			sizeAllocated += cbCommit;
+			countPagesAllocated( cbCommit, false );
 			assert( sizeAllocated <= sizeVirtual );
 			void* const res = pointer + head;
 			head = newHead;
@@ -125,6 +139,7 @@ VirtualAllocator::~VirtualAllocator()
 	if( VirtualFree( pointer, 0, MEM_RELEASE ) )
 	{
 		pointer = nullptr;
+		countPagesReleased( sizeAllocated, largePages );
 		return;
 	}
 
@@ -37,12 +37,15 @@ namespace CpuCompute
 	};
 
 	// An implementation of arena allocator which allocates a large chunk of virtual memory, and maps new physical pages into that memory region as needed.
+	// When the process is able to allocate large pages, the complete arena is committed upfront in large pages instead,
+	// because large pages can't be mapped into a reserved region.
 	class VirtualAllocator : public iArenaAllocator
 	{
 		uint8_t* pointer = nullptr;
 		size_t head = 0;
 		size_t sizeAllocated = 0;
 		size_t sizeVirtual = 0;
+		bool largePages = false;
 
 		void resetArena() noexcept override final
 		{
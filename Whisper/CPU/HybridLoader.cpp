@@ -110,8 +110,9 @@ HRESULT HybridLoader::completeLoad( ComLight::iReadStream* stream, iLoaderProgre
 		return E_INVALIDARG;
 	}
 
+	// The weights are read by the decoder threads on all NUMA nodes, interleave the pages so the memory bandwidth of all nodes is utilized
 	LargeBuffer buffer;
-	CHECK( buffer.allocate( bufferBytes ) );
+	CHECK( buffer.allocateInterleaved( bufferBytes ) );
 
 	uint8_t* rdi = buffer.pointer();
 
@@ -132,9 +133,11 @@ HRESULT HybridLoader::completeLoad( ComLight::iReadStream* stream, iLoaderProgre
 	}
 
 	CHECK( buffer.setReadOnly( bufferBytes ) );
+	const bool largePages = buffer.isLargePages();
 	destination.setMemoryBuffer( std::move( buffer ) );
 
 	constexpr double mulMb = 1.0 / ( 1 << 20 );
-	logDebug( u8"Loaded %zu decoder tensors, %g MB RAM", pending.size(), mulMb * (double)(int64_t)bufferBytes );
+	logDebug( u8"Loaded %zu decoder tensors, %g MB RAM%s", pending.size(), mulMb * (double)(int64_t)bufferBytes,
+		largePages ? u8", in large pages" : u8"" );
 	return S_OK;
 }
\ No newline at end of file
@@ -1,36 +1,116 @@
 #pragma once
+#include <memory>
+#include <atlbase.h>
 #include "Tensor.h"
 #include "LargeBuffer.h"
 #include "../Whisper/sModelParams.h"
 
 namespace CpuCompute
 {
-	class KvTensors
+	// Shared pool of fixed-size blocks for the self-attention keys and values, FP16 precision.
+	// A block contains keys and values of blockTokens consecutive tokens, for all layers of the decoder.
+	// The memory is allocated lazily, in chunks of a few blocks, and only released to the OS when the pool is destroyed.
+	// The methods are thread-safe, the pool is shared by all contexts of the model.
+	class KvBlockPool
 	{
-		uint16_t* keys = nullptr;
-		uint16_t* values = nullptr;
-		uint32_t size = 0;
+	public:
+		static constexpr uint32_t blockTokens = 32;
+
+		KvBlockPool( const Whisper::sModelParams& mp );
+		KvBlockPool( const KvBlockPool& ) = delete;
+
+		// Allocate a new block on the specified NUMA node
+		HRESULT allocate( uint32_t& id, int numaNode );
+		// Return the block to the free list of its NUMA node
+		void release( uint32_t id );
+
+		uint16_t* blockPointer( uint32_t id ) const;
+
+		// Count of FP16 elements in a single layer of a block, for either keys or values
+		size_t layerElements() const { return (size_t)blockTokens * n_state; }
+		size_t blockBytes() const { return sizeof( uint16_t ) * 2 * n_layer * layerElements(); }
+
+		// Count of blocks allocated from the OS, and count of blocks in use
+		void getUsage( uint32_t& allocated, uint32_t& used ) const;
 
-		CpuCompute::LargeBuffer memory;
+	private:
+		const uint32_t n_state;
+		const uint32_t n_layer;
+		uint32_t blocksPerChunk;
+
+		mutable CComAutoCriticalSection critSec;
+		struct Chunk
+		{
+			LargeBuffer memory;
+			int numaNode;
+		};
+		std::vector<Chunk> chunks;
+		// True for the blocks in use
+		std::vector<bool> allocated;
+		// One free list per NUMA node, the first one is for the blocks allocated without node preference
+		std::vector<std::vector<uint32_t>> freeLists;
+	};
+
+	// Self-attention keys and values of a single decoded sequence, stored in the blocks of the shared pool.
+	class KvTensors
+	{
+		std::shared_ptr<KvBlockPool> pool;
+		// Block table: indices of the blocks in the pool, in the order of the tokens
+		std::vector<uint32_t> blocks;
+		// Pointers to the blocks, resolved by the reserve() method
+		std::vector<uint16_t*> pointers;
+		uint32_t n_state = 0;
+		int numaNode = -1;
 
 	public:
-		// Create these two large tensors, FP16 precision
-		HRESULT create( const Whisper::sModelParams& mp );
+		KvTensors() = default;
+		KvTensors( const KvTensors& ) = delete;
+		~KvTensors()
+		{
+			clear();
+		}
+
+		HRESULT create( const Whisper::sModelParams& mp, const std::shared_ptr<KvBlockPool>& blockPool );
+
+		// Release all blocks back to the pool; the new blocks will be allocated on the specified NUMA node
+		void setNumaNode( int node );
+
+		// Release all blocks back to the pool
+		void clear();
+
+		// Make sure the sequence has blocks for `length` tokens, and release the blocks past that length
+		HRESULT reserve( uint32_t length );
 
-		// A slice of model.memory_cross_k tensor
-		Tensor keysView( uint32_t len, uint32_t off ) const
+		// Store keys and values of `count` tokens starting at position `pos`, for the specified layer.
+		// The source matrices are FP32, with n_state elements per token. The blocks must be reserved.
+		void store( uint32_t layer, uint32_t pos, uint32_t count, const float* keys, const float* values );
+
+		// Count of blocks needed for the specified count of tokens
+		static uint32_t countBlocks( uint32_t length )
 		{
-			if( len + off <= size )
-				return Tensor::fromData( keys + off, eDataType::FP16, len );
-			throw E_BOUNDS;
+			return ( length + KvBlockPool::blockTokens - 1 ) / KvBlockPool::blockTokens;
 		}
 
-		// A slice of model.memory_cross_v tensor
-		Tensor valuesView( uint32_t len, uint32_t off ) const
+		// Keys of the first `length` tokens in the block, a dense FP16 vector of length * n_state elements
+		Tensor keysView( uint32_t layer, uint32_t block, uint32_t length ) const;
+
+		// Values of the first `length` tokens in the block, a dense FP16 vector of length * n_state elements
+		Tensor valuesView( uint32_t layer, uint32_t block, uint32_t length ) const;
+
+		// Same as above without the bounds checks, for the attention kernels which walk the block table on the compute threads
+		const uint16_t* keysPointer( uint32_t layer, uint32_t block ) const
 		{
-			if( len + off <= size )
-				return Tensor::fromData( values + off, eDataType::FP16, len );
-			throw E_BOUNDS;
+			assert( block < pointers.size() );
+			return pointers[ block ] + (size_t)layer * 2 * pool->layerElements();
 		}
+		const uint16_t* valuesPointer( uint32_t layer, uint32_t block ) const
+		{
+			assert( block < pointers.size() );
+			return pointers[ block ] + ( (size_t)layer * 2 + 1 ) * pool->layerElements();
+		}
+
+		// Length of the token rows in the blocks, and the count of tokens in the reserved blocks
+		uint32_t stateSize() const { return n_state; }
+		uint32_t capacity() const { return (uint32_t)pointers.size() * KvBlockPool::blockTokens; }
 	};
-}
\ No newline at end of file
+}
@@ -1,19 +1,167 @@
 #include "stdafx.h"
 #include "KvTensors.h"
+#include "NumaTopology.h"
+#include "simdUtils.h"
 using namespace CpuCompute;
 
-// Create these two large tensors, FP16 precision
-HRESULT KvTensors::create( const Whisper::sModelParams& mp )
+using Lock = CComCritSecLock<CComAutoCriticalSection>;
+
+KvBlockPool::KvBlockPool( const Whisper::sModelParams& mp ) :
+	n_state( (uint32_t)mp.n_text_state ),
+	n_layer( (uint32_t)mp.n_text_layer )
+{
+	// Allocate about 4 MB at once; for the large model, a single block is already larger than that
+	constexpr size_t chunkBytes = 1u << 22;
+	blocksPerChunk = (uint32_t)std::max( chunkBytes / blockBytes(), (size_t)1 );
+	freeLists.resize( NumaTopology::get().countNodes() + 1 );
+}
+
+HRESULT KvBlockPool::allocate( uint32_t& id, int numaNode )
+{
+	if( numaNode < 0 || !NumaTopology::get().isNuma() )
+		numaNode = -1;
+	Lock lock{ critSec };
+
+	std::vector<uint32_t>& freeList = freeLists[ numaNode + 1 ];
+	if( freeList.empty() )
+	{
+		Chunk& c = chunks.emplace_back();
+		c.numaNode = numaNode;
+		const HRESULT hr = c.memory.allocate( blockBytes() * blocksPerChunk, numaNode );
+		if( FAILED( hr ) )
+		{
+			chunks.pop_back();
+			return hr;
+		}
+
+		// Push the new blocks in reverse order, so they're allocated in the order of their addresses
+		const uint32_t firstBlock = (uint32_t)allocated.size();
+		allocated.resize( firstBlock + blocksPerChunk, false );
+		for( uint32_t i = blocksPerChunk; i > 0; i-- )
+			freeList.push_back( firstBlock + i - 1 );
+	}
+
+	id = freeList.back();
+	freeList.pop_back();
+	assert( !allocated[ id ] );
+	allocated[ id ] = true;
+	return S_OK;
+}
+
+void KvBlockPool::release( uint32_t id )
+{
+	Lock lock{ critSec };
+	assert( allocated[ id ] );
+	allocated[ id ] = false;
+	const int node = chunks[ id / blocksPerChunk ].numaNode;
+	freeLists[ node + 1 ].push_back( id );
+}
+
+uint16_t* KvBlockPool::blockPointer( uint32_t id ) const
 {
-	const uint32_t n_mem = mp.n_text_layer * mp.n_text_ctx;
-	const uint32_t n_elements = mp.n_text_state * n_mem;
+	Lock lock{ critSec };
+	const Chunk& c = chunks[ id / blocksPerChunk ];
+	uint8_t* const pointer = c.memory.pointer() + ( id % blocksPerChunk ) * blockBytes();
+	return (uint16_t*)pointer;
+}
 
-	const size_t cb = sizeof( uint16_t ) * (size_t)n_elements * 2;
-	CHECK( memory.allocate( cb ) );
+void KvBlockPool::getUsage( uint32_t& allocated, uint32_t& used ) const
+{
+	Lock lock{ critSec };
+	allocated = (uint32_t)this->allocated.size();
+	uint32_t free = 0;
+	for( const auto& list : freeLists )
+		free += (uint32_t)list.size();
+	used = allocated - free;
+}
 
-	uint16_t* pointer = (uint16_t*)memory.pointer();
-	keys = pointer;
-	values = pointer + n_elements;
-	size = n_elements;
+HRESULT KvTensors::create( const Whisper::sModelParams& mp, const std::shared_ptr<KvBlockPool>& blockPool )
+{
+	if( !blockPool )
+		return E_POINTER;
+	clear();
+	pool = blockPool;
+	n_state = (uint32_t)mp.n_text_state;
 	return S_OK;
-}
\ No newline at end of file
+}
+
+void KvTensors::clear()
+{
+	if( pool )
+	{
+		for( uint32_t id : blocks )
+			pool->release( id );
+	}
+	blocks.clear();
+	pointers.clear();
+}
+
+void KvTensors::setNumaNode( int node )
+{
+	clear();
+	numaNode = node;
+}
+
+HRESULT KvTensors::reserve( uint32_t length )
+{
+	if( !pool )
+		return OLE_E_BLANK;
+
+	const uint32_t countNeeded = countBlocks( length );
+	while( blocks.size() > countNeeded )
+	{
+		pool->release( blocks.back() );
+		blocks.pop_back();
+	}
+
+	while( blocks.size() < countNeeded )
+	{
+		uint32_t id;
+		CHECK( pool->allocate( id, numaNode ) );
+		blocks.push_back( id );
+	}
+
+	pointers.resize( blocks.size() );
+	for( size_t i = 0; i < blocks.size(); i++ )
+		pointers[ i ] = pool->blockPointer( blocks[ i ] );
+	return S_OK;
+}
+
+void KvTensors::store( uint32_t layer, uint32_t pos, uint32_t count, const float* keys, const float* values )
+{
+	const size_t layerElements = pool->layerElements();
+	const uint32_t end = pos + count;
+	while( pos < end )
+	{
+		const uint32_t block = pos / KvBlockPool::blockTokens;
+		const uint32_t offset = pos % KvBlockPool::blockTokens;
+		const uint32_t len = std::min( KvBlockPool::blockTokens - offset, end - pos );
+		if( block >= pointers.size() )
+			throw E_BOUNDS;
+
+		uint16_t* rdi = pointers[ block ] + layer * 2 * layerElements + (size_t)offset * n_state;
+		const size_t elements = (size_t)len * n_state;
+		floatsDowncast( rdi, keys, elements );
+		floatsDowncast( rdi + layerElements, values, elements );
+
+		keys += elements;
+		values += elements;
+		pos += len;
+	}
+}
+
+Tensor KvTensors::keysView( uint32_t layer, uint32_t block, uint32_t length ) const
+{
+	if( block >= pointers.size() || length > KvBlockPool::blockTokens )
+		throw E_BOUNDS;
+	uint16_t* const pointer = pointers[ block ] + layer * 2 * pool->layerElements();
+	return Tensor::fromData( pointer, eDataType::FP16, length * n_state );
+}
+
+Tensor KvTensors::valuesView( uint32_t layer, uint32_t block, uint32_t length ) const
+{
+	if( block >= pointers.size() || length > KvBlockPool::blockTokens )
+		throw E_BOUNDS;
+	uint16_t* const pointer = pointers[ block ] + ( layer * 2 + 1 ) * pool->layerElements();
+	return Tensor::fromData( pointer, eDataType::FP16, length * n_state );
+}
@@ -1,5 +1,7 @@
 #include "stdafx.h"
 #include "LargeBuffer.h"
+#include "NumaTopology.h"
+#include "LargePages.h"
 using namespace CpuCompute;
 
 void LargeBuffer::deallocate()
@@ -8,16 +10,77 @@ void LargeBuffer::deallocate()
 		return;
 	VirtualFree( pv, 0, MEM_RELEASE );
 	pv = nullptr;
+	countPagesReleased( cbPages, largePages );
+	cbPages = 0;
+	largePages = false;
 }
 
-HRESULT LargeBuffer::allocate( size_t cb )
+HRESULT LargeBuffer::allocate( size_t cb, int numaNode )
 {
 	deallocate();
-	
-	pv = VirtualAlloc( nullptr, cb, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE );
-	if( nullptr != pv )
-		return S_OK;
-	return HRESULT_FROM_WIN32( GetLastError() );
+
+	size_t cbLarge = cb;
+	if( shouldUseLargePages( cbLarge ) )
+	{
+		pv = allocateLargePages( cbLarge, numaNode );
+		if( nullptr != pv )
+		{
+			cbPages = cbLarge;
+			largePages = true;
+			countPagesAllocated( cbPages, true );
+			return S_OK;
+		}
+	}
+
+	const NumaTopology& topology = NumaTopology::get();
+	if( numaNode >= 0 && topology.isNuma() )
+	{
+		if( (size_t)numaNode >= topology.countNodes() )
+			return E_BOUNDS;
+		pv = VirtualAllocExNuma( GetCurrentProcess(), nullptr, cb, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE, topology.nodeId( numaNode ) );
+	}
+	else
+		pv = VirtualAlloc( nullptr, cb, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE );
+
+	if( nullptr == pv )
+		return HRESULT_FROM_WIN32( GetLastError() );
+	cbPages = cb;
+	countPagesAllocated( cb, false );
+	return S_OK;
+}
+
+HRESULT LargeBuffer::allocateInterleaved( size_t cb )
+{
+	const NumaTopology& topology = NumaTopology::get();
+	if( !topology.isNuma() )
+		return allocate( cb );
+
+	deallocate();
+	pv = VirtualAlloc( nullptr, cb, MEM_RESERVE, PAGE_READWRITE );
+	if( nullptr == pv )
+		return HRESULT_FROM_WIN32( GetLastError() );
+
+	// Commit the reserved space in chunks, round-robin across the nodes
+	constexpr size_t chunkSize = 1u << 21;
+	const HANDLE process = GetCurrentProcess();
+	const size_t countNodes = topology.countNodes();
+	size_t node = 0;
+	for( size_t off = 0; off < cb; off += chunkSize )
+	{
+		const size_t cbChunk = std::min( chunkSize, cb - off );
+		if( nullptr == VirtualAllocExNuma( process, (uint8_t*)pv + off, cbChunk, MEM_COMMIT, PAGE_READWRITE, topology.nodeId( node ) ) )
+		{
+			const HRESULT hr = HRESULT_FROM_WIN32( GetLastError() );
+			deallocate();
+			return hr;
+		}
+		node++;
+		if( node >= countNodes )
+			node = 0;
+	}
+	cbPages = cb;
+	countPagesAllocated( cb, false );
+	return S_OK;
 }
 
 HRESULT LargeBuffer::setReadOnly( size_t cb )
@@ -27,7 +90,14 @@ HRESULT LargeBuffer::setReadOnly( size_t cb )
 		DWORD op = 0;
 		if( VirtualProtect( pv, cb, PAGE_READONLY, &op ) )
 			return S_OK;
-		return HRESULT_FROM_WIN32( GetLastError() );
+		const HRESULT hr = HRESULT_FROM_WIN32( GetLastError() );
+		if( largePages )
+		{
+			// The protection is only there to catch bugs, not worth failing the allocation of large pages
+			logDebug( u8"LargeBuffer.setReadOnly failed for large pages, error 0x%08X", hr );
+			return S_FALSE;
+		}
+		return hr;
 	}
 	else
 		return OLE_E_BLANK;
@@ -3,16 +3,24 @@
 namespace CpuCompute
 {
 	// A large memory buffer allocated with VirtualAlloc kernel API, bypassing the heap.
+	// When the process is able to allocate large pages, buffers of 2MB and more are backed by large pages.
 	class LargeBuffer
 	{
 		void* pv = nullptr;
+		// Count of bytes allocated from the OS, for the memory counters
+		size_t cbPages = 0;
+		bool largePages = false;
+
 	public:
 		LargeBuffer() = default;
 		LargeBuffer( const LargeBuffer& ) = delete;
 		LargeBuffer( LargeBuffer&& that ) noexcept
 		{
 			pv = that.pv;
+			cbPages = that.cbPages;
+			largePages = that.largePages;
 			that.pv = nullptr;
+			that.cbPages = 0;
 		}
 		~LargeBuffer()
 		{
@@ -21,12 +29,20 @@ namespace CpuCompute
 		void operator=( LargeBuffer&& that ) noexcept
 		{
 			std::swap( pv, that.pv );
+			std::swap( cbPages, that.cbPages );
+			std::swap( largePages, that.largePages );
 		}
 		void operator=( const LargeBuffer& that ) = delete;
 
 		// Allocate buffer with specified count of bytes, and read+write memory protection
 		// The OS kernel guarantees zero-initialization of that memory.
-		HRESULT allocate( size_t cb );
+		// When numaNode is not negative, it's the index of the node in NumaTopology where to place the physical memory.
+		HRESULT allocate( size_t cb, int numaNode = -1 );
+
+		// Same as allocate(), but on NUMA computers the physical memory is interleaved across all nodes, in 2MB chunks.
+		// Good for the read-only data shared by the threads of all nodes, like the weights of the model.
+		// Large pages can't be committed into a reserved address range, on NUMA computers these buffers use normal pages.
+		HRESULT allocateInterleaved( size_t cb );
 
 		// Change memory protection of the buffer to read only
 		HRESULT setReadOnly( size_t cb );
@@ -34,6 +50,9 @@ namespace CpuCompute
 		// Unless the pointer is nullptr, deallocate the buffer
 		void deallocate();
 
+		// True when the buffer is backed by large pages
+		bool isLargePages() const { return largePages; }
+
 		// Pointer to the start of the buffer, aligned by memory page = 4 kilobytes
 		uint8_t* pointer() const
 		{
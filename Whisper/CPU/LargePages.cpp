@@ -0,0 +1,110 @@
+#include "stdafx.h"
+#include "LargePages.h"
+#include "NumaTopology.h"
+#include <atomic>
+using namespace CpuCompute;
+
+namespace
+{
+	std::atomic<int64_t> bytesLargePages = 0;
+	std::atomic<int64_t> bytesSmallPages = 0;
+	std::atomic<int64_t> countFailures = 0;
+
+	bool enableLockMemoryPrivilege()
+	{
+		HANDLE token = nullptr;
+		if( !OpenProcessToken( GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token ) )
+			return false;
+
+		TOKEN_PRIVILEGES tp;
+		tp.PrivilegeCount = 1;
+		tp.Privileges[ 0 ].Attributes = SE_PRIVILEGE_ENABLED;
+		bool res = false;
+		if( LookupPrivilegeValue( nullptr, SE_LOCK_MEMORY_NAME, &tp.Privileges[ 0 ].Luid ) )
+		{
+			// AdjustTokenPrivileges succeeds even when the privilege is not granted, it then sets ERROR_NOT_ALL_ASSIGNED code
+			if( AdjustTokenPrivileges( token, FALSE, &tp, 0, nullptr, nullptr ) && ERROR_SUCCESS == GetLastError() )
+				res = true;
+		}
+		CloseHandle( token );
+		return res;
+	}
+
+	size_t initLargePages()
+	{
+		const size_t cb = GetLargePageMinimum();
+		if( 0 == cb )
+		{
+			logDebug( u8"Large pages are not supported by the OS" );
+			return 0;
+		}
+		if( !enableLockMemoryPrivilege() )
+		{
+			logInfo( u8"Large pages are not available, the user doesn't have \"Lock pages in memory\" privilege" );
+			return 0;
+		}
+		logDebug( u8"Large pages are enabled, %zu kb", cb >> 10 );
+		return cb;
+	}
+}
+
+size_t CpuCompute::largePageSize()
+{
+	static const size_t cb = initLargePages();
+	return cb;
+}
+
+bool CpuCompute::shouldUseLargePages( size_t& cb )
+{
+	const size_t lp = largePageSize();
+	if( 0 == lp || cb < lp )
+		return false;
+
+	const size_t mask = lp - 1;
+	const size_t rounded = ( cb + mask ) & ( ~mask );
+	// Large pages are never paged out, don't waste more than 1/8 of the buffer on the rounding
+	if( rounded - cb > cb / 8 )
+		return false;
+	cb = rounded;
+	return true;
+}
+
+void* CpuCompute::allocateLargePages( size_t cb, int numaNode )
+{
+	assert( 0 == ( cb % largePageSize() ) );
+	constexpr DWORD flags = MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES;
+
+	const NumaTopology& topology = NumaTopology::get();
+	void* pv;
+	if( numaNode >= 0 && topology.isNuma() )
+		pv = VirtualAllocExNuma( GetCurrentProcess(), nullptr, cb, flags, PAGE_READWRITE, topology.nodeId( numaNode ) );
+	else
+		pv = VirtualAlloc( nullptr, cb, flags, PAGE_READWRITE );
+
+	if( nullptr != pv )
+		return pv;
+
+	// Usually ERROR_NO_SYSTEM_RESOURCES, the physical memory is too fragmented
+	countFailures++;
+	logDebug( u8"Unable to allocate %zu MB in large pages, falling back to normal pages", cb >> 20 );
+	return nullptr;
+}
+
+void CpuCompute::countPagesAllocated( size_t cb, bool largePages )
+{
+	( largePages ? bytesLargePages : bytesSmallPages ) += (int64_t)cb;
+}
+
+void CpuCompute::countPagesReleased( size_t cb, bool largePages )
+{
+	( largePages ? bytesLargePages : bytesSmallPages ) -= (int64_t)cb;
+}
+
+sMemoryPagesCounters CpuCompute::getMemoryPagesCounters()
+{
+	sMemoryPagesCounters res;
+	res.largePages = bytesLargePages;
+	res.smallPages = bytesSmallPages;
+	res.largePageFailures = countFailures;
+	return res;
+}
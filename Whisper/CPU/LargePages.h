@@ -0,0 +1,31 @@
+#pragma once
+
+namespace CpuCompute
+{
+	// Minimum size of large pages when the process is able to allocate them, or 0 when it can't.
+	// The first call tries to enable SeLockMemoryPrivilege for the process; the administrator needs to grant "Lock pages in memory" right to the user.
+	size_t largePageSize();
+
+	// When large pages are available and the rounding overhead is small, round up the size to the large page, and return true
+	bool shouldUseLargePages( size_t& cb );
+
+	// Try to allocate read+write memory backed by large pages, the size must be a multiple of largePageSize().
+	// Returns nullptr when the OS kernel failed to find enough contiguous physical memory, the caller should then fall back to normal pages.
+	void* allocateLargePages( size_t cb, int numaNode );
+
+	// Memory allocated by LargeBuffer and VirtualAllocator classes
+	struct sMemoryPagesCounters
+	{
+		// Bytes currently allocated in large pages
+		int64_t largePages;
+		// Bytes currently allocated in normal 4kb pages
+		int64_t smallPages;
+		// Count of allocations which tried large pages but fell back to normal pages
+		int64_t largePageFailures;
+	};
+	sMemoryPagesCounters getMemoryPagesCounters();
+
+	// Update the counters, called by the allocators
+	void countPagesAllocated( size_t cb, bool largePages );
+	void countPagesReleased( size_t cb, bool largePages );
+}
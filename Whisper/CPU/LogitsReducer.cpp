@@ -0,0 +1,243 @@
+#include "stdafx.h"
+#include "LogitsReducer.h"
+#include "simdUtils.h"
+#include "simdMath.hpp"
+using namespace CpuCompute;
+using Whisper::sLogitsSummary;
+
+namespace
+{
+	__forceinline float horizontalMax( __m256 vec )
+	{
+		__m128 v = _mm256_extractf128_ps( vec, 1 );
+		v = _mm_max_ps( v, _mm256_castps256_ps128( vec ) );
+		v = _mm_max_ps( v, _mm_movehl_ps( v, v ) );
+		v = _mm_max_ss( v, _mm_movehdup_ps( v ) );
+		return _mm_cvtss_f32( v );
+	}
+
+	__forceinline double horizontalSum( __m256d vec )
+	{
+		__m128d v = _mm_add_pd( _mm256_castpd256_pd128( vec ), _mm256_extractf128_pd( vec, 1 ) );
+		v = _mm_add_sd( v, _mm_unpackhi_pd( v, v ) );
+		return _mm_cvtsd_f64( v );
+	}
+
+	// Load up to 8 floats, the missing lanes are -INFINITY
+	__forceinline __m256 loadLogits( const float* rsi, size_t count )
+	{
+		if( count >= 8 )
+			return _mm256_loadu_ps( rsi );
+		const __m256i mask = loadTailMaskInt( count );
+		const __m256 v = _mm256_maskload_ps( rsi, mask );
+		return _mm256_blendv_ps( _mm256_set1_ps( -INFINITY ), v, _mm256_castsi256_ps( mask ) );
+	}
+}
+
+void LogitsReducer::Accumulator::clear()
+{
+	max = -INFINITY;
+	maxText = -INFINITY;
+	sumExp = sumTimestamps = sumInitial = 0;
+	bestTimestampLogit = bestInitialLogit = -INFINITY;
+	bestTimestamp = bestInitial = -1;
+	topLogits.fill( -INFINITY );
+	topTokens.fill( -1 );
+}
+
+void LogitsReducer::Accumulator::rescale( float newMax )
+{
+	if( max != -INFINITY )
+	{
+		const double mul = std::exp( (double)max - (double)newMax );
+		sumExp *= mul;
+		sumTimestamps *= mul;
+		sumInitial *= mul;
+	}
+	max = newMax;
+}
+
+void LogitsReducer::Accumulator::insertTop( float logit, int id )
+{
+	constexpr size_t K = sLogitsSummary::topK;
+	// The panels are reduced in the order of the tokens, on equal logits the lower token ID wins
+	if( !( logit > topLogits[ K - 1 ] ) )
+		return;
+	size_t i = K - 1;
+	for( ; i > 0 && logit > topLogits[ i - 1 ]; i-- )
+	{
+		topLogits[ i ] = topLogits[ i - 1 ];
+		topTokens[ i ] = topTokens[ i - 1 ];
+	}
+	topLogits[ i ] = logit;
+	topTokens[ i ] = id;
+}
+
+void LogitsReducer::prepare( uint32_t threads, uint32_t countColumns, uint32_t tokenBeg )
+{
+	maxThreads = std::max( threads, 1u );
+	columns = countColumns;
+	token_beg = tokenBeg;
+	nextThread = 0;
+	accumulators.resize( (size_t)maxThreads * columns );
+	for( auto& a : accumulators )
+		a.clear();
+}
+
+uint32_t __stdcall LogitsReducer::beginThread()
+{
+	const uint32_t idx = (uint32_t)InterlockedIncrement( &nextThread ) - 1;
+	assert( idx < maxThreads );
+	return idx;
+}
+
+void __stdcall LogitsReducer::reducePanel( uint32_t state, const float* panel, uint32_t begin, uint32_t height, uint32_t countColumns, size_t stride )
+{
+	assert( countColumns == columns );
+	Accumulator* const accStates = &accumulators[ (size_t)state * columns ];
+	const uint32_t end = begin + height;
+
+	for( uint32_t col = 0; col < countColumns; col++, panel += stride )
+	{
+		Accumulator& acc = accStates[ col ];
+
+		// Max of the panel
+		__m256 maxVec = _mm256_set1_ps( -INFINITY );
+		for( uint32_t i = 0; i < height; i += 8 )
+			maxVec = _mm256_max_ps( maxVec, loadLogits( panel + i, height - i ) );
+		const float panelMax = horizontalMax( maxVec );
+		if( panelMax > acc.max )
+			acc.rescale( panelMax );
+
+		// Streaming log-sum-exp
+		const __m256 accMax = _mm256_set1_ps( acc.max );
+		__m256d sum0 = _mm256_setzero_pd();
+		__m256d sum1 = _mm256_setzero_pd();
+		for( uint32_t i = 0; i < height; i += 8 )
+		{
+			__m256 v = loadLogits( panel + i, height - i );
+			v = expf8( _mm256_sub_ps( v, accMax ) );
+			// The missing lanes were -INFINITY, expf8 clamps the input so they need to be zeroed explicitly
+			if( height - i < 8 )
+				v = _mm256_and_ps( v, loadTailMaskFloats( height - i ) );
+			sum0 = _mm256_add_pd( sum0, _mm256_cvtps_pd( _mm256_castps256_ps128( v ) ) );
+			sum1 = _mm256_add_pd( sum1, _mm256_cvtps_pd( _mm256_extractf128_ps( v, 1 ) ) );
+		}
+		acc.sumExp += horizontalSum( _mm256_add_pd( sum0, sum1 ) );
+
+		if( end <= token_beg )
+		{
+			// Only text tokens in this panel
+			acc.maxText = std::max( acc.maxText, panelMax );
+		}
+		else
+		{
+			// The panel has timestamp tokens, these are less than 4% of the vocabulary
+			const uint32_t initialEnd = token_beg + sLogitsSummary::initialTimestamps;
+			for( uint32_t i = 0; i < height; i++ )
+			{
+				const float logit = panel[ i ];
+				const uint32_t id = begin + i;
+				if( id < token_beg )
+				{
+					acc.maxText = std::max( acc.maxText, logit );
+					continue;
+				}
+				const double e = std::exp( (double)logit - (double)acc.max );
+				acc.sumTimestamps += e;
+				if( logit > acc.bestTimestampLogit )
+				{
+					acc.bestTimestampLogit = logit;
+					acc.bestTimestamp = (int)id;
+				}
+				if( id < initialEnd )
+				{
+					acc.sumInitial += e;
+					if( logit > acc.bestInitialLogit )
+					{
+						acc.bestInitialLogit = logit;
+						acc.bestInitial = (int)id;
+					}
+				}
+			}
+		}
+
+		// Running top K, most panels don't have any candidates
+		if( panelMax > acc.topLogits[ sLogitsSummary::topK - 1 ] )
+		{
+			for( uint32_t i = 0; i < height; i++ )
+				acc.insertTop( panel[ i ], (int)( begin + i ) );
+		}
+	}
+}
+
+void LogitsReducer::finish( std::vector<sLogitsSummary>& rdi ) const
+{
+	constexpr uint32_t K = sLogitsSummary::topK;
+	const uint32_t countThreads = std::min( (uint32_t)nextThread, maxThreads );
+	rdi.resize( columns );
+
+	std::vector<std::pair<float, int>> candidates;
+	candidates.reserve( (size_t)K * countThreads );
+
+	for( uint32_t col = 0; col < columns; col++ )
+	{
+		float max = -INFINITY;
+		for( uint32_t t = 0; t < countThreads; t++ )
+			max = std::max( max, accumulators[ (size_t)t * columns + col ].max );
+
+		double sumExp = 0, sumTimestamps = 0, sumInitial = 0;
+		sLogitsSummary& res = rdi[ col ];
+		res.maxText = -INFINITY;
+		res.bestTimestampLogit = res.bestInitialLogit = -INFINITY;
+		res.bestTimestamp = res.bestInitialTimestamp = -1;
+		candidates.clear();
+
+		for( uint32_t t = 0; t < countThreads; t++ )
+		{
+			const Accumulator& a = accumulators[ (size_t)t * columns + col ];
+			if( a.max == -INFINITY )
+				continue;
+			const double mul = std::exp( (double)a.max - (double)max );
+			sumExp += a.sumExp * mul;
+			sumTimestamps += a.sumTimestamps * mul;
+			sumInitial += a.sumInitial * mul;
+			res.maxText = std::max( res.maxText, a.maxText );
+
+			// The threads have sequential ranges of the vocabulary, on equal logits the lower token ID wins
+			if( a.bestTimestampLogit > res.bestTimestampLogit || ( a.bestTimestampLogit == res.bestTimestampLogit && a.bestTimestamp >= 0 && a.bestTimestamp < res.bestTimestamp ) )
+			{
+				res.bestTimestampLogit = a.bestTimestampLogit;
+				res.bestTimestamp = a.bestTimestamp;
+			}
+			if( a.bestInitialLogit > res.bestInitialLogit || ( a.bestInitialLogit == res.bestInitialLogit && a.bestInitial >= 0 && a.bestInitial < res.bestInitialTimestamp ) )
+			{
+				res.bestInitialLogit = a.bestInitialLogit;
+				res.bestInitialTimestamp = a.bestInitial;
+			}
+			for( uint32_t k = 0; k < K; k++ )
+				if( a.topTokens[ k ] >= 0 )
+					candidates.emplace_back( a.topLogits[ k ], a.topTokens[ k ] );
+		}
+
+		res.logSumExp = (float)( (double)max + std::log( sumExp ) );
+		res.sumTimestamps = (float)( sumTimestamps / sumExp );
+		res.sumInitialTimestamps = (float)( sumInitial / sumExp );
+
+		const size_t countTop = std::min( (size_t)K, candidates.size() );
+		std::partial_sort( candidates.begin(), candidates.begin() + countTop, candidates.end(),
+			[]( const std::pair<float, int>& a, const std::pair<float, int>& b )
+			{
+				if( a.first != b.first )
+					return a.first > b.first;
+				return a.second < b.second;
+			} );
+		res.topLogits.fill( -INFINITY );
+		res.topTokens.fill( -1 );
+		for( size_t k = 0; k < countTop; k++ )
+		{
+			res.topLogits[ k ] = candidates[ k ].first;
+			res.topTokens[ k ] = candidates[ k ].second;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+#include "mulMat.h"
+#include "../Whisper/sLogitsSummary.h"
+
+namespace CpuCompute
+{
+	// Fused output head of the decoder: reduces the logits to Whisper::sLogitsSummary while the matrix product against the token embedding is being computed.
+	// Replaces the softmax over the complete vocabulary, and the copy of the probabilities, with a streaming log-sum-exp and a running top K in every thread.
+	class LogitsReducer : public iMulMatReduce
+	{
+		struct alignas( 64 ) Accumulator
+		{
+			// The sums are relative to exp( max )
+			float max;
+			float maxText;
+			double sumExp, sumTimestamps, sumInitial;
+			float bestTimestampLogit, bestInitialLogit;
+			int bestTimestamp, bestInitial;
+			std::array<float, Whisper::sLogitsSummary::topK> topLogits;
+			std::array<int, Whisper::sLogitsSummary::topK> topTokens;
+
+			void clear();
+			void rescale( float newMax );
+			void insertTop( float logit, int id );
+		};
+
+		// [ thread ][ column ]
+		std::vector<Accumulator> accumulators;
+		uint32_t columns = 0;
+		uint32_t maxThreads = 0;
+		uint32_t token_beg = 0;
+		volatile long nextThread = 0;
+
+		// iMulMatReduce
+		uint32_t __stdcall beginThread() override final;
+		void __stdcall reducePanel( uint32_t state, const float* panel, uint32_t begin, uint32_t height, uint32_t columns, size_t stride ) override final;
+
+	public:
+		// Prepare for a matrix product with the specified count of output columns, computed by up to `threads` threads
+		void prepare( uint32_t threads, uint32_t countColumns, uint32_t tokenBeg );
+
+		// Merge the partial results of the threads, produce one summary per output column
+		void finish( std::vector<Whisper::sLogitsSummary>& rdi ) const;
+	};
+}
\ No newline at end of file
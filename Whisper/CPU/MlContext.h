@@ -1,13 +1,18 @@
 #pragma once
 #include "Tensor.h"
 #include "ParallelForRunner.h"
+#include "OpProfiler.h"
 
 namespace CpuCompute
 {
+	__interface iMulMatReduce;
+	class KvTensors;
+
 	class MlContext
 	{
 		ParallelForRunner pfor;
 		iMemoryAllocator* allocator = nullptr;
+		OpProfiler* profiler = nullptr;
 
 	public:
 		MlContext( int threads );
@@ -19,6 +24,11 @@ namespace CpuCompute
 			return pfor.setThreadsCount( threads );
 		}
 
+		HRESULT setNumaNode( int node )
+		{
+			return pfor.setNumaNode( node );
+		}
+
 		iMemoryAllocator* setAllocator( iMemoryAllocator* alloc )
 		{
 			iMemoryAllocator* const ret = allocator;
@@ -26,6 +36,14 @@ namespace CpuCompute
 			return ret;
 		}
 
+		// When not nullptr, the operations measure their time and cost into that object
+		OpProfiler* setProfiler( OpProfiler* prof )
+		{
+			OpProfiler* const ret = profiler;
+			profiler = prof;
+			return ret;
+		}
+
 		Tensor createTensor( eDataType type, const std::array<uint32_t, 4>& size );
 		Tensor createTensor( eDataType type, std::initializer_list<uint32_t> size );
 
@@ -33,6 +51,9 @@ namespace CpuCompute
 
 		Tensor norm( const Tensor& arg );
 
+		// norm( arg ) * w + b, where w and b are vectors of the row length
+		Tensor normAffine( const Tensor& arg, const TensorPair& wb );
+
 		// cur = add( mul( repeat( w, cur ), cur ), repeat( b, cur ) );
 		void fmaRepeat( Tensor& cur, const Tensor& w, const Tensor& b );
 
@@ -44,6 +65,33 @@ namespace CpuCompute
 		// Multiply two matrices
 		Tensor mulMat( const Tensor& a, const Tensor& b );
 
+		// Element-wise operations for the output of the matrix product: result = gelu( ( a * b + bias ) * scale ) + residual
+		struct sMulMatOps
+		{
+			const Tensor* bias = nullptr;
+			float scale = 1.0f;
+			bool gelu = false;
+			const Tensor* residual = nullptr;
+			// Reduction of the output, computed by the same threads while the output is still in cache; only for 2D products
+			iMulMatReduce* reduce = nullptr;
+		};
+
+		// Multiply two matrices, and apply the element-wise operations to the tiles of the product before they're stored
+		Tensor mulMat( const Tensor& a, const Tensor& b, const sMulMatOps& ops );
+
+		// Multiply two matrices into an existing tensor, which may be a strided view into a larger one.
+		// When accumulate is true, result += a * b, otherwise result = a * b
+		void mulMatInto( Tensor& result, const Tensor& a, const Tensor& b, bool accumulate = false );
+
+		// Self-attention scores over the keys in the blocks of the KV cache, for the first KQ.ne[ 0 ] tokens of the sequence.
+		// Q is [ n_head_state, N, n_head ] with continuous rows, KQ is a dense [ n_kv, N, n_head ] tensor.
+		// A single parallelFor over heads * blocks, the compute threads walk the block table.
+		void attentionScores( Tensor& KQ, const Tensor& Q, const KvTensors& kv, uint32_t layer );
+
+		// KQV = V_trans * KQ, the sum of the values in the blocks of the KV cache weighted by the rows of the dense [ n_kv, N, n_head ] KQ tensor.
+		// KQV is a dense [ n_head_state, N, n_head ] tensor. A single parallelFor over heads * rows of KQ, each row walks all the blocks.
+		void attentionValues( Tensor& KQV, const Tensor& KQ, const KvTensors& kv, uint32_t layer );
+
 		// cur = add( repeat( b, cur ), cur ); cur = scale(cur, scaling)
 		void addRepeatScale( Tensor& cur, const Tensor& b, float scaling );
 
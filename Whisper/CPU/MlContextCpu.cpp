@@ -2,12 +2,68 @@
 #include "MlContext.h"
 #include "simdUtils.h"
 #include "mulMat.h"
+#include "KvTensors.h"
+#include "../Utils/CpuProfiler.h"
 using namespace CpuCompute;
 
 MlContext::MlContext( int threads ) : pfor( threads )
 {
 }
 
+namespace
+{
+	// Measures a single operation into the profiler, when the context has one.
+	// The FLOPs are approximate, the bytes are the compulsory memory traffic: every input element is loaded once, every output element is stored once.
+	class OpRaii
+	{
+		OpProfiler* const profiler;
+		OpProfiler::Key key;
+		uint64_t flops = 0;
+		uint64_t bytes = 0;
+		int64_t tsc = 0;
+
+	public:
+		// Element-wise operation
+		OpRaii( OpProfiler* prof, eCpuOp op, const Tensor& result, uint32_t flopsPerElement, uint32_t bytesPerElement ) :
+			profiler( prof )
+		{
+			if( nullptr == prof )
+				return;
+			key.op = op;
+			key.variant = 0;
+			key.shape = result.ne;
+			const uint64_t elements = result.countElements();
+			flops = elements * flopsPerElement;
+			bytes = elements * bytesPerElement;
+			tsc = Whisper::tscNow();
+		}
+
+		// Matrix product; extraBytes is the count of bytes loaded or stored for each element of the product, in addition to the output itself
+		OpRaii( OpProfiler* prof, eCpuOp op, const Tensor& a, const Tensor& b, uint32_t extraBytes ) :
+			profiler( prof )
+		{
+			if( nullptr == prof )
+				return;
+			key.op = op;
+			key.variant = mulMatVariant( a, b );
+			// [ M, N, K, batch ]
+			key.shape = { a.ne[ 1 ], b.ne[ 1 ], a.ne[ 0 ], a.ne[ 2 ] * b.ne[ 3 ] };
+			const uint64_t elements = (uint64_t)a.ne[ 1 ] * b.ne[ 1 ] * a.ne[ 2 ] * b.ne[ 3 ];
+			flops = elements * a.ne[ 0 ] * 2;
+			bytes = (uint64_t)a.countElements() * 2 + (uint64_t)b.countElements() * 4 + elements * ( 4 + extraBytes );
+			tsc = Whisper::tscNow();
+		}
+
+		OpRaii( const OpRaii& ) = delete;
+
+		~OpRaii()
+		{
+			if( nullptr != profiler )
+				profiler->add( key, (uint64_t)( Whisper::tscNow() - tsc ), flops, bytes );
+		}
+	};
+}
+
 Tensor MlContext::createTensor( eDataType type, const std::array<uint32_t, 4>& size )
 {
 	Tensor res;
@@ -48,6 +104,7 @@ Tensor MlContext::addRows( const Tensor& d_te, const Tensor& d_pe, const int* to
 		throw E_BOUNDS;
 
 	Tensor res = createTensor( eDataType::FP32, { d_te.ne[ 0 ], (uint32_t)n_tokens } );
+	OpRaii prof{ profiler, eCpuOp::AddRows, res, 1, 10 };
 
 	const size_t inner = (size_t)d_te.ne[ 0 ];
 	const size_t outer = (size_t)n_tokens;
@@ -145,6 +202,7 @@ Tensor MlContext::norm( const Tensor& arg )
 	if( arg.type() != eDataType::FP32 || arg.nb[ 0 ] != 1 )
 		throw E_INVALIDARG;
 	Tensor res = createTensor( eDataType::FP32, arg.ne );
+	OpRaii prof{ profiler, eCpuOp::Norm, res, 5, 8 };
 
 	NormContext context;
 	context.source = arg.fp32();
@@ -157,6 +215,66 @@ Tensor MlContext::norm( const Tensor& arg )
 	return res;
 }
 
+namespace
+{
+	// Fused layer normalization and the affine transform; all tensors are dense
+	struct NormAffineContext : public iComputeRange
+	{
+		const float* source;
+		const float* w;
+		const float* b;
+		float* result;
+		size_t inner;
+
+		HRESULT __stdcall compute( size_t i, size_t end ) const override final
+		{
+			ALIGNED_SPAN( temp, inner );
+
+			const size_t off = i * inner;
+			float* rdi = result + off;
+			const float* rsi = source + off;
+			for( ; i < end; i++, rdi += inner, rsi += inner )
+				normAffine( rdi, temp, rsi, inner, w, b );
+			return S_OK;
+		}
+
+		void setWeights( const Tensor& arg, const TensorPair& ln )
+		{
+			const Tensor& w = ln.w;
+			const Tensor& b = ln.b;
+			if( !( arg.type() == eDataType::FP32 && w.type() == eDataType::FP32 && b.type() == eDataType::FP32 ) )
+				throw E_INVALIDARG;
+			if( !( arg.isContinuous() && w.isContinuous() && b.isContinuous() ) )
+				throw E_INVALIDARG;
+			// The fused version only supports the weights which are vectors of the row length, that's how they are in the model
+			if( w.countElements() != arg.ne[ 0 ] || b.countElements() != arg.ne[ 0 ] )
+				throw E_NOTIMPL;
+
+			this->w = w.fp32();
+			this->b = b.fp32();
+			inner = arg.ne[ 0 ];
+		}
+	};
+
+	inline size_t countRows( const Tensor& t )
+	{
+		return (size_t)t.ne[ 1 ] * t.ne[ 2 ] * t.ne[ 3 ];
+	}
+}
+
+Tensor MlContext::normAffine( const Tensor& arg, const TensorPair& wb )
+{
+	NormAffineContext context;
+	context.setWeights( arg, wb );
+	Tensor res = createTensor( eDataType::FP32, arg.ne );
+	OpRaii prof{ profiler, eCpuOp::NormAffine, res, 7, 8 };
+	context.source = arg.fp32();
+	context.result = res.fp32();
+
+	check( pfor.parallelFor( context, countRows( arg ) ) );
+	return res;
+}
+
 void MlContext::fmaRepeat( Tensor& cur, const Tensor& w, const Tensor& b )
 {
 	if( !( cur.isContinuous() && w.isContinuous() && b.isContinuous() ) )
@@ -167,6 +285,7 @@ void MlContext::fmaRepeat( Tensor& cur, const Tensor& w, const Tensor& b )
 
 	if( !isSameShape( w, b ) )
 		throw E_INVALIDARG;
+	OpRaii prof{ profiler, eCpuOp::FmaRepeat, cur, 2, 8 };
 
 	DispatchHelper3 helper{ cur.ne[ 1 ], cur.ne[ 2 ], cur.ne[ 3 ] };
 	std::array<uint32_t, 3> idx = { 0, 0, 0 };
@@ -196,11 +315,196 @@ Tensor MlContext::mulMat( const Tensor& a, const Tensor& b )
 
 	std::array<uint32_t, 4> ne{ a.ne[ 1 ], b.ne[ 1 ], a.ne[ 2 ], b.ne[ 3 ] };
 	Tensor result = createTensor( eDataType::FP32, ne );
+	OpRaii prof{ profiler, eCpuOp::MulMat, a, b, 0 };
 
 	check( CpuCompute::mulMat( result, a, b, pfor ) );
 	return result;
 }
 
+Tensor MlContext::mulMat( const Tensor& a, const Tensor& b, const sMulMatOps& ops )
+{
+	if( !DirectCompute::canMulMat( a, b ) )
+		throw E_INVALIDARG;
+
+	std::array<uint32_t, 4> ne{ a.ne[ 1 ], b.ne[ 1 ], a.ne[ 2 ], b.ne[ 3 ] };
+
+	sMulMatEpilogue epilogue;
+	if( nullptr != ops.bias )
+	{
+		const Tensor& bias = *ops.bias;
+		if( !( bias.type() == eDataType::FP32 && bias.isContinuous() ) )
+			throw E_INVALIDARG;
+		// Only the bias vectors are supported, no other repeat patterns
+		if( bias.countElements() != ne[ 0 ] )
+			throw E_NOTIMPL;
+		epilogue.bias = bias.fp32();
+	}
+	epilogue.scale = ops.scale;
+	epilogue.gelu = ops.gelu;
+	if( nullptr != ops.residual )
+	{
+		const Tensor& residual = *ops.residual;
+		if( !( residual.type() == eDataType::FP32 && residual.isContinuous() ) )
+			throw E_INVALIDARG;
+		if( residual.ne != ne )
+			throw E_INVALIDARG;
+		epilogue.residual = residual.fp32();
+	}
+	epilogue.reduce = ops.reduce;
+
+	Tensor result = createTensor( eDataType::FP32, ne );
+	OpRaii prof{ profiler, eCpuOp::MulMat, a, b, ( nullptr != ops.residual ) ? 4 : 0 };
+	check( CpuCompute::mulMat( result, a, b, pfor, &epilogue ) );
+	return result;
+}
+
+void MlContext::mulMatInto( Tensor& result, const Tensor& a, const Tensor& b, bool accumulate )
+{
+	if( !DirectCompute::canMulMat( a, b ) )
+		throw E_INVALIDARG;
+
+	std::array<uint32_t, 4> ne{ a.ne[ 1 ], b.ne[ 1 ], a.ne[ 2 ], b.ne[ 3 ] };
+	if( result.type() != eDataType::FP32 || result.ne != ne )
+		throw E_INVALIDARG;
+	// The kernel only supports continuous rows of the output
+	if( result.nb[ 0 ] != 1 )
+		throw E_NOTIMPL;
+	OpRaii prof{ profiler, eCpuOp::MulMatInto, a, b, accumulate ? 4 : 0 };
+
+	if( !accumulate )
+	{
+		check( CpuCompute::mulMat( result, a, b, pfor ) );
+		return;
+	}
+
+	// The residual has the same memory layout as the result, and the epilogue loads it before storing the tile
+	sMulMatEpilogue epilogue;
+	epilogue.residual = result.fp32();
+	check( CpuCompute::mulMat( result, a, b, pfor, &epilogue ) );
+}
+
+namespace
+{
+	constexpr uint32_t blockTokens = KvBlockPool::blockTokens;
+
+	// KQ[ t, n, h ] = dot( K[ t, h ], Q[ n, h ] ); one job per head and block of the KV cache
+	struct AttentionScoresContext : public iComputeRange
+	{
+		const KvTensors* kv;
+		uint32_t layer;
+		const float* q;
+		// Strides of Q for the tokens and the heads, in elements
+		size_t qStrideToken, qStrideHead;
+		float* result;
+		uint32_t n_kv, countTokens, headSize, countBlocks;
+
+		HRESULT __stdcall compute( size_t i, size_t end ) const override final
+		{
+			const size_t n_state = kv->stateSize();
+			for( ; i < end; i++ )
+			{
+				const uint32_t head = (uint32_t)( i / countBlocks );
+				const uint32_t block = (uint32_t)( i % countBlocks );
+				const uint32_t begin = block * blockTokens;
+				const uint32_t length = std::min( blockTokens, n_kv - begin );
+
+				const uint16_t* const keys = kv->keysPointer( layer, block ) + (size_t)head * headSize;
+				const float* qRow = q + head * qStrideHead;
+				float* rdi = result + begin + (size_t)head * n_kv * countTokens;
+				for( uint32_t n = 0; n < countTokens; n++, qRow += qStrideToken, rdi += n_kv )
+				{
+					const uint16_t* k = keys;
+					for( uint32_t t = 0; t < length; t++, k += n_state )
+						rdi[ t ] = dotProductF16( k, qRow, headSize );
+				}
+			}
+			return S_OK;
+		}
+	};
+
+	// KQV[ n, h ] = sum over t of V[ t, h ] * KQ[ t, n, h ]; one job per head and row of KQ, the blocks are summed by the same thread
+	struct AttentionValuesContext : public iComputeRange
+	{
+		const KvTensors* kv;
+		uint32_t layer;
+		const float* kq;
+		float* result;
+		uint32_t n_kv, countTokens, headSize, countBlocks;
+
+		HRESULT __stdcall compute( size_t i, size_t end ) const override final
+		{
+			const size_t n_state = kv->stateSize();
+			for( ; i < end; i++ )
+			{
+				const uint32_t head = (uint32_t)( i / countTokens );
+				float* const rdi = result + i * headSize;
+				const float* const weights = kq + i * n_kv;
+				memset( rdi, 0, headSize * sizeof( float ) );
+
+				for( uint32_t block = 0; block < countBlocks; block++ )
+				{
+					const uint32_t begin = block * blockTokens;
+					const uint32_t length = std::min( blockTokens, n_kv - begin );
+					const uint16_t* v = kv->valuesPointer( layer, block ) + (size_t)head * headSize;
+					for( uint32_t t = 0; t < length; t++, v += n_state )
+						fmaRowF16( rdi, v, weights[ begin + t ], headSize );
+				}
+			}
+			return S_OK;
+		}
+	};
+}
+
+void MlContext::attentionScores( Tensor& KQ, const Tensor& Q, const KvTensors& kv, uint32_t layer )
+{
+	if( !( KQ.type() == eDataType::FP32 && KQ.isContinuous() && Q.type() == eDataType::FP32 && Q.nb[ 0 ] == 1 ) )
+		throw E_INVALIDARG;
+	const uint32_t n_kv = KQ.ne[ 0 ];
+	if( KQ.ne[ 1 ] != Q.ne[ 1 ] || KQ.ne[ 2 ] != Q.ne[ 2 ] || (size_t)Q.ne[ 0 ] * Q.ne[ 2 ] != kv.stateSize() )
+		throw E_INVALIDARG;
+	if( 0 == n_kv || n_kv > kv.capacity() )
+		throw E_BOUNDS;
+	OpRaii prof{ profiler, eCpuOp::AttentionScores, KQ, 2 * Q.ne[ 0 ], 2 * Q.ne[ 0 ] + 4 };
+
+	AttentionScoresContext context;
+	context.kv = &kv;
+	context.layer = layer;
+	context.q = Q.fp32();
+	context.qStrideToken = Q.nb[ 1 ];
+	context.qStrideHead = Q.nb[ 2 ];
+	context.result = KQ.fp32();
+	context.n_kv = n_kv;
+	context.countTokens = KQ.ne[ 1 ];
+	context.headSize = Q.ne[ 0 ];
+	context.countBlocks = KvTensors::countBlocks( n_kv );
+
+	check( pfor.parallelFor( context, (size_t)context.countBlocks * KQ.ne[ 2 ] ) );
+}
+
+void MlContext::attentionValues( Tensor& KQV, const Tensor& KQ, const KvTensors& kv, uint32_t layer )
+{
+	if( !( KQV.type() == eDataType::FP32 && KQV.isContinuous() && KQ.type() == eDataType::FP32 && KQ.isContinuous() ) )
+		throw E_INVALIDARG;
+	const uint32_t n_kv = KQ.ne[ 0 ];
+	if( KQV.ne[ 1 ] != KQ.ne[ 1 ] || KQV.ne[ 2 ] != KQ.ne[ 2 ] || (size_t)KQV.ne[ 0 ] * KQV.ne[ 2 ] != kv.stateSize() )
+		throw E_INVALIDARG;
+	if( 0 == n_kv || n_kv > kv.capacity() )
+		throw E_BOUNDS;
+	OpRaii prof{ profiler, eCpuOp::AttentionValues, KQV, 2 * n_kv, 6 * n_kv };
+
+	AttentionValuesContext context;
+	context.kv = &kv;
+	context.layer = layer;
+	context.kq = KQ.fp32();
+	context.result = KQV.fp32();
+	context.n_kv = n_kv;
+	context.countTokens = KQ.ne[ 1 ];
+	context.headSize = KQV.ne[ 0 ];
+	context.countBlocks = KvTensors::countBlocks( n_kv );
+
+	check( pfor.parallelFor( context, (size_t)KQ.ne[ 1 ] * KQ.ne[ 2 ] ) );
+}
+
 // cur = add( repeat( b, cur ), cur ); cur = scale(cur, scaling)
 void MlContext::addRepeatScale( Tensor& cur, const Tensor& b, float scaling )
 {
@@ -208,6 +512,7 @@ void MlContext::addRepeatScale( Tensor& cur, const Tensor& b, float scaling )
 		throw E_INVALIDARG;
 	if( !( cur.type() == eDataType::FP32 && b.type() == eDataType::FP32 ) )
 		throw E_INVALIDARG;
+	OpRaii prof{ profiler, eCpuOp::AddRepeatScale, cur, 2, 8 };
 
 	DispatchHelper3 helper{ cur.ne[ 1 ], cur.ne[ 2 ], cur.ne[ 3 ] };
 	std::array<uint32_t, 3> idx = { 0, 0, 0 };
@@ -236,6 +541,7 @@ void MlContext::addRepeat( Tensor& cur, const Tensor& b )
 		throw E_INVALIDARG;
 	if( !( cur.type() == eDataType::FP32 && b.type() == eDataType::FP32 ) )
 		throw E_INVALIDARG;
+	OpRaii prof{ profiler, eCpuOp::AddRepeat, cur, 1, 8 };
 
 	DispatchHelper3 helper{ cur.ne[ 1 ], cur.ne[ 2 ], cur.ne[ 3 ] };
 	std::array<uint32_t, 3> idx = { 0, 0, 0 };
@@ -263,6 +569,7 @@ void MlContext::scale( Tensor& cur, float scaling )
 	if( !( cur.isContinuous() && cur.type() == eDataType::FP32 ) )
 		throw E_INVALIDARG;
 
+	OpRaii prof{ profiler, eCpuOp::Scale, cur, 1, 8 };
 	const size_t len = cur.countElements();
 	const __m256 scale = _mm256_set1_ps( scaling );
 	scaleRow( cur.fp32(), len, scale );
@@ -272,6 +579,7 @@ void MlContext::diagMaskInf( Tensor& cur, uint32_t n_past )
 {
 	if( !( cur.isContinuous() && cur.type() == eDataType::FP32 ) )
 		throw E_INVALIDARG;
+	OpRaii prof{ profiler, eCpuOp::DiagMaskInf, cur, 0, 4 };
 
 	const size_t n = cur.countRows();
 	const size_t nc = cur.ne[ 0 ];
@@ -317,6 +625,7 @@ void MlContext::softMax( Tensor& cur, float inputScale )
 		}
 	};
 
+	OpRaii prof{ profiler, eCpuOp::SoftMax, cur, 5, 8 };
 	SoftMaxContext context;
 	context.data = cur.fp32();
 	context.inputScale = inputScale;
@@ -487,6 +796,7 @@ Tensor MlContext::copy( const Tensor& a, eDataType type, std::initializer_list<u
 	{
 		// Need to convert types, and/or transpose the tensor. Make another tensor for the output
 		Tensor res = createTensor( type, size );
+		OpRaii prof{ profiler, eCpuOp::Copy, res, 0, (uint32_t)( elementSize( a.type() ) + elementSize( type ) ) };
 		check( copyImpl( res, a ) );
 		return res;
 	}
@@ -545,6 +855,7 @@ void MlContext::copyInPlace( Tensor& dest, const Tensor& a, eDataType type, std:
 	dest.setDenseStrides();
 
 	// Copy the data
+	OpRaii prof{ profiler, eCpuOp::Copy, dest, 0, (uint32_t)( elementSize( a.type() ) + elementSize( type ) ) };
 	check( copyImpl( dest, a ) );
 }
 
@@ -553,6 +864,7 @@ void MlContext::addInPlace( Tensor& a, const Tensor& b )
 	if( !( a.isContinuous() && b.isContinuous() && a.type() == eDataType::FP32 && b.type() == eDataType::FP32 ) )
 		throw E_NOTIMPL;
 
+	OpRaii prof{ profiler, eCpuOp::AddInPlace, a, 1, 12 };
 	const size_t length = a.countElements();
 	addRowInPlace( a.fp32(), b.fp32(), length );
 }
@@ -563,6 +875,7 @@ Tensor MlContext::add( const Tensor& a, const Tensor& b )
 		throw E_NOTIMPL;
 
 	Tensor res = createTensor( eDataType::FP32, a.ne );
+	OpRaii prof{ profiler, eCpuOp::Add, res, 1, 12 };
 	const size_t length = a.countElements();
 	addRow( res.fp32(), a.fp32(), b.fp32(), length );
 	return res;
@@ -574,6 +887,7 @@ void MlContext::addRepeatGelu( Tensor& cur, const Tensor& b )
 		throw E_INVALIDARG;
 	if( !( cur.type() == eDataType::FP32 && b.type() == eDataType::FP32 ) )
 		throw E_INVALIDARG;
+	OpRaii prof{ profiler, eCpuOp::AddRepeatGelu, cur, 2, 8 };
 
 	DispatchHelper3 helper{ cur.ne[ 1 ], cur.ne[ 2 ], cur.ne[ 3 ] };
 	std::array<uint32_t, 3> idx = { 0, 0, 0 };
@@ -582,7 +896,6 @@ void MlContext::addRepeatGelu( Tensor& cur, const Tensor& b )
 	const size_t innerRes = (uint32_t)cur.ne[ 0 ];
 	const size_t innerPattern = (uint32_t)b.ne[ 0 ];
 	float* rdi = cur.fp32();
-	auto& lookupTables = getLookupTables();
 	for( size_t i = 0; i < countRows; i++, helper.next( idx ), rdi += innerRes )
 	{
 		std::array<uint32_t, 3> idxPattern;
@@ -591,7 +904,7 @@ void MlContext::addRepeatGelu( Tensor& cur, const Tensor& b )
 		idxPattern[ 2 ] = idx[ 2 ] % (uint32_t)b.ne[ 3 ];
 
 		const float* source = sourceRow( b.fp32(), idxPattern, b.nb[ 1 ], b.nb[ 2 ], b.nb[ 3 ] );
-		addRepeatGeluRow( rdi, innerRes, source, innerPattern, lookupTables );
+		addRepeatGeluRow( rdi, innerRes, source, innerPattern );
 	}
 	return;
 }
\ No newline at end of file
@@ -0,0 +1,82 @@
+#include "stdafx.h"
+#include "NumaTopology.h"
+using namespace CpuCompute;
+
+NumaTopology::NumaTopology()
+{
+	ULONG highestNode = 0;
+	if( GetNumaHighestNodeNumber( &highestNode ) && highestNode > 0 )
+	{
+		for( ULONG i = 0; i <= highestNode; i++ )
+		{
+			GROUP_AFFINITY ga;
+			if( !GetNumaNodeProcessorMaskEx( (USHORT)i, &ga ) )
+				continue;
+			// Memory-only nodes don't have processors, the threads can't run there
+			if( 0 == ga.Mask )
+				continue;
+
+			Node& n = nodes.emplace_back();
+			n.affinity = ga;
+			n.id = (uint16_t)i;
+			n.countProcessors = (uint16_t)__popcnt64( ga.Mask );
+		}
+	}
+
+	if( nodes.size() <= 1 )
+	{
+		makeSingleNode();
+		return;
+	}
+
+	logInfo( u8"NUMA topology: %zu nodes", nodes.size() );
+	for( const Node& n : nodes )
+		logDebug( u8"NUMA node %i: processor group %i, %i processors", (int)n.id, (int)n.affinity.Group, (int)n.countProcessors );
+}
+
+void NumaTopology::makeSingleNode()
+{
+	nodes.clear();
+	Node& n = nodes.emplace_back();
+	memset( &n.affinity, 0, sizeof( GROUP_AFFINITY ) );
+	n.id = 0;
+
+	SYSTEM_INFO si;
+	GetSystemInfo( &si );
+	n.countProcessors = (uint16_t)si.dwNumberOfProcessors;
+}
+
+const NumaTopology& NumaTopology::get()
+{
+	static const NumaTopology topology;
+	return topology;
+}
+
+HRESULT NumaTopology::setThreadAffinity( size_t idx ) const
+{
+	if( idx >= nodes.size() )
+		return E_BOUNDS;
+	const GROUP_AFFINITY& ga = nodes[ idx ].affinity;
+	if( 0 == ga.Mask )
+		return S_FALSE;
+	if( SetThreadGroupAffinity( GetCurrentThread(), &ga, nullptr ) )
+		return S_OK;
+	return getLastHr();
+}
+
+size_t NumaTopology::currentNode() const
+{
+	if( nodes.size() <= 1 )
+		return 0;
+
+	PROCESSOR_NUMBER pn;
+	GetCurrentProcessorNumberEx( &pn );
+	USHORT id = 0;
+	if( !GetNumaProcessorNodeEx( &pn, &id ) )
+		return 0;
+
+	for( size_t i = 0; i < nodes.size(); i++ )
+		if( nodes[ i ].id == id )
+			return i;
+	return 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+namespace CpuCompute
+{
+	// NUMA topology of the computer: the nodes which have processors, and processor masks of these nodes.
+	// When the computer has a single node, or the OS fails to report the topology, contains a single node with all processors.
+	class NumaTopology
+	{
+		struct Node
+		{
+			// Processors of the node; for the single-node topology the mask is 0, meaning "don't change affinity"
+			GROUP_AFFINITY affinity;
+			// Node number for the OS kernel APIs
+			uint16_t id;
+			uint16_t countProcessors;
+		};
+		std::vector<Node> nodes;
+
+		NumaTopology();
+		void makeSingleNode();
+
+	public:
+		NumaTopology( const NumaTopology& ) = delete;
+
+		// Topology of this computer, detected on the first call
+		static const NumaTopology& get();
+
+		size_t countNodes() const { return nodes.size(); }
+
+		bool isNuma() const { return nodes.size() > 1; }
+
+		// OS node number of the node with the specified index
+		uint16_t nodeId( size_t idx ) const { return nodes[ idx ].id; }
+
+		uint32_t countProcessors( size_t idx ) const { return nodes[ idx ].countProcessors; }
+
+		// Bind the calling thread to processors of the node with the specified index
+		HRESULT setThreadAffinity( size_t idx ) const;
+
+		// Index of the node where the calling thread is running at the moment
+		size_t currentNode() const;
+	};
+}
@@ -0,0 +1,108 @@
+#include "stdafx.h"
+#include "OpProfiler.h"
+#include "../Utils/CpuProfiler.h"
+#include <atlfile.h>
+#include <atlstr.h>
+using namespace CpuCompute;
+
+using Lock = CComCritSecLock<CComAutoCriticalSection>;
+
+const char* CpuCompute::cpuOpName( eCpuOp op )
+{
+	switch( op )
+	{
+#define V(x) case eCpuOp::x: return #x
+		V( AddRows );
+		V( Norm );
+		V( NormAffine );
+		V( FmaRepeat );
+		V( MulMat );
+		V( MulMatInto );
+		V( AttentionScores );
+		V( AttentionValues );
+		V( AddRepeatScale );
+		V( AddRepeat );
+		V( Add );
+		V( AddInPlace );
+		V( AddRepeatGelu );
+		V( Scale );
+		V( DiagMaskInf );
+		V( SoftMax );
+		V( Copy );
+#undef V
+	}
+	assert( false );
+	return nullptr;
+}
+
+void OpProfiler::add( const Key& key, uint64_t tsc, uint64_t flops, uint64_t bytes )
+{
+	Lock lock{ critSec };
+	Stats& s = stats[ key ];
+	s.count++;
+	s.tsc += tsc;
+	s.flops += flops;
+	s.bytes += bytes;
+}
+
+void OpProfiler::reset()
+{
+	Lock lock{ critSec };
+	stats.clear();
+}
+
+void OpProfiler::getEntries( std::vector<Entry>& rdi, bool byShape ) const
+{
+	rdi.clear();
+	{
+		Lock lock{ critSec };
+		if( byShape )
+			rdi.assign( stats.begin(), stats.end() );
+		else
+		{
+			// The map is sorted by [ op, variant, shape ], the entries to merge are adjacent
+			for( const auto& e : stats )
+			{
+				if( !rdi.empty() && rdi.back().first.op == e.first.op && rdi.back().first.variant == e.first.variant )
+				{
+					rdi.back().second.add( e.second );
+					continue;
+				}
+				Entry& ne = rdi.emplace_back( e );
+				ne.first.shape.fill( 0 );
+			}
+		}
+	}
+
+	std::stable_sort( rdi.begin(), rdi.end(), []( const Entry& a, const Entry& b )
+		{
+			return a.second.tsc > b.second.tsc;
+		} );
+}
+
+HRESULT OpProfiler::exportTsv( LPCTSTR path ) const
+{
+	std::vector<Entry> entries;
+	getEntries( entries, true );
+
+	CStringA text;
+	text = "op\tpanelHeightRegs\ttileWidthFloats\tne0\tne1\tne2\tne3\tcalls\tseconds\tflops\tbytes\tGFlops\tGBps\n";
+	for( const Entry& e : entries )
+	{
+		const Key& k = e.first;
+		const Stats& s = e.second;
+		const double seconds = (double)(int64_t)Whisper::ticksFromTsc( s.tsc ) * 1.0E-7;
+		const double mul = ( seconds > 0 ) ? 1.0E-9 / seconds : 0.0;
+		text.AppendFormat( "%s\t%i\t%i\t%u\t%u\t%u\t%u\t%zu\t%g\t%llu\t%llu\t%g\t%g\n",
+			cpuOpName( k.op ), (int)( k.variant >> 4 ), (int)( k.variant & 0xF ),
+			k.shape[ 0 ], k.shape[ 1 ], k.shape[ 2 ], k.shape[ 3 ],
+			s.count, seconds, s.flops, s.bytes,
+			(double)(int64_t)s.flops * mul, (double)(int64_t)s.bytes * mul );
+	}
+
+	CAtlFile file;
+	CHECK( file.Create( path, GENERIC_WRITE, 0, CREATE_ALWAYS ) );
+	CHECK( file.Write( text.GetString(), (DWORD)text.GetLength() ) );
+	CHECK( file.Flush() );
+	return S_OK;
+}
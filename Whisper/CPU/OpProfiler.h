@@ -0,0 +1,87 @@
+#pragma once
+#include <map>
+#include <atlbase.h>
+
+namespace CpuCompute
+{
+	enum struct eCpuOp : uint8_t
+	{
+		AddRows,
+		Norm,
+		NormAffine,
+		FmaRepeat,
+		MulMat,
+		MulMatInto,
+		AttentionScores,
+		AttentionValues,
+		AddRepeatScale,
+		AddRepeat,
+		Add,
+		AddInPlace,
+		AddRepeatGelu,
+		Scale,
+		DiagMaskInf,
+		SoftMax,
+		Copy,
+	};
+
+	const char* cpuOpName( eCpuOp op );
+
+	// Collects time, and approximate counts of FLOPs and bytes of memory traffic, of the individual operations of MlContext.
+	// The measures are grouped by the operation, the variant of the kernel, and the shape of the tensors.
+	class OpProfiler
+	{
+	public:
+		struct Key
+		{
+			eCpuOp op;
+			// For matrix products, panelHeightRegs * 16 + tileWidthFloats of the MulMatImpl template; 0 for other operations
+			uint8_t variant;
+			// For matrix products [ M, N, K, batch ], for other operations size of the output tensor
+			std::array<uint32_t, 4> shape;
+
+			bool operator<( const Key& that ) const
+			{
+				if( op != that.op )
+					return op < that.op;
+				if( variant != that.variant )
+					return variant < that.variant;
+				return shape < that.shape;
+			}
+		};
+
+		struct Stats
+		{
+			size_t count = 0;
+			// Time in CPU timestamp counter units
+			uint64_t tsc = 0;
+			uint64_t flops = 0;
+			uint64_t bytes = 0;
+
+			void add( const Stats& that )
+			{
+				count += that.count;
+				tsc += that.tsc;
+				flops += that.flops;
+				bytes += that.bytes;
+			}
+		};
+
+		using Entry = std::pair<Key, Stats>;
+
+		void add( const Key& key, uint64_t tsc, uint64_t flops, uint64_t bytes );
+
+		void reset();
+
+		// Copy the measures into the vector, sorted by time in descending order.
+		// When byShape is false, the shapes are merged, there's one entry per operation and kernel variant, with zero shape.
+		void getEntries( std::vector<Entry>& rdi, bool byShape ) const;
+
+		// Write all measures to a tab-separated text file, with a header line
+		HRESULT exportTsv( LPCTSTR path ) const;
+
+	private:
+		std::map<Key, Stats> stats;
+		mutable CComAutoCriticalSection critSec;
+	};
+}
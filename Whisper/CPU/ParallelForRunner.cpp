@@ -1,5 +1,7 @@
 #include "stdafx.h"
 #include "ParallelForRunner.h"
+#include "NumaTopology.h"
+#include "../Utils/Timeline.h"
 using namespace CpuCompute;
 
 ParallelForRunner::ParallelForRunner( int threads ) :
@@ -15,6 +17,7 @@ ParallelForRunner::ParallelForRunner( int threads ) :
 	if( nullptr == work )
 		throw getLastHr();
 	threadBuffers.resize( maxThreads );
+	check( createNodePools() );
 }
 
 HRESULT ParallelForRunner::setThreadsCount( int threads )
@@ -33,9 +36,87 @@ HRESULT ParallelForRunner::setThreadsCount( int threads )
 		if( nullptr == work )
 			return getLastHr();
 	}
+	return createNodePools();
+}
+
+HRESULT ParallelForRunner::setNumaNode( int node )
+{
+	const NumaTopology& topology = NumaTopology::get();
+	if( node >= (int)topology.countNodes() )
+		return E_BOUNDS;
+	if( node < 0 )
+		node = -1;
+	if( node == numaNode )
+		return S_OK;
+
+	nodePools.clear();
+	numaNode = node;
+	return createNodePools();
+}
+
+HRESULT ParallelForRunner::createNodePools()
+{
+	const NumaTopology& topology = NumaTopology::get();
+	if( maxThreads <= 1 || !topology.isNuma() || !nodePools.empty() )
+		return S_OK;
+
+	auto add = [ this ]( int node )
+	{
+		auto& np = nodePools.emplace_back( std::make_unique<NodePool>() );
+		return np->create( this, node );
+	};
+
+	HRESULT hr = S_OK;
+	if( numaNode >= 0 )
+		hr = add( numaNode );
+	else
+	{
+		for( size_t i = 0; i < topology.countNodes() && SUCCEEDED( hr ); i++ )
+			hr = add( (int)i );
+	}
+
+	if( SUCCEEDED( hr ) )
+		return S_OK;
+	nodePools.clear();
+	logErrorHr( hr, u8"ParallelForRunner: unable to create thread pools for NUMA nodes" );
+	return hr;
+}
+
+HRESULT ParallelForRunner::NodePool::create( ParallelForRunner* runner, int nodeIndex )
+{
+	owner = runner;
+	node = nodeIndex;
+	countProcessors = NumaTopology::get().countProcessors( nodeIndex );
+
+	InitializeThreadpoolEnvironment( &environment );
+	pool = CreateThreadpool( nullptr );
+	if( nullptr == pool )
+		return getLastHr();
+	SetThreadpoolThreadMaximum( pool, countProcessors );
+	if( !SetThreadpoolThreadMinimum( pool, 1 ) )
+		return getLastHr();
+	SetThreadpoolCallbackPool( &environment, pool );
+
+	work = CreateThreadpoolWork( &nodeCallbackStatic, this, &environment );
+	if( nullptr == work )
+		return getLastHr();
 	return S_OK;
 }
 
+ParallelForRunner::NodePool::~NodePool()
+{
+	if( nullptr != work )
+	{
+		WaitForThreadpoolWorkCallbacks( work, FALSE );
+		CloseThreadpoolWork( work );
+	}
+	if( nullptr != pool )
+	{
+		CloseThreadpool( pool );
+		DestroyThreadpoolEnvironment( &environment );
+	}
+}
+
 ParallelForRunner::~ParallelForRunner()
 {
 	if( nullptr != work )
@@ -49,6 +130,10 @@ ParallelForRunner::~ParallelForRunner()
 namespace
 {
 	thread_local uint32_t currentThreadIndex = UINT_MAX;
+	// Index of the NUMA node of the current batch, or -1 when the batch runs on a thread which isn't bound to a node
+	thread_local int currentNumaNode = -1;
+	// The pool which owns the current thread, the threads are bound to the processors of the node on their first callback
+	thread_local const void* boundPool = nullptr;
 }
 
 void ParallelForRunner::runBatch( size_t ith ) noexcept
@@ -60,6 +145,7 @@ void ParallelForRunner::runBatch( size_t ith ) noexcept
 	HRESULT hr = E_UNEXPECTED;
 	try
 	{
+		Timeline::Span span{ "batch", "parallelFor", (int64_t)ith };
 		hr = computeRange->compute( begin, end );
 	}
 	catch( HRESULT code )
@@ -86,14 +172,16 @@ void* ParallelForRunner::threadLocalBuffer( size_t cb )
 	if( idx < threadBuffers.size() )
 	{
 		ThreadBuffer& tb = threadBuffers[ idx ];
-		if( tb.cb >= cb )
+		const int node = currentNumaNode;
+		if( tb.cb >= cb && tb.numaNode == node )
 		{
 			// We already have large enough buffer for the current thread
 			return tb.memory.pointer();
 		}
 		tb.memory.deallocate();
-		check( tb.memory.allocate( cb ) );
+		check( tb.memory.allocate( cb, node ) );
 		tb.cb = cb;
+		tb.numaNode = node;
 		return tb.memory.pointer();
 	}
 	if( idx != UINT_MAX )
@@ -112,6 +200,58 @@ void __stdcall ParallelForRunner::workCallbackStatic( PTP_CALLBACK_INSTANCE Inst
 	context.runBatch( ith );
 }
 
+void __stdcall ParallelForRunner::nodeCallbackStatic( PTP_CALLBACK_INSTANCE Instance, void* pv, PTP_WORK Work ) noexcept
+{
+	NodePool& np = *(NodePool*)pv;
+	// Threads of a private pool only run callbacks of that pool, setting the affinity once is enough
+	if( boundPool != &np )
+	{
+		NumaTopology::get().setThreadAffinity( np.node );
+		boundPool = &np;
+	}
+
+	const size_t ith = (uint32_t)( InterlockedIncrement( &np.nextBatch ) ) - 1;
+	currentNumaNode = np.node;
+	np.owner->runBatch( ith );
+	currentNumaNode = -1;
+}
+
+void ParallelForRunner::runNodePools( size_t nth ) noexcept
+{
+	// Distribute the batches across the nodes, proportionally to count of processors
+	uint32_t totalProcessors = 0;
+	for( const auto& np : nodePools )
+		totalProcessors += np->countProcessors;
+
+	size_t begin = 0;
+	uint32_t processors = 0;
+	for( auto& np : nodePools )
+	{
+		processors += np->countProcessors;
+		const size_t end = nth * processors / totalProcessors;
+		np->batchBegin = begin;
+		np->batchEnd = end;
+		begin = end;
+	}
+
+	for( auto& np : nodePools )
+	{
+		size_t first = np->batchBegin;
+		// The calling thread runs the first batch
+		if( 0 == first && np->batchEnd > 0 )
+			first = 1;
+		np->nextBatch = (long)first;
+		for( size_t i = first; i < np->batchEnd; i++ )
+			SubmitThreadpoolWork( np->work );
+	}
+
+	runBatch( 0 );
+
+	for( auto& np : nodePools )
+		if( np->batchEnd > np->batchBegin )
+			WaitForThreadpoolWorkCallbacks( np->work, FALSE );
+}
+
 HRESULT ParallelForRunner::parallelFor( iComputeRange& compute, size_t length, size_t minBatch )
 {
 	if( maxThreads <= 1 )
@@ -126,18 +266,24 @@ HRESULT ParallelForRunner::parallelFor( iComputeRange& compute, size_t length, s
 	size_t nth = length / minBatch;
 	nth = std::min( nth, (size_t)(uint32_t)maxThreads );
 
+	Timeline::Span span{ "parallelFor", "parallelFor", (int64_t)nth };
 	computeRange = &compute;
 	countItems = length;
 	countThreads = nth;
 	threadIndex = 0;
 	status = S_FALSE;
 
-	for( size_t i = 1; i < nth; i++ )
-		SubmitThreadpoolWork( work );
-	runBatch( 0 );
+	if( nodePools.empty() )
+	{
+		for( size_t i = 1; i < nth; i++ )
+			SubmitThreadpoolWork( work );
+		runBatch( 0 );
 
-	if( nth > 1 )
-		WaitForThreadpoolWorkCallbacks( work, FALSE );
+		if( nth > 1 )
+			WaitForThreadpoolWorkCallbacks( work, FALSE );
+	}
+	else
+		runNodePools( nth );
 
 	computeRange = nullptr;
 	const HRESULT hr = status;
@@ -1,5 +1,6 @@
 #pragma once
 #include "LargeBuffer.h"
+#include <memory>
 
 namespace CpuCompute
 {
@@ -19,6 +20,10 @@ namespace CpuCompute
 
 		HRESULT setThreadsCount( int threads );
 
+		// On NUMA computers, bind the threads to the node with the specified index in NumaTopology.
+		// Pass -1 to use all nodes, that's the default.
+		HRESULT setNumaNode( int node );
+
 		HRESULT parallelFor( iComputeRange& compute, size_t length, size_t minBatch = 1 );
 
 		// Allocate a temporary buffer for the calling thread.
@@ -28,6 +33,7 @@ namespace CpuCompute
 	private:
 
 		int maxThreads;
+		int numaNode = -1;
 		PTP_WORK work = nullptr;
 		iComputeRange* computeRange = nullptr;
 		size_t countItems = 0;
@@ -39,14 +45,38 @@ namespace CpuCompute
 		{
 			LargeBuffer memory;
 			size_t cb = 0;
+			int numaNode = -1;
 		};
 		std::vector<ThreadBuffer> threadBuffers;
 
+		// On NUMA computers, the work is dispatched to a private thread pool per node, with all threads of the pool bound to processors of that node.
+		// Each pool runs a contiguous range of batches, the count of batches is proportional to the count of processors.
+		struct alignas( 64 ) NodePool
+		{
+			ParallelForRunner* owner = nullptr;
+			PTP_POOL pool = nullptr;
+			PTP_WORK work = nullptr;
+			TP_CALLBACK_ENVIRON environment;
+			// Index of the node in NumaTopology
+			int node = 0;
+			uint32_t countProcessors = 0;
+			size_t batchBegin = 0, batchEnd = 0;
+			alignas( 64 ) volatile long nextBatch = 0;
+
+			HRESULT create( ParallelForRunner* runner, int nodeIndex );
+			~NodePool();
+		};
+		// Empty on computers without NUMA
+		std::vector<std::unique_ptr<NodePool>> nodePools;
+		HRESULT createNodePools();
+
 		alignas( 64 ) volatile long threadIndex = 0;
 		volatile HRESULT status = S_OK;
 
 		void runBatch( size_t ith ) noexcept;
 
 		static void __stdcall workCallbackStatic( PTP_CALLBACK_INSTANCE Instance, void* pv, PTP_WORK Work ) noexcept;
+		static void __stdcall nodeCallbackStatic( PTP_CALLBACK_INSTANCE Instance, void* pv, PTP_WORK Work ) noexcept;
+		void runNodePools( size_t nth ) noexcept;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include "stdafx.h"
+#include "cpuFeatures.h"
+#include <intrin.h>
+using namespace CpuCompute;
+
+namespace
+{
+	inline bool bit( int reg, int idx )
+	{
+		return 0 != ( reg & ( 1 << idx ) );
+	}
+
+	sCpuFeatures detectFeatures()
+	{
+		sCpuFeatures res;
+
+		int cpuInfo[ 4 ];
+		__cpuid( cpuInfo, 0 );
+		const int maxLeaf = cpuInfo[ 0 ];
+
+		// The magic numbers are from "Feature Information" table on Wikipedia:
+		// https://en.wikipedia.org/wiki/CPUID#EAX=1:_Processor_Info_and_Feature_Bits
+		__cpuid( cpuInfo, 1 );
+		res.sse41 = bit( cpuInfo[ 2 ], 19 );
+		const bool cpuAvx = bit( cpuInfo[ 2 ], 28 );
+		const bool cpuFma = bit( cpuInfo[ 2 ], 12 );
+		const bool cpuF16c = bit( cpuInfo[ 2 ], 29 );
+
+		// https://en.wikipedia.org/wiki/CPUID#EAX=7,_ECX=0:_Extended_Features
+		int extended[ 4 ] = { 0, 0, 0, 0 };
+		if( maxLeaf >= 7 )
+			__cpuidex( extended, 7, 0 );
+		res.bmi1 = bit( extended[ 1 ], 3 );
+
+		// AVX needs OS support to preserve the 32-bytes registers across context switches, CPU support alone ain't enough
+		// Calling a kernel API to check that support, the bit numbers are XSTATE_AVX, XSTATE_AVX512_KMASK, XSTATE_AVX512_ZMM_H and XSTATE_AVX512_ZMM
+		const DWORD64 xstate = GetEnabledXStateFeatures();
+		const bool osYmm = 0 != ( xstate & 4 );
+		constexpr DWORD64 zmmStates = 0xE0;
+		const bool osZmm = osYmm && zmmStates == ( xstate & zmmStates );
+
+		// VEX-encoded instructions, including FMA3 and F16C, require the YMM state
+		res.avx = cpuAvx && osYmm;
+		res.fma3 = cpuFma && osYmm;
+		res.f16c = cpuF16c && osYmm;
+		res.avx2 = bit( extended[ 1 ], 5 ) && osYmm;
+
+		res.avx512f = bit( extended[ 1 ], 16 ) && osZmm;
+		res.avx512dq = bit( extended[ 1 ], 17 ) && osZmm;
+		res.avx512bw = bit( extended[ 1 ], 30 ) && osZmm;
+		res.avx512vl = bit( extended[ 1 ], 31 ) && osZmm;
+
+		if( !( res.avx && res.fma3 && res.f16c ) )
+			res.level = eSimdLevel::None;
+		else if( !res.avx2 )
+			res.level = eSimdLevel::AVX;
+		else if( !( res.avx512f && res.avx512bw && res.avx512dq && res.avx512vl ) )
+			res.level = eSimdLevel::AVX2;
+		else
+			res.level = eSimdLevel::AVX512;
+		return res;
+	}
+}
+
+const sCpuFeatures& CpuCompute::cpuFeatures()
+{
+	static const sCpuFeatures features = detectFeatures();
+	return features;
+}
+
+const char* CpuCompute::simdLevelName( eSimdLevel level )
+{
+	switch( level )
+	{
+	case eSimdLevel::None: return "None";
+	case eSimdLevel::AVX: return "AVX";
+	case eSimdLevel::AVX2: return "AVX2";
+	case eSimdLevel::AVX512: return "AVX512";
+	}
+	return "?";
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+namespace CpuCompute
+{
+	// Levels of the SIMD instruction sets the DLL has kernels for, in ascending order
+	enum struct eSimdLevel : uint8_t
+	{
+		// No AVX, the CPU can't run the hybrid model; the GPGPU model only needs the sse41 flag of sCpuFeatures
+		None = 0,
+		// AVX1, FMA3 and F16C, the requirement of the hybrid model; all kernels have this version
+		AVX = 1,
+		// AVX level plus AVX2, used by the transpose of the matrix panels in mulMat
+		AVX2 = 2,
+		// AVX2 level plus AVX-512 F, BW, DQ and VL, used by the memory-bound row kernels in simdUtils.cpp
+		AVX512 = 3,
+	};
+
+	const char* simdLevelName( eSimdLevel level );
+
+	// Instruction set extensions supported by both the CPU and the OS
+	struct sCpuFeatures
+	{
+		bool sse41 = false;
+		bool avx = false;
+		bool fma3 = false;
+		bool f16c = false;
+		bool bmi1 = false;
+		bool avx2 = false;
+		bool avx512f = false;
+		bool avx512bw = false;
+		bool avx512dq = false;
+		bool avx512vl = false;
+
+		// The best level of the kernels this CPU can run
+		eSimdLevel level = eSimdLevel::None;
+	};
+
+	// Features of this CPU, detected on the first call
+	const sCpuFeatures& cpuFeatures();
+
+	// Bind the function pointers of the kernels which have versions for multiple instruction sets to the best versions for this CPU:
+	// the panel transpose of mulMat for AVX2, and the memory-bound row kernels of simdUtils.cpp for AVX-512.
+	// Called by the entry points which run the CPU kernels: loading of the hybrid model, the golden tests, and the kernel benchmark.
+	// Until the first call the kernels use the AVX versions. The function only writes the same values, it's safe to call more than once.
+	void bindKernels();
+
+	inline eSimdLevel simdLevel()
+	{
+		return cpuFeatures().level;
+	}
+}
\ No newline at end of file
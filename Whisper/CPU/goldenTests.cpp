@@ -0,0 +1,972 @@
+#include "stdafx.h"
+#include "goldenTests.h"
+#include "MlContext.h"
+#include "BufferAllocator.h"
+#include "LogitsReducer.h"
+#include "KvTensors.h"
+#include "cpuFeatures.h"
+#include "../ML/LookupTablesData.h"
+#include "../Utils/Trace/TraceWriter.h"
+#include "../Utils/Trace/TraceStructures.h"
+#include "../API/iContext.cl.h"
+#include "../Whisper/TemperatureFallback.h"
+#include "../Whisper/parallelSeams.h"
+#include "../Hybrid/DecoderMemoryPlan.h"
+#include <atlfile.h>
+#include <atlstr.h>
+#include <atlcoll.h>
+#include <cmath>
+using namespace CpuCompute;
+
+namespace
+{
+	// Shapes of the decoder of the tiny model
+	constexpr uint32_t n_state = 384;
+	constexpr uint32_t n_head = 6;
+	constexpr uint32_t n_head_state = n_state / n_head;
+	constexpr uint32_t n_vocab = 51865;
+	constexpr uint32_t n_audio_ctx = 1500;
+	constexpr uint32_t token_beg = 50363;
+
+	constexpr size_t MB = 1u << 20;
+
+	inline float loadElement( const Tensor& t, size_t i )
+	{
+		if( t.type() == eDataType::FP16 )
+			return _cvtsh_ss( t.fp16()[ i ] );
+		return t.fp32()[ i ];
+	}
+
+	// Pseudo-random numbers in [ -1 .. +1 ] interval, the same sequence on every run
+	class Random
+	{
+		uint32_t state = 0x12345678;
+	public:
+		float next()
+		{
+			state = state * 1664525u + 1013904223u;
+			return (float)(int)( state >> 8 ) * ( 2.0f / (float)( 1u << 24 ) ) - 1.0f;
+		}
+	};
+
+	// Maximum errors relative to the magnitude of the output elements; the outputs pass when abs( test - expected ) <= bound * magnitude + absoluteFloor
+	struct sBounds
+	{
+		// Compared to the FP64 reference: the kernels round the activations, and use approximations of the transcendental functions
+		float reference;
+		// Compared to the golden output of the previous version; the code is deterministic, the bound only allows changes in the order of the summation
+		float golden;
+	};
+	constexpr float absoluteFloor = 1E-6f;
+	constexpr sBounds boundsMulMat{ 2E-3f, 1E-5f };
+	constexpr sBounds boundsNorm{ 1E-4f, 1E-5f };
+	constexpr sBounds boundsSoftMax{ 1E-4f, 1E-5f };
+	constexpr sBounds boundsGelu{ 1E-3f, 1E-5f };
+	constexpr sBounds boundsExact{ 1E-7f, 1E-7f };
+
+	// Golden outputs, loaded from the trace file written by a previous run in the update mode
+	class GoldenFile
+	{
+		std::vector<uint8_t> data;
+		CAtlMap<CStringA, const Tracing::sTraceItem*> items;
+		const uint8_t* payload = nullptr;
+
+	public:
+		HRESULT load( LPCTSTR path )
+		{
+			using namespace Tracing;
+			CAtlFile file;
+			CHECK( file.Create( path, GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING ) );
+			ULONGLONG cb;
+			CHECK( file.GetSize( cb ) );
+			if( cb < sizeof( sFileHeader ) || cb > 1024 * MB )
+				return E_INVALIDARG;
+			data.resize( (size_t)cb );
+			CHECK( file.Read( data.data(), (DWORD)cb ) );
+
+			const sFileHeader& header = *(const sFileHeader*)data.data();
+			if( header.magic != header.correctMagic || header.cbItem != sizeof( sTraceItem ) || header.flags != 0 )
+				return E_INVALIDARG;
+			const uint64_t cbExpected = sizeof( sFileHeader ) + header.bytesPayload + header.bytesStrings + (uint64_t)header.cbItem * header.countItems;
+			if( cbExpected > cb || (uint64_t)header.countStrings * 4 > header.bytesStrings )
+				return E_INVALIDARG;
+
+			payload = data.data() + sizeof( sFileHeader );
+			const uint32_t* stringIndex = (const uint32_t*)( payload + header.bytesPayload );
+			const char* stringData = (const char*)( stringIndex + header.countStrings );
+			const size_t cbStringData = header.bytesStrings - header.countStrings * 4;
+			const sTraceItem* rsi = (const sTraceItem*)( payload + header.bytesPayload + header.bytesStrings );
+			for( uint32_t i = 0; i < header.countItems; i++, rsi++ )
+			{
+				if( rsi->stringIndex >= header.countStrings || stringIndex[ rsi->stringIndex ] >= cbStringData )
+					return E_INVALIDARG;
+				if( rsi->payloadOffset + rsi->payloadSize > header.bytesPayload || rsi->dataType != eDataType::FP32 )
+					return E_INVALIDARG;
+				// The names of these items have no format arguments
+				items.SetAt( stringData + stringIndex[ rsi->stringIndex ], rsi );
+			}
+			return S_OK;
+		}
+
+		// The golden output, or nullptr if the file has no item with that name and length
+		const float* lookup( const char* name, size_t length ) const
+		{
+			auto p = items.Lookup( name );
+			if( nullptr == p )
+				return nullptr;
+			const Tracing::sTraceItem& item = *p->m_value;
+			if( item.payloadSize != length * 4 )
+				return nullptr;
+			return (const float*)( payload + item.payloadOffset );
+		}
+	};
+
+	class GoldenTests
+	{
+		const int threads;
+		MlContext ml;
+		// The inputs are allocated once, the outputs are released after every test
+		VirtualAllocator allocInputs, allocTemp;
+		Random rand;
+		const bool update;
+		GoldenFile golden;
+		std::unique_ptr<Tracing::iTraceWriter> writer;
+		size_t countTests = 0, countFailed = 0;
+
+		// The reference output, and the magnitude of each element for the error bounds
+		std::vector<double> expected, magnitude;
+
+		Tensor input( eDataType type, const std::array<uint32_t, 4>& size, float scale = 1.0f );
+
+		// Compare the output with the reference, then with the golden output or save it into the file
+		void verify( const char* name, const float* test, size_t length, const sBounds& bounds );
+
+		void mulMatTests();
+		void fusedTests();
+		void reducerTests();
+		void normTests();
+		void softMaxTests();
+		void elementwiseTests();
+
+		// Tests of the logic which don't have golden outputs, they run in both modes
+		void expect( const char* name, bool passed );
+		void fallbackTests();
+		void seamTests();
+		void memoryPlanTests();
+		void kvCacheTests();
+
+	public:
+		GoldenTests( int t, bool u ) :
+			threads( t ), ml( t ), update( u )
+		{ }
+
+		HRESULT run( LPCTSTR path );
+	};
+
+	Tensor GoldenTests::input( eDataType type, const std::array<uint32_t, 4>& size, float scale )
+	{
+		Tensor res;
+		check( res.create( type, size, &allocInputs ) );
+		const size_t length = res.countElements();
+		if( type == eDataType::FP16 )
+		{
+			uint16_t* rdi = res.fp16();
+			for( size_t i = 0; i < length; i++ )
+				rdi[ i ] = _cvtss_sh( rand.next() * scale, 0 );
+		}
+		else
+		{
+			float* rdi = res.fp32();
+			for( size_t i = 0; i < length; i++ )
+				rdi[ i ] = rand.next() * scale;
+		}
+		return res;
+	}
+
+	void GoldenTests::verify( const char* name, const float* test, size_t length, const sBounds& bounds )
+	{
+		assert( expected.size() == length && magnitude.size() == length );
+		countTests++;
+
+		// Maximum of abs( error ) / allowed error, the test passes when <= 1
+		const auto relativeError = [ & ]( const float* a, const double* b, float bound )
+		{
+			double res = 0;
+			for( size_t i = 0; i < length; i++ )
+			{
+				const double x = a[ i ];
+				const double y = b[ i ];
+				if( std::isinf( y ) || std::isinf( x ) )
+				{
+					if( x != y )
+						return (double)INFINITY;
+					continue;
+				}
+				const double e = std::abs( x - y ) / ( bound * magnitude[ i ] + absoluteFloor );
+				if( !( e <= res ) )
+					res = e;
+			}
+			return res;
+		};
+
+		const double errReference = relativeError( test, expected.data(), bounds.reference );
+		double errGolden = 0;
+		bool missing = false;
+		if( update )
+		{
+			// The writer copies the names, the formatted strings don't need to outlive the call
+			check( writer->buffer( name, test, length, eDataType::FP32 ) );
+		}
+		else
+		{
+			const float* g = golden.lookup( name, length );
+			if( nullptr != g )
+			{
+				for( size_t i = 0; i < length; i++ )
+					expected[ i ] = g[ i ];
+				errGolden = relativeError( test, expected.data(), bounds.golden );
+			}
+			else
+				missing = true;
+		}
+
+		if( errReference <= 1 && errGolden <= 1 && !missing )
+		{
+			logDebug( u8"%-32s OK, error %.3f of the reference bound, %.3f of the golden bound", name, errReference, errGolden );
+			return;
+		}
+		countFailed++;
+		if( missing )
+			logError( u8"%-32s the golden file has no output with that name and size", name );
+		else
+			logError( u8"%-32s FAILED, error %g of the reference bound, %g of the golden bound", name, errReference, errGolden );
+	}
+
+	void GoldenTests::expect( const char* name, bool passed )
+	{
+		countTests++;
+		if( passed )
+		{
+			logDebug( u8"%-32s OK", name );
+			return;
+		}
+		countFailed++;
+		logError( u8"%-32s FAILED", name );
+	}
+
+	// Reference matrix product, a is [ K, N, heads ], b is [ K, M, heads ], the result is [ N, M, heads ]
+	// The magnitude is the sum of absolute values of the products
+	void referenceMulMat( const Tensor& a, const Tensor& b, std::vector<double>& rdi, std::vector<double>& mag )
+	{
+		const size_t K = a.ne[ 0 ], N = a.ne[ 1 ], M = b.ne[ 1 ], heads = a.ne[ 2 ];
+		rdi.resize( N * M * heads );
+		mag.resize( N * M * heads );
+		std::vector<double> rowA( K ), rowB( K );
+		for( size_t h = 0; h < heads; h++ )
+			for( size_t m = 0; m < M; m++ )
+			{
+				for( size_t k = 0; k < K; k++ )
+					rowB[ k ] = loadElement( b, k + K * ( m + M * h ) );
+				for( size_t n = 0; n < N; n++ )
+				{
+					double sum = 0, sumAbs = 0;
+					const size_t offA = K * ( n + N * h );
+					for( size_t k = 0; k < K; k++ )
+					{
+						const double p = (double)loadElement( a, offA + k ) * rowB[ k ];
+						sum += p;
+						sumAbs += std::abs( p );
+					}
+					const size_t idx = n + N * ( m + M * h );
+					rdi[ idx ] = sum;
+					mag[ idx ] = sumAbs;
+				}
+			}
+	}
+
+	void GoldenTests::mulMatTests()
+	{
+		struct Case
+		{
+			const char* name;
+			// Size of the first argument: [ K, N, heads ]
+			std::array<uint32_t, 3> size;
+		};
+		static const std::array<Case, 6> cases =
+		{
+			Case{ "attn.proj", { n_state, n_state, 1 } },
+			Case{ "mlp.0", { n_state, 4 * n_state, 1 } },
+			Case{ "mlp.1", { 4 * n_state, n_state, 1 } },
+			Case{ "self.KQ", { n_head_state, 40, n_head } },
+			Case{ "cross.KQ", { n_head_state, n_audio_ctx, n_head } },
+			Case{ "cross.KQV", { n_audio_ctx, n_head_state, n_head } },
+		};
+		// Batches of 1-8 tokens use different MulMatImpl variants, the longer one has complete and incomplete tiles
+		static const std::array<uint32_t, 9> batches = { 1, 2, 3, 4, 5, 6, 7, 8, 21 };
+
+		CStringA name;
+		for( const Case& c : cases )
+		{
+			const Tensor a = input( eDataType::FP16, { c.size[ 0 ], c.size[ 1 ], c.size[ 2 ], 1 } );
+			for( uint32_t batch : batches )
+			{
+				const Tensor b = input( eDataType::FP32, { c.size[ 0 ], batch, c.size[ 2 ], 1 } );
+				referenceMulMat( a, b, expected, magnitude );
+				const Tensor res = ml.mulMat( a, b );
+				name.Format( "mulMat.%s.%u", c.name, batch );
+				verify( name, res.fp32(), res.countElements(), boundsMulMat );
+				allocTemp.resetArena();
+			}
+		}
+	}
+
+	void GoldenTests::fusedTests()
+	{
+		CStringA name;
+		for( uint32_t batch : { 1u, 5u, 8u } )
+		{
+			// mlp.0 with the bias and GELU
+			{
+				const Tensor a = input( eDataType::FP16, { n_state, 4 * n_state, 1, 1 } );
+				const Tensor b = input( eDataType::FP32, { n_state, batch, 1, 1 } );
+				const Tensor bias = input( eDataType::FP32, { 4 * n_state, 1, 1, 1 } );
+				referenceMulMat( a, b, expected, magnitude );
+				for( size_t i = 0; i < expected.size(); i++ )
+				{
+					const float bv = bias.fp32()[ i % ( 4 * n_state ) ];
+					expected[ i ] = DirectCompute::computeGelu( (float)( expected[ i ] + bv ) );
+					magnitude[ i ] += std::abs( bv );
+				}
+				MlContext::sMulMatOps ops;
+				ops.bias = &bias;
+				ops.gelu = true;
+				const Tensor res = ml.mulMat( a, b, ops );
+				name.Format( "fused.biasGelu.%u", batch );
+				verify( name, res.fp32(), res.countElements(), boundsGelu );
+				allocTemp.resetArena();
+			}
+
+			// Projection with the bias, scale, and the residual connection
+			{
+				const Tensor a = input( eDataType::FP16, { n_state, n_state, 1, 1 } );
+				const Tensor b = input( eDataType::FP32, { n_state, batch, 1, 1 } );
+				const Tensor bias = input( eDataType::FP32, { n_state, 1, 1, 1 } );
+				const Tensor residual = input( eDataType::FP32, { n_state, batch, 1, 1 }, 4.0f );
+				constexpr float scale = 0.125f;
+				referenceMulMat( a, b, expected, magnitude );
+				for( size_t i = 0; i < expected.size(); i++ )
+				{
+					const double bv = bias.fp32()[ i % n_state ];
+					const double rv = residual.fp32()[ i ];
+					expected[ i ] = ( expected[ i ] + bv ) * scale + rv;
+					magnitude[ i ] = ( magnitude[ i ] + std::abs( bv ) ) * scale + std::abs( rv ) * 1E-3;
+				}
+				MlContext::sMulMatOps ops;
+				ops.bias = &bias;
+				ops.scale = scale;
+				ops.residual = &residual;
+				const Tensor res = ml.mulMat( a, b, ops );
+				name.Format( "fused.biasScaleResidual.%u", batch );
+				verify( name, res.fp32(), res.countElements(), boundsMulMat );
+
+				// The same with mulMatInto, accumulating into a copy of the residual
+				Tensor acc = ml.createTensor( eDataType::FP32, residual.ne );
+				memcpy( acc.fp32(), residual.fp32(), residual.countElements() * 4 );
+				ml.mulMatInto( acc, a, b, true );
+				referenceMulMat( a, b, expected, magnitude );
+				for( size_t i = 0; i < expected.size(); i++ )
+				{
+					const double rv = residual.fp32()[ i ];
+					expected[ i ] += rv;
+					magnitude[ i ] += std::abs( rv ) * 1E-3;
+				}
+				name.Format( "fused.accumulate.%u", batch );
+				verify( name, acc.fp32(), acc.countElements(), boundsMulMat );
+				allocTemp.resetArena();
+			}
+		}
+	}
+
+	void GoldenTests::reducerTests()
+	{
+		// The output head of the decoder, the product with the token embedding reduced to the summaries
+		constexpr size_t K = Whisper::sLogitsSummary::topK;
+		const Tensor embedding = input( eDataType::FP16, { n_state, n_vocab, 1, 1 } );
+		CStringA name;
+		for( uint32_t batch : { 1u, 4u } )
+		{
+			// Larger activations make the distribution less uniform, the same as the real model
+			const Tensor cur = input( eDataType::FP32, { n_state, batch, 1, 1 }, 8.0f );
+			std::vector<double> logits, logitsMagnitude;
+			referenceMulMat( embedding, cur, logits, logitsMagnitude );
+
+			LogitsReducer reducer;
+			reducer.prepare( (uint32_t)threads, batch, token_beg );
+			MlContext::sMulMatOps ops;
+			ops.reduce = &reducer;
+			ml.mulMat( embedding, cur, ops );
+			std::vector<Whisper::sLogitsSummary> summaries;
+			reducer.finish( summaries );
+			allocTemp.resetArena();
+
+			// Compare the fields as a vector of floats: log-sum-exp, max text logit, logits of the top tokens, and the top tokens
+			std::vector<float> test;
+			expected.clear();
+			magnitude.clear();
+			for( uint32_t m = 0; m < batch; m++ )
+			{
+				const double* const row = &logits[ (size_t)m * n_vocab ];
+				const double* const rowMag = &logitsMagnitude[ (size_t)m * n_vocab ];
+				const Whisper::sLogitsSummary& s = summaries[ m ];
+
+				double maxLogit = -INFINITY, maxText = -INFINITY, maxMag = 0;
+				for( size_t i = 0; i < n_vocab; i++ )
+				{
+					maxLogit = std::max( maxLogit, row[ i ] );
+					maxMag = std::max( maxMag, rowMag[ i ] );
+					if( i < token_beg )
+						maxText = std::max( maxText, row[ i ] );
+				}
+				double sumExp = 0;
+				for( size_t i = 0; i < n_vocab; i++ )
+					sumExp += std::exp( row[ i ] - maxLogit );
+
+				test.push_back( s.logSumExp );
+				expected.push_back( maxLogit + std::log( sumExp ) );
+				magnitude.push_back( maxMag );
+				test.push_back( s.maxText );
+				expected.push_back( maxText );
+				magnitude.push_back( maxMag );
+
+				// The kernel may legitimately pick a different token when the reference logits are within the error bound, compare the reference logits of the reported tokens
+				for( size_t k = 0; k < K; k++ )
+				{
+					const int tok = s.topTokens[ k ];
+					test.push_back( s.topLogits[ k ] );
+					expected.push_back( ( tok >= 0 && tok < (int)n_vocab ) ? row[ tok ] : INFINITY );
+					magnitude.push_back( maxMag );
+				}
+
+				// The reported tokens must be the top ones, their logits can't be lower than the K-th largest reference logit minus the error bound
+				std::vector<double> sorted{ row, row + n_vocab };
+				std::nth_element( sorted.begin(), sorted.begin() + ( K - 1 ), sorted.end(), []( double a, double b ) { return a > b; } );
+				const double kth = sorted[ K - 1 ];
+				for( size_t k = 0; k < K; k++ )
+				{
+					const int tok = s.topTokens[ k ];
+					const bool ok = tok >= 0 && tok < (int)n_vocab && row[ tok ] >= kth - boundsMulMat.reference * maxMag;
+					test.push_back( ok ? 1.0f : 0.0f );
+					expected.push_back( 1.0 );
+					magnitude.push_back( 0 );
+				}
+			}
+			name.Format( "logitsReducer.%u", batch );
+			verify( name, test.data(), test.size(), boundsMulMat );
+		}
+	}
+
+	void GoldenTests::normTests()
+	{
+		CStringA name;
+		for( uint32_t batch : { 1u, 3u, 8u } )
+		{
+			const Tensor x = input( eDataType::FP32, { n_state, batch, 1, 1 }, 3.0f );
+			TensorPair ln;
+			ln.w = input( eDataType::FP32, { n_state, 1, 1, 1 } );
+			ln.b = input( eDataType::FP32, { n_state, 1, 1, 1 } );
+
+			// Reference layer normalization of the rows, with the optional affine transform
+			const auto reference = [ & ]( const std::vector<double>& source, bool affine )
+			{
+				expected.resize( source.size() );
+				magnitude.resize( source.size() );
+				for( size_t r = 0; r < batch; r++ )
+				{
+					const double* rsi = &source[ r * n_state ];
+					double mean = 0, var = 0;
+					for( size_t i = 0; i < n_state; i++ )
+						mean += rsi[ i ];
+					mean /= n_state;
+					for( size_t i = 0; i < n_state; i++ )
+						var += ( rsi[ i ] - mean ) * ( rsi[ i ] - mean );
+					var /= n_state;
+					const double mul = 1.0 / std::sqrt( var + 1E-5 );
+					for( size_t i = 0; i < n_state; i++ )
+					{
+						const size_t idx = r * n_state + i;
+						const double y = ( rsi[ i ] - mean ) * mul;
+						if( affine )
+						{
+							const double w = ln.w.fp32()[ i ], b = ln.b.fp32()[ i ];
+							expected[ idx ] = y * w + b;
+							magnitude[ idx ] = ( std::abs( y ) + 1 ) * std::abs( w ) + std::abs( b );
+						}
+						else
+						{
+							expected[ idx ] = y;
+							magnitude[ idx ] = std::abs( y ) + 1;
+						}
+					}
+				}
+			};
+
+			std::vector<double> source( x.countElements() );
+			for( size_t i = 0; i < source.size(); i++ )
+				source[ i ] = x.fp32()[ i ];
+
+			reference( source, false );
+			Tensor res = ml.norm( x );
+			name.Format( "norm.%u", batch );
+			verify( name, res.fp32(), res.countElements(), boundsNorm );
+
+			reference( source, true );
+			res = ml.normAffine( x, ln );
+			name.Format( "normAffine.%u", batch );
+			verify( name, res.fp32(), res.countElements(), boundsNorm );
+			allocTemp.resetArena();
+		}
+	}
+
+	void GoldenTests::softMaxTests()
+	{
+		struct Case
+		{
+			const char* name;
+			std::array<uint32_t, 3> size;
+			float inputScale;
+			float inputRange;
+		};
+		static const std::array<Case, 3> cases =
+		{
+			Case{ "logits", { n_vocab, 2, 1 }, 1.0f, 16.0f },
+			Case{ "self.KQ", { 40, 3, n_head }, 0.125f, 8.0f },
+			Case{ "cross.KQ", { n_audio_ctx, 3, n_head }, 0.125f, 8.0f },
+		};
+
+		CStringA name;
+		for( const Case& c : cases )
+		{
+			Tensor x = input( eDataType::FP32, { c.size[ 0 ], c.size[ 1 ], c.size[ 2 ], 1 }, c.inputRange );
+			const size_t length = x.countElements();
+			const size_t rowLength = c.size[ 0 ];
+			expected.resize( length );
+			magnitude.resize( length );
+			for( size_t r = 0; r < length; r += rowLength )
+			{
+				const float* rsi = x.fp32() + r;
+				double maxVal = -INFINITY;
+				for( size_t i = 0; i < rowLength; i++ )
+					maxVal = std::max( maxVal, (double)rsi[ i ] * c.inputScale );
+				double sum = 0;
+				for( size_t i = 0; i < rowLength; i++ )
+				{
+					expected[ r + i ] = std::exp( (double)rsi[ i ] * c.inputScale - maxVal );
+					sum += expected[ r + i ];
+				}
+				for( size_t i = 0; i < rowLength; i++ )
+				{
+					expected[ r + i ] /= sum;
+					magnitude[ r + i ] = expected[ r + i ];
+				}
+			}
+
+			ml.softMax( x, c.inputScale );
+			name.Format( "softMax.%s", c.name );
+			verify( name, x.fp32(), length, boundsSoftMax );
+		}
+	}
+
+	void GoldenTests::elementwiseTests()
+	{
+		CStringA name;
+		for( uint32_t batch : { 1u, 6u } )
+		{
+			// Bias + GELU of the MLP, in place
+			Tensor mlp = input( eDataType::FP32, { 4 * n_state, batch, 1, 1 }, 4.0f );
+			const Tensor bias = input( eDataType::FP32, { 4 * n_state, 1, 1, 1 } );
+			const size_t length = mlp.countElements();
+			expected.resize( length );
+			magnitude.resize( length );
+			for( size_t i = 0; i < length; i++ )
+			{
+				const float x = mlp.fp32()[ i ] + bias.fp32()[ i % ( 4 * n_state ) ];
+				expected[ i ] = DirectCompute::computeGelu( x );
+				magnitude[ i ] = std::abs( x ) + 1;
+			}
+			ml.addRepeatGelu( mlp, bias );
+			name.Format( "addRepeatGelu.%u", batch );
+			verify( name, mlp.fp32(), length, boundsGelu );
+
+			// Causal mask of the self-attention
+			constexpr uint32_t n_past = 5;
+			Tensor kq = input( eDataType::FP32, { n_past + batch, batch, n_head, 1 } );
+			const size_t lengthKq = kq.countElements();
+			expected.resize( lengthKq );
+			magnitude.assign( lengthKq, 1.0 );
+			for( size_t i = 0; i < lengthKq; i++ )
+			{
+				const size_t col = i % ( n_past + batch );
+				const size_t row = ( i / ( n_past + batch ) ) % batch;
+				expected[ i ] = ( col > n_past + row ) ? -INFINITY : kq.fp32()[ i ];
+			}
+			ml.diagMaskInf( kq, n_past );
+			name.Format( "diagMaskInf.%u", batch );
+			verify( name, kq.fp32(), lengthKq, boundsExact );
+
+			// Addition and scaling
+			const Tensor a = input( eDataType::FP32, { n_state, batch, 1, 1 } );
+			const Tensor b = input( eDataType::FP32, { n_state, batch, 1, 1 } );
+			const size_t lengthState = a.countElements();
+			expected.resize( lengthState );
+			magnitude.assign( lengthState, 1.0 );
+			for( size_t i = 0; i < lengthState; i++ )
+				expected[ i ] = a.fp32()[ i ] + b.fp32()[ i ];
+			Tensor sum = ml.add( a, b );
+			name.Format( "add.%u", batch );
+			verify( name, sum.fp32(), lengthState, boundsExact );
+
+			for( size_t i = 0; i < lengthState; i++ )
+				expected[ i ] = sum.fp32()[ i ] * 0.3f;
+			ml.scale( sum, 0.3f );
+			name.Format( "scale.%u", batch );
+			verify( name, sum.fp32(), lengthState, boundsExact );
+			allocTemp.resetArena();
+		}
+	}
+
+	void GoldenTests::fallbackTests()
+	{
+		using namespace Whisper;
+		sFullParams params;
+		memset( &params, 0, sizeof( params ) );
+		params.compression_ratio_thold = 2.4f;
+		params.logprob_thold = -1.0f;
+
+		// Zero increment disables the fallback, the first attempt is the last one
+		{
+			const TemperatureFallback fallback{ params };
+			expect( "fallback.disabled", !fallback.canRetry() && 0 == fallback.temperature() );
+		}
+
+		// With OpenAI's increment the temperatures are 0.0, 0.2, 0.4, 0.6, 0.8 and 1.0
+		params.temperature_inc = 0.2f;
+		TemperatureFallback fallback{ params };
+		int attempts = 1;
+		while( fallback.canRetry() )
+		{
+			fallback.retry();
+			attempts++;
+		}
+		expect( "fallback.attempts", 6 == attempts );
+		expect( "fallback.finalTemperature", std::abs( fallback.temperature() - 1.0f ) < 1E-6f );
+		fallback.reset();
+		expect( "fallback.reset", 0 == fallback.temperature() && fallback.canRetry() );
+
+		// The triggers: low average log-probability, and high compression ratio of the text
+		const std::string speech = " And so my fellow Americans, ask not what your country can do for you, ask what you can do for your country.";
+		std::string loop;
+		for( int i = 0; i < 10; i++ )
+			loop += " Thank you.";
+		expect( "fallback.acceptSpeech", fallback.accept( speech, -0.3 ) );
+		expect( "fallback.rejectLogProb", !fallback.accept( speech, -1.5 ) );
+		expect( "fallback.rejectLoop", !fallback.accept( loop, -0.1 ) );
+		expect( "fallback.earlyLoop", fallback.isRepetitionLoop( loop, 32 ) && !fallback.isRepetitionLoop( loop, 33 ) && !fallback.isRepetitionLoop( speech, 32 ) );
+
+		// zlib.compress() gives 1.37 and 5.00 for these two strings
+		const double ratioSpeech = compressionRatio( speech );
+		const double ratioLoop = compressionRatio( loop );
+		expect( "compressionRatio.speech", ratioSpeech > 1.2 && ratioSpeech < 1.6 );
+		expect( "compressionRatio.loop", ratioLoop > 4.5 && ratioLoop < 5.5 );
+		expect( "fallback.checksLoopAt", fallback.checksLoopAt( 32 ) && fallback.checksLoopAt( 40 ) && !fallback.checksLoopAt( 24 ) && !fallback.checksLoopAt( 33 ) );
+
+		// The longest window of 224 tokens, the hash chains find the repetitions far back; zlib.compress() gives 16.28
+		std::string longLoop;
+		for( int i = 0; i < 30; i++ )
+			longLoop += " I am going to the store today.";
+		longLoop += " and then home";
+		const double ratioLong = compressionRatio( longLoop );
+		expect( "compressionRatio.longLoop", ratioLong > 14.5 && ratioLong < 18.0 );
+	}
+
+	void GoldenTests::seamTests()
+	{
+		using namespace Whisper;
+		struct Segment
+		{
+			int64_t t0, t1;
+		};
+		// Two pieces split at 30 seconds. The first piece decoded past its end: the segment at [ 28.5 .. 31.0 ] straddles the seam, the one at 31.0 belongs to the second piece.
+		constexpr int64_t seam = 3000;
+		std::vector<Segment> first = { { 0, 1400 }, { 1400, 2850 }, { 2850, 3100 }, { 3100, 3500 } };
+		// The second piece starts at the seam, its first segment repeats the end of the straddling one
+		const std::vector<Segment> second = { { 3000, 3100 }, { 3100, 3600 }, { 3600, 4200 } };
+
+		trimPieceEnd( first, seam );
+		expect( "seam.trimPieceEnd", 3 == first.size() && 3100 == first.back().t1 );
+
+		const size_t covered = countCoveredSegments( second, first.back().t1 );
+		expect( "seam.covered", 1 == covered );
+
+		// Stitched, the segments are ordered, and there are no overlaps and no gaps
+		std::vector<Segment> stitched = first;
+		stitched.insert( stitched.end(), second.begin() + covered, second.end() );
+		bool continuous = true;
+		for( size_t i = 1; i < stitched.size(); i++ )
+			continuous = continuous && stitched[ i ].t0 == stitched[ i - 1 ].t1;
+		expect( "seam.continuous", continuous && 0 == stitched.front().t0 && 4200 == stitched.back().t1 );
+
+		// A segment which merely starts before the end of the previous one is kept, the text is not lost
+		const std::vector<Segment> late = { { 3050, 3500 } };
+		expect( "seam.keepMostlyNew", 0 == countCoveredSegments( late, 3100 ) );
+		expect( "seam.emptyPiece", 0 == countCoveredSegments( std::vector<Segment>{}, 3100 ) );
+	}
+
+	void GoldenTests::memoryPlanTests()
+	{
+#if BUILD_HYBRID_VERSION
+		const Whisper::sModelParams mp;
+		const uint32_t M = (uint32_t)mp.n_audio_ctx;
+
+		// The shapes of the decoder: the initial prompt, then one token at a time
+		DecoderMemoryPlan prompt, token;
+		prompt.build( mp, 224, 0, M, 1 );
+		token.build( mp, 1, 100, M, 1 );
+		expect( "memoryPlan.promptValid", prompt.isValid() );
+		expect( "memoryPlan.tokenValid", token.isValid() );
+		expect( "memoryPlan.reuse", prompt.getArenaSize() < prompt.getTotalSize() / 4 && token.getArenaSize() < token.getTotalSize() );
+
+		// n_past within the same bucket shares the plan, and that plan fits the exact one
+		DecoderMemoryPlan::Cache cache;
+		const DecoderMemoryPlan& a = cache.get( mp, 1, 100, M, 1 );
+		const DecoderMemoryPlan& b = cache.get( mp, 1, 120, M, 1 );
+		const DecoderMemoryPlan& c = cache.get( mp, 1, 130, M, 1 );
+		expect( "memoryPlanCache.hit", &a == &b && &a != &c && 2 == cache.size() );
+		expect( "memoryPlanCache.bucket", a.isValid() && a.countBuffers() == token.countBuffers() && a.getArenaSize() >= token.getArenaSize() );
+
+		// The least recently used plan is evicted first
+		for( uint32_t i = 0; i < DecoderMemoryPlan::Cache::maxEntries; i++ )
+		{
+			cache.get( mp, 1, 100, M, 1 );
+			cache.get( mp, 2 + i, 0, M, 1 );
+		}
+		expect( "memoryPlanCache.evict", DecoderMemoryPlan::Cache::maxEntries == cache.size() && &a == &cache.get( mp, 1, 100, M, 1 ) );
+#endif
+	}
+
+	void GoldenTests::kvCacheTests()
+	{
+		const Whisper::sModelParams mp;
+		const uint32_t n_state = (uint32_t)mp.n_text_state;
+		const auto pool = std::make_shared<KvBlockPool>( mp );
+		uint32_t allocated, used;
+
+		// The free list: a released block is the next one allocated, and the pool doesn't grow
+		uint32_t a, b, c;
+		check( pool->allocate( a, -1 ) );
+		check( pool->allocate( b, -1 ) );
+		check( pool->allocate( c, -1 ) );
+		pool->getUsage( allocated, used );
+		expect( "kvPool.allocate", 3 == used && allocated >= 3 && a != b && b != c && a != c );
+
+		pool->release( b );
+		uint32_t d, allocatedAfter;
+		check( pool->allocate( d, -1 ) );
+		pool->getUsage( allocatedAfter, used );
+		expect( "kvPool.freeList", d == b && allocatedAfter == allocated && 3 == used );
+
+		pool->release( a );
+		pool->release( c );
+		pool->release( d );
+		pool->getUsage( allocatedAfter, used );
+		expect( "kvPool.releaseAll", 0 == used && allocatedAfter == allocated );
+
+		{
+			// The sequence grows and shrinks by whole blocks
+			KvTensors kv;
+			check( kv.create( mp, pool ) );
+			check( kv.reserve( 1 ) );
+			pool->getUsage( allocated, used );
+			const bool oneBlock = 1 == used;
+			check( kv.reserve( KvBlockPool::blockTokens + 1 ) );
+			pool->getUsage( allocated, used );
+			expect( "kvTensors.grow", oneBlock && 2 == used );
+
+			// Keys and values of 2 tokens across the boundary of the blocks, the test values are exact in FP16
+			std::vector<float> keys( 2 * n_state ), values( 2 * n_state );
+			for( size_t i = 0; i < keys.size(); i++ )
+			{
+				keys[ i ] = (float)(int)( i % 64 ) * 0.25f;
+				values[ i ] = -keys[ i ];
+			}
+			constexpr uint32_t layer = 1;
+			kv.store( layer, KvBlockPool::blockTokens - 1, 2, keys.data(), values.data() );
+
+			const Tensor k0 = kv.keysView( layer, 0, KvBlockPool::blockTokens );
+			const Tensor k1 = kv.keysView( layer, 1, 1 );
+			const Tensor v0 = kv.valuesView( layer, 0, KvBlockPool::blockTokens );
+			const Tensor v1 = kv.valuesView( layer, 1, 1 );
+			const size_t lastToken = (size_t)( KvBlockPool::blockTokens - 1 ) * n_state;
+			bool equal = true;
+			for( uint32_t i = 0; i < n_state; i++ )
+			{
+				equal = equal && _cvtsh_ss( k0.fp16()[ lastToken + i ] ) == keys[ i ];
+				equal = equal && _cvtsh_ss( k1.fp16()[ i ] ) == keys[ n_state + i ];
+				equal = equal && _cvtsh_ss( v0.fp16()[ lastToken + i ] ) == values[ i ];
+				equal = equal && _cvtsh_ss( v1.fp16()[ i ] ) == values[ n_state + i ];
+			}
+			expect( "kvTensors.store", equal );
+
+			check( kv.reserve( KvBlockPool::blockTokens ) );
+			pool->getUsage( allocated, used );
+			expect( "kvTensors.shrink", 1 == used );
+		}
+
+		{
+			// The attention products over an incomplete last block, compared to the FP64 reference
+			constexpr uint32_t n_kv = KvBlockPool::blockTokens + 8;
+			constexpr uint32_t N = 2;
+			constexpr uint32_t layer = 1;
+			KvTensors kv;
+			check( kv.create( mp, pool ) );
+			check( kv.reserve( n_kv ) );
+			std::vector<float> keys( (size_t)n_kv * n_state ), values( keys.size() );
+			for( size_t i = 0; i < keys.size(); i++ )
+			{
+				keys[ i ] = _cvtsh_ss( _cvtss_sh( rand.next(), 0 ) );
+				values[ i ] = _cvtsh_ss( _cvtss_sh( rand.next(), 0 ) );
+			}
+			kv.store( layer, 0, n_kv, keys.data(), values.data() );
+
+			const Tensor q = input( eDataType::FP32, { n_head_state, N, n_head, 1 } );
+			Tensor kq = ml.createTensor( eDataType::FP32, { n_kv, N, n_head } );
+			ml.attentionScores( kq, q, kv, layer );
+			Tensor kqv = ml.createTensor( eDataType::FP32, { n_head_state, N, n_head } );
+			ml.attentionValues( kqv, kq, kv, layer );
+
+			const auto close = []( float x, double sum, double sumAbs )
+			{
+				return std::abs( x - sum ) <= boundsMulMat.reference * sumAbs + absoluteFloor;
+			};
+			bool scores = true, weighted = true;
+			for( uint32_t h = 0; h < n_head; h++ )
+				for( uint32_t n = 0; n < N; n++ )
+				{
+					const float* qRow = q.fp32() + n_head_state * ( n + N * h );
+					const float* kqRow = kq.fp32() + n_kv * ( n + N * h );
+					for( uint32_t t = 0; t < n_kv; t++ )
+					{
+						double sum = 0, sumAbs = 0;
+						for( uint32_t d = 0; d < n_head_state; d++ )
+						{
+							const double p = (double)keys[ t * n_state + h * n_head_state + d ] * qRow[ d ];
+							sum += p;
+							sumAbs += std::abs( p );
+						}
+						scores = scores && close( kqRow[ t ], sum, sumAbs );
+					}
+					const float* kqvRow = kqv.fp32() + n_head_state * ( n + N * h );
+					for( uint32_t d = 0; d < n_head_state; d++ )
+					{
+						double sum = 0, sumAbs = 0;
+						for( uint32_t t = 0; t < n_kv; t++ )
+						{
+							const double p = (double)values[ t * n_state + h * n_head_state + d ] * kqRow[ t ];
+							sum += p;
+							sumAbs += std::abs( p );
+						}
+						weighted = weighted && close( kqvRow[ d ], sum, sumAbs );
+					}
+				}
+			expect( "kvTensors.attentionScores", scores );
+			expect( "kvTensors.attentionValues", weighted );
+			allocTemp.resetArena();
+		}
+		// The destructor returns the blocks to the pool
+		pool->getUsage( allocated, used );
+		expect( "kvTensors.destroy", 0 == used );
+	}
+
+	HRESULT GoldenTests::run( LPCTSTR path )
+	{
+		if( update )
+		{
+			Tracing::sTraceOptions options;
+			// Uncompressed, this test reads the file without the decompressor
+			options.compress = false;
+			writer = Tracing::iTraceWriter::create( path, options );
+		}
+		else
+		{
+			const HRESULT hr = golden.load( path );
+			if( FAILED( hr ) )
+			{
+				logErrorHr( hr, u8"Unable to load the golden outputs, run the test in the update mode first" );
+				return hr;
+			}
+		}
+
+		CHECK( allocInputs.create( 256 * MB ) );
+		CHECK( allocTemp.create( 64 * MB ) );
+		ml.setAllocator( &allocTemp );
+
+		mulMatTests();
+		fusedTests();
+		reducerTests();
+		normTests();
+		softMaxTests();
+		elementwiseTests();
+		fallbackTests();
+		seamTests();
+		memoryPlanTests();
+		kvCacheTests();
+
+		// Destroying the writer saves the trace
+		writer.reset();
+
+		if( update )
+		{
+			logInfo( u8"CPU golden tests: saved %zu outputs, %zu of them are outside of the reference bounds", countTests, countFailed );
+			return ( 0 == countFailed ) ? S_OK : S_FALSE;
+		}
+		if( 0 == countFailed )
+		{
+			logInfo( u8"CPU golden tests: all %zu tests passed", countTests );
+			return S_OK;
+		}
+		logError( u8"CPU golden tests: %zu of %zu tests failed", countFailed, countTests );
+		return S_FALSE;
+	}
+}
+
+HRESULT CpuCompute::goldenTests( int threads, LPCTSTR goldenPath, bool update )
+{
+	if( threads <= 0 )
+	{
+		SYSTEM_INFO si;
+		GetSystemInfo( &si );
+		threads = (int)si.dwNumberOfProcessors;
+	}
+
+	bindKernels();
+	try
+	{
+		GoldenTests tests{ threads, update };
+		return tests.run( goldenPath );
+	}
+	catch( HRESULT hr )
+	{
+		return hr;
+	}
+	catch( const std::bad_alloc& )
+	{
+		return E_OUTOFMEMORY;
+	}
+}
+
+// DLL entry point
+HRESULT COMLIGHTCALL Whisper::cpuGoldenTests( int threads, const wchar_t* goldenPath, int update )
+{
+	if( nullptr == goldenPath )
+		return E_POINTER;
+	return CpuCompute::goldenTests( threads, goldenPath, 0 != update );
+}
\ No newline at end of file
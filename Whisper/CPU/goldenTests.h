@@ -0,0 +1,11 @@
+#pragma once
+
+namespace CpuCompute
+{
+	// Development-only regression test of the CPU kernels of the hybrid decoder, doesn't need a GPU nor a model.
+	// Runs the operations over the shapes of the tiny model on deterministic pseudo-random inputs, including the fused epilogues, the logits reducer,
+	// and batches of 1-8 tokens which cover every MulMatImpl variant. Each output is compared against the FP64 reference computed by this test,
+	// and against the golden output saved into a trace file by a previous version of the code.
+	// When update is true, saves the outputs into that file instead of comparing. Prints results to the log, returns S_FALSE when any output exceeds the error bounds.
+	HRESULT goldenTests( int threads, LPCTSTR goldenPath, bool update );
+}
\ No newline at end of file
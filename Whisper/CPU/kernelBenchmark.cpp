@@ -0,0 +1,491 @@
+#include "stdafx.h"
+#include "kernelBenchmark.h"
+#include "MlContext.h"
+#include "BufferAllocator.h"
+#include "cpuFeatures.h"
+#include "../Whisper/melSpectrogram.h"
+#include "../Whisper/voiceActivityDetection.h"
+#include "../Utils/CpuProfiler.h"
+#include "../API/iContext.cl.h"
+#include <atlfile.h>
+#include <atlstr.h>
+#include <intrin.h>
+#include <cmath>
+using namespace CpuCompute;
+
+namespace
+{
+	// Shapes of the decoder of the large model
+	constexpr uint32_t n_state = 1280;
+	constexpr uint32_t n_head = 20;
+	constexpr uint32_t n_head_state = n_state / n_head;
+	constexpr uint32_t n_vocab = 51865;
+	constexpr uint32_t n_text_ctx = 448;
+	constexpr uint32_t n_audio_ctx = 1500;
+	constexpr uint32_t maxBatch = 8;
+
+	// Each kernel is called until it runs for that many seconds, at least minCalls times
+	constexpr double minSeconds = 0.2;
+	constexpr size_t minCalls = 3;
+	constexpr size_t maxCalls = 100000;
+
+	// FP32 operations per cycle of a core: two 8-wide FMA instructions, 2 FLOPs each
+	constexpr double flopsPerCycle = 32;
+
+	constexpr size_t MB = 1u << 20;
+
+	double secondsFromTsc( int64_t tsc )
+	{
+		return Whisper::nanosecondsFromTsc( tsc ) * 1.0E-9;
+	}
+
+	// Pseudo-random numbers in [ -1 .. +1 ] interval, the values don't matter for the performance as long as they're normal
+	class Random
+	{
+		uint32_t state = 0x12345678;
+	public:
+		float next()
+		{
+			state = state * 1664525u + 1013904223u;
+			return (float)(int)( state >> 8 ) * ( 2.0f / (float)( 1u << 24 ) ) - 1.0f;
+		}
+	};
+
+	void fillRandom( Tensor& t, Random& rand )
+	{
+		const size_t length = t.countElements();
+		if( t.type() == eDataType::FP16 )
+		{
+			uint16_t* rdi = t.fp16();
+			for( size_t i = 0; i < length; i++ )
+				rdi[ i ] = _cvtss_sh( rand.next(), 0 );
+		}
+		else
+		{
+			float* rdi = t.fp32();
+			for( size_t i = 0; i < length; i++ )
+				rdi[ i ] = rand.next();
+		}
+	}
+
+	// Streaming read of a large buffer, to measure the memory bandwidth
+	struct ReadBandwidth : public iComputeRange
+	{
+		const uint8_t* data;
+		static constexpr size_t chunk = 64 * 1024;
+
+		HRESULT __stdcall compute( size_t i, size_t end ) const override final
+		{
+			__m256 a0 = _mm256_setzero_ps();
+			__m256 a1 = _mm256_setzero_ps();
+			__m256 a2 = _mm256_setzero_ps();
+			__m256 a3 = _mm256_setzero_ps();
+			const float* rsi = (const float*)( data + i * chunk );
+			const float* const rsiEnd = (const float*)( data + end * chunk );
+			for( ; rsi < rsiEnd; rsi += 32 )
+			{
+				a0 = _mm256_add_ps( a0, _mm256_load_ps( rsi ) );
+				a1 = _mm256_add_ps( a1, _mm256_load_ps( rsi + 8 ) );
+				a2 = _mm256_add_ps( a2, _mm256_load_ps( rsi + 16 ) );
+				a3 = _mm256_add_ps( a3, _mm256_load_ps( rsi + 24 ) );
+			}
+			// Use the sum, otherwise the compiler is free to drop the loads
+			a0 = _mm256_add_ps( _mm256_add_ps( a0, a1 ), _mm256_add_ps( a2, a3 ) );
+			return _mm256_testz_ps( a0, a0 ) ? S_OK : S_FALSE;
+		}
+	};
+
+	struct Result
+	{
+		// Operation of MlContext, or the name of the audio kernel
+		const char* kernel;
+		// Where the decoder uses the kernel with that shape
+		const char* name;
+		// For matrix products, panelHeightRegs * 16 + tileWidthFloats
+		uint8_t variant;
+		// For matrix products [ M, N, K, batch ], for other operations size of the data
+		std::array<uint32_t, 4> shape;
+		int threads;
+		size_t calls;
+		// Average for a single call
+		double seconds, flops, bytes;
+	};
+
+	class Benchmark
+	{
+		const int threads;
+		MlContext ml;
+		OpProfiler profiler;
+		// The inputs are allocated once, the outputs are released after every call
+		VirtualAllocator allocInputs, allocTemp;
+		Random rand;
+		std::vector<Result> results;
+		std::vector<OpProfiler::Entry> entries;
+
+		// TSC frequency in GHz, and the peak performance for a single thread, and for all threads
+		double tscGHz = 0;
+		std::array<double, 2> peakGFlops, peakBandwidth;
+
+		Tensor input( eDataType type, const std::array<uint32_t, 4>& size );
+		void measurePeak();
+
+		template<class Fn>
+		void measureOp( const char* name, int opThreads, Fn fn );
+		template<class Fn>
+		void measureFunc( const char* kernel, const char* name, const std::array<uint32_t, 4>& shape, double flops, double bytes, Fn fn );
+
+		void mulMatKernels();
+		void elementwiseKernels();
+		void audioKernels();
+
+		void print() const;
+		HRESULT saveJson( LPCTSTR path ) const;
+
+		double peakGFlopsFor( int t ) const { return ( t > 1 ) ? peakGFlops[ 1 ] : peakGFlops[ 0 ]; }
+		double peakBandwidthFor( int t ) const { return ( t > 1 ) ? peakBandwidth[ 1 ] : peakBandwidth[ 0 ]; }
+
+	public:
+		Benchmark( int t ) :
+			threads( t ), ml( t )
+		{ }
+
+		HRESULT run( LPCTSTR jsonPath );
+	};
+
+	Tensor Benchmark::input( eDataType type, const std::array<uint32_t, 4>& size )
+	{
+		Tensor res;
+		check( res.create( type, size, &allocInputs ) );
+		fillRandom( res, rand );
+		return res;
+	}
+
+	void Benchmark::measurePeak()
+	{
+		tscGHz = 1.0 / Whisper::nanosecondsFromTsc( 1000000000 ) * 1.0E9;
+		peakGFlops[ 0 ] = tscGHz * flopsPerCycle;
+		peakGFlops[ 1 ] = tscGHz * flopsPerCycle * threads;
+
+		// 512 MB is way larger than the caches; the OS zero-initializes these pages, touching them here faults them into the process
+		constexpr size_t cb = 512 * MB;
+		LargeBuffer buffer;
+		check( buffer.allocate( cb ) );
+		memset( buffer.pointer(), 0, cb );
+
+		ReadBandwidth rb;
+		rb.data = buffer.pointer();
+		constexpr size_t countChunks = cb / ReadBandwidth::chunk;
+		ParallelForRunner pfor{ threads };
+		for( size_t i = 0; i < 2; i++ )
+		{
+			// The best of a few passes
+			double best = 0;
+			for( int pass = 0; pass < 5; pass++ )
+			{
+				const int64_t tsc = Whisper::tscNow();
+				if( 0 == i )
+					check( rb.compute( 0, countChunks ) );
+				else
+					check( pfor.parallelFor( rb, countChunks, 16 ) );
+				const double seconds = secondsFromTsc( Whisper::tscNow() - tsc );
+				best = std::max( best, (double)cb / seconds * 1.0E-9 );
+			}
+			peakBandwidth[ i ] = best;
+		}
+		if( threads <= 1 )
+			peakBandwidth[ 1 ] = peakBandwidth[ 0 ];
+
+		logInfo( u8"CPU kernels benchmark: %i threads, %s kernels, TSC %.3f GHz, peak %.1f GFlops, %.1f GB/s; a single thread %.1f GFlops, %.1f GB/s",
+			threads, simdLevelName( simdLevel() ), tscGHz, peakGFlops[ 1 ], peakBandwidth[ 1 ], peakGFlops[ 0 ], peakBandwidth[ 0 ] );
+	}
+
+	// Measure a single operation of MlContext; the cost model for the FLOPs and bytes is the one of the op-level profiler
+	template<class Fn>
+	void Benchmark::measureOp( const char* name, int opThreads, Fn fn )
+	{
+		iArenaAllocator& temp = allocTemp;
+		// Warmup
+		fn();
+		temp.resetArena();
+
+		profiler.reset();
+		ml.setProfiler( &profiler );
+		const int64_t started = Whisper::tscNow();
+		size_t calls = 0;
+		do
+		{
+			fn();
+			temp.resetArena();
+			calls++;
+		}
+		while( calls < maxCalls && ( calls < minCalls || secondsFromTsc( Whisper::tscNow() - started ) < minSeconds ) );
+		ml.setProfiler( nullptr );
+
+		profiler.getEntries( entries, true );
+		assert( entries.size() == 1 );
+		const OpProfiler::Key& k = entries[ 0 ].first;
+		const OpProfiler::Stats& s = entries[ 0 ].second;
+		const double mul = 1.0 / (double)s.count;
+
+		Result& r = results.emplace_back();
+		r.kernel = cpuOpName( k.op );
+		r.name = name;
+		r.variant = k.variant;
+		r.shape = k.shape;
+		r.threads = opThreads;
+		r.calls = s.count;
+		r.seconds = secondsFromTsc( (int64_t)s.tsc ) * mul;
+		r.flops = (double)(int64_t)s.flops * mul;
+		r.bytes = (double)(int64_t)s.bytes * mul;
+	}
+
+	// Measure a single-threaded function which is not a part of MlContext, with the estimated cost of a call
+	template<class Fn>
+	void Benchmark::measureFunc( const char* kernel, const char* name, const std::array<uint32_t, 4>& shape, double flops, double bytes, Fn fn )
+	{
+		fn();
+		const int64_t started = Whisper::tscNow();
+		int64_t elapsed;
+		size_t calls = 0;
+		do
+		{
+			fn();
+			calls++;
+			elapsed = Whisper::tscNow() - started;
+		}
+		while( calls < maxCalls && ( calls < minCalls || secondsFromTsc( elapsed ) < minSeconds ) );
+
+		Result& r = results.emplace_back();
+		r.kernel = kernel;
+		r.name = name;
+		r.variant = 0;
+		r.shape = shape;
+		r.threads = 1;
+		r.calls = calls;
+		r.seconds = secondsFromTsc( elapsed ) / (double)calls;
+		r.flops = flops;
+		r.bytes = bytes;
+	}
+
+	void Benchmark::mulMatKernels()
+	{
+		struct Case
+		{
+			const char* name;
+			// Size of the first argument: [ K, M, heads ]
+			std::array<uint32_t, 3> size;
+		};
+		// The attention with a short context has M < 16, these products use the MulMatImpl variants with 1-register panels
+		static const std::array<Case, 9> cases =
+		{
+			Case{ "attn.proj", { n_state, n_state, 1 } },
+			Case{ "mlp.0", { n_state, 4 * n_state, 1 } },
+			Case{ "mlp.1", { 4 * n_state, n_state, 1 } },
+			Case{ "logits", { n_state, n_vocab, 1 } },
+			Case{ "self.KQ.short", { n_head_state, 8, n_head } },
+			Case{ "self.KQ", { n_head_state, n_text_ctx, n_head } },
+			Case{ "self.KQV", { n_text_ctx, n_head_state, n_head } },
+			Case{ "cross.KQ", { n_head_state, n_audio_ctx, n_head } },
+			Case{ "cross.KQV", { n_audio_ctx, n_head_state, n_head } },
+		};
+
+		for( const Case& c : cases )
+		{
+			const Tensor a = input( eDataType::FP16, { c.size[ 0 ], c.size[ 1 ], c.size[ 2 ], 1 } );
+			for( uint32_t batch = 1; batch <= maxBatch; batch++ )
+			{
+				const Tensor b = input( eDataType::FP32, { c.size[ 0 ], batch, c.size[ 2 ], 1 } );
+				measureOp( c.name, threads, [ & ]() { ml.mulMat( a, b ); } );
+			}
+		}
+	}
+
+	void Benchmark::elementwiseKernels()
+	{
+		for( uint32_t batch : { 1u, 4u, maxBatch } )
+		{
+			Tensor logits = input( eDataType::FP32, { n_vocab, batch, 1, 1 } );
+			measureOp( "logits", threads, [ & ]() { ml.softMax( logits ); } );
+
+			Tensor selfKq = input( eDataType::FP32, { n_text_ctx, batch, n_head, 1 } );
+			measureOp( "self.KQ", threads, [ & ]() { ml.softMax( selfKq ); } );
+
+			Tensor crossKq = input( eDataType::FP32, { n_audio_ctx, batch, n_head, 1 } );
+			measureOp( "cross.KQ", threads, [ & ]() { ml.softMax( crossKq ); } );
+
+			const Tensor state = input( eDataType::FP32, { n_state, batch, 1, 1 } );
+			measureOp( "layer", threads, [ & ]() { ml.norm( state ); } );
+
+			// addRepeatGelu runs on the calling thread
+			Tensor mlp = input( eDataType::FP32, { 4 * n_state, batch, 1, 1 } );
+			const Tensor bias = input( eDataType::FP32, { 4 * n_state, 1, 1, 1 } );
+			measureOp( "mlp.0", 1, [ & ]() { ml.addRepeatGelu( mlp, bias ); } );
+		}
+	}
+
+	void Benchmark::audioKernels()
+	{
+		using namespace Whisper;
+		// 30 seconds of noise, the content doesn't affect the performance of these kernels
+		std::vector<float> pcm( SAMPLE_RATE * 30 );
+		for( float& f : pcm )
+			f = rand.next() * 0.25f;
+
+		// The FFT for a single column of the mel spectrogram; the cost is estimated as 5 N log2( N ) for the FFT, plus the dot products with the filters
+		Filters filters;
+		filters.n_mel = N_MEL;
+		filters.n_fft = 1 + FFT_SIZE / 2;
+		filters.data.resize( (size_t)filters.n_mel * filters.n_fft );
+		for( float& f : filters.data )
+			f = std::abs( rand.next() );
+		SpectrogramContext spectrogram{ filters };
+		std::array<float, N_MEL> mel;
+		const double fftFlops = 5.0 * FFT_SIZE * std::log2( (double)FFT_SIZE ) + 2.0 * N_MEL * filters.n_fft;
+		const double fftBytes = 4.0 * ( FFT_SIZE + N_MEL + filters.data.size() );
+		measureFunc( "FFT", "mel.column", { FFT_SIZE, N_MEL, 1, 1 }, fftFlops, fftBytes,
+			[ & ]() { spectrogram.fft( mel, pcm.data(), FFT_SIZE ); } );
+
+		// Voice activity detector over the complete audio
+		VAD vad;
+		std::vector<uint8_t> vadResult;
+		constexpr size_t fftPoints = VAD::FFT_POINTS;
+		const double frames = (double)( pcm.size() / fftPoints );
+		const double vadFlops = frames * 5.0 * fftPoints * std::log2( (double)fftPoints );
+		measureFunc( "VAD", "classify", { (uint32_t)pcm.size(), 1, 1, 1 }, vadFlops, 4.0 * (double)pcm.size(),
+			[ & ]() { vad.classify( pcm.data(), pcm.size(), vadResult ); } );
+	}
+
+	HRESULT Benchmark::run( LPCTSTR jsonPath )
+	{
+		CHECK( allocInputs.create( 256 * MB ) );
+		CHECK( allocTemp.create( 64 * MB ) );
+		ml.setAllocator( &allocTemp );
+		try
+		{
+			measurePeak();
+			mulMatKernels();
+			elementwiseKernels();
+			audioKernels();
+		}
+		catch( HRESULT hr )
+		{
+			return hr;
+		}
+
+		print();
+		if( nullptr == jsonPath )
+			return S_OK;
+		return saveJson( jsonPath );
+	}
+
+	struct Roofline
+	{
+		double gflops, gbps;
+		// FLOPs per byte
+		double intensity;
+		double percentCompute, percentBandwidth;
+		// Percent of the attainable performance, min( peak compute, intensity * bandwidth )
+		double percentRoofline;
+	};
+
+	Roofline roofline( const Result& r, double peakGFlops, double peakBandwidth )
+	{
+		Roofline res;
+		res.gflops = r.flops / r.seconds * 1.0E-9;
+		res.gbps = r.bytes / r.seconds * 1.0E-9;
+		res.intensity = ( r.bytes > 0 ) ? r.flops / r.bytes : 0.0;
+		res.percentCompute = res.gflops * 100.0 / peakGFlops;
+		res.percentBandwidth = res.gbps * 100.0 / peakBandwidth;
+		const double attainable = std::min( peakGFlops, res.intensity * peakBandwidth );
+		res.percentRoofline = ( attainable > 0 ) ? res.gflops * 100.0 / attainable : 0.0;
+		return res;
+	}
+
+	void Benchmark::print() const
+	{
+		// The bytes are the compulsory traffic; the small tensors are in the caches, for them the percentages of the memory bandwidth may exceed 100%
+		logInfo( u8"%-13s %-13s %2s %7s %5s %5s %4s %10s %8s %8s %6s %6s %6s", "Kernel", "Name", "V", "M", "N", "K", "B",
+			"us", "GFlops", "GB/s", "%FMA", "%BW", "%Roof" );
+		for( const Result& r : results )
+		{
+			const Roofline rl = roofline( r, peakGFlopsFor( r.threads ), peakBandwidthFor( r.threads ) );
+			logInfo( u8"%-13s %-13s %02X %7u %5u %5u %4u %10.2f %8.2f %8.2f %6.1f %6.1f %6.1f",
+				r.kernel, r.name, r.variant, r.shape[ 0 ], r.shape[ 1 ], r.shape[ 2 ], r.shape[ 3 ],
+				r.seconds * 1.0E6, rl.gflops, rl.gbps, rl.percentCompute, rl.percentBandwidth, rl.percentRoofline );
+		}
+	}
+
+	// The brand string of the processor, from CPUID
+	CStringA cpuBrandString()
+	{
+		std::array<int, 12> regs;
+		__cpuid( &regs[ 0 ], 0x80000000 );
+		if( (uint32_t)regs[ 0 ] < 0x80000004 )
+			return CStringA{ "unknown" };
+		for( int i = 0; i < 3; i++ )
+			__cpuid( &regs[ i * 4 ], 0x80000002 + i );
+		CStringA res{ (const char*)regs.data(), (int)strnlen( (const char*)regs.data(), sizeof( regs ) ) };
+		res.Trim();
+		// Not expecting these characters, but they would break JSON
+		res.Remove( '"' );
+		res.Remove( '\\' );
+		return res;
+	}
+
+	HRESULT Benchmark::saveJson( LPCTSTR path ) const
+	{
+		CStringA text;
+		text.Format( "{\n\"machine\":{\"cpu\":\"%s\",\"isa\":\"%s\",\"threads\":%i,\"tscGHz\":%.4f,\"peakGFlops\":%.2f,\"peakGBps\":%.2f,\"peakGFlopsThread\":%.2f,\"peakGBpsThread\":%.2f},\n\"kernels\":[",
+			cpuBrandString().GetString(), simdLevelName( simdLevel() ), threads, tscGHz, peakGFlops[ 1 ], peakBandwidth[ 1 ], peakGFlops[ 0 ], peakBandwidth[ 0 ] );
+
+		for( size_t i = 0; i < results.size(); i++ )
+		{
+			const Result& r = results[ i ];
+			const Roofline rl = roofline( r, peakGFlopsFor( r.threads ), peakBandwidthFor( r.threads ) );
+			text += ( 0 == i ) ? "\n" : ",\n";
+			text.AppendFormat( "{\"kernel\":\"%s\",\"name\":\"%s\",\"panelHeightRegs\":%i,\"tileWidthFloats\":%i,\"shape\":[%u,%u,%u,%u],\"threads\":%i,\"calls\":%zu,",
+				r.kernel, r.name, (int)( r.variant >> 4 ), (int)( r.variant & 0xF ), r.shape[ 0 ], r.shape[ 1 ], r.shape[ 2 ], r.shape[ 3 ], r.threads, r.calls );
+			text.AppendFormat( "\"microseconds\":%.3f,\"flops\":%.0f,\"bytes\":%.0f,\"gflops\":%.3f,\"gbps\":%.3f,\"intensity\":%.4f,\"percentCompute\":%.2f,\"percentBandwidth\":%.2f,\"percentRoofline\":%.2f}",
+				r.seconds * 1.0E6, r.flops, r.bytes, rl.gflops, rl.gbps, rl.intensity, rl.percentCompute, rl.percentBandwidth, rl.percentRoofline );
+		}
+		text += "\n]}\n";
+
+		CAtlFile file;
+		CHECK( file.Create( path, GENERIC_WRITE, 0, CREATE_ALWAYS ) );
+		CHECK( file.Write( text.GetString(), (DWORD)text.GetLength() ) );
+		CHECK( file.Flush() );
+		logDebug( u8"CPU kernels benchmark: saved %zu results", results.size() );
+		return S_OK;
+	}
+}
+
+HRESULT CpuCompute::benchmarkKernels( int threads, LPCTSTR jsonPath )
+{
+	if( threads <= 0 )
+	{
+		SYSTEM_INFO si;
+		GetSystemInfo( &si );
+		threads = (int)si.dwNumberOfProcessors;
+	}
+
+	bindKernels();
+	try
+	{
+		Benchmark bench{ threads };
+		return bench.run( jsonPath );
+	}
+	catch( HRESULT hr )
+	{
+		return hr;
+	}
+	catch( const std::bad_alloc& )
+	{
+		return E_OUTOFMEMORY;
+	}
+}
+
+// DLL entry point
+HRESULT COMLIGHTCALL Whisper::benchmarkCpuKernels( int threads, const wchar_t* jsonPath )
+{
+	return CpuCompute::benchmarkKernels( threads, jsonPath );
+}
\ No newline at end of file
@@ -0,0 +1,10 @@
+#pragma once
+
+namespace CpuCompute
+{
+	// Development-only benchmark of the CPU kernels: matrix products over the shapes of the decoder with batches of 1-8 tokens, which covers every MulMatImpl variant,
+	// soft max, normalization, bias + GELU, and the single-threaded FFT and VAD of the audio pipeline.
+	// Prints the results to the log, relative to the peak compute and the measured memory bandwidth of the computer,
+	// and when the path is not nullptr, saves them into a JSON file for regression tracking.
+	HRESULT benchmarkKernels( int threads, LPCTSTR jsonPath );
+}
\ No newline at end of file
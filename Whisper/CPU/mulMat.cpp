@@ -6,49 +6,49 @@ using namespace CpuCompute;
 namespace
 {
 	template<uint8_t panelHeightRegs, uint8_t tileWidthFloats>
-	static HRESULT mulMatImpl( Tensor& result, const Tensor& a, const Tensor& b, ParallelForRunner& pfor )
+	static HRESULT mulMatImpl( Tensor& result, const Tensor& a, const Tensor& b, ParallelForRunner& pfor, const sMulMatEpilogue* epilogue )
 	{
-		MulMatImpl<panelHeightRegs, tileWidthFloats> impl{ result, a, b, pfor };
+		MulMatImpl<panelHeightRegs, tileWidthFloats> impl{ result, a, b, pfor, epilogue };
 		return impl.run( pfor );
 	}
 }
 
-HRESULT CpuCompute::mulMat( Tensor& result, const Tensor& a, const Tensor& b, ParallelForRunner& pfor )
+uint8_t CpuCompute::mulMatVariant( const Tensor& a, const Tensor& b )
 {
-	if( a.type() != eDataType::FP16 )
-		return E_NOTIMPL;
-	if( b.type() != eDataType::FP32 )
-		return E_NOTIMPL;
-
-	// return mulMatImpl<1, 1>( result, a, b, pfor );
+	// return 0x11;
 
 	if( b.ne[ 1 ] == 1 )
 	{
 		// Multiplying by a single row
-		if( a.ne[ 1 ] >= 32 )
-			return mulMatImpl<4, 1>( result, a, b, pfor );
-		else
-			return mulMatImpl<1, 1>( result, a, b, pfor );
+		return ( a.ne[ 1 ] >= 32 ) ? 0x41 : 0x11;
 	}
 	else if( b.ne[ 1 ] == 2 )
-	{
-		if( a.ne[ 1 ] >= 32 )
-			return mulMatImpl<4, 2>( result, a, b, pfor );
-		else
-			return mulMatImpl<1, 2>( result, a, b, pfor );
-	}
+		return ( a.ne[ 1 ] >= 32 ) ? 0x42 : 0x12;
 	else if( b.ne[ 1 ] == 3 )
-	{
-		if( a.ne[ 1 ] >= 16 )
-			return mulMatImpl<2, 3>( result, a, b, pfor );
-		else
-			return mulMatImpl<1, 3>( result, a, b, pfor );
-	}
+		return ( a.ne[ 1 ] >= 16 ) ? 0x23 : 0x13;
 	else
+		return ( a.ne[ 1 ] >= 16 ) ? 0x24 : 0x14;
+}
+
+HRESULT CpuCompute::mulMat( Tensor& result, const Tensor& a, const Tensor& b, ParallelForRunner& pfor, const sMulMatEpilogue* epilogue )
+{
+	if( a.type() != eDataType::FP16 )
+		return E_NOTIMPL;
+	if( b.type() != eDataType::FP32 )
+		return E_NOTIMPL;
+
+	switch( mulMatVariant( a, b ) )
 	{
-		if( a.ne[ 1 ] >= 16 )
-			return mulMatImpl<2, 4>( result, a, b, pfor );
-		else
-			return mulMatImpl<1, 4>( result, a, b, pfor );
+#define V( h, w ) case h * 16 + w: return mulMatImpl<h, w>( result, a, b, pfor, epilogue )
+		V( 1, 1 );
+		V( 4, 1 );
+		V( 1, 2 );
+		V( 4, 2 );
+		V( 1, 3 );
+		V( 2, 3 );
+		V( 1, 4 );
+		V( 2, 4 );
+#undef V
 	}
+	return E_UNEXPECTED;
 }
\ No newline at end of file
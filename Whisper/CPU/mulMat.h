@@ -4,7 +4,36 @@
 
 namespace CpuCompute
 {
-	HRESULT mulMat( Tensor& result, const Tensor& a, const Tensor& b, ParallelForRunner& pfor );
+	// Optional reduction of the matrix product, fused into the compute threads.
+	// Each thread reduces the panels of the output it has just computed while they're still in L1 cache, into a private state.
+	// Only supported for 2D outputs.
+	__interface iMulMatReduce
+	{
+		// Called by every compute thread before the first panel, returns index of the private state for the thread
+		uint32_t __stdcall beginThread();
+		// The panel has rows [ begin .. begin + height ) of the output matrix, for all `columns` columns.
+		// The element [ row, column ] is at panel[ ( row - begin ) + column * stride ]
+		void __stdcall reducePanel( uint32_t state, const float* panel, uint32_t begin, uint32_t height, uint32_t columns, size_t stride );
+	};
+
+	// Optional element-wise operations applied to the output tiles of the matrix product, while they're still in registers:
+	// result = gelu( ( a * b + bias ) * scale ) + residual
+	struct sMulMatEpilogue
+	{
+		// A vector with length of the result's rows, added to every row
+		const float* bias = nullptr;
+		float scale = 1.0f;
+		bool gelu = false;
+		// A dense matrix of the same size as the result
+		const float* residual = nullptr;
+		// Not element-wise, applied after the above operations
+		iMulMatReduce* reduce = nullptr;
+	};
+
+	HRESULT mulMat( Tensor& result, const Tensor& a, const Tensor& b, ParallelForRunner& pfor, const sMulMatEpilogue* epilogue = nullptr );
+
+	// The MulMatImpl template used by mulMat() for these arguments: panelHeightRegs * 16 + tileWidthFloats
+	uint8_t mulMatVariant( const Tensor& a, const Tensor& b );
 }
 
 #if TENSOR_GGML_COMPAT
@@ -2,6 +2,7 @@
 #include <stdint.h>
 #include <immintrin.h>
 #include "simdUtils.h"
+#include "simdMath.hpp"
 
 template<uint8_t panelHeightRegs, uint8_t tileWidthFloats>
 struct ResultTile
@@ -20,6 +21,32 @@ struct ResultTile
 		throw E_UNEXPECTED;
 	}
 	__forceinline void store( float* rdi, size_t w, size_t h, size_t stride ) const;
+
+	// Apply sMulMatEpilogue to the first h columns of the tile, w is the count of valid floats in the columns
+	__forceinline void epilogue( const std::array<__m256, panelHeightRegs>& bias, __m256 scale, bool gelu, const float* residual, size_t w, size_t h, size_t stride )
+	{
+		for( size_t c = 0; c < tileWidthFloats; c++ )
+		{
+			if( c >= h )
+				break;
+			for( size_t r = 0; r < panelHeightRegs; r++ )
+			{
+				__m256& v = arr[ c * panelHeightRegs + r ];
+				v = _mm256_mul_ps( _mm256_add_ps( v, bias[ r ] ), scale );
+				if( gelu )
+					v = geluf8( v );
+				if( nullptr != residual )
+				{
+					const ptrdiff_t rem = (ptrdiff_t)w - (ptrdiff_t)( r * 8 );
+					const float* rsi = residual + c * stride + r * 8;
+					if( rem >= 8 )
+						v = _mm256_add_ps( v, _mm256_loadu_ps( rsi ) );
+					else if( rem > 0 )
+						v = _mm256_add_ps( v, _mm256_maskload_ps( rsi, loadTailMaskInt( (size_t)rem ) ) );
+				}
+			}
+		}
+	}
 };
 
 #pragma region setZero functions
@@ -267,6 +294,22 @@ __forceinline void loadPanel( const uint16_t* rsi, std::array<__m256, 4>& dest )
 	dest[ 2 ] = loadUpcasted( rsi + 8 * 2 );
 	dest[ 3 ] = loadUpcasted( rsi + 8 * 3 );
 }
+
+// Load FP32 values into the panel-sized array of vectors, the count of elements is at most panelHeightRegs * 8; the remaining lanes are set to zero.
+template<size_t panelHeightRegs>
+__forceinline void loadPartialPanel( const float* rsi, size_t count, std::array<__m256, panelHeightRegs>& dest )
+{
+	for( size_t r = 0; r < panelHeightRegs; r++, rsi += 8 )
+	{
+		const ptrdiff_t rem = (ptrdiff_t)count - (ptrdiff_t)( r * 8 );
+		if( rem >= 8 )
+			dest[ r ] = _mm256_loadu_ps( rsi );
+		else if( rem > 0 )
+			dest[ r ] = _mm256_maskload_ps( rsi, loadTailMaskInt( (size_t)rem ) );
+		else
+			dest[ r ] = _mm256_setzero_ps();
+	}
+}
 #pragma endregion
 
 #pragma region Stores
@@ -1,5 +1,4 @@
 #include "stdafx.h"
-#include <intrin.h>
 #include "mulMatImpl.h"
 #include "mulMat.kernel.hpp"
 
@@ -14,13 +13,6 @@ namespace
 {
 	using namespace CpuCompute;
 
-	bool checkAvx2Support()
-	{
-		int cpuInfo[ 4 ];
-		__cpuid( cpuInfo, 7 );
-		return ( cpuInfo[ 1 ] & ( 1 << 5 ) ) != 0;
-	}
-
 	// a / b, rounded up to the next integer
 	inline uint32_t divRoundUp( uint32_t a, uint32_t b )
 	{
@@ -29,14 +21,23 @@ namespace
 	}
 }
 
-const bool MulMatBase::haveAvx2 = checkAvx2Support();
-
-MulMatBase::MulMatBase( Tensor& result, const Tensor& a, const Tensor& b, ParallelForRunner& pfor, uint8_t panelHeightRegs, uint8_t tileWidthFloats ) :
+MulMatBase::MulMatBase( Tensor& result, const Tensor& a, const Tensor& b, ParallelForRunner& pfor, uint8_t panelHeightRegs, uint8_t tileWidthFloats, const sMulMatEpilogue* ep ) :
 	resultPointer( result.fp32() ),
 	pa( a.data() ),
 	pb( b.data() ),
-	runner( pfor )
+	runner( pfor ),
+	hasEpilogue( nullptr != ep ),
+	reduce( nullptr )
 {
+	if( nullptr != ep )
+	{
+		epilogue = *ep;
+		reduce = ep->reduce;
+		hasEpilogue = nullptr != ep->bias || 1.0f != ep->scale || ep->gelu || nullptr != ep->residual;
+		if( nullptr != reduce && ( result.ne[ 2 ] != 1 || result.ne[ 3 ] != 1 ) )
+			throw E_NOTIMPL;
+	}
+
 	length = a.ne[ 0 ];
 	resultStrides[ 0 ] = result.nb[ 1 ];
 	resultStrides[ 1 ] = result.nb[ 2 ];
@@ -54,12 +55,7 @@ MulMatBase::MulMatBase( Tensor& result, const Tensor& a, const Tensor& b, Parall
 	// Pick a method which reshapes a panel of the matrix A into the shape we need to compute the product
 	// Store the pointer to that method in the field of this class
 	if( a.nb[ 0 ] == 1 )
-	{
-		if( haveAvx2 )
-			pfnMakePanel = &MulMatBase::transposePanelAvx2;
-		else
-			pfnMakePanel = &MulMatBase::transposePanel;
-	}
+		pfnMakePanel = transposeRowMajor();
 	else if( a.nb[ 1 ] == 1 )
 	{
 		switch( panelHeightRegs )
@@ -119,6 +115,7 @@ HRESULT __stdcall MulMatImpl<panelHeightRegs, tileWidthFloats>::compute( size_t
 	// Load a few numbers from this class into local variables, while upcasting from DWORD into size_t
 	const size_t length = this->length;
 	const std::array<size_t, 2> stridesB{ this->stridesB[ 0 ], this->stridesB[ 1 ] };
+	const uint32_t reduceState = ( nullptr != reduce ) ? reduce->beginThread() : 0;
 
 	// This outer loop iterates over the panels assigned to the current thread
 	// For example, matrix A of size [ 1024, 1024 ] may be split into panels of size [ 1024, 16 ]
@@ -142,6 +139,17 @@ HRESULT __stdcall MulMatImpl<panelHeightRegs, tileWidthFloats>::compute( size_t
 #if 1
 		ResultTile<panelHeightRegs, tileWidthFloats> tile;
 
+		// Load the bias slice for this panel, and the other state of the epilogue
+		std::array<__m256, panelHeightRegs> epBias;
+		setZero( epBias );
+		__m256 epScale = _mm256_set1_ps( 1.0f );
+		if( hasEpilogue )
+		{
+			if( nullptr != epilogue.bias )
+				loadPartialPanel( epilogue.bias + iPanel * panelHeightFloats, storeWidth, epBias );
+			epScale = _mm256_set1_ps( epilogue.scale );
+		}
+
 		// This loop iterates over tiles within the panel.
 		// Each iteration of the loop computes an output tile of the result matrix.
 		for( j = 0; j < completeTilesPerPanel; j++, pb += tileWidthFloats * stridesB[ 1 ], rdi += resultStride * tileWidthFloats )
@@ -156,6 +164,8 @@ HRESULT __stdcall MulMatImpl<panelHeightRegs, tileWidthFloats>::compute( size_t
 				loadPanel( rsiA, vecPanel );
 				tile.kernel( vecPanel, rsiB, stridesB[ 1 ] );
 			}
+			if( hasEpilogue )
+				tile.epilogue( epBias, epScale, epilogue.gelu, residualPointer( rdi ), storeWidth, tileWidthFloats, resultStride );
 			tile.store( rdi, storeWidth, tileWidthFloats, resultStride );
 		}
 
@@ -170,8 +180,14 @@ HRESULT __stdcall MulMatImpl<panelHeightRegs, tileWidthFloats>::compute( size_t
 				loadPanel( rsiA, vecPanel );
 				tile.kernelPartial( vecPanel, rsiB, stridesB[ 1 ], lastColumnsInPanel );
 			}
+			if( hasEpilogue )
+				tile.epilogue( epBias, epScale, epilogue.gelu, residualPointer( rdi ), storeWidth, lastColumnsInPanel, resultStride );
 			tile.store( rdi, storeWidth, lastColumnsInPanel, resultStride );
 		}
+
+		// The complete panel of the output was just stored, it's still in L1 cache
+		if( nullptr != reduce )
+			reduce->reducePanel( reduceState, getPanelDest( iPanel, m2, m3 ), (uint32_t)( iPanel * panelHeightFloats ), (uint32_t)storeWidth, resultSize[ 1 ], resultStride );
 #else
 		// This version bypasses horizontal tiling, instead implements a brute force algorithm to multiply the current panel by the complete B matrix
 		// Not terribly efficient, only implemented for debugging purposes
@@ -6,12 +6,18 @@
 // https://link.springer.com/article/10.1007/s11227-022-05003-3
 #include "ParallelForRunner.h"
 #include "Tensor.h"
+#include "mulMat.h"
 
 namespace CpuCompute
 {
+	// Function pointers to the kernels which have versions for multiple instruction sets, defined in simdUtils.cpp
+	struct sKernelTable;
+
 	// Abstract base class for all implementations, to reduce binary size
 	class MulMatBase : public iComputeRange
 	{
+		friend struct sKernelTable;
+
 	protected:
 		// Pointers to the payload of the output matrix
 		float* const resultPointer;
@@ -55,6 +61,12 @@ namespace CpuCompute
 		// The object which implements multithreading for this job, and supplies memory for thread-local buffers
 		ParallelForRunner& runner;
 
+		// Element-wise operations to apply to the output tiles, only used when hasEpilogue is true
+		sMulMatEpilogue epilogue;
+		bool hasEpilogue;
+		// Fused reduction of the output panels, or nullptr
+		iMulMatReduce* reduce;
+
 		// Count of FP16 values in the thread-local panel buffer
 		uint32_t floatsPerPanel() const
 		{
@@ -86,9 +98,18 @@ namespace CpuCompute
 			return rdi;
 		}
 
-		static const bool haveAvx2;
+		// When the epilogue has the residual, pointer to the element of the residual matrix which corresponds to the output element
+		const float* residualPointer( const float* rdi ) const
+		{
+			if( nullptr == epilogue.residual )
+				return nullptr;
+			return epilogue.residual + ( rdi - resultPointer );
+		}
+
+		// Either transposePanelAvx2 or transposePanel, from the kernel table filled by bindKernels()
+		static pfnTransposePanel transposeRowMajor();
 	public:
-		MulMatBase( Tensor& result, const Tensor& a, const Tensor& b, ParallelForRunner& pfor, uint8_t panelHeightRegs, uint8_t tileWidthFloats );
+		MulMatBase( Tensor& result, const Tensor& a, const Tensor& b, ParallelForRunner& pfor, uint8_t panelHeightRegs, uint8_t tileWidthFloats, const sMulMatEpilogue* ep );
 		HRESULT run( ParallelForRunner& pfor );
 	};
 
@@ -99,8 +120,8 @@ namespace CpuCompute
 		HRESULT __stdcall compute( size_t i, size_t end ) const noexcept override final;
 
 	public:
-		MulMatImpl( Tensor& result, const Tensor& a, const Tensor& b, ParallelForRunner& pfor ) :
-			MulMatBase( result, a, b, pfor, panelHeightRegs, tileWidthFloats )
+		MulMatImpl( Tensor& result, const Tensor& a, const Tensor& b, ParallelForRunner& pfor, const sMulMatEpilogue* ep ) :
+			MulMatBase( result, a, b, pfor, panelHeightRegs, tileWidthFloats, ep )
 		{ }
 	};
 }
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+#include <immintrin.h>
+
+// Vectorized transcendental functions for FP32 numbers
+// Only using AVX1 and FMA3 instructions, these are the CPU requirements of the hybrid model
+
+// Polynomial approximation of the exponent, with range reduction; ported from Cephes library, the max.relative error is around 2 ULP.
+// Inputs below -88.37 return 0, inputs above +88.37 return 2.4E+38
+__forceinline __m256 expf8( __m256 x )
+{
+	x = _mm256_min_ps( x, _mm256_set1_ps( 88.3762626647949f ) );
+	x = _mm256_max_ps( x, _mm256_set1_ps( -88.3762626647949f ) );
+
+	// x = n * ln(2) + r, the r is within [ -ln(2)/2 .. +ln(2)/2 ]
+	const __m256 n = _mm256_round_ps( _mm256_mul_ps( x, _mm256_set1_ps( 1.44269504088896341f ) ), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC );
+	// ln(2) is split into two numbers for the extra precision of the reduction
+	__m256 r = _mm256_fnmadd_ps( n, _mm256_set1_ps( 0.693359375f ), x );
+	r = _mm256_fnmadd_ps( n, _mm256_set1_ps( -2.12194440e-4f ), r );
+
+	// exp(r) = 1 + r + r^2 * P(r)
+	__m256 p = _mm256_set1_ps( 1.9875691500E-4f );
+	p = _mm256_fmadd_ps( p, r, _mm256_set1_ps( 1.3981999507E-3f ) );
+	p = _mm256_fmadd_ps( p, r, _mm256_set1_ps( 8.3334519073E-3f ) );
+	p = _mm256_fmadd_ps( p, r, _mm256_set1_ps( 4.1665795894E-2f ) );
+	p = _mm256_fmadd_ps( p, r, _mm256_set1_ps( 1.6666665459E-1f ) );
+	p = _mm256_fmadd_ps( p, r, _mm256_set1_ps( 5.0000001201E-1f ) );
+	const __m256 r2 = _mm256_mul_ps( r, r );
+	p = _mm256_fmadd_ps( p, r2, r );
+	p = _mm256_add_ps( p, _mm256_set1_ps( 1.0f ) );
+
+	// Multiply by 2^n, building the FP32 number from the exponent bits
+	// AVX1 doesn't have 32-byte integer instructions, using 16-byte halves
+	const __m256i e = _mm256_cvtps_epi32( n );
+	const __m128i bias = _mm_set1_epi32( 127 );
+	__m128i low = _mm256_castsi256_si128( e );
+	__m128i high = _mm256_extractf128_si256( e, 1 );
+	low = _mm_slli_epi32( _mm_add_epi32( low, bias ), 23 );
+	high = _mm_slli_epi32( _mm_add_epi32( high, bias ), 23 );
+	return _mm256_mul_ps( p, _mm256_castsi256_ps( _mm256_setr_m128i( low, high ) ) );
+}
+
+// GELU activation, tanh approximation: 0.5 * x * ( 1 + tanh( sqrt( 2 / pi ) * x * ( 1 + 0.044715 * x^2 ) ) )
+// Computed as x / ( 1 + exp( -2 * u ) ), which is the same number because 0.5 * ( 1 + tanh( u ) ) = sigmoid( 2 * u )
+__forceinline __m256 geluf8( __m256 x )
+{
+	constexpr float GELU_COEF_A = 0.044715f;
+	constexpr float SQRT_2_OVER_PI = 0.79788456080286535587989211986876f;
+
+	const __m256 x2 = _mm256_mul_ps( x, x );
+	__m256 u = _mm256_fmadd_ps( x2, _mm256_set1_ps( -2.0f * SQRT_2_OVER_PI * GELU_COEF_A ), _mm256_set1_ps( -2.0f * SQRT_2_OVER_PI ) );
+	u = _mm256_mul_ps( u, x );
+
+	const __m256 denom = _mm256_add_ps( _mm256_set1_ps( 1.0f ), expf8( u ) );
+	return _mm256_div_ps( x, denom );
+}
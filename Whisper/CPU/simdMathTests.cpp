@@ -0,0 +1,108 @@
+#include "stdafx.h"
+#include "simdMathTests.h"
+#include "simdMath.hpp"
+#include "../ML/LookupTablesData.h"
+#include "../ML/testUtils.h"
+#include "../Utils/CpuProfiler.h"
+#include <memory>
+
+namespace
+{
+	using DirectCompute::LookupTablesData;
+
+	// The old implementation, converts the lanes to FP16, and loads the results from the 128 KB table
+	__forceinline __m256 lookup8( __m256 x, const std::array<uint16_t, 0x10000>& table )
+	{
+		__m128i iv = _mm256_cvtps_ph( x, 0 );
+		alignas( 16 ) std::array<uint16_t, 8> arr;
+		_mm_store_si128( ( __m128i* )arr.data(), iv );
+		for( uint16_t& a : arr )
+			a = table[ a ];
+		iv = _mm_load_si128( ( __m128i* )arr.data() );
+		return _mm256_cvtph_ps( iv );
+	}
+
+	template<class Fn>
+	void applyVector( float* rdi, const float* rsi, size_t length, Fn fn )
+	{
+		assert( 0 == length % 8 );
+		for( size_t i = 0; i < length; i += 8 )
+			_mm256_storeu_ps( rdi + i, fn( _mm256_loadu_ps( rsi + i ) ) );
+	}
+
+	// Test inputs evenly distributed over the interval
+	std::vector<float> makeInputs( float min, float max, size_t length )
+	{
+		std::vector<float> vec( length );
+		const double mul = ( (double)max - min ) / (double)( length - 1 );
+		for( size_t i = 0; i < length; i++ )
+			vec[ i ] = (float)( min + mul * (double)i );
+		return vec;
+	}
+
+	float maxRelativeError( const std::vector<float>& test, const std::vector<float>& reference )
+	{
+		double res = 0;
+		for( size_t i = 0; i < test.size(); i++ )
+		{
+			const double ref = reference[ i ];
+			if( std::abs( ref ) < 1E-30 )
+				continue;
+			res = std::max( res, std::abs( ( (double)test[ i ] - ref ) / ref ) );
+		}
+		return (float)res;
+	}
+
+	template<class Fn>
+	double benchmark( float* rdi, const float* rsi, size_t length, Fn fn )
+	{
+		constexpr int passes = 64;
+		// Warmup
+		applyVector( rdi, rsi, length, fn );
+		Whisper::CpuProfiler stopwatch;
+		for( int i = 0; i < passes; i++ )
+			applyVector( rdi, rsi, length, fn );
+		// Nanoseconds per element
+		return (double)stopwatch.elapsed() * 100.0 / ( (double)length * passes );
+	}
+}
+
+void CpuCompute::testSimdMath()
+{
+	const std::unique_ptr<LookupTablesData> lookup = std::make_unique<LookupTablesData>();
+	// 16 KB of the input + 16 KB of the output fits in L1D cache of all modern CPUs
+	constexpr size_t length = 1024 * 4;
+	std::vector<float> result( length ), reference( length ), old( length );
+
+	// GELU
+	std::vector<float> inputs = makeInputs( -10.0f, 10.0f, length );
+	for( size_t i = 0; i < length; i++ )
+		reference[ i ] = DirectCompute::computeGelu( inputs[ i ] );
+
+	applyVector( result.data(), inputs.data(), length, []( __m256 x ) { return geluf8( x ); } );
+	DirectCompute::computeDiff( result.data(), reference.data(), length ).print( "geluf8" );
+
+	const auto geluLookup = [ &lookup ]( __m256 x ) { return lookup8( x, lookup->gelu ); };
+	applyVector( old.data(), inputs.data(), length, geluLookup );
+	DirectCompute::computeDiff( old.data(), reference.data(), length ).print( "gelu FP16 lookup" );
+
+	double timeNew = benchmark( result.data(), inputs.data(), length, []( __m256 x ) { return geluf8( x ); } );
+	double timeOld = benchmark( old.data(), inputs.data(), length, geluLookup );
+	logInfo( u8"GELU: %.3f ns/element, FP16 lookup %.3f ns/element", timeNew, timeOld );
+
+	// Exponent, over the range seen by the softmax
+	inputs = makeInputs( -80.0f, 0.0f, length );
+	for( size_t i = 0; i < length; i++ )
+		reference[ i ] = (float)std::exp( (double)inputs[ i ] );
+
+	applyVector( result.data(), inputs.data(), length, []( __m256 x ) { return expf8( x ); } );
+	logInfo( u8"expf8: max.relative error %g", maxRelativeError( result, reference ) );
+
+	const auto expLookup = [ &lookup ]( __m256 x ) { return lookup8( x, lookup->exponent ); };
+	applyVector( old.data(), inputs.data(), length, expLookup );
+	logInfo( u8"exp FP16 lookup: max.relative error %g", maxRelativeError( old, reference ) );
+
+	timeNew = benchmark( result.data(), inputs.data(), length, []( __m256 x ) { return expf8( x ); } );
+	timeOld = benchmark( old.data(), inputs.data(), length, expLookup );
+	logInfo( u8"exp: %.3f ns/element, FP16 lookup %.3f ns/element", timeNew, timeOld );
+}
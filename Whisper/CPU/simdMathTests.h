@@ -0,0 +1,8 @@
+#pragma once
+
+namespace CpuCompute
+{
+	// Development-only test for the functions in simdMath.hpp: measure the accuracy against the FP64 reference,
+	// and run a microbenchmark comparing them with the FP16 lookup tables used previously. Prints results to the log.
+	void testSimdMath();
+}
\ No newline at end of file
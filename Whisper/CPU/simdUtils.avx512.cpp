@@ -0,0 +1,118 @@
+#include "stdafx.h"
+#include "simdUtils.h"
+// This source file is compiled with /arch:AVX512 option, the functions are only called when the CPU supports AVX-512 F, BW, DQ and VL.
+// Elements are processed in the same order and with the same rounding as the AVX versions in simdUtils.cpp, the outputs are bitwise equal.
+
+namespace
+{
+	constexpr size_t maskAlign16 = ~(size_t)15;
+
+	// Mask with the lowest `remainder` bits set
+	__forceinline __mmask16 tailMask( size_t remainder )
+	{
+		assert( remainder > 0 && remainder < 16 );
+		return (__mmask16)( ( 1u << remainder ) - 1 );
+	}
+
+	__forceinline __m512 load16( const uint16_t* rsi )
+	{
+		return _mm512_cvtph_ps( _mm256_loadu_si256( ( const __m256i* )rsi ) );
+	}
+
+	__forceinline __m512 loadPartial( const uint16_t* rsi, __mmask16 mask )
+	{
+		return _mm512_cvtph_ps( _mm256_maskz_loadu_epi16( mask, rsi ) );
+	}
+}
+
+void Avx512::addF16to32( float* rdi, const uint16_t* a, const uint16_t* b, size_t length )
+{
+	const uint16_t* const endAligned = a + ( length & maskAlign16 );
+	for( ; a < endAligned; a += 16, b += 16, rdi += 16 )
+		_mm512_storeu_ps( rdi, _mm512_add_ps( load16( a ), load16( b ) ) );
+
+	const size_t rem = length % 16;
+	if( 0 != rem )
+	{
+		const __mmask16 mask = tailMask( rem );
+		const __m512 res = _mm512_add_ps( loadPartial( a, mask ), loadPartial( b, mask ) );
+		_mm512_mask_storeu_ps( rdi, mask, res );
+	}
+}
+
+void Avx512::addF16to32( float* rdi, const uint16_t* a, const float* b, size_t length )
+{
+	const uint16_t* const endAligned = a + ( length & maskAlign16 );
+	for( ; a < endAligned; a += 16, b += 16, rdi += 16 )
+		_mm512_storeu_ps( rdi, _mm512_add_ps( load16( a ), _mm512_loadu_ps( b ) ) );
+
+	const size_t rem = length % 16;
+	if( 0 != rem )
+	{
+		const __mmask16 mask = tailMask( rem );
+		const __m512 res = _mm512_add_ps( loadPartial( a, mask ), _mm512_maskz_loadu_ps( mask, b ) );
+		_mm512_mask_storeu_ps( rdi, mask, res );
+	}
+}
+
+void Avx512::floatsUpcast( float* rdi, const uint16_t* rsi, size_t length )
+{
+	const uint16_t* const rsiEndAligned = rsi + ( length & maskAlign16 );
+	for( ; rsi < rsiEndAligned; rsi += 16, rdi += 16 )
+		_mm512_storeu_ps( rdi, load16( rsi ) );
+
+	const size_t rem = length % 16;
+	if( 0 != rem )
+	{
+		const __mmask16 mask = tailMask( rem );
+		_mm512_mask_storeu_ps( rdi, mask, loadPartial( rsi, mask ) );
+	}
+}
+
+void Avx512::floatsDowncast( uint16_t* rdi, const float* rsi, size_t length )
+{
+	const float* const rsiEndAligned = rsi + ( length & maskAlign16 );
+	for( ; rsi < rsiEndAligned; rsi += 16, rdi += 16 )
+	{
+		const __m256i vi = _mm512_cvtps_ph( _mm512_loadu_ps( rsi ), 0 );
+		_mm256_storeu_si256( ( __m256i* )rdi, vi );
+	}
+
+	const size_t rem = length % 16;
+	if( 0 != rem )
+	{
+		const __mmask16 mask = tailMask( rem );
+		const __m256i vi = _mm512_cvtps_ph( _mm512_maskz_loadu_ps( mask, rsi ), 0 );
+		_mm256_mask_storeu_epi16( rdi, mask, vi );
+	}
+}
+
+void Avx512::addRowInPlace( float* rdi, const float* rsi, size_t length )
+{
+	const float* const rdiEndAligned = rdi + ( length & maskAlign16 );
+	for( ; rdi < rdiEndAligned; rdi += 16, rsi += 16 )
+		_mm512_storeu_ps( rdi, _mm512_add_ps( _mm512_loadu_ps( rdi ), _mm512_loadu_ps( rsi ) ) );
+
+	const size_t rem = length % 16;
+	if( 0 != rem )
+	{
+		const __mmask16 mask = tailMask( rem );
+		const __m512 res = _mm512_add_ps( _mm512_maskz_loadu_ps( mask, rdi ), _mm512_maskz_loadu_ps( mask, rsi ) );
+		_mm512_mask_storeu_ps( rdi, mask, res );
+	}
+}
+
+void Avx512::addRow( float* rdi, const float* a, const float* b, size_t length )
+{
+	const float* const aEndAligned = a + ( length & maskAlign16 );
+	for( ; a < aEndAligned; a += 16, b += 16, rdi += 16 )
+		_mm512_storeu_ps( rdi, _mm512_add_ps( _mm512_loadu_ps( a ), _mm512_loadu_ps( b ) ) );
+
+	const size_t rem = length % 16;
+	if( 0 != rem )
+	{
+		const __mmask16 mask = tailMask( rem );
+		const __m512 res = _mm512_add_ps( _mm512_maskz_loadu_ps( mask, a ), _mm512_maskz_loadu_ps( mask, b ) );
+		_mm512_mask_storeu_ps( rdi, mask, res );
+	}
+}
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "stdafx.h"
 #include "simdUtils.h"
-#include "../ML/LookupTablesData.h"
+#include "simdMath.hpp"
+#include "cpuFeatures.h"
+#include "mulMatImpl.h"
 #include <cmath>
 #include <memory>
 
@@ -188,7 +190,7 @@ namespace
 	}
 }
 
-void addF16to32( float* rdi, const uint16_t* a, const uint16_t* b, size_t length )
+static void addF16to32Avx( float* rdi, const uint16_t* a, const uint16_t* b, size_t length )
 {
 	const uint16_t* const endAligned = a + ( length & maskAlign8 );
 	const size_t rem = length % 8;
@@ -210,7 +212,7 @@ void addF16to32( float* rdi, const uint16_t* a, const uint16_t* b, size_t length
 	}
 }
 
-void addF16to32( float* rdi, const uint16_t* a, const float* b, size_t length )
+static void addF16to32Avx( float* rdi, const uint16_t* a, const float* b, size_t length )
 {
 	const uint16_t* const endAligned = a + ( length & maskAlign8 );
 	const size_t rem = length % 8;
@@ -250,72 +252,95 @@ namespace
 	}
 }
 
-void norm( float* rdi, float* temp, const float* rsi, size_t length )
+namespace
 {
-	assert( (size_t)temp % 32 == 0 );
-	const float* rsiEndAligned = rsi + ( length & maskAlign8 );
-	const size_t rem = length % 8;
-
-	// First pass: copy to temp buffer, and compute the sum; computeVectorSum() in HLSL
-	__m256 sum = _mm256_setzero_ps();
-	float* t;
-	for( t = temp; rsi < rsiEndAligned; rsi += 8, t += 8 )
-	{
-		__m256 v = _mm256_loadu_ps( rsi );
-		sum = _mm256_add_ps( sum, v );
-		_mm256_store_ps( t, v );
-	}
-	float* const tEndAligned = t;
-	if( 0 != rem )
-	{
-		__m256 v = loadPartial( rsi, rem );
-		sum = _mm256_add_ps( sum, v );
-		_mm256_store_ps( t, v );
-		t += 8;
-	}
+	// Layer normalization of a single row, optionally fused with the affine transform after
+	template<bool affine>
+	__forceinline void normImpl( float* rdi, float* temp, const float* rsi, size_t length, const float* w, const float* b )
+	{
+		assert( (size_t)temp % 32 == 0 );
+		const float* rsiEndAligned = rsi + ( length & maskAlign8 );
+		const size_t rem = length % 8;
+
+		// First pass: copy to temp buffer, and compute the sum; computeVectorSum() in HLSL
+		__m256 sum = _mm256_setzero_ps();
+		float* t;
+		for( t = temp; rsi < rsiEndAligned; rsi += 8, t += 8 )
+		{
+			const __m256 v = _mm256_loadu_ps( rsi );
+			sum = _mm256_add_ps( sum, v );
+			_mm256_store_ps( t, v );
+		}
+		float* const tEndAligned = t;
+		if( 0 != rem )
+		{
+			const __m256 v = loadPartial( rsi, rem );
+			sum = _mm256_add_ps( sum, v );
+			_mm256_store_ps( t, v );
+			t += 8;
+		}
 
-	const float lengthFloat = (float)(int)length;
-	const float meanScalar = horizontalSum( sum ) / lengthFloat;
-	const __m256 mean = _mm256_set1_ps( meanScalar );
+		const float lengthFloat = (float)(int)length;
+		const float meanScalar = horizontalSum( sum ) / lengthFloat;
+		const __m256 mean = _mm256_set1_ps( meanScalar );
 
-	// Second pass, offsetAndComputeSumSquares() in HLSL
-	sum = _mm256_setzero_ps();
-	for( t = temp; t < tEndAligned; t += 8 )
-	{
-		__m256 v = _mm256_load_ps( t );
-		v = _mm256_sub_ps( v, mean );
-		_mm256_store_ps( t, v );
-		sum = _mm256_fmadd_ps( v, v, sum );
-	}
-	if( 0 != rem )
-	{
-		__m256 v = _mm256_load_ps( t );
-		v = _mm256_sub_ps( v, mean );
-		v = _mm256_and_ps( v, loadTailMaskFloats( rem ) );
-		_mm256_store_ps( t, v );
-		sum = _mm256_fmadd_ps( v, v, sum );
-	}
+		// Second pass, offsetAndComputeSumSquares() in HLSL
+		sum = _mm256_setzero_ps();
+		for( t = temp; t < tEndAligned; t += 8 )
+		{
+			__m256 v = _mm256_load_ps( t );
+			v = _mm256_sub_ps( v, mean );
+			_mm256_store_ps( t, v );
+			sum = _mm256_fmadd_ps( v, v, sum );
+		}
+		if( 0 != rem )
+		{
+			__m256 v = _mm256_load_ps( t );
+			v = _mm256_sub_ps( v, mean );
+			v = _mm256_and_ps( v, loadTailMaskFloats( rem ) );
+			_mm256_store_ps( t, v );
+			sum = _mm256_fmadd_ps( v, v, sum );
+		}
 
-	// Final pass: scale, and copy from temporary buffer into the destination row
+		// Final pass: scale, and copy from temporary buffer into the destination row
 
-	constexpr float eps = 1e-5f; // TODO: make this a parameter
-	const float scaleScalar = 1.0f / std::sqrtf( horizontalSum( sum ) / lengthFloat + eps );
-	const __m256 scale = _mm256_set1_ps( scaleScalar );
+		constexpr float eps = 1e-5f; // TODO: make this a parameter
+		const float scaleScalar = 1.0f / std::sqrtf( horizontalSum( sum ) / lengthFloat + eps );
+		const __m256 scale = _mm256_set1_ps( scaleScalar );
 
-	for( t = temp; t < tEndAligned; t += 8, rdi += 8 )
-	{
-		__m256 v = _mm256_load_ps( t );
-		v = _mm256_mul_ps( v, scale );
-		_mm256_storeu_ps( rdi, v );
-	}
-	if( 0 != rem )
-	{
-		__m256 v = _mm256_load_ps( t );
-		v = _mm256_mul_ps( v, scale );
-		storePartial( rdi, v, rem );
+		for( t = temp; t < tEndAligned; t += 8, rdi += 8 )
+		{
+			__m256 v = _mm256_load_ps( t );
+			v = _mm256_mul_ps( v, scale );
+			if constexpr( affine )
+			{
+				v = _mm256_fmadd_ps( v, _mm256_loadu_ps( w ), _mm256_loadu_ps( b ) );
+				w += 8;
+				b += 8;
+			}
+			_mm256_storeu_ps( rdi, v );
+		}
+		if( 0 != rem )
+		{
+			__m256 v = _mm256_load_ps( t );
+			v = _mm256_mul_ps( v, scale );
+			if constexpr( affine )
+				v = _mm256_fmadd_ps( v, loadPartial( w, rem ), loadPartial( b, rem ) );
+			storePartial( rdi, v, rem );
+		}
 	}
 }
 
+void norm( float* rdi, float* temp, const float* rsi, size_t length )
+{
+	normImpl<false>( rdi, temp, rsi, length, nullptr, nullptr );
+}
+
+void normAffine( float* rdi, float* temp, const float* rsi, size_t length, const float* w, const float* b )
+{
+	normImpl<true>( rdi, temp, rsi, length, w, b );
+}
+
 void fmaRepeatRow( float* rdi, size_t len, const float* w, const float* b, size_t lenPattern )
 {
 	float* rdiEndAligned = rdi + ( len & maskAlign8 );
@@ -468,21 +493,7 @@ void addRepeatRow( float* rdi, size_t len, const float* b, size_t lenPattern )
 	}
 }
 
-namespace
-{
-	__forceinline __m256 gelu( __m256 x, const DirectCompute::LookupTablesData& lookup )
-	{
-		__m128i iv = _mm256_cvtps_ph( x, 0 );
-		alignas( 16 ) std::array<uint16_t, 8> arr;
-		_mm_store_si128( ( __m128i* )arr.data(), iv );
-		for( uint16_t& a : arr )
-			a = lookup.gelu[ a ];
-		iv = _mm_load_si128( ( __m128i* )arr.data() );
-		return _mm256_cvtph_ps( iv );
-	}
-}
-
-void addRepeatGeluRow( float* rdi, size_t len, const float* b, size_t lenPattern, const DirectCompute::LookupTablesData& lookup )
+void addRepeatGeluRow( float* rdi, size_t len, const float* b, size_t lenPattern )
 {
 	float* rdiEndAligned = rdi + ( len & maskAlign8 );
 	const size_t rem = len % 8;
@@ -494,7 +505,7 @@ void addRepeatGeluRow( float* rdi, size_t len, const float* b, size_t lenPattern
 		{
 			__m256 v = _mm256_loadu_ps( rdi );
 			v = _mm256_add_ps( v, v2 );
-			v = gelu( v, lookup );
+			v = geluf8( v );
 			_mm256_storeu_ps( rdi, v );
 		}
 		if( 0 != rem )
@@ -502,7 +513,7 @@ void addRepeatGeluRow( float* rdi, size_t len, const float* b, size_t lenPattern
 			const __m256i mask = loadTailMaskInt( rem );
 			__m256 v = _mm256_maskload_ps( rdi, mask );
 			v = _mm256_add_ps( v, v2 );
-			v = gelu( v, lookup );
+			v = geluf8( v );
 			_mm256_maskstore_ps( rdi, mask, v );
 		}
 		return;
@@ -514,7 +525,7 @@ void addRepeatGeluRow( float* rdi, size_t len, const float* b, size_t lenPattern
 			__m256 v = _mm256_loadu_ps( rdi );
 			__m256 v2 = _mm256_loadu_ps( b );
 			v = _mm256_add_ps( v, v2 );
-			v = gelu( v, lookup );
+			v = geluf8( v );
 			_mm256_storeu_ps( rdi, v );
 		}
 		if( 0 != rem )
@@ -523,7 +534,7 @@ void addRepeatGeluRow( float* rdi, size_t len, const float* b, size_t lenPattern
 			__m256 v = _mm256_maskload_ps( rdi, mask );
 			__m256 v2 = _mm256_maskload_ps( b, mask );
 			v = _mm256_add_ps( v, v2 );
-			v = gelu( v, lookup );
+			v = geluf8( v );
 			_mm256_maskstore_ps( rdi, mask, v );
 		}
 		return;
@@ -556,8 +567,6 @@ void __vectorcall scaleRow( float* rdi, size_t len, const __m256 scale )
 
 namespace
 {
-	using DirectCompute::LookupTablesData;
-
 	__forceinline float horizontalMax( __m256 vec )
 	{
 		__m128 v = _mm256_extractf128_ps( vec, 1 );
@@ -567,26 +576,17 @@ namespace
 		return _mm_cvtss_f32( v );
 	}
 
-	__forceinline float _cvtsh_ss( uint16_t f16 )
+	// Compute exponent of ( x - max ) * scale, replacing -INFINITY inputs with zeros; accumulate the sum in FP64 precision
+	__forceinline __m256 __vectorcall softMaxExp( __m256 x, __m256 max, __m256 scale, __m256d& sum0, __m256d& sum1 )
 	{
-		__m128i i = _mm_cvtsi32_si128( f16 );
-		__m128 f = _mm_cvtph_ps( i );
-		return _mm_cvtss_f32( f );
+		const __m256 isMasked = _mm256_cmp_ps( x, _mm256_set1_ps( -INFINITY ), _CMP_EQ_OQ );
+		x = _mm256_mul_ps( _mm256_sub_ps( x, max ), scale );
+		x = expf8( x );
+		x = _mm256_andnot_ps( isMasked, x );
+		sum0 = _mm256_add_pd( sum0, _mm256_cvtps_pd( _mm256_castps256_ps128( x ) ) );
+		sum1 = _mm256_add_pd( sum1, _mm256_cvtps_pd( _mm256_extractf128_ps( x, 1 ) ) );
+		return x;
 	}
-
-	__forceinline uint16_t _cvtss_sh( float f, int rounding )
-	{
-		assert( 0 == rounding );
-		__m128 v = _mm_set_ss( f );
-		__m128i i = _mm_cvtps_ph( v, 0 );
-		return (uint16_t)(uint32_t)_mm_cvtsi128_si32( i );
-	}
-}
-
-const LookupTablesData& getLookupTables()
-{
-	static const std::unique_ptr<LookupTablesData> res = std::make_unique<LookupTablesData>();
-	return *res;
 }
 
 void softMax( float* rdi, size_t length, const float inputScale )
@@ -611,30 +611,28 @@ void softMax( float* rdi, size_t length, const float inputScale )
 	}
 
 	// Second pass: apply initial scale, compute the exponent, and compute total sum over the row
-	const LookupTablesData& lookup = getLookupTables();
-	const float maxScalar = horizontalMax( max );
-
-	float* const rdiEnd = rdiBegin + length;
-	double sum = 0;
-	for( rdi = rdiBegin; rdi < rdiEnd; rdi++ )
-	{
-		// Possible to vectorize, but relatively hard
-		// An easy way is upcast the complete lookup table to FP32 and then use two _mm256_i32gather_ps instructions per iteration
-		// However, that instruction is from AVX2 set. Let's hope this loop won't be a bottleneck.
-		float f = *rdi;
-		if( f != -INFINITY )
-		{
-			f = ( f - maxScalar ) * inputScale;
-			uint16_t f16 = _cvtss_sh( f, 0 );
-			f16 = lookup.exponent[ f16 ];
-			f = _cvtsh_ss( f16 );
-			sum += f;
-		}
-		else
-			f = 0;
-
-		*rdi = f;
+	const __m256 maxVec = _mm256_set1_ps( horizontalMax( max ) );
+	const __m256 scale = _mm256_set1_ps( inputScale );
+	__m256d sum0 = _mm256_setzero_pd();
+	__m256d sum1 = _mm256_setzero_pd();
+	for( rdi = rdiBegin; rdi < rdiEndAligned; rdi += 8 )
+	{
+		__m256 v = _mm256_loadu_ps( rdi );
+		v = softMaxExp( v, maxVec, scale, sum0, sum1 );
+		_mm256_storeu_ps( rdi, v );
 	}
+	if( 0 != remainder )
+	{
+		__m256 v = _mm256_maskload_ps( rdi, tailMask );
+		// The masked lanes are loaded as zeros, replace them with -INFINITY to exclude from the sum
+		v = _mm256_blendv_ps( _mm256_set1_ps( -INFINITY ), v, _mm256_castsi256_ps( tailMask ) );
+		v = softMaxExp( v, maxVec, scale, sum0, sum1 );
+		_mm256_maskstore_ps( rdi, tailMask, v );
+	}
+	sum0 = _mm256_add_pd( sum0, sum1 );
+	__m128d s2 = _mm_add_pd( _mm256_castpd256_pd128( sum0 ), _mm256_extractf128_pd( sum0, 1 ) );
+	s2 = _mm_add_sd( s2, _mm_unpackhi_pd( s2, s2 ) );
+	const double sum = _mm_cvtsd_f64( s2 );
 
 	// Final pass: apply the final scale
 	const __m256 finalScale = _mm256_set1_ps( (float)( 1.0 / sum ) );
@@ -652,7 +650,48 @@ void softMax( float* rdi, size_t length, const float inputScale )
 	}
 }
 
-void floatsUpcast( float* rdi, const uint16_t* rsi, size_t length )
+float dotProductF16( const uint16_t* a, const float* b, size_t length )
+{
+	const uint16_t* aEndAligned = a + ( length & maskAlign8 );
+	const size_t rem = length % 8;
+
+	// Two accumulators to hide the latency of FMA, the attention heads are only 64 elements
+	__m256 acc0 = _mm256_setzero_ps();
+	__m256 acc1 = _mm256_setzero_ps();
+	for( ; a + 8 < aEndAligned; a += 16, b += 16 )
+	{
+		acc0 = _mm256_fmadd_ps( load8( a ), _mm256_loadu_ps( b ), acc0 );
+		acc1 = _mm256_fmadd_ps( load8( a + 8 ), _mm256_loadu_ps( b + 8 ), acc1 );
+	}
+	if( a < aEndAligned )
+	{
+		acc0 = _mm256_fmadd_ps( load8( a ), _mm256_loadu_ps( b ), acc0 );
+		a += 8;
+		b += 8;
+	}
+	if( 0 != rem )
+		acc1 = _mm256_fmadd_ps( loadPartial( a, rem ), loadPartial( b, rem ), acc1 );
+	return horizontalSum( _mm256_add_ps( acc0, acc1 ) );
+}
+
+void fmaRowF16( float* rdi, const uint16_t* a, float scale, size_t length )
+{
+	const float* rdiEndAligned = rdi + ( length & maskAlign8 );
+	const size_t rem = length % 8;
+	const __m256 s = _mm256_set1_ps( scale );
+
+	for( ; rdi < rdiEndAligned; rdi += 8, a += 8 )
+		_mm256_storeu_ps( rdi, _mm256_fmadd_ps( load8( a ), s, _mm256_loadu_ps( rdi ) ) );
+
+	if( 0 != rem )
+	{
+		const __m256i mask = loadTailMaskInt( rem );
+		const __m256 v = _mm256_fmadd_ps( loadPartial( a, rem ), s, _mm256_maskload_ps( rdi, mask ) );
+		_mm256_maskstore_ps( rdi, mask, v );
+	}
+}
+
+static void floatsUpcastAvx( float* rdi, const uint16_t* rsi, size_t length )
 {
 	const uint16_t* rsiEndAligned = rsi + ( length & maskAlign8 );
 	const size_t rem = length % 8;
@@ -667,7 +706,7 @@ void floatsUpcast( float* rdi, const uint16_t* rsi, size_t length )
 	}
 }
 
-void floatsDowncast( uint16_t* rdi, const float* rsi, size_t length )
+static void floatsDowncastAvx( uint16_t* rdi, const float* rsi, size_t length )
 {
 	const float* rsiEndAligned = rsi + ( length & maskAlign8 );
 	size_t rem = length % 8;
@@ -691,7 +730,7 @@ void floatsDowncast( uint16_t* rdi, const float* rsi, size_t length )
 	}
 }
 
-void addRowInPlace( float* rdi, const float* rsi, size_t length )
+static void addRowInPlaceAvx( float* rdi, const float* rsi, size_t length )
 {
 	const float* rdiEndAligned = rdi + ( length & maskAlign8 );
 	size_t rem = length % 8;
@@ -714,7 +753,7 @@ void addRowInPlace( float* rdi, const float* rsi, size_t length )
 	}
 }
 
-void addRow( float* rdi, const float* a, const float* b, size_t length )
+static void addRowAvx( float* rdi, const float* a, const float* b, size_t length )
 {
 	const float* aEndAligned = a + ( length & maskAlign8 );
 	size_t rem = length % 8;
@@ -735,4 +774,79 @@ void addRow( float* rdi, const float* a, const float* b, size_t length )
 		x = _mm256_add_ps( x, y );
 		_mm256_maskstore_ps( rdi, mask, x );
 	}
+}
+
+// Function pointers to the kernels which have versions for multiple instruction sets.
+// The default values are the AVX versions; the struct is a friend of MulMatBase to reference the protected panel transpose methods.
+struct CpuCompute::sKernelTable
+{
+	void( *addF16to32_16 )( float* rdi, const uint16_t* a, const uint16_t* b, size_t length ) = &addF16to32Avx;
+	void( *addF16to32_32 )( float* rdi, const uint16_t* a, const float* b, size_t length ) = &addF16to32Avx;
+	void( *floatsUpcast )( float* rdi, const uint16_t* rsi, size_t length ) = &floatsUpcastAvx;
+	void( *floatsDowncast )( uint16_t* rdi, const float* rsi, size_t length ) = &floatsDowncastAvx;
+	void( *addRowInPlace )( float* rdi, const float* rsi, size_t length ) = &addRowInPlaceAvx;
+	void( *addRow )( float* rdi, const float* a, const float* b, size_t length ) = &addRowAvx;
+	MulMatBase::pfnTransposePanel transposeRowMajor = &MulMatBase::transposePanel;
+
+	void bind( eSimdLevel level )
+	{
+		if( level >= eSimdLevel::AVX2 )
+			transposeRowMajor = &MulMatBase::transposePanelAvx2;
+		if( level >= eSimdLevel::AVX512 )
+		{
+			addF16to32_16 = &::Avx512::addF16to32;
+			addF16to32_32 = &::Avx512::addF16to32;
+			floatsUpcast = &::Avx512::floatsUpcast;
+			floatsDowncast = &::Avx512::floatsDowncast;
+			addRowInPlace = &::Avx512::addRowInPlace;
+			addRow = &::Avx512::addRow;
+		}
+	}
+};
+
+namespace
+{
+	// The table is constant-initialized, no code runs on DLL load: this source file is compiled with /arch:AVX, and the DLL loads on any CPU.
+	// CpuCompute::bindKernels() upgrades the pointers, the calls then go straight through the table without the guard of a function-local static.
+	CpuCompute::sKernelTable s_kernels;
+}
+
+void CpuCompute::bindKernels()
+{
+	s_kernels.bind( simdLevel() );
+}
+
+CpuCompute::MulMatBase::pfnTransposePanel CpuCompute::MulMatBase::transposeRowMajor()
+{
+	return s_kernels.transposeRowMajor;
+}
+
+void addF16to32( float* rdi, const uint16_t* a, const uint16_t* b, size_t length )
+{
+	s_kernels.addF16to32_16( rdi, a, b, length );
+}
+
+void addF16to32( float* rdi, const uint16_t* a, const float* b, size_t length )
+{
+	s_kernels.addF16to32_32( rdi, a, b, length );
+}
+
+void floatsUpcast( float* rdi, const uint16_t* rsi, size_t length )
+{
+	s_kernels.floatsUpcast( rdi, rsi, length );
+}
+
+void floatsDowncast( uint16_t* rdi, const float* rsi, size_t length )
+{
+	s_kernels.floatsDowncast( rdi, rsi, length );
+}
+
+void addRowInPlace( float* rdi, const float* rsi, size_t length )
+{
+	s_kernels.addRowInPlace( rdi, rsi, length );
+}
+
+void addRow( float* rdi, const float* a, const float* b, size_t length )
+{
+	s_kernels.addRow( rdi, a, b, length );
 }
\ No newline at end of file
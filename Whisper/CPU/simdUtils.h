@@ -33,21 +33,23 @@ inline size_t tempBufferForFloats( size_t count )
 #define ALIGNED_SPAN( name, countFloats ) AlignedSpan name{ _alloca( tempBufferForFloats( countFloats ) ) }
 
 void norm( float* rdi, float* temp, const float* rsi, size_t length );
+// rdi = norm( rsi ) * w + b
+void normAffine( float* rdi, float* temp, const float* rsi, size_t length, const float* w, const float* b );
 
 void fmaRepeatRow( float* rdi, size_t len, const float* w, const float* b, size_t lenPattern );
 void __vectorcall addRepeatScaleRow( float* rdi, size_t len, const float* b, size_t lenPattern, const __m256 scale );
 void addRepeatRow( float* rdi, size_t len, const float* b, size_t lenPattern );
 void __vectorcall scaleRow( float* rdi, size_t len, const __m256 scale );
 
-namespace DirectCompute
-{
-	struct LookupTablesData;
-}
-const DirectCompute::LookupTablesData& getLookupTables();
-void addRepeatGeluRow( float* rdi, size_t len, const float* b, size_t lenPattern, const DirectCompute::LookupTablesData& lookup );
+void addRepeatGeluRow( float* rdi, size_t len, const float* b, size_t lenPattern );
 
 void softMax( float* rdi, size_t length, const float inputScale );
 
+// Dot product of FP16 and FP32 vectors
+float dotProductF16( const uint16_t* a, const float* b, size_t length );
+// rdi += a * scale, where a is FP16 vector
+void fmaRowF16( float* rdi, const uint16_t* a, float scale, size_t length );
+
 // A cache line-aligned array where first 8 elements have all bits set, last 8 elements are zeros
 extern const std::array<int, 16> s_zeroTailMask;
 
@@ -79,4 +81,16 @@ void floatsUpcast( float* rdi, const uint16_t* rsi, size_t length );
 void floatsDowncast( uint16_t* rdi, const float* rsi, size_t length );
 
 void addRowInPlace( float* rdi, const float* rsi, size_t length );
-void addRow( float* rdi, const float* a, const float* b, size_t length );
\ No newline at end of file
+void addRow( float* rdi, const float* a, const float* b, size_t length );
+
+// AVX-512 versions of some of the above functions, implemented in simdUtils.avx512.cpp.
+// The public functions are dispatched to these when the CPU supports AVX-512, don't call them directly.
+namespace Avx512
+{
+	void addF16to32( float* rdi, const uint16_t* a, const uint16_t* b, size_t length );
+	void addF16to32( float* rdi, const uint16_t* a, const float* b, size_t length );
+	void floatsUpcast( float* rdi, const uint16_t* rsi, size_t length );
+	void floatsDowncast( uint16_t* rdi, const float* rsi, size_t length );
+	void addRowInPlace( float* rdi, const float* rsi, size_t length );
+	void addRow( float* rdi, const float* a, const float* b, size_t length );
+}
\ No newline at end of file
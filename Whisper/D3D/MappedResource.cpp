@@ -22,7 +22,7 @@ HRESULT MappedResource::map( ID3D11Resource* res, bool reading )
 	return HRESULT_FROM_WIN32( ERROR_ALREADY_INITIALIZED );
 }
 
-MappedResource::~MappedResource()
+void MappedResource::unmap()
 {
 	if( nullptr != resource )
 	{
@@ -30,4 +30,9 @@ MappedResource::~MappedResource()
 		resource = nullptr;
 		mapped.pData = nullptr;
 	}
+}
+
+MappedResource::~MappedResource()
+{
+	unmap();
 }
\ No newline at end of file
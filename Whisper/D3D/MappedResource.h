@@ -11,6 +11,7 @@ namespace DirectCompute
 	public:
 		MappedResource();
 		HRESULT map( ID3D11Resource* res, bool reading );
+		void unmap();
 		~MappedResource();
 
 		void* data() const
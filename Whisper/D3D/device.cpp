@@ -15,6 +15,12 @@ namespace DirectCompute
 	ID3D11DeviceContext* context() { return g_context; }
 	D3D_FEATURE_LEVEL featureLevel() { return g_featureLevel; }
 
+	static CComAutoCriticalSection s_gpuLock;
+	GpuLock lockGpu()
+	{
+		return GpuLock{ s_gpuLock };
+	}
+
 	void terminate()
 	{
 		g_context = nullptr;
@@ -43,7 +49,7 @@ namespace DirectCompute
 			return S_OK;
 		// D3D11_CREATE_DEVICE_DISABLE_GPU_TIMEOUT: This value is not supported until Direct3D 11.1
 		// https://learn.microsoft.com/en-us/windows/win32/api/d3d11/ne-d3d11-d3d11_create_device_flag
-		flags = _andn_u32( D3D11_CREATE_DEVICE_DISABLE_GPU_TIMEOUT, flags );
+		flags &= ~D3D11_CREATE_DEVICE_DISABLE_GPU_TIMEOUT;
 
 		hr = D3D11CreateDevice( nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, flags, levels.data(), levelsCount, D3D11_SDK_VERSION, &g_device, &g_featureLevel, &g_context );
 		if( SUCCEEDED( hr ) )
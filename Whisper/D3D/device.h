@@ -1,4 +1,5 @@
 #pragma once
+#include <atlbase.h>
 #include <atlcomcli.h>
 #include <string>
 
@@ -11,6 +12,11 @@ namespace DirectCompute
 	HRESULT initialize();
 	void terminate();
 
+	// The device is created with D3D11_CREATE_DEVICE_SINGLETHREADED flag.
+	// When several contexts run on different threads, they serialize their GPU calls with this recursive lock.
+	using GpuLock = CComCritSecLock<CComAutoCriticalSection>;
+	GpuLock lockGpu();
+
 	// DXGI_ADAPTER_DESC.VendorId magic numbers; they come from that database: https://pcisig.com/membership/member-companies
 	enum struct eGpuVendor : uint16_t
 	{
@@ -0,0 +1,270 @@
+#include "stdafx.h"
+#include "DecoderMemoryPlan.h"
+#include "../CPU/BufferAllocator.h"
+
+#if BUILD_HYBRID_VERSION
+namespace
+{
+	// Same rounding as in the arena allocators of CpuCompute namespace
+	inline size_t roundUpAlloc( size_t cb )
+	{
+		return ( cb + 31 ) & ~(size_t)31;
+	}
+}
+
+uint32_t DecoderMemoryPlan::alloc( size_t elements )
+{
+	currentOp++;
+	const uint32_t id = (uint32_t)buffers.size();
+	Buffer& b = buffers.emplace_back();
+	b.cb = roundUpAlloc( elements * sizeof( float ) );
+	b.offset = 0;
+	b.first = b.last = currentOp;
+	return id;
+}
+
+void DecoderMemoryPlan::use( uint32_t id )
+{
+	Buffer& b = buffers[ id ];
+	assert( b.last <= currentOp );
+	b.last = currentOp;
+}
+
+void DecoderMemoryPlan::build( const Whisper::sModelParams& mp, uint32_t n_tokens, uint32_t n_past, uint32_t M, uint32_t n_output )
+{
+	buffers.clear();
+	currentOp = 0;
+
+	// This method must match the sequence of tensor allocations in HybridContext::decode
+	// Tensors produced by copy() of dense FP32 tensors, and by permute(), are views of their source, they don't allocate memory
+	const size_t N = n_tokens;
+	const size_t n_state = (uint32_t)mp.n_text_state;
+	const size_t n_head = (uint32_t)mp.n_text_head;
+	const size_t n_mlp = n_state * 4;
+	const size_t n_kv = n_past + n_tokens;
+
+	// addRows
+	uint32_t inpL = alloc( n_state * N );
+	// normAffine of the first layer
+	uint32_t cur = alloc( n_state * N );
+	use( inpL );
+
+	for( int il = 0; il < mp.n_text_layer; il++ )
+	{
+		// Self-attention: Q, K and V projections
+		const uint32_t Qcur = alloc( n_state * N );
+		use( cur );
+		const uint32_t Kcur = alloc( n_state * N );
+		use( cur );
+		const uint32_t Vcur = alloc( n_state * N );
+		use( cur );
+		// Store K and V into memory_k / memory_v
+		op();
+		use( Kcur );
+		use( Vcur );
+
+		uint32_t KQ = alloc( n_kv * N * n_head );
+		use( Qcur );
+		uint32_t KQV = alloc( n_state * N );
+		use( KQ );
+		// copyInPlace into cur
+		op();
+		use( KQV );
+		use( cur );
+
+		// Projection, the epilogue of mulMat adds the residual
+		const uint32_t inpCA = alloc( n_state * N );
+		use( cur );
+		use( inpL );
+		cur = alloc( n_state * N );
+		use( inpCA );
+
+		// Cross-attention
+		const uint32_t Qcross = alloc( n_state * N );
+		use( cur );
+		KQ = alloc( (size_t)M * N * n_head );
+		use( Qcross );
+		KQV = alloc( n_state * N );
+		use( KQ );
+		op();
+		use( KQV );
+		use( cur );
+
+		// Projection with the residual, then normAffine
+		const uint32_t inpFF = alloc( n_state * N );
+		use( cur );
+		use( inpCA );
+		cur = alloc( n_state * N );
+		use( inpFF );
+
+		// Feed-forward network
+		const uint32_t mlp = alloc( n_mlp * N );
+		use( cur );
+		const uint32_t output = alloc( n_state * N );
+		use( mlp );
+		use( inpFF );
+
+		// normAffine makes the input for the next layer, or the final norm after the last one
+		cur = alloc( n_state * N );
+		use( output );
+		inpL = output;
+	}
+
+	// logits, only for the last n_output rows; the slice of the final norm is a view
+	assert( n_output > 0 && n_output <= n_tokens );
+	const uint32_t logits = alloc( (size_t)(uint32_t)mp.n_vocab * n_output );
+	use( cur );
+	// softMax, and the copy into the output vector
+	op();
+	use( logits );
+
+	assignOffsets();
+}
+
+void DecoderMemoryPlan::assignOffsets()
+{
+	// Greedy by size: place larger tensors first, each one at the lowest offset which doesn't overlap with already placed tensors alive at the same time.
+	// Known to be within a few percent of optimal for the transformer graphs, which mostly consist of many equally-sized tensors.
+	std::vector<uint32_t> order( buffers.size() );
+	for( uint32_t i = 0; i < (uint32_t)order.size(); i++ )
+		order[ i ] = i;
+	std::stable_sort( order.begin(), order.end(), [ this ]( uint32_t a, uint32_t b ) { return buffers[ a ].cb > buffers[ b ].cb; } );
+
+	std::vector<uint32_t> placed;
+	placed.reserve( buffers.size() );
+	std::vector<std::pair<size_t, size_t>> busy;
+	arenaSize = 0;
+
+	for( uint32_t id : order )
+	{
+		Buffer& b = buffers[ id ];
+
+		// Collect memory ranges of the placed tensors which are alive at the same time as this one
+		busy.clear();
+		for( uint32_t p : placed )
+		{
+			const Buffer& e = buffers[ p ];
+			if( e.last < b.first || b.last < e.first )
+				continue;
+			busy.emplace_back( e.offset, e.offset + e.cb );
+		}
+		std::sort( busy.begin(), busy.end() );
+
+		// Find the first gap large enough
+		size_t offset = 0;
+		for( const auto& r : busy )
+		{
+			if( r.first >= offset + b.cb )
+				break;
+			offset = std::max( offset, r.second );
+		}
+
+		b.offset = offset;
+		arenaSize = std::max( arenaSize, offset + b.cb );
+		placed.push_back( id );
+	}
+}
+
+bool DecoderMemoryPlan::isValid() const
+{
+	for( size_t i = 0; i < buffers.size(); i++ )
+	{
+		const Buffer& a = buffers[ i ];
+		if( a.offset + a.cb > arenaSize || a.first > a.last )
+			return false;
+		for( size_t j = i + 1; j < buffers.size(); j++ )
+		{
+			const Buffer& b = buffers[ j ];
+			if( a.last < b.first || b.last < a.first )
+				continue;
+			if( a.offset < b.offset + b.cb && b.offset < a.offset + a.cb )
+				return false;
+		}
+	}
+	return true;
+}
+
+const DecoderMemoryPlan& DecoderMemoryPlan::Cache::get( const Whisper::sModelParams& mp, uint32_t n_tokens, uint32_t n_past, uint32_t M, uint32_t n_output )
+{
+	const uint32_t pastRounded = ( n_past + pastBucket - 1 ) / pastBucket * pastBucket;
+	for( size_t i = 0; i < entries.size(); i++ )
+	{
+		const Entry& e = entries[ i ];
+		if( e.n_tokens != n_tokens || e.n_past != pastRounded || e.M != M || e.n_output != n_output )
+			continue;
+		// Move to the back of the vector
+		std::rotate( entries.begin() + i, entries.begin() + i + 1, entries.end() );
+		return *entries.back().plan;
+	}
+
+	if( entries.size() >= maxEntries )
+		entries.erase( entries.begin() );
+	Entry& e = entries.emplace_back();
+	e.n_tokens = n_tokens;
+	e.n_past = pastRounded;
+	e.M = M;
+	e.n_output = n_output;
+	e.plan = std::make_unique<DecoderMemoryPlan>();
+	e.plan->build( mp, n_tokens, pastRounded, M, n_output );
+	return *e.plan;
+}
+
+size_t DecoderMemoryPlan::getTotalSize() const
+{
+	size_t res = 0;
+	for( const auto& b : buffers )
+		res += b.cb;
+	return res;
+}
+
+HRESULT DecoderMemoryPlan::Allocator::setPlan( const DecoderMemoryPlan& p )
+{
+	plan = &p;
+	nextBuffer = 0;
+	const size_t cb = p.getArenaSize();
+	if( cb <= capacity )
+		return S_OK;
+
+	CHECK( buffer.allocate( cb, numaNode ) );
+	capacity = cb;
+	return S_OK;
+}
+
+void DecoderMemoryPlan::Allocator::setNumaNode( int node )
+{
+	buffer.deallocate();
+	capacity = 0;
+	plan = nullptr;
+	nextBuffer = 0;
+	numaNode = node;
+}
+
+void* DecoderMemoryPlan::Allocator::allocate( size_t cb, size_t align )
+{
+	assert( align <= 32 );
+	if( nullptr == plan || nextBuffer >= plan->buffers.size() )
+	{
+		logError( u8"DecoderMemoryPlan.Allocator: more tensors than planned" );
+		throw E_UNEXPECTED;
+	}
+
+	const Buffer& b = plan->buffers[ nextBuffer ];
+	if( roundUpAlloc( cb ) > b.cb )
+	{
+		logError( u8"DecoderMemoryPlan.Allocator: tensor #%zu is %zu bytes, planned %zu", nextBuffer, cb, b.cb );
+		throw E_UNEXPECTED;
+	}
+	nextBuffer++;
+
+	uint8_t* const res = buffer.pointer() + b.offset;
+	CpuCompute::dbgMarkUninitializedMemory( res, b.cb );
+	return res;
+}
+
+void DecoderMemoryPlan::Allocator::resetArena()
+{
+	nextBuffer = 0;
+	if( capacity > 0 )
+		CpuCompute::dbgMarkFreedMemory( buffer.pointer(), capacity );
+}
+#endif
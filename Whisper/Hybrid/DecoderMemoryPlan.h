@@ -0,0 +1,102 @@
+#pragma once
+#include "../Whisper/sModelParams.h"
+#include "../CPU/Tensor.h"
+#include "../CPU/LargeBuffer.h"
+#include <memory>
+
+// Memory plan for the temporary tensors of HybridContext::decode method.
+// Replays the sequence of tensor allocations made by the decoder for the given shape of the model and batch,
+// computes the lifetime of every tensor, and assigns offsets in a single arena so the tensors which are never alive at the same time share memory.
+class DecoderMemoryPlan
+{
+	struct Buffer
+	{
+		// Size in bytes, rounded up to 32 bytes
+		size_t cb;
+		// Offset in the arena
+		size_t offset;
+		// Indices of the first and the last decoder operations which use the tensor, inclusive
+		uint32_t first, last;
+	};
+	std::vector<Buffer> buffers;
+	uint32_t currentOp = 0;
+	size_t arenaSize = 0;
+
+	// Record a new operation which produces a new tensor of the specified count of FP32 elements, return index of the tensor
+	uint32_t alloc( size_t elements );
+	// Mark the tensor as used by the current operation
+	void use( uint32_t id );
+	// Record a new operation which only reads or updates existing tensors
+	void op()
+	{
+		currentOp++;
+	}
+	void assignOffsets();
+
+public:
+	// Build the plan for decoding n_tokens tokens after n_past tokens, with M length of the encoded audio,
+	// computing the output for the last n_output of these tokens
+	void build( const Whisper::sModelParams& mp, uint32_t n_tokens, uint32_t n_past, uint32_t M, uint32_t n_output );
+
+	// Count of bytes in the arena
+	size_t getArenaSize() const { return arenaSize; }
+
+	// Count of bytes for all temporary tensors without the memory reuse
+	size_t getTotalSize() const;
+
+	size_t countBuffers() const { return buffers.size(); }
+
+	// True when every tensor is inside the arena, and the tensors alive at the same time don't overlap. Quadratic complexity, for tests.
+	bool isValid() const;
+
+	// The decoder runs with a few distinct shapes, while building a plan takes quadratic time in the count of tensors.
+	// This cache keeps the recently used plans. The key rounds n_past up to a multiple of pastBucket, the KQ tensors of the plan are slightly larger than the decoder needs.
+	class Cache
+	{
+		struct Entry
+		{
+			uint32_t n_tokens, n_past, M, n_output;
+			std::unique_ptr<DecoderMemoryPlan> plan;
+		};
+		// The most recently used entry is the last one
+		std::vector<Entry> entries;
+
+	public:
+		static constexpr uint32_t pastBucket = 64;
+		static constexpr size_t maxEntries = 16;
+
+		// Find or build the plan for the shape; the reference stays valid until maxEntries other shapes are requested
+		const DecoderMemoryPlan& get( const Whisper::sModelParams& mp, uint32_t n_tokens, uint32_t n_past, uint32_t M, uint32_t n_output );
+
+		size_t size() const { return entries.size(); }
+	};
+
+	// Arena allocator which follows the plan: the Nth call to allocate() returns pointer to the Nth tensor of the plan, which may be larger than requested.
+	// Throws E_UNEXPECTED when the decoder deviates from the plan.
+	class Allocator : public CpuCompute::iArenaAllocator
+	{
+		CpuCompute::LargeBuffer buffer;
+		size_t capacity = 0;
+		const DecoderMemoryPlan* plan = nullptr;
+		size_t nextBuffer = 0;
+		int numaNode = -1;
+
+		// Inherited via iArenaAllocator
+		virtual void* allocate( size_t cb, size_t align ) override final;
+
+	public:
+		virtual void resetArena() override final;
+
+		// Set the plan for the next decoder run, grow the arena if needed
+		HRESULT setPlan( const DecoderMemoryPlan& p );
+
+		// Release the arena; the next setPlan() call allocates a new one on the specified NUMA node
+		void setNumaNode( int node );
+
+		// True when all tensors of the plan were allocated
+		bool complete() const
+		{
+			return nullptr != plan && nextBuffer == plan->buffers.size();
+		}
+	};
+};
\ No newline at end of file
@@ -1,7 +1,7 @@
 #include "stdafx.h"
-#include <immintrin.h>
 #include <optional>
 #include "HybridContext.h"
+#include "../CPU/LargePages.h"
 #include "../Utils/Trace/tracing.h"
 
 #if BUILD_HYBRID_VERSION
@@ -33,87 +33,45 @@ HybridContext::HybridContext( const Whisper::WhisperModel& wm ) :
 	whisperModel( wm )
 { }
 
-namespace
+const DecoderMemoryPlan& HybridContext::initialPlan()
 {
-	enum struct eModelType : uint8_t
-	{
-		Tiny = 0,
-		Base = 1,
-		Small = 2,
-		Medium = 3,
-		Large = 4,
-	};
-
-	static HRESULT detectModelType( const Whisper::sModelParams& modelParams, eModelType& mt )
-	{
-		switch( modelParams.n_audio_layer )
-		{
-		case 4:
-			mt = eModelType::Tiny;
-			return S_OK;
-		case 6:
-			mt = eModelType::Base;
-			return S_OK;
-		case 12:
-			mt = eModelType::Small;
-			return S_OK;
-		case 24:
-			mt = eModelType::Medium;
-			return S_OK;
-		case 32:
-			mt = eModelType::Large;
-			return S_OK;
-		}
-		logError( u8"Unrecognized model" );
-		return E_INVALIDARG;
-	}
-
-	struct alignas( 2 ) RamMB
-	{
-		uint8_t dec, decLayer;
-		constexpr RamMB( uint8_t d, uint8_t dl ) : dec( d ), decLayer( dl ) { }
-
-		__m128i loadBytes() const
-		{
-			__m128i v = _mm_loadu_si16( this );
-			// Upcast bytes to int64_t. That instruction can load directly from memory, too bad VC++ optimized doesn't care
-			v = _mm_cvtepu8_epi64( v );
-			// Scale from megabytes into bytes, the multiplier is obviously 2^20
-			v = _mm_slli_epi64( v, 20 );
-			return v;
-		}
-	};
-
-	// The magic numbers are from MEM_REQ_DECODE and MEM_REQ_DECODE_LAYER red/black maps in the reference version,
-	// near the top of whisper.cpp source file
-	static const std::array<RamMB, 5> s_memRequirements =
-	{
-		RamMB{ 200, 32 },	// Tiny
-		RamMB{ 202, 44 },	// Base
-		RamMB{ 204, 64 },	// Small
-		RamMB{ 206, 84 },	// Medium
-		RamMB{ 208, 110 },	// Large
-	};
+	// The longest batch the decoder is going to see is the complete prompt, which is up to n_text_ctx/2 tokens
+	const auto& hparams = whisperModel.parameters;
+	const uint32_t n_max_batch = (uint32_t)hparams.n_text_ctx / 2;
+	return memoryPlans.get( hparams, n_max_batch, 0, (uint32_t)hparams.n_audio_ctx, 1 );
 }
 
 HRESULT HybridContext::create()
 {
-	// Allocate buffers for compute
-	// We know they're large, so bypassing the heap
-	eModelType modelType;
-	CHECK( detectModelType( whisperModel.parameters, modelType ) );
-
-	const __m128i bytes = s_memRequirements.at( (uint8_t)modelType ).loadBytes();
-	CHECK( allocCompute.create( _mm_cvtsi128_si64( bytes ) ) );
-	CHECK( allocComputeLayer.create( _mm_extract_epi64( bytes, 1 ) ) );
+	// Allocate the arena for compute, the arena grows in decode() if needed
+	const DecoderMemoryPlan& plan = initialPlan();
+	CHECK( allocCompute.setPlan( plan ) );
+	logDebug( u8"HybridContext: compute arena %zu MB, %zu MB without memory reuse",
+		plan.getArenaSize() / MB, plan.getTotalSize() / MB );
 
 	// Create staging buffers to download output from encoder stage,
 	// in the reference version they're named memory_cross_k / memory_cross_v
 	CHECK( kvCross.create( whisperModel.parameters ) );
 
-	// Create RAM buffers for memory_k / memory_v
-	CHECK( kv.create( whisperModel.parameters ) );
+	// memory_k / memory_v are in the blocks of the pool shared by all contexts of the model, the blocks are allocated as needed
+	CHECK( kv.create( whisperModel.parameters, whisperModel.kvPool ) );
+	logDebug( u8"HybridContext: KV cache blocks of %u tokens, %zu kb each",
+		CpuCompute::KvBlockPool::blockTokens, whisperModel.kvPool->blockBytes() >> 10 );
 
+	const CpuCompute::sMemoryPagesCounters pages = CpuCompute::getMemoryPagesCounters();
+	logDebug( u8"HybridContext: CPU memory %zu MB in large pages, %zu MB in normal pages, %zu allocations failed to get large pages",
+		(size_t)pages.largePages / MB, (size_t)pages.smallPages / MB, (size_t)pages.largePageFailures );
+
+	return S_OK;
+}
+
+HRESULT HybridContext::setNumaNode( int node )
+{
+	CHECK( ml.setNumaNode( node ) );
+	allocCompute.setNumaNode( node );
+	CHECK( allocCompute.setPlan( initialPlan() ) );
+	// This discards the content of memory_k / memory_v
+	kv.setNumaNode( node );
 	return S_OK;
 }
 
@@ -137,8 +95,10 @@ public:
 	}
 };
 
-HRESULT HybridContext::decode( const int* tokens, const int n_tokens, const int n_past, const sDecParams& dp, std::vector<float>& probs )
+HRESULT HybridContext::decode( const int* tokens, const int n_tokens, const int n_past, const sDecParams& dp, std::vector<float>& probs,
+	std::vector<Whisper::sLogitsSummary>* summaries )
 {
+	using namespace CpuCompute;
 	CHECK( ml.setThreadsCount( dp.n_threads ) );
 
 	// whisper_decode
@@ -152,96 +112,79 @@ HRESULT HybridContext::decode( const int* tokens, const int n_tokens, const int
 
 	const uint32_t N = n_tokens;
 	const uint32_t M = dp.M;
+	const uint32_t n_output = ( dp.n_output > 0 ) ? std::min( (uint32_t)dp.n_output, N ) : N;
+
+	CHECK( allocCompute.setPlan( memoryPlans.get( hparams, N, (uint32_t)n_past, M, n_output ) ) );
+
+	// Make sure the KV cache has the blocks for all the tokens
+	const uint32_t n_kv = (uint32_t)n_past + N;
+	if( n_kv > n_ctx )
+		return E_BOUNDS;
+	CHECK( kv.reserve( n_kv ) );
 
 	SetAllocatorRaii ac{ this, allocCompute };
-	using namespace CpuCompute;
 	Tensor cur = ml.addRows( model.tokenEmbedding, model.positionalEmbedding, tokens, n_tokens, n_past );
 	Tracing::tensor( "dec-rows", cur );
 
 	Tensor inpL = cur;
+	Tracing::tensor( "dec-inpL", inpL );
 	auto kvCross = this->kvCross.map();
 
+	// norm of the first layer; for other layers, the norm is at the end of the previous layer
+	cur = ml.normAffine( inpL, model.layers[ 0 ].attnLn0 );
+	Tracing::tensor( "dec-norm", cur );
+
 	for( uint32_t il = 0; il < n_layer; il++ )
 	{
-		if( 0 == il ) Tracing::tensor( "dec-inpL", inpL );
 		const auto& layer = model.layers[ il ];
-		SetAllocatorRaii acLayer{ this, allocComputeLayer };
-
-		// norm
-		Tensor cur = ml.norm( inpL );
-		ml.fmaRepeat( cur, layer.attnLn0 );
-		if( 0 == il ) Tracing::tensor( "dec-norm", cur );
 
 		// self-attention
 		{
-			Tensor Qcur = ml.mulMat( layer.attnQuery.w, cur );
-			if( 0 == il ) Tracing::tensor( "dec-Qcur-0", Qcur );
+			// The bias and scale are applied by the epilogue of mulMat()
 			const float scaling = (float)pow( float( (int)n_state ) / (int)n_head, -0.25 );
-			ml.addRepeatScale( Qcur, layer.attnQuery.b, scaling );
+			Tensor Qcur = ml.mulMat( layer.attnQuery.w, cur, { .bias = &layer.attnQuery.b, .scale = scaling } );
 			if( 0 == il ) Tracing::tensor( "dec-Qcur-1", Qcur );
 
 			// note: no bias for Key
-			Tensor Kcur = ml.mulMat( layer.attnKey, cur );
-			ml.scale( Kcur, scaling );
+			Tensor Kcur = ml.mulMat( layer.attnKey, cur, { .scale = scaling } );
 			if( 0 == il ) Tracing::tensor( "dec-Kcur", Kcur );
 
-			Tensor Vcur = ml.mulMat( layer.attnValue.w, cur );
-			ml.addRepeat( Vcur, layer.attnValue.b );
+			Tensor Vcur = ml.mulMat( layer.attnValue.w, cur, { .bias = &layer.attnValue.b } );
 			if( 0 == il ) Tracing::tensor( "dec-Vcur", Vcur );
 
 			// store key and value to memory
-			{
-				const uint32_t len = N * n_state;
-				const uint32_t off = n_state * ( (uint32_t)il * n_ctx + n_past );
-				Tensor k = kv.keysView( len, off );
-				Tensor v = kv.valuesView( len, off );
-
-				CHECK( ml.copyImpl( k, Kcur ) );
-				CHECK( ml.copyImpl( v, Vcur ) );
-			}
+			kv.store( il, (uint32_t)n_past, N, Kcur.fp32(), Vcur.fp32() );
 
 			// ------
-			Tensor Q = ml.permute( ml.copy( Qcur, eDataType::FP32, { n_state / n_head, n_head, N } ), 0, 2, 1, 3 );
-			Tensor K = ml.permute( kv.keysView( ( n_past + N ) * n_state, (uint32_t)il * n_ctx * n_state )
-				.reshape3d( n_state / n_head, n_head, n_past + N ),
-				0, 2, 1, 3 );
-			Tensor KQ = ml.mulMat( K, Q );
+			// The keys and values are in the blocks of the KV cache, both products walk the block table on the compute threads of a single parallelFor
+			const uint32_t n_head_state = n_state / n_head;
+			Tensor Q = ml.permute( ml.copy( Qcur, eDataType::FP32, { n_head_state, n_head, N } ), 0, 2, 1, 3 );
+			Tensor KQ = ml.createTensor( eDataType::FP32, { n_kv, N, n_head } );
+			ml.attentionScores( KQ, Q, kv, il );
 			if( 0 == il ) Tracing::tensor( "dec-KQ-0", KQ );
 			ml.diagMaskInf( KQ, n_past );
 			if( 0 == il ) Tracing::tensor( "dec-KQ-1", KQ );
 			ml.softMax( KQ );
 			if( 0 == il ) Tracing::tensor( "dec-KQ-2", KQ );
 
-			Tensor V_trans = ml.permute(
-				kv.valuesView( ( n_past + N ) * n_state, (uint32_t)il * n_ctx * n_state )
-				.reshape3d( n_state / n_head, n_head, n_past + N ),
-				1, 2, 0, 3 );
-
-			Tensor KQV = ml.mulMat( V_trans, KQ );
+			Tensor KQV = ml.createTensor( eDataType::FP32, { n_head_state, N, n_head } );
+			ml.attentionValues( KQV, KQ, kv, il );
 			if( 0 == il ) Tracing::tensor( "dec-KQV", KQV );
 
 			Tensor KQV_merged = ml.permute( KQV, 0, 2, 1, 3 );
 			ml.copyInPlace( cur, KQV_merged, eDataType::FP32, { n_state, N } );
 		}
 
-		{
-			cur = ml.mulMat( layer.attnLn1.w, cur );
-			ml.addRepeat( cur, layer.attnLn1.b );
-		}
-
-		// add the input
-		Tensor inpCA = ml.add( cur, inpL );
+		// projection, and add the input
+		Tensor inpCA = ml.mulMat( layer.attnLn1.w, cur, { .bias = &layer.attnLn1.b, .residual = &inpL } );
 
 		// norm
-		{
-			cur = ml.norm( inpCA );
-			ml.fmaRepeat( cur, layer.crossAttnLn0 );
-		}
+		cur = ml.normAffine( inpCA, layer.crossAttnLn0 );
 
 		// cross-attention
 		{
-			Tensor Qcur = ml.mulMat( layer.crossAttnQuery.w, cur );
-			ml.addRepeatScale( Qcur, layer.crossAttnQuery.b, (float)pow( float( (int)n_state ) / (int)n_head, -0.25 ) );
+			const float scaling = (float)pow( float( (int)n_state ) / (int)n_head, -0.25 );
+			Tensor Qcur = ml.mulMat( layer.crossAttnQuery.w, cur, { .bias = &layer.crossAttnQuery.b, .scale = scaling } );
 
 			// Kcross is already scaled
 			const uint32_t len = M * n_state;
@@ -262,88 +205,56 @@ HRESULT HybridContext::decode( const int* tokens, const int n_tokens, const int
 			ml.copyInPlace( cur, KQV_merged, eDataType::FP32, { n_state, N } );
 		}
 
-		// projection
-		{
-			cur = ml.mulMat( layer.crossAttnLn1.w, cur );
-			ml.addRepeat( cur, layer.crossAttnLn1.b );
-		}
-		// add the input
-		ml.addInPlace( cur, inpCA );
-		Tensor inpFF = cur;
+		// projection, and add the input
+		Tensor inpFF = ml.mulMat( layer.crossAttnLn1.w, cur, { .bias = &layer.crossAttnLn1.b, .residual = &inpCA } );
 
 		// feed-forward network
 		{
 			// norm
-			cur = ml.norm( inpFF );
-			ml.fmaRepeat( cur, layer.mlpLn );
+			cur = ml.normAffine( inpFF, layer.mlpLn );
 
-			cur = ml.mulMat( layer.mlp0.w, cur );
-			ml.addRepeatGelu( cur, layer.mlp0.b );
+			// The 4*n_state activation is only written once, after the bias and GELU
+			cur = ml.mulMat( layer.mlp0.w, cur, { .bias = &layer.mlp0.b, .gelu = true } );
 
-			// The mulMat() below creates a tensor for the output of this layer.
-			// We have a special memory storage for these tensors, that's how they survive resets of per-layer arenas
-			allocLayerOutput.resetArena();
-			ml.setAllocator( &allocLayerOutput );
-
-			// projection
-			cur = ml.mulMat( layer.mlp1.w, cur );
-			ml.addRepeat( cur, layer.mlp1.b );
+			// projection, and add the input; that's the output from this layer
+			inpL = ml.mulMat( layer.mlp1.w, cur, { .bias = &layer.mlp1.b, .residual = &inpFF } );
 		}
 
-		// output from this layer
-		ml.addInPlace( cur, inpFF );
-		inpL = cur;
+		// norm for the next layer; after the last layer, that's the final norm of the decoder
+		const TensorPair& ln = ( il + 1 < n_layer ) ? model.layers[ il + 1 ].attnLn0 : model.ln;
+		cur = ml.normAffine( inpL, ln );
 	}
 
-	// norm
-	cur = ml.norm( inpL );
-	ml.fmaRepeat( cur, model.ln );
+	// The caller only needs the output for the last n_output tokens, usually just one;
+	// the rows of the final norm are continuous, the slice is a view of the last rows
+	if( n_output != N )
+	{
+		Tensor last = cur;
+		last.ne[ 1 ] = n_output;
+		last.setDataPointer( (void*)( cur.fp32() + (size_t)( N - n_output ) * n_state ) );
+		cur = last;
+	}
+
+	if( nullptr != summaries )
+	{
+		// The reducer consumes the logits panel by panel while they're computed, without the softmax over the complete vocabulary
+		logitsReducer.prepare( (uint32_t)std::max( dp.n_threads, 1 ), n_output, (uint32_t)whisperModel.vocab.token_beg );
+		cur = ml.mulMat( model.tokenEmbedding, cur, { .reduce = &logitsReducer } );
+		assert( allocCompute.complete() );
+		logitsReducer.finish( *summaries );
+		probs.clear();
+		return S_OK;
+	}
 
 	cur = ml.mulMat( model.tokenEmbedding, cur );
 
 	// logits -> probs
 	ml.softMax( cur );
 
+	assert( allocCompute.complete() );
 	const float* rsi = cur.fp32();
 	probs.assign( rsi, rsi + cur.countElements() );
 	Tracing::vector( "probs", probs );
 	return S_OK;
 }
-
-void* HybridContext::AllocSingle::allocate( size_t cb, size_t align )
-{
-	if( !allocated )
-	{
-		allocated = true;
-		if( cb <= capacity )
-		{
-			CpuCompute::dbgMarkUninitializedMemory( buffer.pointer(), capacity );
-			return buffer.pointer();
-		}
-		else
-		{
-			HRESULT hr = buffer.allocate( cb );
-			if( SUCCEEDED( hr ) )
-			{
-				capacity = cb;
-				CpuCompute::dbgMarkUninitializedMemory( buffer.pointer(), capacity );
-				return buffer.pointer();
-			}
-			logErrorHr( hr, u8"HybridContext.AllocSingle.allocate" );
-			throw hr;
-		}
-	}
-	else
-	{
-		logError( u8"HybridContext.AllocSingle only supports 1 tensor" );
-		throw E_UNEXPECTED;
-	}
-}
-
-void HybridContext::AllocSingle::resetArena()
-{
-	allocated = false;
-	if( capacity > 0 )
-		CpuCompute::dbgMarkFreedMemory( buffer.pointer(), capacity );
-}
 #endif
\ No newline at end of file
@@ -1,33 +1,26 @@
 #pragma once
 #include "../Whisper/WhisperModel.h"
 #include "../CPU/MlContext.h"
-#include "../CPU/BufferAllocator.h"
 #include "KeyValueDownloader.h"
 #include "../CPU/KvTensors.h"
+#include "DecoderMemoryPlan.h"
+#include "../CPU/LogitsReducer.h"
 
 // This version of the hybrid context uses the new, custom-built kernels
 class HybridContext
 {
 	CpuCompute::MlContext ml;
-	CpuCompute::VirtualAllocator allocCompute, allocComputeLayer;
-	
-	class AllocSingle : public CpuCompute::iArenaAllocator
-	{
-		CpuCompute::LargeBuffer buffer;
-		size_t capacity = 0;
-		bool allocated = false;
-		// Inherited via iArenaAllocator
-		virtual void* allocate( size_t cb, size_t align ) override final;
-
-	public:
-		virtual void resetArena() override final;
-	};
-	AllocSingle allocLayerOutput;
+	// All temporary tensors of the decoder are in a single arena, at the offsets computed by the memory plans
+	DecoderMemoryPlan::Cache memoryPlans;
+	DecoderMemoryPlan::Allocator allocCompute;
+	// Plan for the longest batch, the complete prompt, used to allocate the arena upfront
+	const DecoderMemoryPlan& initialPlan();
 
 	const CpuCompute::DecoderTensors& model;
 	const Whisper::WhisperModel& whisperModel;
 	KeyValueDownloader kvCross;
 	CpuCompute::KvTensors kv;
+	CpuCompute::LogitsReducer logitsReducer;
 
 	class SetAllocatorRaii;
 
@@ -37,6 +30,16 @@ public:
 
 	HRESULT create();
 
+	// Bind the decoder threads to the specified NUMA node, and move the memory of this context to that node; -1 to use all nodes
+	// Only call this between transcriptions, it discards the self-attention keys and values
+	HRESULT setNumaNode( int node );
+
+	// Measure the individual operations of the decoder into the specified object, nullptr to disable
+	void setProfiler( CpuCompute::OpProfiler* profiler )
+	{
+		ml.setProfiler( profiler );
+	}
+
 	HRESULT downloadKeyValues( const DirectCompute::KeyValueBuffers& source )
 	{
 		return kvCross.download( source );
@@ -46,7 +49,12 @@ public:
 	{
 		int n_threads;
 		int M;
+		// Count of the last tokens to compute the output for, 0 to compute the output for all tokens
+		int n_output;
 	};
 
-	HRESULT decode( const int* tokens, const int n_tokens, const int n_past, const sDecParams& dp, std::vector<float>& probs_out );
+	// Produce the output for the last dp.n_output tokens: n_output rows of probs_out.
+	// When the summaries vector is not nullptr, the method only produces these summaries of the logits, one per output row, and leaves probs_out empty
+	HRESULT decode( const int* tokens, const int n_tokens, const int n_past, const sDecParams& dp, std::vector<float>& probs_out,
+		std::vector<Whisper::sLogitsSummary>* summaries = nullptr );
 };
\ No newline at end of file
@@ -27,6 +27,14 @@ HRESULT KeyValueDownloader::download( const DirectCompute::KeyValueBuffers& sour
 KeyValueDownloader::ReadMap::ReadMap( KeyValueDownloader& owner ) :
 	length( owner.length )
 {
+	auto gpuLock = DirectCompute::lockGpu();
 	check( mappedKeys.map( owner.keys, true ) );
 	check( mappedValues.map( owner.values, true ) );
+}
+
+KeyValueDownloader::ReadMap::~ReadMap()
+{
+	auto gpuLock = DirectCompute::lockGpu();
+	mappedValues.unmap();
+	mappedKeys.unmap();
 }
\ No newline at end of file
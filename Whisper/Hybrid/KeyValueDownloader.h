@@ -26,7 +26,7 @@ public:
 
 	public:
 		ReadMap( KeyValueDownloader& owner );
-		~ReadMap() = default;
+		~ReadMap();
 		ReadMap( const ReadMap& ) = delete;
 
 		// A slice of model.memory_k tensor
@@ -22,11 +22,11 @@ namespace
 
 	constexpr double GELU_COEF_A = 0.044715;
 	constexpr double SQRT_2_OVER_PI = 0.79788456080286535587989211986876;
+}
 
-	inline float computeGelu( float x )
-	{
-		return (float)( 0.5 * x * ( 1.0 + tanh( SQRT_2_OVER_PI * x * ( 1.0 + GELU_COEF_A * x * x ) ) ) );
-	}
+float DirectCompute::computeGelu( float x )
+{
+	return (float)( 0.5 * x * ( 1.0 + tanh( SQRT_2_OVER_PI * x * ( 1.0 + GELU_COEF_A * x * x ) ) ) );
 }
 
 LookupTablesData::LookupTablesData()
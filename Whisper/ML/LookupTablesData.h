@@ -11,4 +11,7 @@ namespace DirectCompute
 
 		LookupTablesData();
 	};
+
+	// Reference implementation of the GELU activation, computed in FP64 precision
+	float computeGelu( float x );
 }
\ No newline at end of file
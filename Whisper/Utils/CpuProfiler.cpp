@@ -35,6 +35,14 @@ namespace
 
 			return makeTime( tsc, freq );
 		}
+
+		inline double computeNanoseconds( int64_t tsc )
+		{
+			uint64_t freq = frequency;
+			if( freq == 0 )
+				freq = computeTscFrequency();
+			return (double)tsc * 1.0E9 / (double)(int64_t)freq;
+		}
 	};
 
 	uint64_t __declspec( noinline ) CpuTimescale::computeTscFrequency()
@@ -62,4 +70,9 @@ namespace
 uint64_t Whisper::ticksFromTsc( uint64_t tscDiff )
 {
 	return timescale.computeTicks( tscDiff );
+}
+
+double Whisper::nanosecondsFromTsc( int64_t tscDiff )
+{
+	return timescale.computeNanoseconds( tscDiff );
 }
\ No newline at end of file
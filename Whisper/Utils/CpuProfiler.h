@@ -12,6 +12,9 @@ namespace Whisper
 	// Scale the time interval from CPU time stamp counter clock into 100-nanosecond ticks, rounding to nearest
 	uint64_t ticksFromTsc( uint64_t tscDiff );
 
+	// Scale the time interval from CPU time stamp counter clock into nanoseconds
+	double nanosecondsFromTsc( int64_t tscDiff );
+
 	class CpuProfiler
 	{
 		const int64_t started = tscNow();
@@ -218,6 +218,7 @@ HRESULT GpuProfiler::create( size_t maxDepth )
 
 void GpuProfiler::blockStart( eProfilerBlock which )
 {
+	auto gpuLock = lockGpu();
 	BlockState* parentBlock;
 	if( stack.empty() )
 	{
@@ -245,6 +246,7 @@ void GpuProfiler::blockStart( eProfilerBlock which )
 
 void GpuProfiler::blockEnd()
 {
+	auto gpuLock = lockGpu();
 	assert( !stack.empty() );
 	BlockState* const bs = *stack.rbegin();
 	queries.submit( bs, eEvent::BlockEnd );
@@ -5,26 +5,80 @@
 #include "../D3D/shaderNames.h"
 using namespace Whisper;
 
+namespace
+{
+	using Lock = CComCritSecLock<CComAutoCriticalSection>;
+
+	// Slabs of the CPU measures for the current thread, for the last few profile collections the thread has used.
+	// A thread may alternate between several contexts, like the main and the draft model of the speculative decoding, or the contexts of the parallel transcription.
+	struct ThreadSlabCache
+	{
+		static constexpr size_t ways = 4;
+		std::array<uint64_t, ways> owners = {};
+		std::array<ProfileCollection::CpuMeasure*, ways> measures = {};
+		// The entry to replace on the next miss
+		size_t next = 0;
+	};
+	thread_local ThreadSlabCache ts_slabCache;
+
+	volatile int64_t s_lastInstanceId = 0;
+
+	constexpr size_t gpuBlockIndex( DirectCompute::eProfilerBlock which )
+	{
+		// The values of that enum are 0x1000, 0x2000, etc.
+		return ( (size_t)which >> 12 ) - 1;
+	}
+
+	static size_t countShaders()
+	{
+		size_t i = 0;
+		while( nullptr != DirectCompute::computeShaderName( (DirectCompute::eComputeShader)i ) )
+			i++;
+		return i;
+	}
+}
+
 ProfileCollection::Measure& ProfileCollection::measure( DirectCompute::eProfilerBlock which )
 {
-	uint32_t key = (uint16_t)which;
-	key |= 0x20000;
-	return measures[ key ];
+	const size_t i = gpuBlockIndex( which );
+	assert( i < countGpuBlocks );
+	return gpuBlocks[ i ];
 }
 
 ProfileCollection::Measure& ProfileCollection::measure( DirectCompute::eComputeShader which )
 {
-	uint32_t key = (uint16_t)which;
-	key |= 0x30000;
-	return measures[ key ];
+	const size_t i = (uint16_t)which;
+	assert( i < shaders.size() );
+	return shaders[ i ];
 }
 
-ProfileCollection::Measure& ProfileCollection::measure( eCpuBlock which )
+ProfileCollection::CpuMeasure& ProfileCollection::measure( eCpuBlock which )
 {
-	uint32_t key = (uint8_t)which;
-	key |= 0x10000;
-	CComCritSecLock<CComAutoCriticalSection> lock{ critSec };
-	return measures[ key ];
+	assert( (size_t)which < countCpuBlocks );
+	ThreadSlabCache& cache = ts_slabCache;
+	for( size_t i = 0; i < ThreadSlabCache::ways; i++ )
+		if( cache.owners[ i ] == instanceId )
+			return cache.measures[ i ][ (uint8_t)which ];
+
+	// The instance IDs are never reused, the entries of the destroyed collections are never matched and eventually replaced
+	const size_t i = cache.next;
+	cache.next = ( i + 1 ) % ThreadSlabCache::ways;
+	cache.measures[ i ] = threadSlab();
+	cache.owners[ i ] = instanceId;
+	return cache.measures[ i ][ (uint8_t)which ];
+}
+
+ProfileCollection::CpuMeasure* ProfileCollection::threadSlab()
+{
+	const DWORD tid = GetCurrentThreadId();
+	Lock lock{ critSec };
+	for( const auto& slab : cpuSlabs )
+		if( slab->threadId == tid )
+			return slab->blocks.data();
+
+	CpuSlab& slab = *cpuSlabs.emplace_back( std::make_unique<CpuSlab>() );
+	slab.threadId = tid;
+	return slab.blocks.data();
 }
 
 #if PROFILER_COLLECT_TAGS
@@ -33,33 +87,37 @@ ProfileCollection::Measure& ProfileCollection::measure( DirectCompute::eComputeS
 	uint32_t key = (uint8_t)which;
 	key = key << 16;
 	key |= tag;
-	CComCritSecLock<CComAutoCriticalSection> lock{ critSec };
+	Lock lock{ critSec };
 	return taggedShaders[ key ];
 }
 #endif
 
+const char* Whisper::cpuBlockName( eCpuBlock which )
+{
+	switch( which )
+	{
+#define V(x) case eCpuBlock::x: return #x
+		V( LoadModel );
+		V( Run );
+		V( Spectrogram );
+		V( Sample );
+		V( VAD );
+		V( Decode );
+		V( DecodeStep );
+		V( DecodeLayer );
+#undef V
+	}
+	assert( false );
+	return nullptr;
+}
+
 namespace
 {
 	using pfnPrintEnum = const char* ( * )( uint16_t val );
 
 	static const char* printCpuBlock( uint16_t id )
 	{
-		const eCpuBlock which = (eCpuBlock)id;
-		switch( which )
-		{
-#define V(x) case eCpuBlock::x: return #x
-			V( LoadModel );
-			V( Run );
-			V( Spectrogram );
-			V( Sample );
-			V( VAD );
-			V( Decode );
-			V( DecodeStep );
-			V( DecodeLayer );
-#undef V
-		}
-		assert( false );
-		return nullptr;
+		return cpuBlockName( (eCpuBlock)id );
 	}
 
 	static const char* printGpuBlock( uint16_t id )
@@ -191,27 +249,35 @@ void ProfileCollection::TaggedTemp::print() const
 
 void ProfileCollection::print()
 {
-	keysTemp.clear();
-	for( POSITION pos = measures.GetStartPosition(); nullptr != pos; )
-	{
-		auto* p = measures.GetNext( pos );
-		if( p->m_value.count == 0 )
-			continue;
-		keysTemp.push_back( p->m_key );
-	}
-
-	std::sort( keysTemp.begin(), keysTemp.end() );
-	auto it = std::lower_bound( keysTemp.begin(), keysTemp.end(), 0x30000u );
-	if( it != keysTemp.end() )
+	// Collect non-empty measures, keyed by type in the higher 16 bits, and the value of the enum in the lower ones
+	printTemp.clear();
 	{
-		auto lambda = [ this ]( uint32_t a, uint32_t b )
+		std::array<Measure, countCpuBlocks> cpu;
+		Lock lock{ critSec };
+		for( const auto& slab : cpuSlabs )
 		{
-			const uint64_t ta = measures.Lookup( a )->m_value.totalTicks;
-			const uint64_t tb = measures.Lookup( b )->m_value.totalTicks;
-			return ta > tb;
-		};
-		std::stable_sort( it, keysTemp.end(), lambda );
+			for( size_t i = 0; i < countCpuBlocks; i++ )
+			{
+				cpu[ i ].count += slab->blocks[ i ].count.load( std::memory_order_relaxed );
+				cpu[ i ].totalTicks += slab->blocks[ i ].totalTicks.load( std::memory_order_relaxed );
+			}
+		}
+		for( size_t i = 0; i < countCpuBlocks; i++ )
+			if( 0 != cpu[ i ].count )
+				printTemp.emplace_back( (uint32_t)( 0x10000 | i ), cpu[ i ] );
 	}
+	for( size_t i = 0; i < countGpuBlocks; i++ )
+		if( 0 != gpuBlocks[ i ].count )
+			printTemp.emplace_back( (uint32_t)( 0x20000 | ( ( i + 1 ) << 12 ) ), gpuBlocks[ i ] );
+	// Compute shaders are sorted by time, in descending order
+	const size_t shadersBegin = printTemp.size();
+	for( size_t i = 0; i < shaders.size(); i++ )
+		if( 0 != shaders[ i ].count )
+			printTemp.emplace_back( (uint32_t)( 0x30000 | i ), shaders[ i ] );
+	std::stable_sort( printTemp.begin() + shadersBegin, printTemp.end(), []( const auto& a, const auto& b )
+		{
+			return a.second.totalTicks > b.second.totalTicks;
+		} );
 
 #if PROFILER_COLLECT_TAGS
 	taggedKeysTemp.clear();
@@ -227,8 +293,9 @@ void ProfileCollection::print()
 
 	uint16_t prevKeyType = 0;
 	pfnPrintEnum pfn = nullptr;
-	for( uint32_t k : keysTemp )
+	for( const auto& e : printTemp )
 	{
+		const uint32_t k = e.first;
 		const uint16_t type = (uint16_t)( k >> 16 );
 		if( type != prevKeyType )
 		{
@@ -237,9 +304,8 @@ void ProfileCollection::print()
 		}
 		if( pfn == nullptr )
 			continue;
-		const auto* p = measures.Lookup( k );
-		assert( nullptr != p );
-		p->m_value.print( pfn( (uint16_t)k ) );
+		const Measure& measure = e.second;
+		measure.print( pfn( (uint16_t)k ) );
 
 #if PROFILER_COLLECT_TAGS
 		if( type == 3 )	
@@ -270,12 +336,12 @@ void ProfileCollection::print()
 					rdi.name = tagNames[ tagId ];
 				}
 
-				assert( totalCount <= p->m_value.count );
-				if( totalCount < p->m_value.count )
+				assert( totalCount <= measure.count );
+				if( totalCount < measure.count )
 				{
 					auto& rdi = taggedTimes.emplace_back();
-					rdi.ticks = p->m_value.totalTicks - totalTicks;
-					rdi.count = p->m_value.count - totalCount;
+					rdi.ticks = measure.totalTicks - totalTicks;
+					rdi.count = measure.count - totalCount;
 					rdi.name = tagNames[ 0 ];
 				}
 				std::stable_sort( taggedTimes.begin(), taggedTimes.end() );
@@ -285,16 +351,73 @@ void ProfileCollection::print()
 		}
 #endif
 	}
+
+	printCpuOps();
+}
+
+namespace
+{
+	static void printCpuOp( const CpuCompute::OpProfiler::Entry& e, bool shape )
+	{
+		using namespace CpuCompute;
+		const OpProfiler::Key& k = e.first;
+		const OpProfiler::Stats& s = e.second;
+
+		char name[ 96 ];
+		int cc;
+		if( 0 != k.variant )
+			cc = sprintf_s( name, "%s<%i,%i>", cpuOpName( k.op ), (int)( k.variant >> 4 ), (int)( k.variant & 0xF ) );
+		else
+			cc = sprintf_s( name, "%s", cpuOpName( k.op ) );
+		if( shape && cc > 0 )
+			sprintf_s( name + cc, std::size( name ) - cc, " [ %u, %u, %u, %u ]", k.shape[ 0 ], k.shape[ 1 ], k.shape[ 2 ], k.shape[ 3 ] );
+
+		const uint64_t ticks = ticksFromTsc( s.tsc );
+		const PrintedTime total{ ticks };
+		// FLOPs per 100 nanoseconds * 1E-2 = GFLOPs per second
+		const double mul = ( 0 != ticks ) ? 1.0E-2 / (double)(int64_t)ticks : 0.0;
+		logInfo( u8"%s\t%g %s, %zu calls, %g GFlops, %g GB/s", name, total.value, total.unit, s.count,
+			(double)(int64_t)s.flops * mul, (double)(int64_t)s.bytes * mul );
+	}
+}
+
+void ProfileCollection::printCpuOps()
+{
+	ops.getEntries( opsTemp, false );
+	if( opsTemp.empty() )
+		return;
+	logInfo( u8"    CPU Operations" );
+	for( const auto& e : opsTemp )
+		printCpuOp( e, false );
+
+	constexpr size_t maxShapes = 16;
+	ops.getEntries( opsTemp, true );
+	logInfo( u8"    CPU Operations, top %zu shapes", std::min( maxShapes, opsTemp.size() ) );
+	for( size_t i = 0; i < opsTemp.size() && i < maxShapes; i++ )
+		printCpuOp( opsTemp[ i ], true );
 }
 
 void ProfileCollection::reset()
 {
-	for( POSITION pos = measures.GetStartPosition(); nullptr != pos; )
-		measures.GetNextValue( pos ).reset();
+	{
+		Lock lock{ critSec };
+		for( const auto& slab : cpuSlabs )
+			for( CpuMeasure& m : slab->blocks )
+				m.reset();
+	}
+	for( Measure& m : gpuBlocks )
+		m.reset();
+	for( Measure& m : shaders )
+		m.reset();
+	ops.reset();
 }
 
-ProfileCollection::ProfileCollection( const WhisperModel& model )
+ProfileCollection::ProfileCollection( const WhisperModel& model ) :
+	instanceId( (uint64_t)InterlockedIncrement64( &s_lastInstanceId ) )
 {
+	static_assert( gpuBlockIndex( DirectCompute::eProfilerBlock::DecodeLayer ) + 1 == countGpuBlocks );
+	shaders.resize( countShaders() );
+
 	const __m128i vals = model.getLoadTimes();
 
 	uint64_t s = (uint64_t)_mm_cvtsi128_si64( vals );
@@ -1,6 +1,10 @@
 #pragma once
 #include <atlcoll.h>
+#include <memory>
+#include <atomic>
 #include "CpuProfiler.h"
+#include "Timeline.h"
+#include "../CPU/OpProfiler.h"
 
 namespace DirectCompute
 {
@@ -23,6 +27,8 @@ namespace Whisper
 		DecodeStep,
 		DecodeLayer,
 	};
+	constexpr size_t countCpuBlocks = (size_t)eCpuBlock::DecodeLayer + 1;
+	const char* cpuBlockName( eCpuBlock which );
 
 	class ProfileCollection
 	{
@@ -50,9 +56,29 @@ namespace Whisper
 			}
 		};
 
+		// The CPU blocks are measured by the thread which runs them, while print() and reset() can be called by another thread.
+		// The counters are atomic, the readers may see a measure which is being added, with the count already incremented and the time not yet.
+		struct CpuMeasure
+		{
+			std::atomic<size_t> count = 0;
+			std::atomic<uint64_t> totalTicks = 0;
+
+			void reset()
+			{
+				count.store( 0, std::memory_order_relaxed );
+				totalTicks.store( 0, std::memory_order_relaxed );
+			}
+
+			void add( uint64_t val )
+			{
+				count.fetch_add( 1, std::memory_order_relaxed );
+				totalTicks.fetch_add( val, std::memory_order_relaxed );
+			}
+		};
+
 		Measure& measure( DirectCompute::eProfilerBlock which );
 		Measure& measure( DirectCompute::eComputeShader which );
-		Measure& measure( eCpuBlock which );
+		CpuMeasure& measure( eCpuBlock which );
 #if PROFILER_COLLECT_TAGS
 		Measure& measure( DirectCompute::eComputeShader which, uint16_t tag );
 #endif
@@ -62,29 +88,61 @@ namespace Whisper
 
 		class CpuRaii
 		{
-			Measure& dest;
+			CpuMeasure& dest;
+			const char* const name;
 			const int64_t tsc;
 
 		public:
-			CpuRaii( Measure& m ) : dest( m ), tsc( tscNow() )
+			// When the name is not nullptr, the block is also recorded on the timeline
+			CpuRaii( CpuMeasure& m, const char* timelineName = nullptr ) : dest( m ), name( timelineName ), tsc( tscNow() )
 			{ }
 
 			~CpuRaii()
 			{
-				const int64_t elapsed = tscNow() - tsc;
-				dest.add( ticksFromTsc( elapsed ) );
+				const int64_t now = tscNow();
+				dest.add( ticksFromTsc( now - tsc ) );
+				if( nullptr != name )
+					Timeline::span( name, "cpu", tsc, now );
 			}
 		};
 
 		decltype( auto ) cpuBlock( eCpuBlock which )
 		{
-			return CpuRaii{ measure( which ) };
+			return CpuRaii{ measure( which ), cpuBlockName( which ) };
 		}
 
 		uint16_t makeTagId( const char* tag );
 
+		// Per-operation measures of the CPU decoder, only collected when PROFILER_CPU_OPS is enabled
+		CpuCompute::OpProfiler& cpuOps()
+		{
+			return ops;
+		}
+
 	private:
-		CAtlMap<uint32_t, Measure> measures;
+		CpuCompute::OpProfiler ops;
+		std::vector<CpuCompute::OpProfiler::Entry> opsTemp;
+		void printCpuOps();
+
+		// The CPU blocks are measured by multiple threads. Each thread has a private slab of these counters, found without locks through a thread-local cache.
+		// The slabs are only merged by print(), the CPU blocks are indexed by the enum.
+		struct alignas( 64 ) CpuSlab
+		{
+			std::array<CpuMeasure, countCpuBlocks> blocks;
+			DWORD threadId = 0;
+		};
+		std::vector<std::unique_ptr<CpuSlab>> cpuSlabs;
+		// Unique ID of this object, the entries of the thread-local cache are only valid for the object with that ID
+		const uint64_t instanceId;
+		// Slow path of measure( eCpuBlock ), find or create the slab of the calling thread
+		CpuMeasure* threadSlab();
+
+		// GPU measures are only updated by the thread which owns the context, they don't need slabs
+		static constexpr size_t countGpuBlocks = 7;
+		std::array<Measure, countGpuBlocks> gpuBlocks;
+		std::vector<Measure> shaders;
+
+		// Protects the list of the slabs
 		CComAutoCriticalSection critSec;
 #if PROFILER_COLLECT_TAGS
 		CAtlMap<const char*, uint16_t> tagIDs;
@@ -107,6 +165,6 @@ namespace Whisper
 		};
 		std::vector<TaggedTemp> taggedTimes;
 #endif
-		std::vector<uint32_t> keysTemp;
+		std::vector<std::pair<uint32_t, Measure>> printTemp;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,281 @@
+#include "stdafx.h"
+#include "Timeline.h"
+#include "../API/iContext.cl.h"
+#include <atlfile.h>
+#include <atlstr.h>
+#include <memory>
+
+volatile bool Timeline::details::s_enabled = false;
+
+namespace
+{
+	using Lock = CComCritSecLock<CComAutoCriticalSection>;
+
+	struct Event
+	{
+		const char* name;
+		const char* category;
+		int64_t begin, end;
+		int64_t arg;
+	};
+
+	// Ring buffer of a single thread
+	struct alignas( 64 ) ThreadBuffer
+	{
+		std::vector<Event> ring;
+		// Count of events recorded since the start, the last ring.size() of them are in the buffer
+		size_t written = 0;
+		DWORD threadId = 0;
+		// Non-zero while the owning thread is writing an event
+		volatile long busy = 0;
+		// The owning thread has exited. The events are kept until the recording is stopped, then the object is reused for another thread.
+		bool exited = false;
+	};
+
+	class Recorder
+	{
+		CComAutoCriticalSection critSec;
+		// Buffers of the running threads, and of the threads which exited while recording
+		std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+		// Buffers of the exited threads without the rings, reused by the new threads
+		std::vector<std::unique_ptr<ThreadBuffer>> spare;
+		uint32_t capacity = 0;
+		int64_t tscStart = 0;
+
+		HRESULT save( LPCTSTR path ) const;
+		// Move the buffers of the exited threads to the spare list, and release their rings
+		void recycleExited() noexcept;
+
+	public:
+		~Recorder();
+		ThreadBuffer* createBuffer() noexcept;
+		// Called when the thread which owns the buffer exits
+		void releaseBuffer( ThreadBuffer* tb ) noexcept;
+		HRESULT start( uint32_t eventsPerThread );
+		HRESULT stop( LPCTSTR path );
+	};
+
+	static Recorder s_recorder;
+	// Set by the destructor of the recorder, the threads which exit later don't touch the destroyed object
+	static bool s_recorderDestroyed = false;
+
+	// The buffer of the calling thread; the destructor runs when the thread exits
+	struct ThreadBufferRef
+	{
+		ThreadBuffer* buffer = nullptr;
+
+		~ThreadBufferRef()
+		{
+			if( nullptr != buffer && !s_recorderDestroyed )
+				s_recorder.releaseBuffer( buffer );
+		}
+	};
+	thread_local ThreadBufferRef ts_buffer;
+}
+
+Recorder::~Recorder()
+{
+	s_recorderDestroyed = true;
+}
+
+ThreadBuffer* Recorder::createBuffer() noexcept
+{
+	Lock lock{ critSec };
+	try
+	{
+		std::unique_ptr<ThreadBuffer> b;
+		if( !spare.empty() )
+		{
+			b = std::move( spare.back() );
+			spare.pop_back();
+		}
+		else
+			b = std::make_unique<ThreadBuffer>();
+
+		b->threadId = GetCurrentThreadId();
+		b->written = 0;
+		b->exited = false;
+		b->ring.resize( capacity );
+		return buffers.emplace_back( std::move( b ) ).get();
+	}
+	catch( const std::bad_alloc& )
+	{
+		return nullptr;
+	}
+}
+
+void Recorder::releaseBuffer( ThreadBuffer* tb ) noexcept
+{
+	Lock lock{ critSec };
+	tb->exited = true;
+	// While recording, keep the events of the thread until stop() saves them
+	if( !Timeline::details::s_enabled )
+		recycleExited();
+}
+
+void Recorder::recycleExited() noexcept
+{
+	for( size_t i = 0; i < buffers.size(); )
+	{
+		if( !buffers[ i ]->exited )
+		{
+			i++;
+			continue;
+		}
+		std::unique_ptr<ThreadBuffer> b = std::move( buffers[ i ] );
+		buffers.erase( buffers.begin() + i );
+		b->ring = std::vector<Event>{};
+		try
+		{
+			spare.push_back( std::move( b ) );
+		}
+		catch( const std::bad_alloc& )
+		{
+			// Unable to grow the spare list, the object is destroyed instead
+		}
+	}
+}
+
+void Timeline::details::record( const char* name, const char* category, int64_t tscBegin, int64_t tscEnd, int64_t arg ) noexcept
+{
+	ThreadBufferRef& ref = ts_buffer;
+	ThreadBuffer* tb = ref.buffer;
+	if( nullptr == tb )
+	{
+		tb = s_recorder.createBuffer();
+		if( nullptr == tb )
+			return;
+		ref.buffer = tb;
+	}
+
+	// The interlocked instruction is a full memory barrier, Recorder::stop() relies on that
+	_InterlockedExchange( &tb->busy, 1 );
+	if( s_enabled && !tb->ring.empty() )
+	{
+		Event& e = tb->ring[ tb->written % tb->ring.size() ];
+		e.name = name;
+		e.category = category;
+		e.begin = tscBegin;
+		e.end = tscEnd;
+		e.arg = arg;
+		tb->written++;
+	}
+	tb->busy = 0;
+}
+
+HRESULT Recorder::start( uint32_t eventsPerThread )
+{
+	Lock lock{ critSec };
+	if( Timeline::details::s_enabled )
+		return S_FALSE;
+
+	if( 0 == eventsPerThread )
+		eventsPerThread = 1u << 16;
+	try
+	{
+		// Not recording at the moment, the threads don't touch the rings.
+		// The events of the threads which exited during the previous recording are no longer needed.
+		recycleExited();
+		capacity = eventsPerThread;
+		for( auto& b : buffers )
+		{
+			b->ring.resize( capacity );
+			b->written = 0;
+		}
+	}
+	catch( const std::bad_alloc& )
+	{
+		return E_OUTOFMEMORY;
+	}
+
+	tscStart = Whisper::tscNow();
+	Timeline::details::s_enabled = true;
+	return S_OK;
+}
+
+HRESULT Recorder::stop( LPCTSTR path )
+{
+	Lock lock{ critSec };
+	if( !Timeline::details::s_enabled )
+		return S_FALSE;
+	Timeline::details::s_enabled = false;
+	MemoryBarrier();
+
+	// Wait for the threads which are writing events at the moment
+	for( const auto& b : buffers )
+		while( 0 != b->busy )
+			YieldProcessor();
+
+	if( nullptr == path )
+		return S_OK;
+	return save( path );
+}
+
+HRESULT Recorder::save( LPCTSTR path ) const
+{
+	CAtlFile file;
+	CHECK( file.Create( path, GENERIC_WRITE, 0, CREATE_ALWAYS ) );
+
+	const DWORD pid = GetCurrentProcessId();
+	CStringA text;
+	text = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+	text.AppendFormat( "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"Whisper\"}}", pid );
+
+	size_t countEvents = 0;
+	for( const auto& b : buffers )
+	{
+		const size_t size = b->ring.size();
+		if( 0 == size || 0 == b->written )
+			continue;
+		const size_t count = std::min( b->written, size );
+		if( count < b->written )
+			logWarning( u8"Timeline: thread %u lost %zu oldest events, increase the capacity of the ring buffers", b->threadId, b->written - count );
+
+		for( size_t i = b->written - count; i < b->written; i++ )
+		{
+			const Event& e = b->ring[ i % size ];
+			// Chrome trace timestamps are in microseconds, the fractional part keeps the nanoseconds
+			const double ts = Whisper::nanosecondsFromTsc( e.begin - tscStart ) * 1.0E-3;
+			const double dur = Whisper::nanosecondsFromTsc( e.end - e.begin ) * 1.0E-3;
+			text.AppendFormat( ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u",
+				e.name, e.category, ts, dur, pid, b->threadId );
+			if( e.arg >= 0 )
+				text.AppendFormat( ",\"args\":{\"value\":%lli}}", e.arg );
+			else
+				text += "}";
+
+			if( text.GetLength() >= ( 1 << 20 ) )
+			{
+				CHECK( file.Write( text.GetString(), (DWORD)text.GetLength() ) );
+				text.Empty();
+			}
+		}
+		countEvents += count;
+	}
+	text += "\n]}\n";
+	CHECK( file.Write( text.GetString(), (DWORD)text.GetLength() ) );
+	CHECK( file.Flush() );
+	logDebug( u8"Timeline: saved %zu events", countEvents );
+	return S_OK;
+}
+
+HRESULT Timeline::start( uint32_t eventsPerThread )
+{
+	return s_recorder.start( eventsPerThread );
+}
+
+HRESULT Timeline::stop( LPCTSTR path )
+{
+	return s_recorder.stop( path );
+}
+
+// DLL entry points
+HRESULT COMLIGHTCALL Whisper::timelineStart( uint32_t eventsPerThread )
+{
+	return Timeline::start( eventsPerThread );
+}
+
+HRESULT COMLIGHTCALL Whisper::timelineStop( const wchar_t* path )
+{
+	return Timeline::stop( path );
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#pragma once
+#include "CpuProfiler.h"
+
+// Opt-in recorder of CPU events for a timeline view of the transcription.
+// Each thread records complete events into a private ring buffer, the recorder saves them in Chrome trace JSON format, viewable in chrome://tracing or ui.perfetto.dev
+namespace Timeline
+{
+	namespace details
+	{
+		extern volatile bool s_enabled;
+		void record( const char* name, const char* category, int64_t tscBegin, int64_t tscEnd, int64_t arg ) noexcept;
+	}
+
+	// True while the timeline is being recorded
+	inline bool enabled()
+	{
+		return details::s_enabled;
+	}
+
+	// Start recording; each thread keeps up to eventsPerThread latest events, 0 for the default of 64k.
+	// Returns S_FALSE if the timeline was already being recorded.
+	HRESULT start( uint32_t eventsPerThread );
+
+	// Stop recording, and save the events into the file; when the path is nullptr, the events are discarded
+	HRESULT stop( LPCTSTR path );
+
+	// Record a complete event which ran on the calling thread. The strings aren't copied, they must be literals.
+	// The optional argument is shown in the details of the event, negative values are omitted.
+	inline void span( const char* name, const char* category, int64_t tscBegin, int64_t tscEnd, int64_t arg = -1 )
+	{
+		if( enabled() )
+			details::record( name, category, tscBegin, tscEnd, arg );
+	}
+
+	// RAII class to record a scope of code
+	class Span
+	{
+		const char* const name;
+		const char* const category;
+		const int64_t arg;
+		const int64_t tsc;
+
+	public:
+		Span( const char* n, const char* c, int64_t a = -1 ) :
+			name( n ), category( c ), arg( a ),
+			tsc( enabled() ? Whisper::tscNow() : 0 )
+		{ }
+		Span( const Span& ) = delete;
+
+		~Span()
+		{
+			if( 0 != tsc )
+				span( name, category, tsc, Whisper::tscNow(), arg );
+		}
+	};
+}
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "TraceStructures.h"
+#include <cmath>
 using namespace Tracing;
 
 uint64_t sTraceItem::buffer( uint64_t off, size_t length, eDataType type )
@@ -28,4 +29,67 @@ uint64_t sTraceItem::tensor( uint64_t off, __m128i ne, __m128i nb, eDataType typ
 	itemType = eItemType::Tensor;
 	dataType = type;
 	return payloadSize;
-}
\ No newline at end of file
+}
+
+namespace
+{
+	uint64_t hashPayload( const void* rsi, size_t cb )
+	{
+		constexpr uint64_t prime = 0x100000001B3ull;
+		uint64_t h = 0xCBF29CE484222325ull;
+		const uint8_t* p = (const uint8_t*)rsi;
+		const uint8_t* const pEndAligned = p + ( cb & ~(size_t)7 );
+		for( ; p < pEndAligned; p += 8 )
+			h = ( h ^ *(const uint64_t*)p ) * prime;
+
+		const size_t rem = cb % 8;
+		if( 0 != rem )
+		{
+			uint64_t last = 0;
+			memcpy( &last, p, rem );
+			h = ( h ^ last ) * prime;
+		}
+		return h;
+	}
+}
+
+void sTensorStats::compute( const void* rsi, size_t length, eDataType type )
+{
+	const size_t cb = length * DirectCompute::elementSize( type );
+	hash = ( nullptr != rsi ) ? hashPayload( rsi, cb ) : 0;
+	zzPadding = 0;
+	countNonFinite = 0;
+
+	double sum = 0, sumSquares = 0;
+	float lo = INFINITY, hi = -INFINITY;
+	size_t countFinite = 0;
+	if( nullptr != rsi && type != eDataType::U32 )
+	{
+		const float* rsi32 = (const float*)rsi;
+		const uint16_t* rsi16 = (const uint16_t*)rsi;
+		for( size_t i = 0; i < length; i++ )
+		{
+			const float f = ( type == eDataType::FP32 ) ? rsi32[ i ] : _cvtsh_ss( rsi16[ i ] );
+			if( !std::isfinite( f ) )
+			{
+				countNonFinite++;
+				continue;
+			}
+			lo = std::min( lo, f );
+			hi = std::max( hi, f );
+			sum += f;
+			sumSquares += (double)f * f;
+			countFinite++;
+		}
+	}
+
+	if( 0 != countFinite )
+	{
+		min = lo;
+		max = hi;
+		mean = (float)( sum / (double)countFinite );
+	}
+	else
+		min = max = mean = 0;
+	l2 = (float)std::sqrt( sumSquares );
+}
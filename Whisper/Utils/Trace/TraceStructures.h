@@ -13,8 +13,10 @@ namespace Tracing
 		static constexpr uint32_t correctMagic = 0xE6B4A12Du;	// random.org
 
 		uint32_t magic;
+		// 0 = the original format, 1 = the flags field, and the statistics of the items
 		uint8_t formatVersion;
-		uint8_t zzPadding;
+		// A combination of eFileFlags values, zero in version 0 files
+		uint8_t flags;
 		uint16_t cbItem;
 		uint32_t countItems;
 		uint32_t zzPadding2;
@@ -28,6 +30,27 @@ namespace Tracing
 	// The format is weird because optimized for streaming.
 	// These traces can grow large, we can’t afford memory keeping the payload data in memory.
 	// Metadata is tiny compared to payload, we accumulate that in memory, and write to the end of the file when closed.
+	// In version 1, the items are followed by countItems sTensorStats structures.
+
+	enum struct eFileFlags : uint8_t
+	{
+		None = 0,
+		// The payload is a sequence of compressed blocks, each one starts with sCompressedBlock header.
+		// Offsets in sTraceItem are in the decompressed payload; bytesPayload in the header is the size of these blocks in the file.
+		Compressed = 1,
+		// The file has no payload at all, only the statistics of the items
+		StatisticsOnly = 2,
+	};
+
+	struct sCompressedBlock
+	{
+		// When equal to cbOriginal, the block is stored without compression
+		uint32_t cbCompressed;
+		uint32_t cbOriginal;
+	};
+
+	// Compression algorithm of the blocks, a parameter for CreateCompressor / CreateDecompressor Windows APIs
+	constexpr uint32_t compressionAlgorithm = 3;	// COMPRESS_ALGORITHM_XPRESS
 
 	enum struct eItemType : uint8_t
 	{
@@ -52,4 +75,19 @@ namespace Tracing
 
 		uint64_t tensor( uint64_t off, __m128i ne, __m128i nb, eDataType type );
 	};
+
+	// Statistics of a trace item, computed in FP32 precision from the payload
+	struct sTensorStats
+	{
+		float min, max, mean;
+		// sqrt( sum of squares )
+		float l2;
+		// Count of NaN and infinite elements, they're excluded from the statistics above
+		uint32_t countNonFinite;
+		uint32_t zzPadding;
+		// 64-bit FNV-1a hash of the payload, over 8-byte words, the incomplete last word is padded with zeros
+		uint64_t hash;
+
+		void compute( const void* rsi, size_t length, eDataType type );
+	};
 }
\ No newline at end of file
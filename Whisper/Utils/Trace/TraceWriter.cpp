@@ -7,6 +7,9 @@
 #include "../../ML/Tensor.h"
 #include "../../CPU/Tensor.h"
 #include <Shlobj.h>
+#include <compressapi.h>
+#include <deque>
+#pragma comment( lib, "Cabinet.lib" )
 using namespace Tracing;
 
 namespace
@@ -27,6 +30,170 @@ namespace
 		return HRESULT_FROM_WIN32( status );
 	}
 
+	using Lock = CComCritSecLock<CComAutoCriticalSection>;
+
+	// Compresses the payload in blocks, and writes the blocks into the file on a background thread
+	class PayloadCompressor
+	{
+		static constexpr size_t blockSize = 4 << 20;
+		// Maximum count of the blocks waiting for the background thread, limits the memory when the compression is slower than the model
+		static constexpr size_t maxQueue = 8;
+
+		CAtlFile& file;
+		COMPRESSOR_HANDLE compressor = nullptr;
+		std::vector<uint8_t> current;
+
+		CComAutoCriticalSection critSec;
+		CONDITION_VARIABLE wakeWriter, wakeProducer;
+		std::deque<std::vector<uint8_t>> queue;
+		bool shuttingDown = false;
+		HRESULT status = S_OK;
+		CHandle thread;
+
+		// Only accessed by the background thread
+		uint64_t bytesWritten = 0;
+
+		static DWORD __stdcall threadProcStatic( void* lpParameter )
+		{
+			PayloadCompressor* pc = (PayloadCompressor*)lpParameter;
+			return (DWORD)pc->threadMain();
+		}
+
+		HRESULT threadMain()
+		{
+			std::vector<uint8_t> block, temp;
+			while( true )
+			{
+				{
+					Lock lock{ critSec };
+					while( queue.empty() && !shuttingDown )
+						SleepConditionVariableCS( &wakeWriter, &critSec.m_sec, INFINITE );
+					if( queue.empty() )
+						return S_OK;
+					block.swap( queue.front() );
+					queue.pop_front();
+				}
+				WakeConditionVariable( &wakeProducer );
+
+				const HRESULT hr = writeBlock( block, temp );
+				if( FAILED( hr ) )
+				{
+					{
+						Lock lock{ critSec };
+						status = hr;
+					}
+					WakeConditionVariable( &wakeProducer );
+					return hr;
+				}
+			}
+		}
+
+		HRESULT writeBlock( const std::vector<uint8_t>& block, std::vector<uint8_t>& temp )
+		{
+			sCompressedBlock header;
+			header.cbOriginal = (uint32_t)block.size();
+			const uint8_t* payload = block.data();
+
+			// When the data is incompressible, the output buffer is too small, and the API fails; these blocks are stored as is
+			temp.resize( block.size() );
+			SIZE_T cbCompressed = 0;
+			if( Compress( compressor, block.data(), block.size(), temp.data(), temp.size(), &cbCompressed ) && cbCompressed < block.size() )
+			{
+				header.cbCompressed = (uint32_t)cbCompressed;
+				payload = temp.data();
+			}
+			else
+				header.cbCompressed = header.cbOriginal;
+
+			CHECK( file.Write( &header, sizeof( header ) ) );
+			CHECK( file.Write( payload, header.cbCompressed ) );
+			bytesWritten += sizeof( header ) + header.cbCompressed;
+			return S_OK;
+		}
+
+		HRESULT enqueue()
+		{
+			{
+				Lock lock{ critSec };
+				while( queue.size() >= maxQueue && SUCCEEDED( status ) )
+					SleepConditionVariableCS( &wakeProducer, &critSec.m_sec, INFINITE );
+				CHECK( status );
+				queue.emplace_back( std::move( current ) );
+			}
+			WakeConditionVariable( &wakeWriter );
+			current = std::vector<uint8_t>{};
+			current.reserve( blockSize );
+			return S_OK;
+		}
+
+		void stopThread()
+		{
+			if( !thread )
+				return;
+			{
+				Lock lock{ critSec };
+				shuttingDown = true;
+			}
+			WakeConditionVariable( &wakeWriter );
+			WaitForSingleObject( thread, INFINITE );
+			thread.Close();
+		}
+
+	public:
+		PayloadCompressor( CAtlFile& f ) :
+			file( f )
+		{
+			InitializeConditionVariable( &wakeWriter );
+			InitializeConditionVariable( &wakeProducer );
+		}
+		PayloadCompressor( const PayloadCompressor& ) = delete;
+
+		~PayloadCompressor()
+		{
+			stopThread();
+			if( nullptr != compressor )
+				CloseCompressor( compressor );
+		}
+
+		HRESULT create()
+		{
+			if( !CreateCompressor( compressionAlgorithm, nullptr, &compressor ) )
+				return getLastHr();
+			current.reserve( blockSize );
+			const HANDLE h = CreateThread( nullptr, 0, &threadProcStatic, this, 0, nullptr );
+			if( nullptr == h )
+				return getLastHr();
+			thread.Attach( h );
+			return S_OK;
+		}
+
+		HRESULT write( const void* rsi, size_t cb )
+		{
+			const uint8_t* source = (const uint8_t*)rsi;
+			while( cb > 0 )
+			{
+				const size_t chunk = std::min( cb, blockSize - current.size() );
+				current.insert( current.end(), source, source + chunk );
+				source += chunk;
+				cb -= chunk;
+				if( current.size() >= blockSize )
+					CHECK( enqueue() );
+			}
+			return S_OK;
+		}
+
+		// Compress the incomplete block, and wait for the background thread to write everything into the file
+		HRESULT close( uint64_t& cbFile )
+		{
+			if( !current.empty() )
+				CHECK( enqueue() );
+			stopThread();
+			CHECK( status );
+			cbFile = bytesWritten;
+			return S_OK;
+		}
+	};
+
 	class TraceFileWriter
 	{
 		CAtlFile file;
@@ -61,12 +228,46 @@ namespace
 		}
 
 		std::vector<sTraceItem> items;
+		std::vector<sTensorStats> stats;
 		uint64_t offset = 0;
 
+		sTraceOptions options;
+		std::vector<CStringA> namePrefixes;
+		std::unique_ptr<PayloadCompressor> compressor;
+
+		HRESULT writePayload( const void* rsi, uint64_t cb )
+		{
+			if( options.statisticsOnly )
+				return S_FALSE;
+			assert( cb <= UINT_MAX );
+			if( compressor )
+			{
+				CHECK( compressor->write( rsi, (size_t)cb ) );
+			}
+			else
+				CHECK( file.Write( rsi, (DWORD)cb ) );
+			offset += cb;
+			return S_OK;
+		}
+
 	public:
 
-		HRESULT create( LPCTSTR path )
+		HRESULT create( LPCTSTR path, const sTraceOptions& traceOptions )
 		{
+			options = traceOptions;
+			if( nullptr != options.names )
+			{
+				CStringA names{ options.names };
+				int pos = 0;
+				while( pos >= 0 )
+				{
+					CStringA token = names.Tokenize( ";", pos );
+					token.Trim();
+					if( !token.IsEmpty() )
+						namePrefixes.push_back( token );
+				}
+			}
+
 			CHECK( createDir( path ) );
 			CHECK( file.Create( path, GENERIC_WRITE, 0, CREATE_ALWAYS ) );
 
@@ -75,28 +276,48 @@ namespace
 			CHECK( file.Seek( 0, SEEK_END ) );
 			offset = 0;
 
+			if( options.compress && !options.statisticsOnly )
+			{
+				compressor = std::make_unique<PayloadCompressor>( file );
+				CHECK( compressor->create() );
+			}
 			return S_OK;
 		}
 
+		// True when the options exclude the item with that name
+		bool skip( const ItemName& name ) const
+		{
+			if( name.countArgs > 0 && ( name.args[ 0 ] < options.layerBegin || name.args[ 0 ] >= options.layerEnd ) )
+				return true;
+			if( namePrefixes.empty() )
+				return false;
+			for( const CStringA& prefix : namePrefixes )
+				if( 0 == strncmp( name.pointer, prefix, (size_t)prefix.GetLength() ) )
+					return false;
+			return true;
+		}
+
 		HRESULT buffer( const ItemName& name, const void* rsi, size_t length, eDataType dt )
 		{
+			if( skip( name ) )
+				return S_FALSE;
 			sTraceItem& rdi = items.emplace_back();
 			const uint64_t cb = rdi.buffer( offset, length, dt );
 			addString( rdi, name );
-			assert( cb <= UINT_MAX );
-			CHECK( file.Write( rsi, (DWORD)cb ) );
-			offset += cb;
+			stats.emplace_back().compute( rsi, length, dt );
+			CHECK( writePayload( rsi, cb ) );
 			return S_OK;
 		}
 
 		HRESULT tensor( const ItemName& name, const void* rsi, __m128i size, __m128i strides, eDataType dt )
 		{
+			if( skip( name ) )
+				return S_FALSE;
 			sTraceItem& rdi = items.emplace_back();
 			const uint64_t cb = rdi.tensor( offset, size, strides, dt );
 			addString( rdi, name );
-			assert( cb <= UINT_MAX );
-			CHECK( file.Write( rsi, (DWORD)cb ) );
-			offset += cb;
+			stats.emplace_back().compute( rsi, cb / DirectCompute::elementSize( dt ), dt );
+			CHECK( writePayload( rsi, cb ) );
 			return S_OK;
 		}
 
@@ -105,6 +326,17 @@ namespace
 			if( !file )
 				return S_FALSE;
 
+			uint64_t cbPayload = offset;
+			uint8_t flags = (uint8_t)eFileFlags::None;
+			if( options.statisticsOnly )
+				flags |= (uint8_t)eFileFlags::StatisticsOnly;
+			if( compressor )
+			{
+				CHECK( compressor->close( cbPayload ) );
+				compressor.reset();
+				flags |= (uint8_t)eFileFlags::Compressed;
+			}
+
 			const uint32_t cbStringsData = (uint32_t)stringsData.size();
 			const uint32_t cbStringsIndex = (uint32_t)( stringsIndex.size() * 4 );
 			if( !stringsIndex.empty() )
@@ -114,15 +346,20 @@ namespace
 
 			const uint32_t cbItems = (uint32_t)items.size() * (uint32_t)sizeof( sTraceItem );
 			if( !items.empty() )
+			{
 				CHECK( file.Write( items.data(), cbItems ) );
+				CHECK( file.Write( stats.data(), (DWORD)( stats.size() * sizeof( sTensorStats ) ) ) );
+			}
 			CHECK( file.Seek( 0, FILE_BEGIN ) );
 
 			sFileHeader header;
 			memset( &header, 0, sizeof( header ) );
 			header.magic = header.correctMagic;
+			header.formatVersion = 1;
+			header.flags = flags;
 			header.cbItem = sizeof( sTraceItem );
 			header.countItems = (uint32_t)items.size();
-			header.bytesPayload = offset;
+			header.bytesPayload = cbPayload;
 			header.countStrings = (uint32_t)stringsIndex.size();
 			header.bytesStrings = cbStringsData + cbStringsIndex;
 			CHECK( file.Write( &header, sizeof( header ) ) );
@@ -147,11 +384,16 @@ namespace
 			return file.tensor( name, rsi, size, strides, dt );
 		}
 
+		bool skip( const ItemName& name ) const override final
+		{
+			return file.skip( name );
+		}
+
 	public:
 
-		TraceWriter( LPCTSTR path )
+		TraceWriter( LPCTSTR path, const sTraceOptions& options )
 		{
-			check( file.create( path ) );
+			check( file.create( path, options ) );
 		}
 
 		~TraceWriter()
@@ -161,9 +403,9 @@ namespace
 	};
 }
 
-std::unique_ptr<iTraceWriter> iTraceWriter::create( LPCTSTR path )
+std::unique_ptr<iTraceWriter> iTraceWriter::create( LPCTSTR path, const sTraceOptions& options )
 {
-	return std::make_unique<TraceWriter>( path );
+	return std::make_unique<TraceWriter>( path, options );
 }
 
 namespace
@@ -180,6 +422,9 @@ namespace
 
 HRESULT iTraceWriter::tensor( const ItemName& name, const DirectCompute::Tensor& source )
 {
+	// Skip the download from VRAM when the item is filtered out
+	if( skip( name ) )
+		return S_FALSE;
 	const __m128i size = source.sizeVec();
 	const __m128i strides = source.stridesVec();
 	const eDataType dt = source.getType();
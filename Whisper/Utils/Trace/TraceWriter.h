@@ -52,17 +52,35 @@ namespace Tracing
 		}
 	};
 
+	// What to save into the trace
+	struct sTraceOptions
+	{
+		// Only save statistics of the items: min, max, mean, L2 norm, and a hash of the payload.
+		// Such traces are tiny, and cheap enough to run on real inputs.
+		bool statisticsOnly = false;
+		// Compress the payload on a background thread
+		bool compress = true;
+		// When not nullptr, a semicolon-separated list of name prefixes, the items with other names are skipped
+		const char* names = nullptr;
+		// The items with format arguments, like "enc.layer[ %i ].in", are skipped unless the first argument is in [ layerBegin .. layerEnd ) range
+		uint32_t layerBegin = 0;
+		uint32_t layerEnd = UINT_MAX;
+	};
+
 	class iTraceWriter
 	{
 	public:
 		virtual ~iTraceWriter() {}
 
-		static std::unique_ptr<iTraceWriter> create( LPCTSTR path );
+		static std::unique_ptr<iTraceWriter> create( LPCTSTR path, const sTraceOptions& options );
 
 		virtual HRESULT buffer( const ItemName& name, const void* rsi, size_t length, eDataType dt ) = 0;
 
 		virtual HRESULT tensor( const ItemName& name, const void* rsi, __m128i size, __m128i strides, eDataType dt ) = 0;
 
+		// True when the options of the trace exclude the item with that name
+		virtual bool skip( const ItemName& name ) const = 0;
+
 		HRESULT tensor( const ItemName& name, const DirectCompute::Tensor& tensor );
 		HRESULT tensor( const ItemName& name, const CpuCompute::Tensor& tensor );
 		HRESULT tensor( const ItemName& name, const ggml_tensor& tensor );
@@ -17,9 +17,9 @@ namespace Tracing
 		return FALSE;
 	}
 
-	void traceCreate( LPCTSTR path )
+	void traceCreate( LPCTSTR path, const sTraceOptions& options )
 	{
-		s_writer = iTraceWriter::create( path );
+		s_writer = iTraceWriter::create( path, options );
 		SetConsoleCtrlHandler( &consoleHandler, TRUE );
 	}
 
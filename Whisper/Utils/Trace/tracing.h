@@ -4,7 +4,7 @@
 namespace Tracing
 {
 #if SAVE_DEBUG_TRACE
-	void traceCreate( LPCTSTR path );
+	void traceCreate( LPCTSTR path, const sTraceOptions& options = {} );
 	void traceClose();
 
 	iTraceWriter* getWriter();
@@ -53,7 +53,7 @@ namespace Tracing
 		return buffer( name, rsi, length, eDataType::FP32 );
 	}
 #else
-	inline void traceCreate( LPCTSTR path ) { }
+	inline void traceCreate( LPCTSTR path, const sTraceOptions& options = {} ) { }
 	inline void traceClose() { }
 	inline HRESULT tensor( const ItemName& name, const DirectCompute::Tensor& tensor ) { return S_FALSE; }
 	inline HRESULT tensor( const ItemName& name, const CpuCompute::Tensor& tensor ) { return S_FALSE; }
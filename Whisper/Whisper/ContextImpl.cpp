@@ -1,7 +1,9 @@
 #include "stdafx.h"
 #include "ContextImpl.h"
 #include "Languages.h"
+#include "TemperatureFallback.h"
 #include "../Utils/Trace/tracing.h"
+#include "../Utils/Timeline.h"
 using namespace Whisper;
 
 ContextImpl::ContextImpl( const WhisperModel& modelData, iModel* modelPointer ) :
@@ -13,13 +15,18 @@ ContextImpl::ContextImpl( const WhisperModel& modelData, iModel* modelPointer )
 
 #define WHISPER_CHUNK_SIZE  30
 
+uint32_t ContextImpl::audioContextSize() const
+{
+	return ( exp_n_audio_ctx > 0 ) ? exp_n_audio_ctx : model.parameters.n_audio_ctx;
+}
+
 HRESULT ContextImpl::encode( iSpectrogram& mel, int seek )
 {
 	// whisper_encode
 	using namespace DirectCompute;
 
 	sEncodeParams ep;
-	ep.n_ctx = ( exp_n_audio_ctx > 0 ) ? exp_n_audio_ctx : model.parameters.n_audio_ctx;
+	ep.n_ctx = audioContextSize();
 	ep.n_mels = model.parameters.n_mels;
 	ep.mel_offset = seek;
 	ep.layersCount = model.parameters.n_audio_layer;
@@ -29,6 +36,7 @@ HRESULT ContextImpl::encode( iSpectrogram& mel, int seek )
 	ep.n_text_state = model.parameters.n_text_state;
 	ep.n_text_layer = model.parameters.n_text_layer;
 	ep.n_text_ctx = model.parameters.n_text_ctx;
+	Timeline::Span span{ "encode", "cpu", seek };
 	try
 	{
 		auto cur = context.encode( mel, ep );
@@ -41,7 +49,70 @@ HRESULT ContextImpl::encode( iSpectrogram& mel, int seek )
 	}
 }
 
-HRESULT ContextImpl::decode( const int* tokens, size_t length, int n_past, int threads )
+void ContextImpl::clearEncodedWindow()
+{
+	encodedSource = nullptr;
+}
+
+bool ContextImpl::isEncoded( const iSpectrogram& mel, int seek ) const
+{
+	if( !encodedSource || &mel != &spectrogram )
+		return false;
+	const DirectCompute::EncodedWindow& window = context.getCurrentWindow();
+	return window.getSeek() == seek && window.getContextSize() == audioContextSize();
+}
+
+HRESULT ContextImpl::detectLanguageImpl( int threads, std::vector<sLanguageProbability>& rdi )
+{
+	// Ported from whisper_lang_auto_detect() function
+	rdi.clear();
+	if( !model.vocab.is_multilingual() )
+	{
+		logError( u8"%s: the model is English-only", __func__ );
+		return E_INVALIDARG;
+	}
+
+	const whisper_token sot = model.vocab.token_sot;
+	{
+		auto prof = context.decodeProfiler();
+		CHECK( decode( &sot, 1, 0, threads ) );
+	}
+
+	auto p = profiler.cpuBlock( eCpuBlock::Sample );
+	const float* const lp = probs.data() + ( probs.size() - model.vocab.n_vocab );
+
+	sLanguageList list;
+	CHECK( getSupportedLanguages( list ) );
+	rdi.reserve( list.length );
+	double sum = 0;
+	for( uint32_t i = 0; i < list.length; i++ )
+	{
+		const sLanguageEntry& e = list.pointer[ i ];
+		const int token = sot + 1 + e.id;
+		if( token >= Vocabulary::token_translate )
+			continue;
+		const float prob = lp[ token ];
+		rdi.push_back( sLanguageProbability{ e.key, prob } );
+		sum += prob;
+	}
+
+	// The decoder computed softmax over the complete vocabulary, re-normalize over the language tokens only
+	// This is equal to the softmax over the logits of these tokens, which is what the reference version does
+	if( sum > 0 )
+	{
+		const float mul = (float)( 1.0 / sum );
+		for( auto& e : rdi )
+			e.probability *= mul;
+	}
+
+	std::sort( rdi.begin(), rdi.end(), []( const sLanguageProbability& a, const sLanguageProbability& b )
+		{
+			return a.probability > b.probability;
+		} );
+	return S_OK;
+}
+
+HRESULT ContextImpl::decode( const int* tokens, size_t length, int n_past, int threads, bool fullProbs, bool allRows )
 {
 	// whisper_decode
 	using namespace DirectCompute;
@@ -50,13 +121,16 @@ HRESULT ContextImpl::decode( const int* tokens, size_t length, int n_past, int t
 	dp.n_head = model.parameters.n_audio_head;
 	dp.n_ctx = model.parameters.n_text_ctx;
 	dp.n_past = n_past;
-	dp.M = exp_n_audio_ctx > 0 ? exp_n_audio_ctx : model.parameters.n_audio_ctx;
+	dp.M = audioContextSize();
 	dp.n_text_layer = model.parameters.n_text_layer;
 	dp.n_vocab = model.parameters.n_vocab;
+	// The sampling only reads the output of the last token
+	dp.n_output = allRows ? 0 : 1;
 
 	try
 	{
-		context.decode( tokens, (int)length, dp, probs, threads );
+		summaries.clear();
+		context.decode( tokens, (int)length, dp, probs, threads, fullProbs ? nullptr : &summaries );
 		return S_OK;
 	}
 	catch( HRESULT hr )
@@ -66,7 +140,8 @@ HRESULT ContextImpl::decode( const int* tokens, size_t length, int n_past, int t
 }
 
 // the most basic sampling scheme - select the top token
-sTokenData ContextImpl::sampleBest( const float* probs, bool force_timestamp, bool is_initial )
+// when the temperature is positive, sample the token from the distribution instead
+sTokenData ContextImpl::sampleBest( const float* probs, bool force_timestamp, bool is_initial, float temperature )
 {
 	// whisper_sample_best
 	const Vocabulary& vocab = model.vocab;
@@ -122,6 +197,36 @@ sTokenData ContextImpl::sampleBest( const float* probs, bool force_timestamp, bo
 		result.ptsum = (float)sum_ts;
 	}
 
+	if( temperature > 0 )
+	{
+		// softmax( logits / T ) is equal to probs^( 1 / T ), normalized
+		const double invTemp = 1.0 / temperature;
+		double sum = 0;
+		for( auto& e : probs_id )
+		{
+			const Vocabulary::id id = e.second;
+			if( e.first <= 0 || id == vocab.token_sot || id == vocab.token_solm || id == vocab.token_not )
+				e.first = 0;
+			else
+				e.first = std::pow( e.first, invTemp );
+			sum += e.first;
+		}
+
+		std::uniform_real_distribution<double> distribution( 0.0, sum );
+		double x = distribution( rng );
+		size_t i = 0;
+		for( ; i < probs_id.size() - 1; i++ )
+		{
+			x -= probs_id[ i ].first;
+			if( x < 0 )
+				break;
+		}
+
+		result.id = probs_id[ i ].second;
+		result.p = probs[ result.id ];
+		return result;
+	}
+
 	// find the top K tokens
 	const int top_k = 4;
 
@@ -154,16 +259,72 @@ sTokenData ContextImpl::sampleBest( const float* probs, bool force_timestamp, bo
 	return result;
 }
 
-sTokenData ContextImpl::sampleBest()
+sTokenData ContextImpl::sampleBest( const sLogitsSummary& s, bool force_timestamp, bool is_initial ) const
+{
+	// Must match the above method at zero temperature
+	const Vocabulary& vocab = model.vocab;
+	sTokenData result = { 0 };
+
+	const double lse = s.logSumExp;
+	const double max_tx = std::exp( (double)s.maxText - lse );
+	double sum_ts, max_ts;
+	if( is_initial )
+	{
+		sum_ts = s.sumInitialTimestamps;
+		max_ts = std::exp( (double)s.bestInitialLogit - lse );
+		result.tid = s.bestInitialTimestamp;
+	}
+	else
+	{
+		sum_ts = s.sumTimestamps;
+		max_ts = std::exp( (double)s.bestTimestampLogit - lse );
+		result.tid = s.bestTimestamp;
+	}
+	result.pt = (float)( max_ts / ( sum_ts + 1e-10 ) );
+	result.ptsum = (float)sum_ts;
+
+	if( sum_ts > max_tx || force_timestamp )
+	{
+		// The text tokens are suppressed, the most probable of the remaining ones is the best timestamp
+		result.id = result.tid;
+		result.p = (float)max_ts;
+		return result;
+	}
+
+	int res = 0;
+	while( ( s.topTokens[ res ] == vocab.token_sot ||
+		s.topTokens[ res ] == vocab.token_solm ||
+		s.topTokens[ res ] == vocab.token_not ) &&
+		res < (int)sLogitsSummary::topK - 1 )
+	{
+		res++;
+	}
+
+	result.id = s.topTokens[ res ];
+	result.p = (float)std::exp( (double)s.topLogits[ res ] - lse );
+	return result;
+}
+
+sTokenData ContextImpl::sampleBest( float temperature )
 {
+	if( !summaries.empty() )
+	{
+		assert( temperature <= 0 );
+		return sampleBest( summaries.back(), false, false );
+	}
 	const int n_vocab = model.vocab.n_vocab;
-	return sampleBest( probs.data() + ( probs.size() - n_vocab ), false, false );
+	return sampleBest( probs.data() + ( probs.size() - n_vocab ), false, false, temperature );
 }
 
-sTokenData ContextImpl::sampleTimestamp( bool initial )
+sTokenData ContextImpl::sampleTimestamp( bool initial, float temperature )
 {
+	if( !summaries.empty() )
+	{
+		assert( temperature <= 0 );
+		return sampleBest( summaries.back(), true, initial );
+	}
 	const int n_vocab = model.vocab.n_vocab;
-	return sampleBest( probs.data() + ( probs.size() - n_vocab ), true, initial );
+	return sampleBest( probs.data() + ( probs.size() - n_vocab ), true, initial, temperature );
 }
 
 void ContextImpl::expComputeTokenLevelTimestamps( int i_segment, float thold_pt, float thold_ptsum )
@@ -188,7 +349,7 @@ static std::string to_timestamp( int64_t t, bool comma = false )
 	return std::string( buf );
 }
 
-HRESULT COMLIGHTCALL ContextImpl::runFullImpl( const sFullParams& params, const sProgressSink& progress, iSpectrogram& mel )
+HRESULT COMLIGHTCALL ContextImpl::runFullImpl( const sFullParams& params, const sProgressSink& progress, iSpectrogram& mel, const SpeechMap* speech )
 {
 	// Ported from whisper_full() function
 	result_all.clear();
@@ -225,23 +386,28 @@ HRESULT COMLIGHTCALL ContextImpl::runFullImpl( const sFullParams& params, const
 
 	// these tokens determine the task that will be performed
 	std::vector<whisper_token> prompt_init = { model.vocab.token_sot };
+	const whisper_token taskToken = params.flag( eFullParamsFlags::Translate ) ? model.vocab.token_translate : model.vocab.token_transcribe;
+	// When the language is "auto", the language and task tokens are appended after the first window is encoded
+	bool autoLanguage = false;
 	if( model.vocab.is_multilingual() )
 	{
-		int langId = lookupLanguageId( params.language );
-		if( langId < 0 )
+		if( params.language == makeLanguageKey( "auto" ) )
+			autoLanguage = true;
+		else
 		{
-			char lang[ 5 ];
-			*(uint32_t*)( &lang[ 0 ] ) = params.language;
-			lang[ 4 ] = '\0';
-			logError( u8"%s: unknown language '%s'", __func__, lang );
-			return E_INVALIDARG;
-		}
+			int langId = lookupLanguageId( params.language );
+			if( langId < 0 )
+			{
+				char lang[ 5 ];
+				*(uint32_t*)( &lang[ 0 ] ) = params.language;
+				lang[ 4 ] = '\0';
+				logError( u8"%s: unknown language '%s'", __func__, lang );
+				return E_INVALIDARG;
+			}
 
-		prompt_init.push_back( model.vocab.token_sot + 1 + langId );
-		if( params.flag( eFullParamsFlags::Translate ) )
-			prompt_init.push_back( model.vocab.token_translate );
-		else
-			prompt_init.push_back( model.vocab.token_transcribe );
+			prompt_init.push_back( model.vocab.token_sot + 1 + langId );
+			prompt_init.push_back( taskToken );
+		}
 	}
 
 	// int progress_prev = 0;
@@ -251,6 +417,28 @@ HRESULT COMLIGHTCALL ContextImpl::runFullImpl( const sFullParams& params, const
 	tokens_cur.reserve( model.parameters.n_text_ctx );
 	std::vector<whisper_token> prompt;
 	prompt.reserve( model.parameters.n_text_ctx );
+	std::vector<whisper_token> prompt_window;
+	prompt_window.reserve( model.parameters.n_text_ctx );
+	TemperatureFallback fallback{ params };
+	// Decoded text of tokens_cur, the compression ratio is computed over the text.
+	// The text is appended as the tokens are sampled; textEnds[ i ] is the length of the text of the first i + 1 tokens.
+	std::string fallbackText;
+	std::vector<size_t> textEnds;
+	const auto decodedText = [ & ]( size_t count ) -> std::string_view
+	{
+		assert( count <= tokens_cur.size() );
+		for( size_t i = textEnds.size(); i < count; i++ )
+		{
+			if( tokens_cur[ i ].id < model.vocab.token_eot )
+				fallbackText += model.vocab.string( tokens_cur[ i ].id );
+			textEnds.push_back( fallbackText.length() );
+		}
+		const size_t length = ( 0 != count ) ? textEnds[ count - 1 ] : 0;
+		return std::string_view{ fallbackText.data(), length };
+	};
+
+	// The sampling at positive temperatures is reproducible, the generator is seeded on every call
+	rng.seed( params.seed );
 
 	// main loop
 	int seek = seek_start;
@@ -277,6 +465,19 @@ HRESULT COMLIGHTCALL ContextImpl::runFullImpl( const sFullParams& params, const
 		if( seek + 100 >= seek_end )
 			break;
 
+		if( nullptr != speech )
+		{
+			const int next = speech->nextSpeech( seek );
+			if( next < 0 )
+				break;	// No more speech in the audio
+			if( next > seek )
+			{
+				logDebug( u8"%s: skipped silence [%s --> %s]", __func__, to_timestamp( seek ).c_str(), to_timestamp( next ).c_str() );
+				seek = next;
+				continue;
+			}
+		}
+
 		if( nullptr != params.encoder_begin_callback )
 		{
 			HRESULT hr = params.encoder_begin_callback( this, params.encoder_begin_callback_user_data );
@@ -286,27 +487,45 @@ HRESULT COMLIGHTCALL ContextImpl::runFullImpl( const sFullParams& params, const
 				break;
 		}
 
-		// encode audio features starting at offset seek
-		CHECK( encode( mel, seek ) );
+		// encode audio features starting at offset seek, unless detectLanguage() has already done that
+		if( !isEncoded( mel, seek ) )
+			CHECK( encode( mel, seek ) );
+		clearEncodedWindow();
+		CHECK( speculativeBeginWindow( mel, seek ) );
 
-		int n_past = 0;
-		prompt.clear();
+		if( autoLanguage )
+		{
+			autoLanguage = false;
+			std::vector<sLanguageProbability> languages;
+			CHECK( detectLanguageImpl( params.cpuThreads, languages ) );
+			if( languages.empty() )
+				return E_UNEXPECTED;
+
+			const sLanguageProbability& best = languages.front();
+			char lang[ 5 ];
+			*(uint32_t*)( &lang[ 0 ] ) = best.key;
+			lang[ 4 ] = '\0';
+			logInfo( u8"%s: auto-detected language: %s (p = %f)", __func__, lang, best.probability );
+
+			prompt_init.push_back( model.vocab.token_sot + 1 + lookupLanguageId( best.key ) );
+			prompt_init.push_back( taskToken );
+		}
+
+		prompt_window.clear();
 
 		// if we have already generated some text, use it as a prompt to condition the next generation
 		if( !prompt_past.empty() )
 		{
 			int n_take = std::min( std::min( params.n_max_text_ctx, model.parameters.n_text_ctx / 2 ), int( prompt_past.size() ) );
 
-			prompt = { model.vocab.token_prev };
-			prompt.insert( prompt.begin() + 1, prompt_past.end() - n_take, prompt_past.end() );
+			prompt_window = { model.vocab.token_prev };
+			prompt_window.insert( prompt_window.begin() + 1, prompt_past.end() - n_take, prompt_past.end() );
 
 			prompt_past.clear();
-			prompt_past.insert( prompt_past.end(), prompt.begin() + 1, prompt.end() );
+			prompt_past.insert( prompt_past.end(), prompt_window.begin() + 1, prompt_window.end() );
 		}
 
-		prompt.insert( prompt.end(), prompt_init.begin(), prompt_init.end() );
-
-		int seek_delta = 100 * WHISPER_CHUNK_SIZE;
+		prompt_window.insert( prompt_window.end(), prompt_init.begin(), prompt_init.end() );
 
 		// print the prompt
 		//printf("\n\n");
@@ -315,92 +534,152 @@ HRESULT COMLIGHTCALL ContextImpl::runFullImpl( const sFullParams& params, const
 		//}
 		//printf("\n\n");
 
+		int seek_delta;
 		// the accumulated transcription in the current iteration
-		int result_len = 0;
-		tokens_cur.clear();
-
-		bool failed = false;
-		bool has_ts = false; // have we already sampled a non-beg timestamp token for the current segment?
-
+		int result_len;
+		bool failed;
+
+		// Temperature fallback: when the output of the window is rejected, decode the same encoder output again with a higher temperature
+		fallback.reset();
+		// The attempts decode the same prompt with the same encoder output, and the sampled tokens only write the KV cache past the prompt.
+		// After the first attempt, the keys and values of the prompt are still in the KV cache; the retries reuse them along with the output probabilities.
+		bool promptCached = false;
+		while( true )
 		{
-			auto prof = context.decodeProfiler();
-			for( int i = 0, n_max = model.parameters.n_text_ctx / 2 - 4; i < n_max; i++ )
+			const float temperature = fallback.temperature();
+			const bool canFallback = fallback.canRetry();
+			// The draft model only helps the greedy decoding, the sampled tokens are too random to predict
+			const bool speculate = temperature <= 0;
+			// Sampling at a positive temperature needs the complete probabilities, the greedy sampling only needs the summaries of the logits
+			const bool fullProbs = temperature > 0;
+
+			int n_past = 0;
+			prompt = prompt_window;
+			if( promptCached )
 			{
-				CHECK( decode( prompt.data(), prompt.size(), n_past, params.cpuThreads ) );
-
-				n_past += (int)prompt.size();
+				n_past = (int)prompt_window.size();
 				prompt.clear();
+				probs = promptProbs;
+				summaries.clear();
+			}
+			seek_delta = 100 * WHISPER_CHUNK_SIZE;
+			result_len = 0;
+			tokens_cur.clear();
+			fallbackText.clear();
+			textEnds.clear();
 
-				// very basic greedy sampling strategy:
-				//
-				//   - always take the most probable token
-				//
-				// more sophisticated sampling strategies could be implemented here, but we keep it simple
-				// feel free to experiment!
-				//
+			failed = false;
+			bool has_ts = false; // have we already sampled a non-beg timestamp token for the current segment?
+
+			{
+				auto prof = context.decodeProfiler();
+				for( int i = 0, n_max = model.parameters.n_text_ctx / 2 - 4; i < n_max; i++ )
 				{
-					auto p = profiler.cpuBlock( eCpuBlock::Sample );
-					const sTokenData token = ( i == 0 ) ? sampleTimestamp( true ) : sampleBest();
+					if( i != 0 || !promptCached )
+					{
+						CHECK( decodeStep( prompt, n_past, params.cpuThreads, speculate, fullProbs || ( 0 == i && canFallback ) ) );
+						// The retries sample from the cached prompt output at a higher temperature, that's why it has the complete probabilities
+						if( 0 == i && canFallback )
+						{
+							promptProbs = probs;
+							promptCached = true;
+						}
+					}
 
-					// timestamp token - update sliding window
-					if( token.id > model.vocab.token_beg )
+					// very basic greedy sampling strategy:
+					//
+					//   - always take the most probable token
+					//
+					// more sophisticated sampling strategies could be implemented here, but we keep it simple
+					// feel free to experiment!
+					//
 					{
-						const int seek_delta_new = 2 * ( token.id - model.vocab.token_beg );
+						auto p = profiler.cpuBlock( eCpuBlock::Sample );
+						const sTokenData token = ( i == 0 ) ? sampleTimestamp( true, temperature ) : sampleBest( temperature );
 
-						// do not allow to go back in time
-						if( has_ts && seek_delta > seek_delta_new && result_len < i )
-							break;
+						// timestamp token - update sliding window
+						if( token.id > model.vocab.token_beg )
+						{
+							const int seek_delta_new = 2 * ( token.id - model.vocab.token_beg );
 
-						seek_delta = seek_delta_new;
-						result_len = i + 1;
-						has_ts = true;
-					}
+							// do not allow to go back in time
+							if( has_ts && seek_delta > seek_delta_new && result_len < i )
+								break;
 
-					// add it to the context
-					prompt.push_back( token.id );
-					tokens_cur.push_back( token );
+							seek_delta = seek_delta_new;
+							result_len = i + 1;
+							has_ts = true;
+						}
 
-					//{
-					//    const auto tt = token.pt > 0.10 ? ctx->vocab.id_to_token[token.tid] : "[?]";
-					//    printf("%s: %10s %6d %6.3f '%s'\n", __func__, tt.c_str(), token.id, token.pt, ctx->vocab.id_to_token[token.id].c_str());
-					//}
+						// add it to the context
+						prompt.push_back( token.id );
+						tokens_cur.push_back( token );
 
-					// end of segment
-					if( token.id == model.vocab.token_eot ||                  // end of text token
-						( params.max_tokens > 0 && i >= params.max_tokens ) || // max tokens per segment reached
-						( has_ts && seek + seek_delta + 100 >= seek_end )     // end of audio reached
-						)
-					{
-						if( result_len == 0 )
+						//{
+						//    const auto tt = token.pt > 0.10 ? ctx->vocab.id_to_token[token.tid] : "[?]";
+						//    printf("%s: %10s %6d %6.3f '%s'\n", __func__, tt.c_str(), token.id, token.pt, ctx->vocab.id_to_token[token.id].c_str());
+						//}
+
+						// end of segment
+						if( token.id == model.vocab.token_eot ||                  // end of text token
+							( params.max_tokens > 0 && i >= params.max_tokens ) || // max tokens per segment reached
+							( has_ts && seek + seek_delta + 100 >= seek_end )     // end of audio reached
+							)
 						{
-							if( seek + seek_delta + 100 >= seek_end )
-								result_len = i + 1;
-							else
+							if( result_len == 0 )
 							{
-								failed = true;
-								break;
+								if( seek + seek_delta + 100 >= seek_end )
+									result_len = i + 1;
+								else
+								{
+									failed = true;
+									break;
+								}
 							}
-						}
 
-						if( params.flag( eFullParamsFlags::SingleSegment ) )
-						{
-							result_len = i + 1;
-							seek_delta = 100 * WHISPER_CHUNK_SIZE;
+							if( params.flag( eFullParamsFlags::SingleSegment ) )
+							{
+								result_len = i + 1;
+								seek_delta = 100 * WHISPER_CHUNK_SIZE;
+							}
+
+							break;
 						}
+					}
+
+					// When there's a higher temperature to try, don't waste time decoding a repetition loop to the end of the window
+					if( canFallback && fallback.checksLoopAt( tokens_cur.size() ) && fallback.isRepetitionLoop( decodedText( tokens_cur.size() ), tokens_cur.size() ) )
+					{
+						failed = true;
+						break;
+					}
 
+					// sometimes, the decoding can get stuck in a repetition loop
+					// this is a simple strategy to avoid such cases - we simply flag the decoding as failed and advance
+					// the sliding window by 1 second
+					if( i == n_max - 1 && ( result_len == 0 || seek_delta < 100 * WHISPER_CHUNK_SIZE / 2 ) )
+					{
+						failed = true;
 						break;
 					}
 				}
+			}
 
-				// sometimes, the decoding can get stuck in a repetition loop
-				// this is a simple strategy to avoid such cases - we simply flag the decoding as failed and advance
-				// the sliding window by 1 second
-				if( i == n_max - 1 && ( result_len == 0 || seek_delta < 100 * WHISPER_CHUNK_SIZE / 2 ) )
-				{
-					failed = true;
+			if( !canFallback )
+				break;
+
+			if( !failed )
+			{
+				double sumLogProb = 0;
+				for( int i = 0; i < result_len; i++ )
+					sumLogProb += std::log( std::max( tokens_cur[ i ].p, 1e-20f ) );
+				const double avgLogProb = sumLogProb / std::max( result_len, 1 );
+				if( fallback.accept( decodedText( result_len ), avgLogProb ) )
 					break;
-				}
 			}
+
+			fallback.retry();
+			logDebug( u8"%s: decoding the window at %i again, with temperature %g", __func__, seek, fallback.temperature() );
 		}
 
 		if( failed )
@@ -519,6 +798,7 @@ HRESULT COMLIGHTCALL ContextImpl::runFullImpl( const sFullParams& params, const
 		}
 		seek += seek_delta;
 	}
+	speculativeReportStats();
 
 	if( nullptr != progress.pfn )
 	{
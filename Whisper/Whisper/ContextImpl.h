@@ -5,6 +5,8 @@
 #include "Spectrogram.h"
 #include "TranscribeResult.h"
 #include "sTokenData.h"
+#include "voiceActivityDetection.h"
+#include <random>
 
 namespace Whisper
 {
@@ -21,10 +23,29 @@ namespace Whisper
 		HRESULT COMLIGHTCALL timingsPrint() override final;
 		HRESULT COMLIGHTCALL timingsReset() override final;
 		HRESULT COMLIGHTCALL fullDefaultParams( eSamplingStrategy strategy, sFullParams* rdi ) override final;
-		HRESULT COMLIGHTCALL runFullImpl( const sFullParams& params, const sProgressSink& progress, iSpectrogram& mel );
+		// When the speech map is specified, the method skips long silences without encoding them
+		HRESULT COMLIGHTCALL runFullImpl( const sFullParams& params, const sProgressSink& progress, iSpectrogram& mel, const SpeechMap* speech = nullptr );
 		HRESULT COMLIGHTCALL runFull( const sFullParams& params, const iAudioBuffer* buffer ) override final;
 		HRESULT COMLIGHTCALL runStreamed( const sFullParams& params, const sProgressSink& progress, const iAudioReader* reader ) override final;
 		HRESULT COMLIGHTCALL runCapture( const sFullParams& params, const sCaptureCallbacks& callbacks, const iAudioCapture* reader ) override final;
+		HRESULT COMLIGHTCALL detectLanguage( const sFullParams& params, const iAudioBuffer* buffer, pfnDetectedLanguages pfn, void* pv ) override final;
+		HRESULT COMLIGHTCALL runFullParallel( const sFullParams& params, const iAudioBuffer* buffer, int countContexts ) override final;
+
+		struct ParallelJob;
+		static HRESULT parallelCallback( int ith, void* pv ) noexcept;
+
+		HRESULT COMLIGHTCALL setDraftModel( iModel* draft, int countTokens ) override final;
+
+		// Speculative decoding: the draft context proposes tokens, this context verifies them with a single decoder pass
+		struct Speculative;
+		std::unique_ptr<Speculative> speculative;
+		// Encode the window with the draft model, and forget the tokens decoded in the previous window
+		HRESULT speculativeBeginWindow( iSpectrogram& mel, int seek );
+		// Decode the prompt at n_past, then advance n_past and clear the prompt.
+		// When speculate is true and the prompt is a single token, the method may serve the output from the rows computed by the previous verification pass.
+		HRESULT decodeStep( std::vector<whisper_token>& prompt, int& n_past, int threads, bool speculate, bool fullProbs );
+		// Log the count of proposed and accepted tokens, and reset these counters
+		void speculativeReportStats();
 
 		struct Segment
 		{
@@ -47,16 +68,37 @@ namespace Whisper
 		// [EXPERIMENTAL] speed-up techniques
 		int32_t exp_n_audio_ctx = 0; // 0 - use default
 
+		// When detectLanguage() method has already computed the spectrogram of this buffer and encoded the first window,
+		// runFull() doesn't need to do that again
+		ComLight::CComPtr<iAudioBuffer> encodedSource;
+		void clearEncodedWindow();
+		// True when the current encoded window is at the specified offset of the spectrogram computed by detectLanguage()
+		bool isEncoded( const iSpectrogram& mel, int seek ) const;
+
+		// Run the encoder, the output replaces the encoded window of the context
 		HRESULT encode( iSpectrogram& mel, int seek );
-		HRESULT decode( const int* tokens, size_t length, int n_past, int threads );
-		sTokenData sampleBest( const float* probs, bool force_timestamp, bool is_initial );
-		sTokenData sampleBest();
-		sTokenData sampleTimestamp( bool initial );
+		uint32_t audioContextSize() const;
+		// Run a single decoder step over [ sot ] with the currently encoded window, and produce languages sorted by probability
+		HRESULT detectLanguageImpl( int threads, std::vector<sLanguageProbability>& rdi );
+		// When fullProbs is false, the decoder may only produce the summaries of the logits, which are enough for the greedy sampling.
+		// Unless allRows is true, the decoder may only produce the output for the last token.
+		HRESULT decode( const int* tokens, size_t length, int n_past, int threads, bool fullProbs = true, bool allRows = false );
+		sTokenData sampleBest( const float* probs, bool force_timestamp, bool is_initial, float temperature );
+		// Same as the above at zero temperature, using the summary of the logits instead of the probabilities
+		sTokenData sampleBest( const sLogitsSummary& summary, bool force_timestamp, bool is_initial ) const;
+		sTokenData sampleBest( float temperature );
+		sTokenData sampleTimestamp( bool initial, float temperature );
 		int wrapSegment( int max_len );
 		void expComputeTokenLevelTimestamps( int i_segment, float thold_pt, float thold_ptsum );
 
 		std::vector<float> probs;
+		// When not empty, the last decoder pass only produced these summaries of the logits, and the probs vector is empty
+		std::vector<sLogitsSummary> summaries;
+		// Output of the decoder for the prompt of the current window, reused by the temperature fallback
+		std::vector<float> promptProbs;
 		std::vector<std::pair<double, Vocabulary::id>> probs_id;
+		// Random generator for the temperature fallback, seeded with sFullParams.seed at the start of every runFull
+		std::mt19937 rng;
 
 		mutable TranscribeResultStatic results;
 
@@ -71,5 +113,6 @@ namespace Whisper
 	public:
 
 		ContextImpl( const WhisperModel& modelData, iModel* modelPointer );
+		~ContextImpl();
 	};
 }
\ No newline at end of file
@@ -72,6 +72,8 @@ HRESULT COMLIGHTCALL ContextImpl::fullDefaultParams( eSamplingStrategy strategy,
 	rdi->thold_pt = 0.01f;
 	rdi->thold_ptsum = 0.01f;
 	rdi->language = makeLanguageKey( "en" );
+	rdi->compression_ratio_thold = 2.4f;
+	rdi->logprob_thold = -1.0f;
 
 	switch( strategy )
 	{
@@ -117,6 +119,7 @@ __m128i ContextImpl::getMemoryUse() const
 	cb += vectorMemoryUse( prompt_past );
 	cb += vectorMemoryUse( energy );
 	cb += vectorMemoryUse( probs );
+	cb += vectorMemoryUse( summaries );
 	cb += vectorMemoryUse( probs_id );
 	cb += vectorMemoryUse( results.segments );
 	cb += vectorMemoryUse( results.tokens );
@@ -167,9 +170,21 @@ namespace
 	}
 }
 
+#if PROFILER_CPU_OPS
+namespace
+{
+	LPCTSTR cpuOpsFile = LR"(C:\Temp\2remove\Whisper\cpuOps.tsv)";
+}
+#endif
+
 HRESULT COMLIGHTCALL ContextImpl::timingsPrint()
 {
 	profiler.print();
+#if PROFILER_CPU_OPS
+	const HRESULT hrExport = profiler.cpuOps().exportTsv( cpuOpsFile );
+	if( FAILED( hrExport ) )
+		logWarningHr( hrExport, u8"Unable to save CPU operations to %S", cpuOpsFile );
+#endif
 
 	const __m128i memModel = model.getMemoryUse();
 	const __m128i memContext = getMemoryUse();
@@ -349,7 +364,10 @@ HRESULT COMLIGHTCALL ContextImpl::runFull( const sFullParams& params, const iAud
 	CHECK( buffer->getTime( mediaTimeOffset ) );
 
 	auto profCompleteCpu = profiler.cpuBlock( eCpuBlock::Run );
+	if( buffer != encodedSource )
 	{
+		// The spectrogram from detectLanguage() is for another buffer, or there's none
+		clearEncodedWindow();
 		auto p = profiler.cpuBlock( eCpuBlock::Spectrogram );
 		CHECK( spectrogram.pcmToMel( buffer, model.filters, params.cpuThreads ) );
 	}
@@ -362,10 +380,21 @@ HRESULT COMLIGHTCALL ContextImpl::runFull( const sFullParams& params, const iAud
 		computeSignalEnergy( energy, buffer, 32 );
 	}
 
+	SpeechMap speech;
+	if( params.flag( eFullParamsFlags::SkipSilence ) )
+	{
+		auto p = profiler.cpuBlock( eCpuBlock::VAD );
+		std::vector<uint8_t> frames;
+		VAD vad;
+		vad.classify( buffer->getPcmMono(), buffer->countSamples(), frames );
+		speech.build( frames );
+		logDebug( u8"%s: speech length %i ms out of %i", __func__, speech.speechLength() * 10, (int)spectrogram.getLength() * 10 );
+	}
+
 	try
 	{
 		sProgressSink progressSink{ nullptr, nullptr };
-		return runFullImpl( params, progressSink, spectrogram );
+		return runFullImpl( params, progressSink, spectrogram, params.flag( eFullParamsFlags::SkipSilence ) ? &speech : nullptr );
 	}
 	catch( HRESULT hr )
 	{
@@ -373,6 +402,44 @@ HRESULT COMLIGHTCALL ContextImpl::runFull( const sFullParams& params, const iAud
 	}
 }
 
+HRESULT COMLIGHTCALL ContextImpl::detectLanguage( const sFullParams& params, const iAudioBuffer* buffer, pfnDetectedLanguages pfn, void* pv )
+{
+	if( nullptr == buffer || nullptr == pfn )
+		return E_POINTER;
+	clearEncodedWindow();
+
+	auto profCompleteCpu = profiler.cpuBlock( eCpuBlock::Run );
+	{
+		auto p = profiler.cpuBlock( eCpuBlock::Spectrogram );
+		CHECK( spectrogram.pcmToMel( buffer, model.filters, params.cpuThreads ) );
+	}
+
+	const int seek = params.offset_ms / 10;
+	if( seek + 100 >= (int)spectrogram.getLength() )
+	{
+		logError( u8"%s: the audio is too short", __func__ );
+		return E_INVALIDARG;
+	}
+
+	exp_n_audio_ctx = params.audio_ctx;
+	std::vector<sLanguageProbability> languages;
+	try
+	{
+		auto prof = context.completeProfiler();
+		CHECK( encode( spectrogram, seek ) );
+		CHECK( detectLanguageImpl( params.cpuThreads, languages ) );
+	}
+	catch( HRESULT hr )
+	{
+		return hr;
+	}
+
+	// Keep the buffer alive, this way the pointer comparison in runFull() method is reliable
+	encodedSource = const_cast<iAudioBuffer*>( buffer );
+
+	return pfn( (int)languages.size(), languages.data(), pv );
+}
+
 HRESULT COMLIGHTCALL ContextImpl::runStreamed( const sFullParams& params, const sProgressSink& progress, const iAudioReader* reader )
 {
 	if( params.flag( eFullParamsFlags::TokenTimestamps ) )
@@ -380,6 +447,8 @@ HRESULT COMLIGHTCALL ContextImpl::runStreamed( const sFullParams& params, const
 		logError( u8"eFullParamsFlags.TokenTimestamps flag is not supported in streaming mode" );
 		return E_NOTIMPL;
 	}
+	if( params.flag( eFullParamsFlags::SkipSilence ) )
+		logWarning( u8"eFullParamsFlags.SkipSilence flag is ignored in streaming mode" );
 
 	mediaTimeOffset = 0;
 	auto profCompleteCpu = profiler.cpuBlock( eCpuBlock::Run );
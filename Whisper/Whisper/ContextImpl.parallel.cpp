@@ -0,0 +1,226 @@
+#include "stdafx.h"
+#include "ContextImpl.h"
+#include "voiceActivityDetection.h"
+#include "parallelSeams.h"
+#include "../Utils/parallelFor.h"
+#include "../CPU/NumaTopology.h"
+using namespace Whisper;
+
+namespace
+{
+	// Don't make pieces shorter than that, in 10ms units of the spectrogram
+	constexpr int minPieceLength = 100 * 30;
+	// How far from the equal subdivision point to search for the silence, in 10ms units
+	constexpr int searchRadius = 100 * 15;
+
+	// Find the longest silence within [ begin .. end ) interval of the spectrogram, return the middle of it, or -1 if there's no silence
+	int findSilence( const std::vector<uint8_t>& speech, int begin, int end )
+	{
+		const size_t i0 = vadFrameFromMel( begin );
+		const size_t i1 = std::min( vadFrameFromMel( end ), speech.size() );
+
+		size_t bestStart = 0, bestLength = 0;
+		size_t runStart = 0;
+		bool inSilence = false;
+		for( size_t i = i0; i <= i1; i++ )
+		{
+			const bool silent = i < i1 && 0 == speech[ i ];
+			if( silent )
+			{
+				if( !inSilence )
+				{
+					runStart = i;
+					inSilence = true;
+				}
+				continue;
+			}
+			if( inSilence )
+			{
+				inSilence = false;
+				if( i - runStart > bestLength )
+				{
+					bestStart = runStart;
+					bestLength = i - runStart;
+				}
+			}
+		}
+
+		if( 0 == bestLength )
+			return -1;
+		return melFromVadFrame( bestStart + bestLength / 2 );
+	}
+
+	// Split [ seekStart .. seekEnd ) interval into up to `count` pieces of similar length,
+	// at the middle of the longest silences near the equal subdivision points
+	void splitAudio( const std::vector<uint8_t>& speech, int seekStart, int seekEnd, int count, std::vector<std::pair<int, int>>& pieces )
+	{
+		pieces.clear();
+		int prev = seekStart;
+		for( int i = 1; i < count; i++ )
+		{
+			const int target = seekStart + (int)( (int64_t)( seekEnd - seekStart ) * i / count );
+			const int begin = std::max( prev + minPieceLength, target - searchRadius );
+			const int end = std::min( target + searchRadius, seekEnd - minPieceLength );
+			if( begin >= end )
+				continue;
+
+			int split = findSilence( speech, begin, end );
+			if( split < 0 )
+				split = std::clamp( target, begin, end );
+			pieces.emplace_back( prev, split );
+			prev = split;
+		}
+		pieces.emplace_back( prev, seekEnd );
+	}
+}
+
+struct ContextImpl::ParallelJob
+{
+	sFullParams params;
+	iSpectrogram* mel;
+	std::vector<std::pair<int, int>> pieces;
+	// Only used with eFullParamsFlags::SkipSilence flag
+	SpeechMap speech;
+	const SpeechMap* speechMap() const
+	{
+		return params.flag( eFullParamsFlags::SkipSilence ) ? &speech : nullptr;
+	}
+	// The first one is the context which called runFullParallel()
+	std::vector<ContextImpl*> contexts;
+};
+
+HRESULT ContextImpl::parallelCallback( int ith, void* pv ) noexcept
+{
+	const ParallelJob& job = *(const ParallelJob*)pv;
+	ContextImpl& ctx = *job.contexts[ ith ];
+	const auto& piece = job.pieces[ ith ];
+
+	sFullParams params = job.params;
+	params.offset_ms = piece.first * 10;
+	params.duration_ms = ( piece.second - piece.first ) * 10;
+	if( ith != 0 )
+		params.setFlag( eFullParamsFlags::NoContext );
+
+	try
+	{
+		sProgressSink progressSink{ nullptr, nullptr };
+		CHECK( ctx.runFullImpl( params, progressSink, *job.mel, job.speechMap() ) );
+	}
+	catch( HRESULT hr )
+	{
+		return hr;
+	}
+
+	trimPieceEnd( ctx.result_all, piece.second );
+	return S_OK;
+}
+
+HRESULT COMLIGHTCALL ContextImpl::runFullParallel( const sFullParams& params, const iAudioBuffer* buffer, int countContexts )
+{
+	if( countContexts <= 1 )
+		return runFull( params, buffer );
+	if( params.flag( eFullParamsFlags::TokenTimestamps ) )
+	{
+		logError( u8"eFullParamsFlags.TokenTimestamps flag is not supported by runFullParallel" );
+		return E_NOTIMPL;
+	}
+
+	CHECK( buffer->getTime( mediaTimeOffset ) );
+	auto profCompleteCpu = profiler.cpuBlock( eCpuBlock::Run );
+	if( buffer != encodedSource )
+	{
+		clearEncodedWindow();
+		auto p = profiler.cpuBlock( eCpuBlock::Spectrogram );
+		CHECK( spectrogram.pcmToMel( buffer, model.filters, params.cpuThreads ) );
+	}
+
+	const int length = (int)spectrogram.getLength();
+	const int seekStart = params.offset_ms / 10;
+	const int seekEnd = std::min( length, seekStart + ( params.duration_ms == 0 ? length : params.duration_ms / 10 ) );
+
+	ParallelJob job;
+	{
+		std::vector<uint8_t> speech;
+		{
+			auto p = profiler.cpuBlock( eCpuBlock::VAD );
+			VAD vad;
+			vad.classify( buffer->getPcmMono(), buffer->countSamples(), speech );
+		}
+		splitAudio( speech, seekStart, seekEnd, countContexts, job.pieces );
+		if( params.flag( eFullParamsFlags::SkipSilence ) )
+			job.speech.build( speech );
+	}
+	job.params = params;
+
+	const int countPieces = (int)job.pieces.size();
+	logDebug( u8"%s: split the audio into %i pieces", __func__, countPieces );
+	if( countPieces <= 1 )
+	{
+		// The audio is too short to split
+		try
+		{
+			sProgressSink progressSink{ nullptr, nullptr };
+			return runFullImpl( params, progressSink, spectrogram, job.speechMap() );
+		}
+		catch( HRESULT hr )
+		{
+			return hr;
+		}
+	}
+
+	// Create more contexts sharing the model. The GPU work is serialized with DirectCompute::lockGpu(),
+	// the CPU work of these contexts (spectrogram, sampling, and the decoder of the hybrid model) runs concurrently.
+	std::vector<ComLight::CComPtr<ComLight::Object<ContextImpl>>> workers;
+	workers.resize( countPieces - 1 );
+	job.contexts.push_back( this );
+	iModel* const m = modelPtr;
+	for( auto& w : workers )
+	{
+		CHECK( ComLight::Object<ContextImpl>::create( w, model, m ) );
+		job.contexts.push_back( w );
+	}
+
+	job.params.cpuThreads = std::max( 1, params.cpuThreads / countPieces );
+	// The segments are reported after they're stitched together
+	job.params.new_segment_callback = nullptr;
+	job.params.new_segment_callback_user_data = nullptr;
+	job.params.encoder_begin_callback = nullptr;
+	job.params.encoder_begin_callback_user_data = nullptr;
+	job.mel = &spectrogram;
+
+	// On NUMA computers, pin the contexts to the nodes, round-robin.
+	// This only affects the hybrid model, where each context runs its own CPU decoder.
+	const CpuCompute::NumaTopology& numa = CpuCompute::NumaTopology::get();
+	const bool pinContexts = numa.isNuma();
+	if( pinContexts )
+	{
+		for( int i = 0; i < countPieces; i++ )
+			CHECK( job.contexts[ i ]->context.setNumaNode( (int)( i % numa.countNodes() ) ) );
+	}
+
+	const HRESULT hrParallel = parallelFor( &parallelCallback, countPieces, &job );
+	// This context is reused by the caller, let it use all nodes again
+	if( pinContexts )
+		CHECK( context.setNumaNode( -1 ) );
+	CHECK( hrParallel );
+
+	// Timestamps in the segments are already absolute, because runFullImpl keeps seek relative to the start of the spectrogram
+	for( auto& w : workers )
+	{
+		auto& segments = w->result_all;
+		// The last segment of the previous piece may extend into this one, drop the segments of this piece which repeat that text
+		const size_t covered = result_all.empty() ? 0 : countCoveredSegments( segments, result_all.back().t1 );
+		if( covered > 0 )
+			logDebug( u8"%s: dropped %zu segments at the seam between pieces", __func__, covered );
+		result_all.insert( result_all.end(), std::make_move_iterator( segments.begin() + covered ), std::make_move_iterator( segments.end() ) );
+		segments.clear();
+	}
+
+	if( nullptr != params.new_segment_callback && !result_all.empty() )
+	{
+		HRESULT hr = params.new_segment_callback( this, (uint32_t)result_all.size(), params.new_segment_callback_user_data );
+		if( FAILED( hr ) )
+			return hr;
+	}
+	return S_OK;
+}
@@ -0,0 +1,181 @@
+#include "stdafx.h"
+#include "ContextImpl.h"
+using namespace Whisper;
+
+// Speculative decoding.
+// The decoder is bound by memory bandwidth: each call streams all the weights, regardless of how many tokens are in the batch.
+// The draft model is much smaller, it proposes a few tokens greedily. This model then decodes the pending token along with all the proposals in one pass.
+// Row #i of that output is what the decoder would have produced after the i-th proposal, so while the sampled tokens match the proposals,
+// the following steps are served from these rows without running the decoder. The sampling code is unchanged.
+// The output is equivalent up to floating-point rounding: the batched pass uses other matrix product kernels and accumulation order than the single-token one,
+// so when the two best tokens have nearly equal probabilities, the greedy choice may differ.
+struct ContextImpl::Speculative
+{
+	ComLight::CComPtr<iContext> draftObject;
+	ContextImpl* draft;
+	int countTokens;
+
+	// Tokens decoded by this context in the current window, and tokens in the KV cache of the draft context
+	std::vector<whisper_token> sequence, draftSequence;
+	// The batch of the last verification pass: the pending token, followed by the proposals of the draft model
+	std::vector<whisper_token> batch;
+	// n_past of the last verification pass
+	int batchPast = 0;
+	// Output of the last verification pass, batch.size() rows of n_vocab probabilities, or batch.size() summaries of the logits
+	std::vector<float> rows;
+	std::vector<sLogitsSummary> rowSummaries;
+
+	size_t countProposed = 0;
+	size_t countAccepted = 0;
+
+	void reset()
+	{
+		sequence.clear();
+		draftSequence.clear();
+		batch.clear();
+	}
+
+	// Make the specified row of the last verification pass the current output of the context
+	void selectRow( ContextImpl& ctx, size_t row ) const;
+};
+
+ContextImpl::~ContextImpl() = default;
+
+void ContextImpl::speculativeReportStats()
+{
+	if( !speculative || 0 == speculative->countProposed )
+		return;
+	Speculative& s = *speculative;
+	logDebug( u8"Speculative decoding: accepted %zu of %zu proposed tokens, %.1f%%",
+		s.countAccepted, s.countProposed, 100.0 * (double)s.countAccepted / (double)s.countProposed );
+	s.countProposed = s.countAccepted = 0;
+}
+
+HRESULT COMLIGHTCALL ContextImpl::setDraftModel( iModel* draftModel, int countTokens )
+{
+	speculative.reset();
+	if( nullptr == draftModel )
+		return S_OK;
+
+	ComLight::CComPtr<iContext> obj;
+	CHECK( draftModel->createContext( &obj ) );
+	ContextImpl* const draft = dynamic_cast<ContextImpl*>( (iContext*)obj );
+	if( nullptr == draft )
+	{
+		logError( u8"%s: the draft model must be either GPU or hybrid implementation", __func__ );
+		return E_NOINTERFACE;
+	}
+
+	const sModelParams& mp = model.parameters;
+	const sModelParams& dp = draft->model.parameters;
+	if( mp.n_vocab != dp.n_vocab || mp.n_mels != dp.n_mels || mp.n_audio_ctx != dp.n_audio_ctx || mp.n_text_ctx != dp.n_text_ctx )
+	{
+		logError( u8"%s: the draft model is incompatible, it has a different vocabulary or input shape", __func__ );
+		return E_INVALIDARG;
+	}
+
+	auto s = std::make_unique<Speculative>();
+	s->draftObject = obj;
+	s->draft = draft;
+	s->countTokens = ( countTokens > 0 ) ? countTokens : 4;
+	speculative = std::move( s );
+	return S_OK;
+}
+
+HRESULT ContextImpl::speculativeBeginWindow( iSpectrogram& mel, int seek )
+{
+	if( !speculative )
+		return S_FALSE;
+	speculative->reset();
+	ContextImpl& draft = *speculative->draft;
+	draft.exp_n_audio_ctx = exp_n_audio_ctx;
+	return draft.encode( mel, seek );
+}
+
+void ContextImpl::Speculative::selectRow( ContextImpl& ctx, size_t row ) const
+{
+	if( !rowSummaries.empty() )
+	{
+		ctx.summaries.assign( 1, rowSummaries[ row ] );
+		ctx.probs.clear();
+	}
+	else
+	{
+		const size_t n_vocab = (uint32_t)ctx.model.parameters.n_vocab;
+		const float* rsi = rows.data() + row * n_vocab;
+		ctx.probs.assign( rsi, rsi + n_vocab );
+		ctx.summaries.clear();
+	}
+}
+
+HRESULT ContextImpl::decodeStep( std::vector<whisper_token>& prompt, int& n_past, int threads, bool speculate, bool fullProbs )
+{
+	Speculative* const spec = speculative.get();
+	if( nullptr == spec || !speculate || prompt.size() != 1 || spec->sequence.size() < (size_t)n_past )
+	{
+		CHECK( decode( prompt.data(), prompt.size(), n_past, threads, fullProbs ) );
+		if( nullptr != spec )
+		{
+			spec->batch.clear();
+			if( spec->sequence.size() >= (size_t)n_past )
+			{
+				spec->sequence.resize( n_past );
+				spec->sequence.insert( spec->sequence.end(), prompt.begin(), prompt.end() );
+			}
+		}
+		n_past += (int)prompt.size();
+		prompt.clear();
+		return S_OK;
+	}
+
+	const whisper_token token = prompt[ 0 ];
+	spec->sequence.resize( n_past );
+	spec->sequence.push_back( token );
+
+	// When the previous verification pass has already decoded this token after the same prefix, use the output of that pass
+	const int row = n_past - spec->batchPast;
+	if( row > 0 && row < (int)spec->batch.size() && spec->batch[ row ] == token )
+	{
+		spec->countAccepted++;
+		spec->selectRow( *this, row );
+		n_past++;
+		prompt.clear();
+		return S_OK;
+	}
+
+	// Bring the KV cache of the draft model up to date; it has the longest common prefix already, at least one token needs to be decoded for the output
+	ContextImpl& draft = *spec->draft;
+	std::vector<whisper_token>& ds = spec->draftSequence;
+	const std::vector<whisper_token>& seq = spec->sequence;
+	size_t common = 0;
+	while( common < ds.size() && common + 1 < seq.size() && ds[ common ] == seq[ common ] )
+		common++;
+	CHECK( draft.decode( seq.data() + common, seq.size() - common, (int)common, threads, false ) );
+	ds = seq;
+
+	// Propose the tokens, greedily
+	const int n_text_ctx = model.parameters.n_text_ctx;
+	const int maxProposals = std::min( spec->countTokens, n_text_ctx - n_past - 1 );
+	spec->batch.clear();
+	spec->batch.push_back( token );
+	for( int i = 0; i < maxProposals; i++ )
+	{
+		const whisper_token proposed = draft.sampleBest( 0.0f ).id;
+		spec->batch.push_back( proposed );
+		if( proposed == model.vocab.token_eot || i + 1 == maxProposals )
+			break;
+		CHECK( draft.decode( &proposed, 1, (int)ds.size(), threads, false ) );
+		ds.push_back( proposed );
+	}
+	spec->countProposed += spec->batch.size() - 1;
+
+	// Verify all of them with a single pass of this model
+	CHECK( decode( spec->batch.data(), spec->batch.size(), n_past, threads, fullProbs, true ) );
+	spec->batchPast = n_past;
+	spec->rows.swap( probs );
+	spec->rowSummaries.swap( summaries );
+	spec->selectRow( *this, 0 );
+	n_past++;
+	prompt.clear();
+	return S_OK;
+}
@@ -0,0 +1,143 @@
+#include "stdafx.h"
+#include "TemperatureFallback.h"
+#include <bit>
+#include <cmath>
+using namespace Whisper;
+
+namespace
+{
+	// Deflate limits
+	constexpr size_t minMatch = 3;
+	constexpr size_t maxMatch = 258;
+	constexpr size_t windowSize = 32768;
+	// Same as zlib's max_chain at the default compression level 6
+	constexpr size_t maxChain = 128;
+	constexpr uint32_t hashBits = 12;
+
+	inline uint32_t hash3( const uint8_t* rsi )
+	{
+		const uint32_t v = (uint32_t)rsi[ 0 ] | ( (uint32_t)rsi[ 1 ] << 8 ) | ( (uint32_t)rsi[ 2 ] << 16 );
+		return ( v * 2654435761u ) >> ( 32 - hashBits );
+	}
+
+	// Same as int( log2( x ) ) for positive integers
+	inline int floorLog2( size_t x )
+	{
+		return (int)std::bit_width( x ) - 1;
+	}
+
+	// Approximate count of bits deflate spends on a back reference: the length and distance codes, and their extra bits
+	inline double matchBits( size_t length, size_t distance )
+	{
+		int extraLength = 0;
+		if( length >= 11 )
+			extraLength = std::min( 5, std::max( 0, floorLog2( length - 3 ) - 2 ) );
+		const int extraDistance = ( distance > 4 ) ? floorLog2( distance ) - 1 : 0;
+		return 7 + extraLength + 5 + extraDistance;
+	}
+}
+
+double Whisper::compressionRatio( const char* text, size_t length )
+{
+	if( 0 == length )
+		return 1.0;
+	const uint8_t* const rsi = (const uint8_t*)text;
+
+	// Greedy LZ77 parse. The candidates are found with hash chains of the 3-byte prefixes, visiting at most maxChain of them per position,
+	// so the cost is linear in the length of the text; the chains go from the closest position to the farthest one.
+	std::array<int, 1u << hashBits> head;
+	head.fill( -1 );
+	std::vector<int> prev( length, -1 );
+	const auto insert = [ & ]( size_t pos )
+	{
+		if( pos + minMatch > length )
+			return;
+		const uint32_t h = hash3( rsi + pos );
+		prev[ pos ] = head[ h ];
+		head[ h ] = (int)pos;
+	};
+
+	std::array<uint32_t, 256> literals;
+	literals.fill( 0 );
+	size_t countLiterals = 0;
+	double bitsMatches = 0;
+	for( size_t i = 0; i < length; )
+	{
+		size_t bestLength = 0, bestDistance = 0;
+		const size_t maxLength = std::min( maxMatch, length - i );
+		if( maxLength >= minMatch )
+		{
+			int j = head[ hash3( rsi + i ) ];
+			for( size_t chain = 0; j >= 0 && chain < maxChain && i - (size_t)j <= windowSize; chain++, j = prev[ j ] )
+			{
+				size_t len = 0;
+				while( len < maxLength && rsi[ j + len ] == rsi[ i + len ] )
+					len++;
+				// Prefer the closest match, shorter distances cost less bits
+				if( len > bestLength )
+				{
+					bestLength = len;
+					bestDistance = i - (size_t)j;
+					if( len == maxLength )
+						break;
+				}
+			}
+		}
+
+		if( bestLength >= minMatch )
+		{
+			bitsMatches += matchBits( bestLength, bestDistance );
+			for( size_t end = i + bestLength; i < end; i++ )
+				insert( i );
+		}
+		else
+		{
+			literals[ rsi[ i ] ]++;
+			countLiterals++;
+			insert( i );
+			i++;
+		}
+	}
+
+	// Literals with dynamic Huffman codes: entropy of the literals, plus about 5 bits per distinct symbol for the code tree, plus the block header
+	double entropy = 0;
+	size_t distinct = 0;
+	for( uint32_t c : literals )
+	{
+		if( 0 == c )
+			continue;
+		distinct++;
+		entropy -= c * std::log2( (double)c / (double)countLiterals );
+	}
+	const double bitsDynamic = entropy + 5.0 * distinct + bitsMatches + 68;
+	// Literals with the fixed Huffman codes, 8 or 9 bits each
+	const double bitsFixed = countLiterals * 8.5 + bitsMatches + 7;
+
+	// zlib adds 2 bytes of header and 4 bytes of Adler-32 checksum
+	const double bytes = std::floor( ( std::min( bitsDynamic, bitsFixed ) + 7 ) / 8 ) + 6;
+	return (double)length / bytes;
+}
+
+TemperatureFallback::TemperatureFallback( const sFullParams& params ) :
+	initial( params.temperature ),
+	increment( params.temperature_inc ),
+	compressionThreshold( params.compression_ratio_thold ),
+	logProbThreshold( params.logprob_thold )
+{ }
+
+bool TemperatureFallback::isRepetitionLoop( std::string_view text, size_t countTokens ) const
+{
+	if( !checksLoopAt( countTokens ) )
+		return false;
+	return compressionRatio( text ) > compressionThreshold;
+}
+
+bool TemperatureFallback::accept( std::string_view text, double avgLogProb ) const
+{
+	// ref: https://github.com/openai/whisper/blob/v20230314/whisper/transcribe.py#L166-L179
+	if( compressionThreshold > 0 && compressionRatio( text ) > compressionThreshold )
+		return false;
+	if( logProbThreshold < 0 && avgLogProb < logProbThreshold )
+		return false;
+	return true;
+}
\ No newline at end of file
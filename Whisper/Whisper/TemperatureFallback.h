@@ -0,0 +1,64 @@
+#pragma once
+#include <string_view>
+#include "../API/sFullParams.h"
+
+namespace Whisper
+{
+	// Estimate of zlib's compression ratio of the UTF-8 text, the metric of OpenAI's "compression_ratio_threshold": length of the text divided by length of the compressed stream.
+	// Parses the text with LZ77 like deflate does, with hash chains of limited length like zlib, and approximates the Huffman codes with the entropy of the literals.
+	// For the lengths of Whisper's segments the estimate is within 10% of zlib, so the thresholds calibrated for zlib apply.
+	double compressionRatio( const char* text, size_t length );
+
+	inline double compressionRatio( std::string_view text )
+	{
+		return compressionRatio( text.data(), text.length() );
+	}
+
+	// Decisions of the temperature fallback for a single window, separate from the decoder to be testable
+	class TemperatureFallback
+	{
+		const float initial;
+		const float increment;
+		const float compressionThreshold;
+		const float logProbThreshold;
+		int attempt = 0;
+
+	public:
+		TemperatureFallback( const sFullParams& params );
+
+		// Start over for the next window
+		void reset() { attempt = 0; }
+
+		// Temperature of the current attempt
+		float temperature() const
+		{
+			return initial + increment * (float)attempt;
+		}
+
+		// True when the window can be decoded again at a higher temperature, i.e. the fallback is enabled and the next temperature doesn't exceed 1.0
+		bool canRetry() const
+		{
+			return increment > 0 && temperature() + increment <= 1.0f + 1e-5f;
+		}
+
+		// Move to the next temperature
+		void retry()
+		{
+			assert( canRetry() );
+			attempt++;
+		}
+
+		// True when isRepetitionLoop() checks the output of that many tokens: every 8 tokens starting from 32, to save time
+		bool checksLoopAt( size_t countTokens ) const
+		{
+			return compressionThreshold > 0 && countTokens >= 32 && 0 == ( countTokens % 8 );
+		}
+
+		// Early rejection while decoding: true when the output so far already looks like a repetition loop.
+		// Returns false without looking at the text when checksLoopAt( countTokens ) is false.
+		bool isRepetitionLoop( std::string_view text, size_t countTokens ) const;
+
+		// True when the complete output of the window passes both thresholds
+		bool accept( std::string_view text, double avgLogProb ) const;
+	};
+}
\ No newline at end of file
@@ -16,6 +16,10 @@ namespace
 
 	LPCTSTR traceFileNative = LR"(C:\Temp\2remove\Whisper\gpu.bin)";
 	LPCTSTR traceFileHybrid = LR"(C:\Temp\2remove\Whisper\hybrid.bin)";
+#if SAVE_DEBUG_TRACE
+	// Set statisticsOnly = true to trace long inputs, set the names or layers to only trace a portion of the model
+	const Tracing::sTraceOptions traceOptions;
+#endif
 
 	TensorsArena::sArenaConfigs defaultArenaConfigs()
 	{
@@ -64,15 +68,18 @@ WhisperContext::WhisperContext( const Whisper::WhisperModel& wm, Whisper::Profil
 	{
 		hybridContext = std::make_unique<HybridContext>( wm );
 		check( hybridContext->create() );
+#if PROFILER_CPU_OPS
+		hybridContext->setProfiler( &pc.cpuOps() );
+#endif
 #if SAVE_DEBUG_TRACE
-		Tracing::traceCreate( traceFileHybrid );
+		Tracing::traceCreate( traceFileHybrid, traceOptions );
 #endif
 	}
 	else
 #endif
 	{
 #if SAVE_DEBUG_TRACE
-		Tracing::traceCreate( traceFileNative );
+		Tracing::traceCreate( traceFileNative, traceOptions );
 #endif
 	}
 }
@@ -297,7 +304,7 @@ void WhisperContext::createKeyValueBuffers( const sEncodeParams& encParams )
 		const uint32_t n_audio_ctx = encParams.n_audio_ctx;
 		const uint32_t n_mem = encParams.n_text_layer * encParams.n_audio_ctx;
 		const uint32_t n_elements = encParams.n_text_state * n_mem;
-		kvCross.resize( n_elements );
+		window.kvCross.resize( n_elements );
 	}
 
 #if BUILD_HYBRID_VERSION
@@ -312,10 +319,15 @@ void WhisperContext::createKeyValueBuffers( const sEncodeParams& encParams )
 
 Tensor WhisperContext::encode( Whisper::iSpectrogram& spectrogram, const sEncodeParams& encParams )
 {
+	auto gpuLock = lockGpu();
 	auto prof = profiler.block( eProfilerBlock::Encode );
 	CaptureRaii renderdocCapture;
 	profiler.profileShaders = profileEncodeShaders;
 
+	// Until the encoder completes, the window has unknown content
+	window.seek = -1;
+	KeyValueBuffers& kvCross = window.kvCross;
+
 	createKeyValueBuffers( encParams );
 	// Upload the source
 	check( melInput.create( spectrogram, encParams ) );
@@ -399,6 +411,9 @@ Tensor WhisperContext::encode( Whisper::iSpectrogram& spectrogram, const sEncode
 		check( hybridContext->downloadKeyValues( kvCross ) );
 	}
 #endif
+
+	window.seek = (int)encParams.mel_offset;
+	window.n_ctx = encParams.n_ctx;
 	return cur;
 }
 
@@ -501,6 +516,7 @@ Tensor WhisperContext::decodeLayer( const Tensor& inpL, size_t il, const sLayerD
 		// Kcross is already scaled
 		const uint32_t len = ldp.M * ldp.n_state;
 		const uint32_t off = (uint32_t)il * len;
+		const KeyValueBuffers& kvCross = window.kvCross;
 		Tensor Kcross = kvCross.keys.view( len, off ).reshape3d( ldp.n_state / ldp.n_head, ldp.n_head, ldp.M );
 		Tensor Vcross = kvCross.values.view( len, off ).reshape3d( ldp.n_state / ldp.n_head, ldp.n_head, ldp.M );
 
@@ -581,9 +597,12 @@ Tensor WhisperContext::decodeLayer( const Tensor& inpL, size_t il, const sLayerD
 	return cur;
 }
 
-void WhisperContext::decode( const int* tokens, const int n_tokens, const sDecodeParams& decParams, std::vector<float>& probs, int threads )
+void WhisperContext::decode( const int* tokens, const int n_tokens, const sDecodeParams& decParams, std::vector<float>& probs, int threads,
+	std::vector<Whisper::sLogitsSummary>* summaries )
 {
 	auto cppp = profiler.cpuBlock( Whisper::eCpuBlock::DecodeStep );
+	if( window.empty() )
+		throw OLE_E_BLANK;
 
 #if BUILD_HYBRID_VERSION
 	if( hybridContext )
@@ -591,11 +610,16 @@ void WhisperContext::decode( const int* tokens, const int n_tokens, const sDecod
 		HybridContext::sDecParams sdp;
 		sdp.n_threads = threads;
 		sdp.M = decParams.M;
-		check( hybridContext->decode( tokens, n_tokens, decParams.n_past, sdp, probs ) );
+		sdp.n_output = (int)decParams.n_output;
+		check( hybridContext->decode( tokens, n_tokens, decParams.n_past, sdp, probs, summaries ) );
 		return;
 	}
 #endif
+	// The GPU decoder always downloads the complete probabilities
+	if( nullptr != summaries )
+		summaries->clear();
 
+	auto gpuLock = lockGpu();
 	auto prof = profiler.block( eProfilerBlock::DecodeStep );
 	CaptureRaii renderdocCapture;
 	profiler.profileShaders = profileDecodeShaders;
@@ -666,7 +690,7 @@ __m128i WhisperContext::getMemoryUse() const
 	res = _mm_add_epi64( res, decPool.getMemoryUse() );
 	res = _mm_add_epi64( res, melInput.getMemoryUse() );
 	res = _mm_add_epi64( res, kv.getMemoryUse() );
-	res = _mm_add_epi64( res, kvCross.getMemoryUse() );
+	res = _mm_add_epi64( res, window.getMemoryUse() );
 	res = _mm_add_epi64( res, decoderInput.getMemoryUse() );
 	res = _mm_add_epi64( res, decoderOutput.getMemoryUse() );
 	return res;
@@ -7,6 +7,7 @@
 #include "DecoderResultBuffer.h"
 #include "../ML/TensorsArena.h"
 #include "iSpectrogram.h"
+#include "sLogitsSummary.h"
 #include "../Hybrid/HybridContext.h"
 #include <memory>
 #include "WhisperModel.h"
@@ -18,6 +19,36 @@ namespace DirectCompute
 	struct TensorPair;
 	struct ModelBuffers;
 
+	// Output of the encoder for a single window of audio: the cross-attention keys and values, in VRAM.
+	// Several decoder passes run against the same window, e.g. language detection followed by transcription, or retries with another temperature.
+	// The window stays valid until encoded again.
+	class EncodedWindow
+	{
+		friend class WhisperContext;
+		KeyValueBuffers kvCross;
+		int seek = -1;
+		uint32_t n_ctx = 0;
+
+	public:
+		bool empty() const { return seek < 0; }
+		// Offset of the window in the spectrogram, in 10ms units
+		int getSeek() const { return seek; }
+		// Count of encoder output rows, the M parameter of the decoder
+		uint32_t getContextSize() const { return n_ctx; }
+
+		void clear()
+		{
+			kvCross.clear();
+			seek = -1;
+			n_ctx = 0;
+		}
+
+		__m128i getMemoryUse() const
+		{
+			return kvCross.getMemoryUse();
+		}
+	};
+
 	class WhisperContext : public MlContext
 	{
 		struct Arenas
@@ -49,7 +80,9 @@ namespace DirectCompute
 		class ArenaRaii;
 
 		MelInputTensor melInput;
-		KeyValueBuffers kv, kvCross;
+		KeyValueBuffers kv;
+		// The decoder reads cross-attention keys and values from this window
+		EncodedWindow window;
 		DecoderInputBuffers decoderInput;
 		DecoderResultBuffer decoderOutput;
 		const ModelBuffers& gpuModel;
@@ -88,9 +121,26 @@ namespace DirectCompute
 		WhisperContext( const Whisper::WhisperModel& wm, Whisper::ProfileCollection& pc );
 		WhisperContext( const WhisperContext& ) = delete;
 
+		// Run the encoder, and compute cross-attention keys and values of the window
 		Tensor encode( Whisper::iSpectrogram& spectrogram, const sEncodeParams& encParams );
 
-		void decode( const int* tokens, const int n_tokens, const sDecodeParams& decParams, std::vector<float>& probs, int threads );
+		const EncodedWindow& getCurrentWindow() const { return window; }
+
+		// When summaries is not nullptr and the decoder supports that, only produce the summaries of the logits, and leave the probs empty.
+		// Otherwise, produce the probabilities, and clear the summaries.
+		void decode( const int* tokens, const int n_tokens, const sDecodeParams& decParams, std::vector<float>& probs, int threads,
+			std::vector<Whisper::sLogitsSummary>* summaries = nullptr );
+
+		// With the hybrid model, bind the CPU decoder to the specified NUMA node, -1 = all nodes.
+		// Returns S_FALSE when the context doesn't decode on CPU.
+		HRESULT setNumaNode( int node )
+		{
+#if BUILD_HYBRID_VERSION
+			if( hybridContext )
+				return hybridContext->setNumaNode( node );
+#endif
+			return S_FALSE;
+		}
 
 		static WhisperContext& current();
 
@@ -6,6 +6,7 @@
 #include <atlstr.h>
 #include "../Utils/GpuProfilerSimple.h"
 #include "../Utils/CpuProfiler.h"
+#include "../Utils/Timeline.h"
 #include "../CPU/HybridLoader.h"
 #include "../ML/Reshaper.h"
 using namespace Whisper;
@@ -438,7 +439,11 @@ HRESULT WhisperModel::loadHybrid( ComLight::iReadStream* stm, CallbacksImpl& cal
 	constexpr double mulMb = 1.0 / ( 1 << 20 );
 	logDebug( u8"Loaded %zu GPU tensors, %g MB VRAM", countLoaded, mulMb * cb );
 
-	CHECK( loader.completeLoad( stm, callbacks ) );
+	{
+		Timeline::Span span{ "decoderTensors", "loader" };
+		CHECK( loader.completeLoad( stm, callbacks ) );
+	}
+	kvPool = std::make_shared<CpuCompute::KvBlockPool>( parameters );
 	return S_OK;
 }
 #endif
@@ -446,6 +451,7 @@ HRESULT WhisperModel::loadHybrid( ComLight::iReadStream* stm, CallbacksImpl& cal
 HRESULT WhisperModel::load( ComLight::iReadStream* stm, bool hybrid, const sLoadModelCallbacks* callbacks )
 {
 	CpuProfiler cpuPerf;
+	Timeline::Span spanLoad{ "loadModel", "loader" };
 	CallbacksImpl cb;
 	CHECK( cb.initialize( stm, callbacks ) );
 	// verify magic
@@ -461,6 +467,7 @@ HRESULT WhisperModel::load( ComLight::iReadStream* stm, bool hybrid, const sLoad
 
 	// hparams and MEL filters
 	{
+		Timeline::Span span{ "header", "loader" };
 		ParamsAndMelHeader pmh;
 		CHECK( readStruct( stm, pmh ) );
 		parameters = pmh.mp;
@@ -479,12 +486,16 @@ HRESULT WhisperModel::load( ComLight::iReadStream* stm, bool hybrid, const sLoad
 	CHECK( cb.call( stm ) );
 
 	// Vocabulary
-	CHECK( vocab.load( stm, parameters.n_vocab ) );
+	{
+		Timeline::Span span{ "vocabulary", "loader" };
+		CHECK( vocab.load( stm, parameters.n_vocab ) );
+	}
 	CHECK( cb.call( stm ) );
 
 	DirectCompute::GpuProfilerSimple gpuProfiler;
 	CHECK( gpuProfiler.create() );
 
+	Timeline::Span spanTensors{ "tensors", "loader" };
 	if( hybrid )
 	{
 #if BUILD_HYBRID_VERSION
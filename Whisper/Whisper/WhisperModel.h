@@ -3,6 +3,7 @@
 #include "ModelBuffers.h"
 #include "../../ComLightLib/streams.h"
 #include "../CPU/DecoderTensors.h"
+#include "../CPU/KvTensors.h"
 #include "../API/sLoadModelCallbacks.h"
 #include "sModelParams.h"
 
@@ -27,6 +28,8 @@ namespace Whisper
 
 #if BUILD_HYBRID_VERSION
 		CpuCompute::DecoderTensors hybridTensors;
+		// Self-attention keys and values of the CPU decoders, shared by all contexts of the model
+		std::shared_ptr<CpuCompute::KvBlockPool> kvPool;
 #endif
 
 		HRESULT load( ComLight::iReadStream* stm, bool hybrid, const sLoadModelCallbacks* callbacks );
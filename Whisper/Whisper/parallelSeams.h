@@ -0,0 +1,28 @@
+#pragma once
+#include <vector>
+
+namespace Whisper
+{
+	// runFullParallel transcribes pieces of the audio on separate contexts, then concatenates the segments.
+	// The encoder of a piece sees the audio past the end of that piece, so the last segment of a piece may extend into the next one,
+	// while the next piece transcribes the same audio again. These functions resolve the overlap at the seams.
+
+	// Drop the segments which start at or after the end of the piece, they belong to the next piece
+	template<class Segment>
+	inline void trimPieceEnd( std::vector<Segment>& segments, int64_t pieceEnd )
+	{
+		while( !segments.empty() && segments.back().t0 >= pieceEnd )
+			segments.pop_back();
+	}
+
+	// Count of the leading segments of the next piece which are mostly covered by the previous piece:
+	// the middle of these segments is before prevEnd, the end time of the last segment kept from the previous piece
+	template<class Segment>
+	inline size_t countCoveredSegments( const std::vector<Segment>& segments, int64_t prevEnd )
+	{
+		size_t i = 0;
+		while( i < segments.size() && segments[ i ].t0 + segments[ i ].t1 < 2 * prevEnd )
+			i++;
+		return i;
+	}
+}
\ No newline at end of file
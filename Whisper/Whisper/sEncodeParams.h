@@ -16,5 +16,8 @@ namespace DirectCompute
 		uint32_t n_ctx, n_past, M;
 		uint32_t n_text_layer;
 		uint32_t n_vocab;
+		// Count of the last tokens the caller needs the output for, 0 = all tokens.
+		// Only the CPU decoder of the hybrid model takes advantage of this, the GPU decoder always produces all rows.
+		uint32_t n_output;
 	};
 }
\ No newline at end of file
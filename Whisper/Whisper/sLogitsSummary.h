@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+#include <array>
+
+namespace Whisper
+{
+	// Compact output of the decoder for a single token, enough for the greedy sampling without the complete vector of probabilities.
+	// Probability of a token is exp( logit - logSumExp )
+	struct sLogitsSummary
+	{
+		static constexpr uint32_t topK = 4;
+		// Count of the timestamp tokens allowed for the first token of the window
+		static constexpr uint32_t initialTimestamps = 101;
+
+		// log( sum( exp( logits ) ) ) over the complete vocabulary
+		float logSumExp;
+		// Maximum logit of the text tokens, [ 0 .. token_beg )
+		float maxText;
+		// Sum of probabilities of the timestamp tokens [ token_beg .. n_vocab ), and of the initial ones [ token_beg .. token_beg + 101 )
+		float sumTimestamps, sumInitialTimestamps;
+		// The most probable timestamp token, and the most probable initial one
+		int bestTimestamp, bestInitialTimestamp;
+		float bestTimestampLogit, bestInitialLogit;
+		// The most probable tokens of the complete vocabulary, sorted by logits in descending order
+		std::array<int, topK> topTokens;
+		std::array<float, topK> topLogits;
+	};
+}
\ No newline at end of file
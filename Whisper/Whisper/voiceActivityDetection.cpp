@@ -112,9 +112,69 @@ void VAD::clear()
 	state.currThresh = primThresh;
 }
 
-size_t VAD::detect( const float* rsi, size_t length )
+bool VAD::frame( const float* rsi, State& s )
 {
 	// The cryptic numbers in the comments are from section 3 "Proposed VAD Algorithm" of the article, on page 2550, on the right
+	Feature& currThresh = s.currThresh;
+	Feature& minFeature = s.minFeature;
+	Feature& curr = s.curr;
+	const uint32_t i = s.i;
+
+	// 3-2 calculate FFT
+	for( size_t j = 0; j < FFT_POINTS; j++ )
+	{
+		const float re = rsi[ j ] * mulInt16FromFloat;
+		fft_signal[ j ] = { re, 0.0f };
+	}
+	fft();
+
+	// 3-1 + 3-2 calculate features
+	curr.energy = computeEnergy( rsi );
+	curr.F = computeDominant( fft_signal.get() );
+	curr.SFM = computreSpectralFlatnessMeasure( fft_signal.get() );
+
+	// 3-3 calculate minimum value for first 30 frames
+	if( i == 0 )
+		minFeature = curr;
+	else if( i < 30 )
+	{
+		minFeature.energy = std::min( minFeature.energy, curr.energy );
+		minFeature.F = std::min( minFeature.F, curr.F );
+		minFeature.SFM = std::min( minFeature.SFM, curr.SFM );
+	}
+
+	// 3-4 set thresholds
+	currThresh.energy = primThresh.energy * std::log10f( minFeature.energy );
+
+	// 3-5 calculate decision
+	uint8_t counter = 0;
+	if( ( curr.energy - minFeature.energy ) >= currThresh.energy )
+		counter = 1;
+	if( ( curr.F - minFeature.F ) >= currThresh.F )
+		counter++;
+	if( ( curr.SFM - minFeature.SFM ) >= currThresh.SFM )
+		counter++;
+
+	const bool speech = counter > 1;
+	if( speech )
+	{
+		// 3-6 If counter > 1 mark the current frame as speech
+		s.silenceRun = 0.0f;
+	}
+	else
+	{
+		s.silenceRun += 1.0f;
+		// 3-7 If current frame is marked as silence, update the energy minimum value
+		minFeature.energy = ( ( s.silenceRun * minFeature.energy ) + curr.energy ) / ( s.silenceRun + 1 );
+	}
+
+	// 3-8
+	currThresh.energy = primThresh.energy * std::log10f( minFeature.energy );
+	return speech;
+}
+
+size_t VAD::detect( const float* rsi, size_t length )
+{
 	const size_t frames = length / FFT_POINTS;
 	if( frames <= 0 )
 	{
@@ -122,78 +182,69 @@ size_t VAD::detect( const float* rsi, size_t length )
 		return 0;
 	}
 
-	// Load detection state from the field
-	Feature currThresh = state.currThresh;
-	Feature minFeature = state.minFeature;
-	Feature curr = state.curr;
-
-	size_t lastSpeech = state.lastSpeech;
-	float silenceRun = state.silenceRun;
-	size_t i = state.i;
-
 	// Run the loop just on the [ state.i .. frames ] slice of the input PCM
-	rsi += i * FFT_POINTS;
-	for( ; i < frames; i++, rsi += FFT_POINTS )
+	rsi += (size_t)state.i * FFT_POINTS;
+	for( ; state.i < frames; state.i++, rsi += FFT_POINTS )
 	{
-		// 3-2 calculate FFT
-		for( size_t j = 0; j < FFT_POINTS; j++ )
-		{
-			const float re = rsi[ j ] * mulInt16FromFloat;
-			fft_signal[ j ] = { re, 0.0f };
-		}
-		fft();
-
-		// 3-1 + 3-2 calculate features
-		curr.energy = computeEnergy( rsi );
-		curr.F = computeDominant( fft_signal.get() );
-		curr.SFM = computreSpectralFlatnessMeasure( fft_signal.get() );
-
-		// 3-3 calculate minimum value for first 30 frames
-		if( i == 0 )
-			minFeature = curr;
-		else if( i < 30 )
-		{
-			minFeature.energy = std::min( minFeature.energy, curr.energy );
-			minFeature.F = std::min( minFeature.F, curr.F );
-			minFeature.SFM = std::min( minFeature.SFM, curr.SFM );
-		}
+		if( frame( rsi, state ) )
+			state.lastSpeech = ( state.i + 1 ) * FFT_POINTS;
+	}
+	return state.lastSpeech;
+}
 
-		// 3-4 set thresholds
-		currThresh.energy = primThresh.energy * std::log10f( minFeature.energy );
+void VAD::classify( const float* rsi, size_t length, std::vector<uint8_t>& rdi )
+{
+	clear();
+	const size_t frames = length / FFT_POINTS;
+	rdi.resize( frames );
+	for( ; state.i < frames; state.i++, rsi += FFT_POINTS )
+		rdi[ state.i ] = frame( rsi, state ) ? 1 : 0;
+	clear();
+}
 
-		// 3-5 calculate decision
-		uint8_t counter = 0;
-		if( ( curr.energy - minFeature.energy ) >= currThresh.energy )
-			counter = 1;
-		if( ( curr.F - minFeature.F ) >= currThresh.F )
-			counter++;
-		if( ( curr.SFM - minFeature.SFM ) >= currThresh.SFM )
-			counter++;
+void SpeechMap::build( const std::vector<uint8_t>& frames, int minSilence, int padding )
+{
+	intervals.clear();
 
-		if( counter > 1 )
+	const size_t length = frames.size();
+	size_t i = 0;
+	while( i < length )
+	{
+		if( 0 == frames[ i ] )
 		{
-			// 3-6 If counter > 1 mark the current frame as speech
-			lastSpeech = ( i + 1 ) * FFT_POINTS;
-			silenceRun = 0.0f;
+			i++;
+			continue;
 		}
-		else
+		const size_t begin = i;
+		while( i < length && 0 != frames[ i ] )
+			i++;
+
+		int a = std::max( melFromVadFrame( begin ) - padding, 0 );
+		const int b = melFromVadFrame( i ) + padding;
+		if( !intervals.empty() && a - intervals.back().second < minSilence )
 		{
-			silenceRun += 1.0f;
-			// 3-7 If current frame is marked as silence, update the energy minimum value
-			minFeature.energy = ( ( silenceRun * minFeature.energy ) + curr.energy ) / ( silenceRun + 1 );
+			// The silence is too short to skip, merge with the previous interval
+			intervals.back().second = b;
+			continue;
 		}
-
-		// 3-8
-		currThresh.energy = primThresh.energy * std::log10f( minFeature.energy );
+		intervals.emplace_back( a, b );
 	}
+}
 
-	// Store the updated detection state back into that field
-	state.currThresh = currThresh;
-	state.minFeature = minFeature;
-	state.curr = curr;
-	state.lastSpeech = (uint32_t)lastSpeech;
-	state.silenceRun = silenceRun;
-	state.i = (uint32_t)i;
+int SpeechMap::nextSpeech( int seek ) const
+{
+	// Find the first interval which ends after the position
+	auto it = std::upper_bound( intervals.begin(), intervals.end(), seek,
+		[]( int pos, const std::pair<int, int>& e ) { return pos < e.second; } );
+	if( it == intervals.end() )
+		return -1;
+	return std::max( seek, it->first );
+}
 
-	return lastSpeech;
+int SpeechMap::speechLength() const
+{
+	int res = 0;
+	for( const auto& e : intervals )
+		res += e.second - e.first;
+	return res;
 }
\ No newline at end of file
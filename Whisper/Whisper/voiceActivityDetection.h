@@ -1,6 +1,7 @@
 #pragma once
 #include <complex>
 #include <memory>
+#include <vector>
 #include "audioConstants.h"
 
 namespace Whisper
@@ -38,6 +39,9 @@ namespace Whisper
 		static float computeDominant( const cplx* spectrum );
 		static float computreSpectralFlatnessMeasure( const cplx* spectrum );
 
+		// Run the detector on a single frame of FFT_POINTS samples, update the state, return true for speech
+		bool frame( const float* rsi, State& s );
+
 	public:
 
 		VAD();
@@ -46,9 +50,43 @@ namespace Whisper
 		// When speech is detected, returns sample position for the end of the speech
 		size_t detect( const float* rsi, size_t length );
 
+		// Classify the complete audio into speech and silence, one byte per FFT_POINTS samples, 1 = speech.
+		// Resets the state, both before and after.
+		void classify( const float* rsi, size_t length, std::vector<uint8_t>& rdi );
+
 		void clear();
 
 		static constexpr uint32_t FFT_POINTS = 256;
 		static constexpr float FFT_STEP = (float)SAMPLE_RATE / (float)FFT_POINTS;
 	};
+
+	// Convert index of the VAD frame into 10ms units of the spectrogram, rounding down
+	inline int melFromVadFrame( size_t frame )
+	{
+		return (int)( frame * VAD::FFT_POINTS / FFT_STEP );
+	}
+	// Convert 10ms units of the spectrogram into index of the VAD frame, rounding down
+	inline size_t vadFrameFromMel( int mel )
+	{
+		return (size_t)mel * FFT_STEP / VAD::FFT_POINTS;
+	}
+
+	// Intervals of the audio which contain speech, in 10ms units of the spectrogram
+	class SpeechMap
+	{
+		std::vector<std::pair<int, int>> intervals;
+
+	public:
+		// Build the map from the output of VAD::classify method.
+		// Silences shorter than minSilence are kept, and every interval of speech is expanded by the padding on both ends.
+		void build( const std::vector<uint8_t>& frames, int minSilence = 200, int padding = 50 );
+
+		// If the position is within speech, return the argument; otherwise return start of the next speech interval, or -1 if there's no more speech
+		int nextSpeech( int seek ) const;
+
+		// Total length of the speech, in 10ms units
+		int speechLength() const;
+
+		bool empty() const { return intervals.empty(); }
+	};
 }
\ No newline at end of file
@@ -38,6 +38,11 @@
 // The feature is relatively cheap in terms of performance overhead, but pretty much useless in production, and clutters debug console with all these numbers
 #define PROFILER_COLLECT_TAGS 0
 
+// Measure individual operations of the hybrid model's CPU decoder: time, FLOPs and memory traffic, grouped by operation, matrix multiplication kernel, and tensor shapes
+// The results are printed by iContext.timingsPrint, which also saves them into a tab-separated text file.
+// The overhead is a couple of timestamp reads and a map lookup per operation, not much but the feature is only useful while optimizing these kernels
+#define PROFILER_CPU_OPS 0
+
 // Reshape some of the tensors to a better VRAM layout while loading a model
 // So far, the feature is only used on AMD GPUs. On AMD Vega integrated GPUs it helps by up to 30%.
 // Should be enabled in production build
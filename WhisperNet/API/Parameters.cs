@@ -24,6 +24,9 @@ namespace Whisper
 		PrintProgress = 0x10,
 		PrintRealtime = 0x20,
 		PrintTimestamps = 0x40,
+		/// <summary>Run voice activity detection over the complete audio buffer, and don't encode long silences</summary>
+		/// <remarks>Only supported when transcribing audio buffers, not streams</remarks>
+		SkipSilence = 0x80,
 
 		// Experimental
 		TokenTimestamps = 0x100,
@@ -91,5 +94,18 @@ namespace Whisper
 		// [EXPERIMENTAL] speed-up techniques
 		/// <summary>overwrite the audio context size (0 = use default)</summary>
 		public int audioContextSize;
+
+		// Temperature fallback: when the output of a window fails these thresholds, it's decoded again with a higher temperature
+		// Disabled by default, set temperatureIncrement to enable; OpenAI's default is 0.2
+		/// <summary>Initial decoding temperature, 0 = greedy</summary>
+		public float temperature;
+		/// <summary>Temperature increment for each retry, 0 = disable the fallback</summary>
+		public float temperatureIncrement;
+		/// <summary>Similar to OpenAI's "compression_ratio_threshold" (~2.4), 0 = disabled</summary>
+		public float compressionRatioThreshold;
+		/// <summary>Average log-probability of the tokens (~-1.0), 0 = disabled</summary>
+		public float logProbThreshold;
+		/// <summary>Seed of the random generator for the sampling at positive temperatures, the same seed gives the same output</summary>
+		public uint seed;
 	}
 }
\ No newline at end of file
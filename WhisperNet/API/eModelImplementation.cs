@@ -10,7 +10,7 @@
 		/// <remarks>
 		/// <para>The build of the native DLL included into this nuget package doesn’t implement this version.<br/>
 		/// To enable, edit <c>stdafx.h</c> in Whisper project, change the value of <c>BUILD_HYBRID_VERSION</c> macro from zero to one, and build.</para>
-		/// <para>This implementation requires a CPU with AVX1, FMA3, F16C and BMI1 instruction set extensions.</para>
+		/// <para>This implementation requires a CPU with AVX1, FMA3 and F16C instruction set extensions; a few memory-bound kernels use AVX2 and AVX-512 when available.</para>
 		/// </remarks>
 		Hybrid = 2,
 
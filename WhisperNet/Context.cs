@@ -140,6 +140,41 @@ namespace Whisper
 		public void runFull( iAudioReader reader, Callbacks? callbacks, Action<double>? pfnProgress, int[]? promptTokens ) =>
 			runFull( reader, callbacks, pfnProgress, promptTokens ?? ReadOnlySpan<int>.Empty );
 
+		/// <summary>Split the audio at silences into up to <paramref name="countContexts" /> pieces, and transcribe them in parallel</summary>
+		/// <remarks>The pieces are decoded on temporary contexts which share the model.<br/>
+		/// The new segment callback is called once, after all the pieces are complete.</remarks>
+		public void runFullParallel( iAudioBuffer buffer, int countContexts, Callbacks? callbacks = null )
+		{
+			runImpl( buffer, callbacks, ReadOnlySpan<int>.Empty, delegate ( object obj )
+			{
+				context.runFullParallel( ref fullParams, (iAudioBuffer)obj, countContexts );
+			} );
+		}
+
+		/// <summary>Speed up the decoder with a smaller model of the same vocabulary, like <c>ggml-tiny</c> for <c>ggml-medium</c></summary>
+		/// <remarks>The draft model proposes up to <paramref name="countTokens" /> tokens, this model verifies them with a single decoder pass.<br/>
+		/// Only used for greedy decoding at zero temperature. The text is equivalent up to floating-point rounding: when two tokens have nearly equal probabilities, the choice may differ from the output without the draft model.<br/>
+		/// Pass null to disable.</remarks>
+		public void setDraftModel( iModel? draft, int countTokens = 4 )
+		{
+			context.setDraftModel( draft, countTokens );
+		}
+
+		/// <summary>Detect the spoken language, using the first 30 seconds of the audio</summary>
+		/// <remarks>Returns all supported languages sorted by probability, the most likely one is first.<br/>
+		/// When followed by <see cref="runFull(iAudioBuffer, Callbacks?)" /> with the same buffer, that method skips the first encoder pass.</remarks>
+		public sLanguageProbability[] detectLanguage( iAudioBuffer buffer )
+		{
+			sLanguageProbability[]? result = null;
+			pfnDetectedLanguages pfn = delegate ( int len, sLanguageProbability[]? arr, IntPtr pv )
+			{
+				result = arr;
+				return 0;
+			};
+			context.detectLanguage( ref fullParams, buffer, pfn, IntPtr.Zero );
+			return result ?? Array.Empty<sLanguageProbability>();
+		}
+
 		/// <summary>Get text results out of the context</summary>
 		public TranscribeResult results( eResultFlags flags = eResultFlags.None )
 		{
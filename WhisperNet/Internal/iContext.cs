@@ -33,5 +33,16 @@ namespace Whisper.Internal
 		void timingsPrint();
 		/// <summary>Reset timing data</summary>
 		void timingsReset();
+
+		/// <summary>Encode the first 30 seconds of the audio, and detect the spoken language</summary>
+		/// <remarks>A subsequent <see cref="runFull" /> call with the same buffer reuses the encoder output</remarks>
+		void detectLanguage( [In] ref sFullParams @params, iAudioBuffer buffer, [MarshalAs( UnmanagedType.FunctionPtr )] pfnDetectedLanguages pfn, IntPtr pv );
+
+		/// <summary>Split the audio at silences, and transcribe the pieces in parallel on temporary contexts which share the model</summary>
+		void runFullParallel( [In] ref sFullParams @params, iAudioBuffer buffer, int countContexts );
+
+		/// <summary>Use a smaller model to propose the tokens, and verify them with a single decoder pass of this model</summary>
+		/// <remarks>Pass null to disable the speculative decoding</remarks>
+		void setDraftModel( iModel? draft, int countTokens );
 	}
 }
\ No newline at end of file
@@ -0,0 +1,21 @@
+﻿#pragma warning disable CS0649 // Field is never assigned to
+using System.Runtime.InteropServices;
+
+namespace Whisper.Internal
+{
+	/// <summary>Probability of a spoken language, produced by the language detection</summary>
+	public struct sLanguageProbability
+	{
+		/// <summary>The language</summary>
+		public readonly eLanguage language;
+		/// <summary>Probability of that language, in the [ 0 .. 1 ] interval</summary>
+		public readonly float probability;
+
+		/// <summary>Returns a string that represents the current object</summary>
+		public override string ToString() => $"{language}: {probability}";
+	}
+
+	/// <summary>Function pointer to consume a list of detected languages, sorted by probability in descending order</summary>
+	[UnmanagedFunctionPointer( CallingConvention.StdCall )]
+	public delegate int pfnDetectedLanguages( int len, [In, MarshalAs( UnmanagedType.LPArray, SizeParamIndex = 0 )] sLanguageProbability[]? arr, IntPtr pv );
+}
\ No newline at end of file
@@ -101,6 +101,29 @@ namespace Whisper
 			return null;
 		}
 
+		[DllImport( dll, CallingConvention = RuntimeClass.defaultCallingConvention, PreserveSig = false )]
+		static extern void timelineStart( uint eventsPerThread );
+
+		[DllImport( dll, CallingConvention = RuntimeClass.defaultCallingConvention, PreserveSig = false )]
+		static extern void timelineStop( [MarshalAs( UnmanagedType.LPWStr )] string? path );
+
+		/// <summary>Start recording a timeline of CPU events of the library</summary>
+		/// <remarks>Each thread keeps up to <paramref name="eventsPerThread" /> latest events, 0 for the default of 64k.</remarks>
+		public static void startTimeline( uint eventsPerThread = 0 )
+		{
+			NativeLogger.prologue();
+			timelineStart( eventsPerThread );
+		}
+
+		/// <summary>Stop recording the timeline, and save the events into Chrome trace JSON file.</summary>
+		/// <remarks>View the file in chrome://tracing or https://ui.perfetto.dev/<br/>
+		/// Pass null to discard the events.</remarks>
+		public static void stopTimeline( string? path )
+		{
+			NativeLogger.prologue();
+			timelineStop( path );
+		}
+
 		/// <summary>Set up delegate to receive log messages from the C++ library</summary>
 		public static void setLogSink( eLogLevel lvl, eLoggerFlags flags = eLoggerFlags.SkipFormatMessage, pfnLogMessage? pfn = null )
 		{